@@ -0,0 +1,210 @@
+/*
+ See BGLAccounting.h.
+
+ State is global, like the library's other per-process tables, since the
+ call sites have nothing to hand it to. Sites past kBGLAccountingSiteMax
+ share one overflow entry rather than being dropped.
+ */
+
+#include "BGLAccounting.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static BGLAccountingSite sites[kBGLAccountingSiteMax + 1]; // the last is overflow
+static uint32_t siteCount;
+static uint32_t lastSiteIndex;
+
+static BGLAccountingCounts frameCounts[kBGLAccountingPhaseCount];
+static BGLAccountingCounts lastFrameCounts[kBGLAccountingPhaseCount];
+static BGLAccountingCounts totalCounts[kBGLAccountingPhaseCount];
+static uint32_t frameCount;
+static BGLAccountingPhase phase = kBGLAccountingPhaseIdle;
+
+static int steadyState;
+static BGLAccountingViolationHandler violationHandler;
+
+
+static const char *BGLAccountingSiteBaseName(const char *site)
+{
+    const char *slash = site ? strrchr(site, '/') : NULL;
+    return slash ? slash + 1 : (site ? site : "(other sites)");
+}
+
+
+static void BGLAccountingDefaultViolation(const char *site, BGLAccountingPhase p, size_t bytes)
+{
+    fprintf(stderr, "BGLAccounting: %zu byte allocation in steady state at %s (%s)\n",
+            bytes, BGLAccountingSiteBaseName(site), BGLAccountingPhaseName(p));
+    abort();
+}
+
+
+void BGLAccountingReset(void)
+{
+    memset(sites, 0, sizeof(sites));
+    siteCount = 0;
+    lastSiteIndex = 0;
+    memset(frameCounts, 0, sizeof(frameCounts));
+    memset(lastFrameCounts, 0, sizeof(lastFrameCounts));
+    memset(totalCounts, 0, sizeof(totalCounts));
+    frameCount = 0;
+}
+
+
+#pragma mark Frames
+
+
+void BGLAccountingFrameBegin(void)
+{
+    memset(frameCounts, 0, sizeof(frameCounts));
+    phase = kBGLAccountingPhaseIdle;
+}
+
+
+void BGLAccountingSetPhase(BGLAccountingPhase p)
+{
+    phase = p;
+}
+
+
+void BGLAccountingFrameEnd(void)
+{
+    memcpy(lastFrameCounts, frameCounts, sizeof(frameCounts));
+    memset(frameCounts, 0, sizeof(frameCounts));
+    phase = kBGLAccountingPhaseIdle;
+    frameCount += 1;
+}
+
+
+#pragma mark Recording
+
+
+static BGLAccountingSite *BGLAccountingFindSite(const char *name)
+{
+    // Consecutive records usually come from the same site.
+    if (siteCount && sites[lastSiteIndex].name == name) return &sites[lastSiteIndex];
+    for (uint32_t i = 0; i < siteCount; i++) {
+        if (sites[i].name == name) {
+            lastSiteIndex = i;
+            return &sites[i];
+        }
+    }
+    if (siteCount == kBGLAccountingSiteMax) return &sites[kBGLAccountingSiteMax];
+    lastSiteIndex = siteCount++;
+    sites[lastSiteIndex].name = name;
+    return &sites[lastSiteIndex];
+}
+
+
+static void BGLAccountingAdd(const char *site, uint32_t autoreleases, size_t bytes)
+{
+    BGLAccountingCounts *all[3] = {
+        &BGLAccountingFindSite(site)->counts[phase], &frameCounts[phase], &totalCounts[phase]
+    };
+    for (int i = 0; i < 3; i++) {
+        all[i]->allocationCount += 1;
+        all[i]->autoreleaseCount += autoreleases;
+        all[i]->allocationBytes += bytes;
+    }
+    if (steadyState) {
+        (violationHandler ? violationHandler : BGLAccountingDefaultViolation)(site, phase, bytes);
+    }
+}
+
+
+void BGLAccountingRecordAllocation(const char *site, size_t bytes)
+{
+    BGLAccountingAdd(site, 0, bytes);
+}
+
+
+void BGLAccountingRecordAutorelease(const char *site, size_t bytes)
+{
+    BGLAccountingAdd(site, 1, bytes);
+}
+
+
+void BGLAccountingRecordMessages(uint32_t count)
+{
+    frameCounts[phase].messageCount += count;
+    totalCounts[phase].messageCount += count;
+}
+
+
+void BGLAccountingSetSteadyState(int enabled)
+{
+    steadyState = enabled;
+}
+
+
+void BGLAccountingSetViolationHandler(BGLAccountingViolationHandler handler)
+{
+    violationHandler = handler;
+}
+
+
+#pragma mark Results
+
+
+uint32_t BGLAccountingGetFrameCount(void)
+{
+    return frameCount;
+}
+
+
+const BGLAccountingCounts *BGLAccountingGetLastFrame(void)
+{
+    return lastFrameCounts;
+}
+
+
+const BGLAccountingCounts *BGLAccountingGetTotals(void)
+{
+    return totalCounts;
+}
+
+
+const BGLAccountingSite *BGLAccountingGetSites(uint32_t *count)
+{
+    // The overflow entry follows the named ones once the table is full.
+    *count = siteCount + (siteCount == kBGLAccountingSiteMax);
+    return sites;
+}
+
+
+const char *BGLAccountingPhaseName(BGLAccountingPhase p)
+{
+    switch (p) {
+        case kBGLAccountingPhaseIdle: return "idle";
+        case kBGLAccountingPhaseInput: return "input";
+        case kBGLAccountingPhaseAnimate: return "animate";
+        case kBGLAccountingPhaseRender: return "render";
+        default: return "?";
+    }
+}
+
+
+void BGLAccountingPrintReport(FILE *f)
+{
+    double n = frameCount ? frameCount : 1;
+    fprintf(f, "ALLOCATIONS PER FRAME over %u frames:\n", frameCount);
+    for (int p = 0; p < kBGLAccountingPhaseCount; p++) {
+        const BGLAccountingCounts *c = &totalCounts[p];
+        fprintf(f, "  %-8s %8.2f allocs %10.1f bytes %8.2f autoreleases %10.1f sends\n",
+                BGLAccountingPhaseName(p), c->allocationCount / n, c->allocationBytes / n,
+                c->autoreleaseCount / n, c->messageCount / n);
+    }
+    uint32_t count;
+    const BGLAccountingSite *s = BGLAccountingGetSites(&count);
+    for (uint32_t i = 0; i < count; i++) {
+        for (int p = 0; p < kBGLAccountingPhaseCount; p++) {
+            const BGLAccountingCounts *c = &s[i].counts[p];
+            if (c->allocationCount == 0) continue;
+            fprintf(f, "  %s (%s): %u allocs, %llu bytes, %u autoreleases\n",
+                    BGLAccountingSiteBaseName(s[i].name), BGLAccountingPhaseName(p),
+                    c->allocationCount, (unsigned long long)c->allocationBytes, c->autoreleaseCount);
+        }
+    }
+}
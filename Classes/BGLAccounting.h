@@ -0,0 +1,118 @@
+/*
+ Counts heap allocations, bytes, autoreleases and message sends per frame
+ phase, and attributes the allocations to the call sites in the library
+ that made them.
+
+ Sites are instrumented with the BGLAccount macros below, which compile to
+ nothing unless BGL_ACCOUNTING is defined, so a normal build pays nothing.
+ A site is named by its file and line; the name is a string literal, so the
+ site table is searched by pointer and a site costs a few compares. A site
+ whose allocation is made out of sight (by Foundation or the text library)
+ records it as 0 bytes: counted, but its size not guessed at.
+
+ A frame is bracketed by BGLAccountFrameBegin and BGLAccountFrameEnd, and
+ the phase within it set as the frame proceeds; anything recorded outside
+ a frame is charged to the idle phase (touch handling, setup).
+
+ Steady-state mode treats any allocation or autorelease as a violation and
+ calls the violation handler, which by default prints the site and aborts.
+ A test warms a scene up, turns the mode on, and runs more frames; the
+ first allocation names the line to fix. Message sends are only counted.
+
+ Frees aren't counted. Main thread only. This is plain C with no GL calls.
+ */
+
+#ifndef BGLACCOUNTING_H
+#define BGLACCOUNTING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define kBGLAccountingSiteMax 128
+
+
+typedef enum {
+    kBGLAccountingPhaseIdle,    // outside a frame
+    kBGLAccountingPhaseInput,
+    kBGLAccountingPhaseAnimate,
+    kBGLAccountingPhaseRender,
+    kBGLAccountingPhaseCount
+} BGLAccountingPhase;
+
+
+typedef struct {
+    uint32_t allocationCount;
+    uint32_t autoreleaseCount;
+    uint32_t messageCount;
+    uint64_t allocationBytes;
+} BGLAccountingCounts;
+
+
+typedef struct {
+    const char *name;           // "file:line"; NULL for sites past the limit
+    BGLAccountingCounts counts[kBGLAccountingPhaseCount];
+} BGLAccountingSite;
+
+
+typedef void (*BGLAccountingViolationHandler)(const char *site, BGLAccountingPhase phase, size_t bytes);
+
+
+// Clears every count and site, but not the mode or handler.
+void BGLAccountingReset(void);
+
+void BGLAccountingFrameBegin(void);
+void BGLAccountingSetPhase(BGLAccountingPhase phase);
+void BGLAccountingFrameEnd(void);
+
+void BGLAccountingRecordAllocation(const char *site, size_t bytes);
+void BGLAccountingRecordAutorelease(const char *site, size_t bytes);
+// Sends are counted by phase only; they are everywhere and would crowd out
+// the sites that allocate.
+void BGLAccountingRecordMessages(uint32_t count);
+
+void BGLAccountingSetSteadyState(int enabled);
+// NULL restores the default, which aborts.
+void BGLAccountingSetViolationHandler(BGLAccountingViolationHandler handler);
+
+uint32_t BGLAccountingGetFrameCount(void);
+// The most recently ended frame, by phase.
+const BGLAccountingCounts *BGLAccountingGetLastFrame(void);
+// Everything since the last reset, by phase.
+const BGLAccountingCounts *BGLAccountingGetTotals(void);
+const BGLAccountingSite *BGLAccountingGetSites(uint32_t *count);
+
+const char *BGLAccountingPhaseName(BGLAccountingPhase phase);
+// Per-frame means by phase, then every site that allocated.
+void BGLAccountingPrintReport(FILE *f);
+
+
+#ifdef BGL_ACCOUNTING
+
+#define BGL_ACCOUNTING_STRING(x) #x
+#define BGL_ACCOUNTING_LINE(x) BGL_ACCOUNTING_STRING(x)
+#define BGL_ACCOUNTING_SITE __FILE__ ":" BGL_ACCOUNTING_LINE(__LINE__)
+
+#define BGLAccountFrameBegin() BGLAccountingFrameBegin()
+#define BGLAccountPhase(phase) BGLAccountingSetPhase(phase)
+#define BGLAccountFrameEnd() BGLAccountingFrameEnd()
+#define BGLAccountAllocation(bytes) BGLAccountingRecordAllocation(BGL_ACCOUNTING_SITE, (bytes))
+// An object allocated and autoreleased; counts as both.
+#define BGLAccountAutorelease(bytes) BGLAccountingRecordAutorelease(BGL_ACCOUNTING_SITE, (bytes))
+#define BGLAccountMessages(count) BGLAccountingRecordMessages(count)
+
+#else
+
+#define BGLAccountFrameBegin() ((void)0)
+#define BGLAccountPhase(phase) ((void)0)
+#define BGLAccountFrameEnd() ((void)0)
+// sizeof keeps the argument's variables used without evaluating it.
+#define BGLAccountAllocation(bytes) ((void)sizeof(bytes))
+#define BGLAccountAutorelease(bytes) ((void)sizeof(bytes))
+#define BGLAccountMessages(count) ((void)sizeof(count))
+
+#endif
+
+
+#endif
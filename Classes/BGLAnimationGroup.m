@@ -7,12 +7,15 @@
 //
 
 #import "BGLAnimationGroup.h"
+#import "BGLAccounting.h"
+#import <objc/runtime.h>
 
 
 @implementation BGLAnimationGroup
 
 + (BGLAnimationGroup *)groupWithAnimations:(NSArray *)array
 {
+    BGLAccountAutorelease(class_getInstanceSize([BGLAnimationGroup class]));
     return [[[BGLAnimationGroup alloc] initWithAnimations:array] autorelease];
 }
 
@@ -7,6 +7,8 @@
 //
 
 #import "BGLBasicAnimation.h"
+#import "BGLAccounting.h"
+#import <objc/runtime.h>
 
 
 // Curve function domain and range is [0,1]
@@ -70,6 +72,7 @@ float BGLScalarCurveSaw(float t)
 
 + (BGLBasicAnimation *)animationWithTarget:(NSObject *)target selector:(SEL)setSelector
 {
+    BGLAccountAutorelease(class_getInstanceSize(self));
     return [[[self alloc] initWithTarget:target selector:setSelector] autorelease];
 }
 
@@ -22,6 +22,7 @@
     BOOL highlighted;
     BGLColor color;
     float vertexPositions[8];
+    BGLMatrix touchTransform; // root to local, cached while a touch is active
 }
 @property (nonatomic) CGRect frame;
 @property (nonatomic) BGLColor color;
@@ -15,6 +15,12 @@
 #import "BGLRenderState.h"
 
 #import "BGLManifest.h"
+#import "BGLProgramBindings.h"
+
+
+@interface BGLButton ()
+@property (nonatomic,readwrite,getter=isHighlighted) BOOL highlighted;
+@end
 
 
 @implementation BGLButton
@@ -39,6 +45,22 @@
 }
 
 
+- (void)setColor:(BGLColor)aColor
+{
+    color = aColor;
+    [self setNeedsDisplay];
+}
+
+
+- (void)setHighlighted:(BOOL)flag
+{
+    if (highlighted != flag) {
+        highlighted = flag;
+        [self setNeedsDisplay];
+    }
+}
+
+
 - (void)setFrame:(CGRect)rect
 {
     frame = rect;
@@ -69,15 +91,28 @@
 }
 
 
+- (BOOL)getDrawBounds:(CGRect *)bounds
+{
+    *bounds = CGRectMake(0, 0, CGRectGetWidth(frame), CGRectGetHeight(frame));
+    return YES;
+}
+
+
+- (BOOL)getOpaqueRect:(CGRect *)rect
+{
+    return [self getDrawBounds:rect];
+}
+
+
 - (void)render
 {
     glDisable(GL_BLEND);
     glDisable(GL_DEPTH_TEST);
 
-    BGLUniformColor(SHU[shu_Button_color], highlighted ? &BGLColorWhite : &color);
+    BGLButtonSetColor((const GLfloat *)(highlighted ? &BGLColorWhite : &color));
     
-    glVertexAttribPointer(sha_Button_vertexPosition, 2, GL_FLOAT, GL_FALSE, 0, vertexPositions);
-    glEnableVertexAttribArray(sha_Button_vertexPosition);
+    glVertexAttribPointer(kBGLButtonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, 0, vertexPositions);
+    glEnableVertexAttribArray(kBGLButtonAttributeVertexPosition);
     
     DAssert([self.program validate], @"Failed to validate program.");
 
@@ -90,8 +125,9 @@
 
 - (void)touch:(UITouch *)touch beganAtPoint:(CGPoint)p
 {
+    [self getInverseRootTransform:touchTransform];
     if (! enabled) return;
-    highlighted = YES;
+    self.highlighted = YES;
     if (touchDownAction) {
         [target performSelector:touchDownAction withObject:self];
     }
@@ -101,8 +137,8 @@
 - (void)touch:(UITouch *)touch movedToPoint:(CGPoint)p0
 {
     if (! enabled) return;
-    BGLVector3 p1 = [self transformPointFromRoot:BGLVector3Make(p0.x, p0.y, 0)];
-    highlighted = [self containsPoint:p1];
+    BGLVector3 p1 = BGLMatrixApplyTransform(touchTransform, BGLVector3Make(p0.x, p0.y, 0));
+    self.highlighted = [self containsPoint:p1];
 }
 
 
@@ -112,14 +148,14 @@
     if (highlighted && touchUpInsideAction) {
         [target performSelector:touchUpInsideAction withObject:self];
     }
-    highlighted = NO;    
+    self.highlighted = NO;
 }
 
 
 - (void)touchCancelled:(UITouch *)touch
 {
     // perform no action
-    highlighted = NO;
+    self.highlighted = NO;
 }
 
 
@@ -0,0 +1,27 @@
+//
+//  BGLClipNode.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLNode.h"
+
+/*
+ A node whose subnodes draw only inside its clip rect. It draws nothing
+ itself; the rect is taken through its matrix and program (for the
+ projection) to a scissor rect in pixels, intersected with the clip rects
+ of any clip nodes above it. A rotated clip scissors to its bounding box.
+
+ When the renderer culls occluded nodes, the same pass culls the subnodes
+ that fall wholly outside the clip, so they issue no draws, and counts them
+ and the pixels the scissor saved in its occlusion stats.
+
+ Hit tests miss the subnodes outside the clip rect, as drawing does.
+ */
+
+@interface BGLClipNode : BGLNode {
+    CGRect clipRect;
+}
+@property (nonatomic) CGRect clipRect; // in the node's coordinates; infinite clips nothing
+- (id)initWithClipRect:(CGRect)rect;
+@end
@@ -0,0 +1,91 @@
+//
+//  BGLClipNode.m
+//  FingerPaintBall
+//
+
+#import "BGLClipNode.h"
+#import "BGLProgram.h"
+
+
+@implementation BGLClipNode
+
+
+@synthesize clipRect;
+
+
+- (id)initWithClipRect:(CGRect)rect
+{
+    if ((self = [super init])) {
+        // Only its projection is used, which most nodes share.
+        self.program = [BGLProgram programNamed:@"Polygon"];
+        clipRect = rect;
+        BGLNodeStoreSetFlag(BGLNodeStoreGetDefault(), handle, kBGLNodeFlagClips, 1);
+    }
+    return self;
+}
+
+
+- (id)init
+{
+    return [self initWithClipRect:CGRectInfinite];
+}
+
+
+- (void)setClipRect:(CGRect)rect
+{
+    clipRect = rect;
+    [self setNeedsDisplay];
+}
+
+
+- (BOOL)getClipRect:(CGRect *)rect
+{
+    if (CGRectIsInfinite(clipRect)) return NO;
+    *rect = clipRect;
+    return YES;
+}
+
+
+- (BOOL)clipContainsPoint:(BGLVector3)p withInverse:(const BGLMatrix)m
+{
+    BGLVector3 p1 = BGLMatrixApplyTransform(m, p);
+    return CGRectContainsPoint(clipRect, CGPointMake(p1.x, p1.y));
+}
+
+
+#pragma mark BGLNode
+
+
+- (BGLNode *)hitTest:(BGLVector3)p0
+{
+    BGLMatrix m;
+    if (! CGRectIsInfinite(clipRect) &&
+        BGLMatrixInvert(m, BGLNodeStoreLocalMatrix(BGLNodeStoreGetDefault(), handle)) &&
+        ! [self clipContainsPoint:p0 withInverse:m]) {
+        return nil;
+    }
+    return [super hitTest:p0];
+}
+
+
+- (void)hitTestPoints:(const BGLVector3 *)points results:(BGLNode **)results count:(NSUInteger)count
+{
+    BGLMatrix m;
+    if (CGRectIsInfinite(clipRect) || ! BGLMatrixInvert(m, BGLNodeStoreLocalMatrix(BGLNodeStoreGetDefault(), handle))) {
+        [super hitTestPoints:points results:results count:count];
+        return;
+    }
+    // Points outside are given a result for the time being, so they're skipped.
+    BOOL outside[kBGLHitTestBatchMax];
+    for (NSUInteger i = 0; i < count; i++) {
+        outside[i] = (results[i] == nil && ! [self clipContainsPoint:points[i] withInverse:m]);
+        if (outside[i]) results[i] = self;
+    }
+    [super hitTestPoints:points results:results count:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        if (outside[i]) results[i] = nil;
+    }
+}
+
+
+@end
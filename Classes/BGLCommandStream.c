@@ -0,0 +1,143 @@
+/*
+ See BGLCommandStream.h.
+ */
+
+#include "BGLCommandStream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char kMagic[4] = { 'B', 'G', 'L', 'C' };
+
+static const uint32_t kHasDataFlag = 1 << 16;
+
+
+int BGLCommandStreamWriterOpen(BGLCommandStreamWriter *w, const char *path)
+{
+    memset(w, 0, sizeof(BGLCommandStreamWriter));
+    w->file = fopen(path, "wb");
+    if (w->file == NULL) return 0;
+    // Capture runs inside the frame; keep writes out of the kernel.
+    setvbuf(w->file, NULL, _IOFBF, 256 * 1024);
+    uint32_t version = kBGLCommandStreamVersion;
+    fwrite(kMagic, 1, 4, w->file);
+    fwrite(&version, sizeof(version), 1, w->file);
+    w->byteCount = 8;
+    return 1;
+}
+
+
+void BGLCommandStreamWrite(BGLCommandStreamWriter *w, uint32_t opcode, const uint32_t *args, uint32_t argCount, const void *data, uint32_t dataLength)
+{
+    static const uint8_t zeros[4] = { 0, 0, 0, 0 };
+
+    if (w->file == NULL) return;
+    uint32_t word = opcode | (argCount << 8) | (data ? kHasDataFlag : 0);
+    fwrite(&word, sizeof(word), 1, w->file);
+    fwrite(args, sizeof(uint32_t), argCount, w->file);
+    w->byteCount += 4 * (1 + argCount);
+    if (data) {
+        uint32_t padding = (4 - dataLength % 4) % 4;
+        fwrite(&dataLength, sizeof(dataLength), 1, w->file);
+        fwrite(data, 1, dataLength, w->file);
+        fwrite(zeros, 1, padding, w->file);
+        w->byteCount += 4 + dataLength + padding;
+    }
+    w->commandCount += 1;
+}
+
+
+void BGLCommandStreamWriterClose(BGLCommandStreamWriter *w)
+{
+    if (w->file) fclose(w->file);
+    w->file = NULL;
+}
+
+
+int BGLCommandStreamReaderInit(BGLCommandStreamReader *r, const void *bytes, size_t length)
+{
+    r->bytes = bytes;
+    r->length = length;
+    r->offset = 8;
+    if (length < 8 || memcmp(bytes, kMagic, 4) != 0) return 0;
+    uint32_t version;
+    memcpy(&version, r->bytes + 4, sizeof(version));
+    return (version == kBGLCommandStreamVersion);
+}
+
+
+static inline int BGLCommandStreamReadWord(BGLCommandStreamReader *r, uint32_t *word)
+{
+    if (r->offset + 4 > r->length) return 0;
+    memcpy(word, r->bytes + r->offset, 4);
+    r->offset += 4;
+    return 1;
+}
+
+
+int BGLCommandStreamNext(BGLCommandStreamReader *r, BGLCommand *cmd)
+{
+    if (r->offset == r->length) return 0;
+
+    uint32_t word;
+    if (! BGLCommandStreamReadWord(r, &word)) return -1;
+    cmd->opcode = word & 0xFF;
+    cmd->argCount = (word >> 8) & 0xFF;
+    if (cmd->opcode == 0 || cmd->opcode >= kBGLCommandCount) return -1;
+    if (cmd->argCount > kBGLCommandArgMax) return -1;
+    for (uint32_t i = 0; i < cmd->argCount; i++) {
+        if (! BGLCommandStreamReadWord(r, &cmd->args[i])) return -1;
+    }
+    cmd->data = NULL;
+    cmd->dataLength = 0;
+    if (word & kHasDataFlag) {
+        if (! BGLCommandStreamReadWord(r, &cmd->dataLength)) return -1;
+        size_t padded = cmd->dataLength + (4 - cmd->dataLength % 4) % 4;
+        if (r->offset + padded > r->length) return -1;
+        cmd->data = r->bytes + r->offset;
+        r->offset += padded;
+    }
+    return 1;
+}
+
+
+const char *BGLCommandName(uint32_t opcode)
+{
+    static const char *names[kBGLCommandCount] = {
+        [kBGLCommandFrame] = "Frame",
+        [kBGLCommandActiveTexture] = "ActiveTexture",
+        [kBGLCommandBindTexture] = "BindTexture",
+        [kBGLCommandTexParameteri] = "TexParameteri",
+        [kBGLCommandTexImage2D] = "TexImage2D",
+        [kBGLCommandBindBuffer] = "BindBuffer",
+        [kBGLCommandBufferData] = "BufferData",
+        [kBGLCommandBufferSubData] = "BufferSubData",
+        [kBGLCommandBindFramebuffer] = "BindFramebuffer",
+        [kBGLCommandBindRenderbuffer] = "BindRenderbuffer",
+        [kBGLCommandViewport] = "Viewport",
+        [kBGLCommandEnable] = "Enable",
+        [kBGLCommandDisable] = "Disable",
+        [kBGLCommandBlendFunc] = "BlendFunc",
+        [kBGLCommandBlendFuncSeparate] = "BlendFuncSeparate",
+        [kBGLCommandClearColor] = "ClearColor",
+        [kBGLCommandClear] = "Clear",
+        [kBGLCommandUseProgram] = "UseProgram",
+        [kBGLCommandUniform1i] = "Uniform1i",
+        [kBGLCommandUniform1f] = "Uniform1f",
+        [kBGLCommandUniform4fv] = "Uniform4fv",
+        [kBGLCommandUniformMatrix4fv] = "UniformMatrix4fv",
+        [kBGLCommandEnableVertexAttribArray] = "EnableVertexAttribArray",
+        [kBGLCommandDisableVertexAttribArray] = "DisableVertexAttribArray",
+        [kBGLCommandVertexAttribPointer] = "VertexAttribPointer",
+        [kBGLCommandVertexAttribDivisor] = "VertexAttribDivisor",
+        [kBGLCommandAttribData] = "AttribData",
+        [kBGLCommandDrawArrays] = "DrawArrays",
+        [kBGLCommandDrawArraysInstanced] = "DrawArraysInstanced",
+        [kBGLCommandDiscardFramebuffer] = "DiscardFramebuffer",
+        [kBGLCommandResolveMultisampleFramebuffer] = "ResolveMultisampleFramebuffer",
+        [kBGLCommandScissor] = "Scissor",
+    };
+    if (opcode >= kBGLCommandCount || names[opcode] == NULL) return "?";
+    return names[opcode];
+}
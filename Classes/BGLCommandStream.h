@@ -0,0 +1,119 @@
+/*
+ Binary stream of GL commands, as written by the capture dispatch in
+ BGLGLDispatch.c and read back by Tools/bglreplay.c.
+
+ A stream is a header followed by commands. Each command is one word holding
+ the opcode, argument count and a has-data flag, then its arguments as
+ 32-bit words (floats by bit pattern), then for commands with data a length
+ word and the bytes, padded to a multiple of four. Data holds whatever the
+ call read from client memory: uniform values, buffer and texture contents,
+ and, just before each draw, the client-side vertex arrays it uses.
+
+ Object names are recorded as the application saw them. Anything created
+ before capture began (programs, textures, buffers) appears only by name.
+
+ This is plain C with no GL calls, so the replay tool can build anywhere.
+ */
+
+#ifndef BGLCOMMANDSTREAM_H
+#define BGLCOMMANDSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define kBGLCommandStreamVersion 1
+#define kBGLCommandArgMax 8
+
+
+typedef enum {
+    kBGLCommandFrame = 1,       // frame index
+    kBGLCommandActiveTexture,
+    kBGLCommandBindTexture,
+    kBGLCommandTexParameteri,
+    kBGLCommandTexImage2D,      // target, level, internalformat, width, height, format, type; pixels
+    kBGLCommandBindBuffer,
+    kBGLCommandBufferData,      // target, size, usage; data
+    kBGLCommandBufferSubData,   // target, offset; data
+    kBGLCommandBindFramebuffer,
+    kBGLCommandBindRenderbuffer,
+    kBGLCommandViewport,
+    kBGLCommandEnable,
+    kBGLCommandDisable,
+    kBGLCommandBlendFunc,
+    kBGLCommandBlendFuncSeparate,
+    kBGLCommandClearColor,
+    kBGLCommandClear,
+    kBGLCommandUseProgram,
+    kBGLCommandUniform1i,
+    kBGLCommandUniform1f,
+    kBGLCommandUniform4fv,      // location, count; values
+    kBGLCommandUniformMatrix4fv,// location, count, transpose; values
+    kBGLCommandEnableVertexAttribArray,
+    kBGLCommandDisableVertexAttribArray,
+    kBGLCommandVertexAttribPointer, // index, size, type, normalized, stride, client, offset
+    kBGLCommandVertexAttribDivisor,
+    kBGLCommandAttribData,      // index; client array bytes from the pointer onward
+    kBGLCommandDrawArrays,
+    kBGLCommandDrawArraysInstanced,
+    kBGLCommandDiscardFramebuffer, // target; attachments
+    kBGLCommandResolveMultisampleFramebuffer,
+    kBGLCommandScissor,
+    kBGLCommandCount
+} BGLCommandOpcode;
+
+
+typedef struct {
+    uint32_t opcode;
+    uint32_t argCount;
+    uint32_t args[kBGLCommandArgMax];
+    const void *data;           // NULL if the command has none
+    uint32_t dataLength;
+} BGLCommand;
+
+
+typedef struct {
+    FILE *file;
+    uint32_t commandCount;
+    uint64_t byteCount;
+} BGLCommandStreamWriter;
+
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} BGLCommandStreamReader;
+
+
+static inline uint32_t BGLCommandFloatBits(float f)
+{
+    union { float f; uint32_t u; } v;
+    v.f = f;
+    return v.u;
+}
+
+
+static inline float BGLCommandBitsFloat(uint32_t u)
+{
+    union { float f; uint32_t u; } v;
+    v.u = u;
+    return v.f;
+}
+
+
+int BGLCommandStreamWriterOpen(BGLCommandStreamWriter *w, const char *path);
+void BGLCommandStreamWrite(BGLCommandStreamWriter *w, uint32_t opcode, const uint32_t *args, uint32_t argCount, const void *data, uint32_t dataLength);
+void BGLCommandStreamWriterClose(BGLCommandStreamWriter *w);
+
+// Returns 0 if the bytes don't start with a stream header of a known version.
+int BGLCommandStreamReaderInit(BGLCommandStreamReader *r, const void *bytes, size_t length);
+// Returns 1 and fills cmd, 0 at the end of the stream, or -1 if it is corrupt.
+// cmd->data points into the reader's bytes.
+int BGLCommandStreamNext(BGLCommandStreamReader *r, BGLCommand *cmd);
+
+const char *BGLCommandName(uint32_t opcode);
+
+
+#endif
@@ -0,0 +1,24 @@
+//
+//  BGLDistanceFieldProgram.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLProgram.h"
+
+/*
+ Program for text drawn from a signed distance field atlas. The atlas stores
+ distance to the glyph edge (0.5 = on the edge) instead of coverage, so one
+ atlas renders crisply at any scale. Because the width of the antialiasing
+ band depends on how large the glyphs are on screen, the smoothing uniform is
+ derived from the modelview scale each time uniforms are applied.
+ 
+ Use it by setting the manifest entry's Class to BGLDistanceFieldProgram.
+ */
+
+@interface BGLDistanceFieldProgram : BGLProgram {
+    GLint smoothingUniformLocation;
+    float spread;
+}
+@property (nonatomic) float spread; // distance field spread, in screen units at scale 1
+@end
@@ -0,0 +1,54 @@
+//
+//  BGLDistanceFieldProgram.m
+//  FingerPaintBall
+//
+
+#import "BGLDistanceFieldProgram.h"
+
+
+static const float kDefaultSpread = 8.0f;
+
+
+@implementation BGLDistanceFieldProgram
+
+
+@synthesize spread;
+
+
+- (id)init
+{
+    if ((self = [super init])) {
+        smoothingUniformLocation = -1;
+        spread = kDefaultSpread;
+    }
+    return self;
+}
+
+
+- (BOOL)link
+{
+    BOOL linked = [super link];
+    if (linked) {
+        smoothingUniformLocation = [self uniformLocationNamed:"smoothing"];
+    }
+    return linked;
+}
+
+
+- (void)applyModelViewMatrix:(const BGLMatrix)modelView modelViewProjectionMatrix:(const BGLMatrix)modelViewProjection
+{
+    [super applyModelViewMatrix:modelView modelViewProjectionMatrix:modelViewProjection];
+    if (smoothingUniformLocation > -1) {
+        // Length of the transformed X axis is the on-screen scale factor.
+        float scale = BGLVector2Length(BGLVector2Make(modelView[0], modelView[1]));
+        float smoothing = (scale > 0) ? 0.5f / (spread * scale) : 0.5f;
+        if (smoothing > 0.5f) smoothing = 0.5f;
+        // Keep the smoothstep edges apart at mediump precision near 0.5;
+        // equal edges are undefined in GLSL ES.
+        if (smoothing < 1.0f / 512) smoothing = 1.0f / 512;
+        glUniform1f(smoothingUniformLocation, smoothing);
+    }
+}
+
+
+@end
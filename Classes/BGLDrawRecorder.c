@@ -0,0 +1,377 @@
+/*
+ See BGLDrawRecorder.h.
+
+ Threads take partitions one at a time from a shared counter, so a thread
+ that draws a heavy subtree doesn't hold up the rest. Each thread appends
+ to its own list; a partition notes where its commands landed, and merging
+ copies them out in partition order, which is sort key order, without
+ comparing keys.
+
+ Lists keep their storage from frame to frame. Only the calling thread's
+ growth is accounted (see BGLAccounting.h), since accounting is not
+ thread-safe; worker lists stop growing once the scene stops growing.
+ */
+
+#include "BGLDrawRecorder.h"
+#include "BGLAccounting.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+static const int kCutRounds = 8; // levels of the tree to look down for subtrees
+static const uint32_t kParallelNodeMin = 256; // fewer record faster than threads wake
+
+
+typedef struct {
+    BGLDrawRecorder *recorder;
+    BGLDrawList *list;
+    uint64_t keyBase;
+    uint32_t drawKey;           // of the projection last looked up
+    const float *projection;
+    uint32_t openClips;         // each with room kept for its end
+} BGLDrawContext;
+
+
+#pragma mark Recording
+
+
+// Returns NULL, dropping the command, if the list can't grow. A clip end is
+// never dropped: every command leaves room for the ends of the clips open.
+static BGLDrawCommand *BGLDrawContextAppend(BGLDrawContext *c, uint32_t node, uint32_t kind)
+{
+    BGLDrawList *list = c->list;
+    uint32_t needed = list->count + 1;
+    if (kind != kBGLDrawCommandClipEnd) needed += c->openClips + (kind == kBGLDrawCommandClipBegin);
+    if (needed > list->capacity) {
+        uint32_t capacity = list->capacity ? 2 * list->capacity : 256;
+        while (capacity < needed) capacity *= 2;
+        BGLDrawCommand *commands = realloc(list->commands, capacity * sizeof(BGLDrawCommand));
+        if (commands == NULL) return NULL;
+        list->commands = commands;
+        list->capacity = capacity;
+    }
+    if (kind == kBGLDrawCommandClipBegin) c->openClips += 1;
+    if (kind == kBGLDrawCommandClipEnd) c->openClips -= 1;
+    BGLDrawCommand *cmd = &list->commands[list->count];
+    cmd->sortKey = c->keyBase + list->count;
+    cmd->node = node;
+    cmd->drawKey = c->recorder->store->drawKey[node];
+    cmd->kind = kind;
+    list->count += 1;
+    return cmd;
+}
+
+
+static const float *BGLDrawContextProjection(BGLDrawContext *c, uint32_t drawKey)
+{
+    if (drawKey == c->drawKey) return c->projection;
+    c->drawKey = drawKey;
+    c->projection = NULL;
+    for (uint32_t i = 0; i < c->recorder->projectionCount; i++) {
+        if (c->recorder->projections[i].drawKey == drawKey) {
+            c->projection = c->recorder->projections[i].projection;
+            break;
+        }
+    }
+    return c->projection;
+}
+
+
+static int BGLDrawContextAppendDraw(BGLDrawContext *c, uint32_t i, uint32_t kind, const BGLMatrix m)
+{
+    BGLDrawCommand *cmd = BGLDrawContextAppend(c, i, kind);
+    if (cmd == NULL) return 0;
+    BGLMatrixCopy(cmd->modelView, m);
+    const float *projection = BGLDrawContextProjection(c, cmd->drawKey);
+    if (projection) {
+        BGLMatrixMultiply(cmd->modelViewProjection, projection, m);
+    } else {
+        BGLMatrixCopy(cmd->modelViewProjection, m);
+    }
+    return 1;
+}
+
+
+static void BGLDrawRecordNode(BGLDrawContext *c, uint32_t i, const BGLMatrix parentMatrix, int subnodes)
+{
+    // Mirrors -[BGLNode renderSelfAndSubnodesWithState:].
+    BGLNodeStore *s = c->recorder->store;
+    const uint8_t flags = s->flags[i];
+    if (flags & kBGLNodeFlagHidden) return;
+
+    if (flags & kBGLNodeFlagRasterized) {
+        BGLDrawCommand *cmd = BGLDrawContextAppend(c, i, kBGLDrawCommandSubtree);
+        if (cmd == NULL) return;
+        BGLMatrixCopy(cmd->modelView, parentMatrix);
+        BGLMatrixCopy(cmd->modelViewProjection, parentMatrix); // unused; its nodes project themselves
+        return;
+    }
+
+    BGLMatrix m;
+    BGLMatrixMultiply(m, BGLNodeStoreLocalMatrixAtIndex(s, i), parentMatrix);
+    const int clips = (flags & kBGLNodeFlagClips) && s->drawKey[i];
+    if (clips) {
+        // Unclipped, its subnodes would draw where they shouldn't.
+        if (! BGLDrawContextAppendDraw(c, i, kBGLDrawCommandClipBegin, m)) return;
+    } else if (flags & kBGLNodeFlagOccluded) {
+        s->flags[i] &= ~kBGLNodeFlagOccluded;
+    } else if (s->drawKey[i]) {
+        BGLDrawContextAppendDraw(c, i, kBGLDrawCommandNode, m);
+    }
+    if (! subnodes) return;
+    for (uint32_t k = s->firstChild[i]; k != kBGLNodeIndexNone; k = s->nextSibling[k]) {
+        BGLDrawRecordNode(c, k, m, 1);
+    }
+    if (clips) {
+        BGLDrawCommand *cmd = BGLDrawContextAppend(c, i, kBGLDrawCommandClipEnd);
+        BGLMatrixCopy(cmd->modelView, m); // unused
+        BGLMatrixCopy(cmd->modelViewProjection, m);
+    }
+}
+
+
+static void BGLDrawRecordPartitions(BGLDrawRecorder *r, uint32_t listIndex)
+{
+    BGLDrawList *list = &r->lists[listIndex];
+    for (;;) {
+        uint32_t p = __sync_fetch_and_add(&r->nextPartition, 1);
+        if (p >= r->partitionCount) break;
+        BGLDrawPartition *part = &r->partitions[p];
+        part->list = listIndex;
+        part->start = list->count;
+        // Keys count from the partition's start in this list, so order within it holds.
+        BGLDrawContext c = { r, list, ((uint64_t)p << 32) - part->start, 0, NULL, 0 };
+        if (part->siblingCount == 0) {
+            BGLDrawRecordNode(&c, part->node, part->parentMatrix, 0);
+        } else {
+            uint32_t k = part->node;
+            for (uint32_t n = 0; n < part->siblingCount; n++, k = r->store->nextSibling[k]) {
+                BGLDrawRecordNode(&c, k, part->parentMatrix, 1);
+            }
+        }
+        part->count = list->count - part->start;
+    }
+}
+
+
+#pragma mark Partitions
+
+
+// Returns 0 if the partitions can't grow; those there are stay usable.
+static int BGLDrawRecorderReservePartitions(BGLDrawRecorder *r, uint32_t count)
+{
+    if (count <= r->partitionCapacity) return 1;
+    uint32_t capacity = r->partitionCapacity ? r->partitionCapacity : 64;
+    while (capacity < count) capacity *= 2;
+    BGLDrawPartition *partitions = realloc(r->partitions, capacity * sizeof(BGLDrawPartition));
+    if (partitions == NULL) return 0;
+    BGLAccountAllocation(capacity * sizeof(BGLDrawPartition));
+    r->partitions = partitions;
+    BGLDrawPartition *scratch = realloc(r->scratch, capacity * sizeof(BGLDrawPartition));
+    if (scratch == NULL) return 0;
+    BGLAccountAllocation(capacity * sizeof(BGLDrawPartition));
+    r->scratch = scratch;
+    r->partitionCapacity = capacity;
+    return 1;
+}
+
+
+static inline int BGLDrawPartitionIsSplittable(const BGLNodeStore *s, const BGLDrawPartition *part)
+{
+    // One subtree that rendering would descend into.
+    return (part->siblingCount == 1 && s->firstChild[part->node] != kBGLNodeIndexNone &&
+            ! (s->flags[part->node] & (kBGLNodeFlagHidden | kBGLNodeFlagRasterized | kBGLNodeFlagClips)));
+}
+
+
+static void BGLDrawRecorderCut(BGLDrawRecorder *r, uint32_t root)
+{
+    BGLNodeStore *s = r->store;
+    if (! BGLDrawRecorderReservePartitions(r, 1)) {
+        r->partitionCount = 0; // nothing to record into
+        return;
+    }
+    r->partitions[0].node = root;
+    r->partitions[0].siblingCount = 1;
+    BGLMatrixLoadIdentity(r->partitions[0].parentMatrix);
+    r->partitionCount = 1;
+
+    for (int round = 0; round < kCutRounds && r->partitionCount < kBGLDrawPartitionTarget; round++) {
+        // A subtree splits into its root alone, then runs of its children,
+        // at most kBGLDrawPartitionTarget of them.
+        uint32_t needed = 0, splittable = 0;
+        for (uint32_t p = 0; p < r->partitionCount; p++) {
+            const BGLDrawPartition *part = &r->partitions[p];
+            needed += 1;
+            if (BGLDrawPartitionIsSplittable(s, part)) {
+                needed += kBGLDrawPartitionTarget;
+                splittable += 1;
+            }
+        }
+        if (splittable == 0) break;
+        if (! BGLDrawRecorderReservePartitions(r, needed)) break; // record as cut so far
+
+        uint32_t n = 0;
+        for (uint32_t p = 0; p < r->partitionCount; p++) {
+            const BGLDrawPartition *part = &r->partitions[p];
+            if (! BGLDrawPartitionIsSplittable(s, part)) {
+                r->scratch[n++] = *part;
+                continue;
+            }
+            uint32_t i = part->node;
+            BGLDrawPartition *self = &r->scratch[n++];
+            *self = *part;
+            self->siblingCount = 0;
+
+            BGLMatrix m;
+            BGLMatrixMultiply(m, BGLNodeStoreLocalMatrixAtIndex(s, i), part->parentMatrix);
+            uint32_t childCount = 0;
+            for (uint32_t k = s->firstChild[i]; k != kBGLNodeIndexNone; k = s->nextSibling[k]) childCount++;
+            uint32_t runLength = (childCount + kBGLDrawPartitionTarget - 1) / kBGLDrawPartitionTarget;
+            uint32_t k = s->firstChild[i];
+            while (k != kBGLNodeIndexNone) {
+                BGLDrawPartition *run = &r->scratch[n++];
+                run->node = k;
+                run->siblingCount = 0;
+                BGLMatrixCopy(run->parentMatrix, m);
+                while (k != kBGLNodeIndexNone && run->siblingCount < runLength) {
+                    run->siblingCount += 1;
+                    k = s->nextSibling[k];
+                }
+            }
+        }
+        BGLDrawPartition *t = r->partitions;
+        r->partitions = r->scratch;
+        r->scratch = t;
+        r->partitionCount = n;
+    }
+}
+
+
+#pragma mark Threads
+
+
+static void *BGLDrawWorkerMain(void *arg)
+{
+    BGLDrawWorker *w = arg;
+    BGLDrawRecorder *r = w->recorder;
+    uint32_t seen = 0;
+    pthread_mutex_lock(&r->mutex);
+    for (;;) {
+        while (r->generation == seen && ! r->stopping) pthread_cond_wait(&r->start, &r->mutex);
+        if (r->stopping) break;
+        seen = r->generation;
+        pthread_mutex_unlock(&r->mutex);
+        BGLDrawRecordPartitions(r, w->index);
+        pthread_mutex_lock(&r->mutex);
+        if (--r->running == 0) pthread_cond_signal(&r->done);
+    }
+    pthread_mutex_unlock(&r->mutex);
+    return NULL;
+}
+
+
+void BGLDrawRecorderInit(BGLDrawRecorder *r, uint32_t threadCount)
+{
+    memset(r, 0, sizeof(BGLDrawRecorder));
+    if (threadCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = (cores > 0) ? (uint32_t)cores : 1;
+    }
+    if (threadCount > kBGLDrawThreadMax) threadCount = kBGLDrawThreadMax;
+    r->threadCount = 1;
+    pthread_mutex_init(&r->mutex, NULL);
+    pthread_cond_init(&r->start, NULL);
+    pthread_cond_init(&r->done, NULL);
+    for (uint32_t t = 1; t < threadCount; t++) {
+        BGLDrawWorker *w = &r->workers[t];
+        w->recorder = r;
+        w->index = t;
+        if (pthread_create(&w->thread, NULL, BGLDrawWorkerMain, w) != 0) break;
+        r->threadCount += 1;
+    }
+}
+
+
+void BGLDrawRecorderFree(BGLDrawRecorder *r)
+{
+    pthread_mutex_lock(&r->mutex);
+    r->stopping = 1;
+    pthread_cond_broadcast(&r->start);
+    pthread_mutex_unlock(&r->mutex);
+    for (uint32_t t = 1; t < r->threadCount; t++) {
+        pthread_join(r->workers[t].thread, NULL);
+    }
+    pthread_cond_destroy(&r->done);
+    pthread_cond_destroy(&r->start);
+    pthread_mutex_destroy(&r->mutex);
+    for (uint32_t t = 0; t < kBGLDrawThreadMax; t++) {
+        free(r->lists[t].commands);
+    }
+    free(r->merged.commands);
+    free(r->partitions);
+    free(r->scratch);
+    memset(r, 0, sizeof(BGLDrawRecorder));
+}
+
+
+#pragma mark Frames
+
+
+const BGLDrawList *BGLDrawRecorderRecord(BGLDrawRecorder *r, BGLNodeStore *store, BGLNodeHandle root,
+                                         const BGLDrawProjection *projections, uint32_t projectionCount)
+{
+    r->store = store;
+    r->projections = projections;
+    r->projectionCount = projectionCount;
+    BGLDrawRecorderCut(r, BGLNodeHandleIndex(root));
+    for (uint32_t t = 0; t < r->threadCount; t++) {
+        r->lists[t].count = 0;
+    }
+    r->nextPartition = 0;
+
+    // A small scene or a lone partition isn't worth waking anyone for.
+    int parallel = (r->threadCount > 1 && r->partitionCount > 1 && store->count >= kParallelNodeMin);
+    if (parallel) {
+        pthread_mutex_lock(&r->mutex);
+        r->running = r->threadCount - 1;
+        r->generation += 1;
+        pthread_cond_broadcast(&r->start);
+        pthread_mutex_unlock(&r->mutex);
+    }
+    uint32_t grown = r->lists[0].capacity;
+    BGLDrawRecordPartitions(r, 0);
+    if (r->lists[0].capacity != grown) {
+        BGLAccountAllocation(r->lists[0].capacity * sizeof(BGLDrawCommand));
+    }
+    if (parallel) {
+        pthread_mutex_lock(&r->mutex);
+        while (r->running > 0) pthread_cond_wait(&r->done, &r->mutex);
+        pthread_mutex_unlock(&r->mutex);
+    }
+
+    // Partition order is key order.
+    uint32_t total = 0;
+    for (uint32_t p = 0; p < r->partitionCount; p++) {
+        total += r->partitions[p].count;
+    }
+    BGLDrawList *merged = &r->merged;
+    merged->count = 0;
+    if (total > merged->capacity) {
+        uint32_t capacity = total + total / 2;
+        BGLDrawCommand *commands = realloc(merged->commands, capacity * sizeof(BGLDrawCommand));
+        if (commands == NULL) return merged; // empty; a frame with no draws
+        BGLAccountAllocation(capacity * sizeof(BGLDrawCommand));
+        merged->commands = commands;
+        merged->capacity = capacity;
+    }
+    for (uint32_t p = 0; p < r->partitionCount; p++) {
+        const BGLDrawPartition *part = &r->partitions[p];
+        memcpy(&merged->commands[merged->count], &r->lists[part->list].commands[part->start],
+               part->count * sizeof(BGLDrawCommand));
+        merged->count += part->count;
+    }
+    return merged;
+}
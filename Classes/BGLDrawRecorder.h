@@ -0,0 +1,132 @@
+/*
+ Records a frame's draws as a list of GL-free commands, on several threads.
+
+ Rendering is split in two. Recording walks the node store and, for every
+ visible node with a draw key (its program), computes the model-view and
+ model-view-projection matrices it will draw with and appends a command.
+ Submitting, on the GL thread, runs through the list calling each node's
+ -render (see +[BGLNode submitDrawList:state:]).
+
+ To record in parallel, the tree is first cut into partitions in draw
+ order: runs of sibling subtrees, and the nodes above them recorded singly.
+ A partition's commands carry sort keys of its index and their order within
+ it, so however the partitions are shared out among threads, merging the
+ per-thread lists by key reproduces serial preorder exactly. The cut
+ depends only on the tree, never on the thread count, so the merged list is
+ the same bytes with one thread or eight.
+
+ The key keeps draw order rather than grouping by program, since draws blend
+ over one another; submitting still skips a program switch when consecutive
+ commands share one.
+
+ A rasterized node is recorded as one subtree command at its parent's
+ matrix, to be drawn through its cache as before, and is not descended
+ into. Occluded nodes are skipped and their mark cleared, as rendering does.
+ A clip node (see BGLClipNode.h) records a clip begin command in place of a
+ draw and a clip end after its subnodes; it is never cut, so a clip scissors
+ a single partition.
+
+ Recording reads only the store, and each node's slot is written (composing
+ a changed local matrix, clearing the occluded mark) by just the thread
+ recording it; nothing else may change the store meanwhile. Threads are
+ POSIX threads kept waiting between frames. This is plain C with no GL calls.
+ */
+
+#ifndef BGLDRAWRECORDER_H
+#define BGLDRAWRECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "BGLMatrix.h"
+#include "BGLNodeStore.h"
+
+
+#define kBGLDrawThreadMax 8
+#define kBGLDrawPartitionTarget 64  // subtrees to cut the tree into, if it has them
+
+
+typedef enum {
+    kBGLDrawCommandNode,        // program use, uniforms, -render
+    kBGLDrawCommandSubtree,     // a rasterized node: draw it and its subnodes as before
+    kBGLDrawCommandClipBegin,   // a clip node: scissor what follows to its clip rect
+    kBGLDrawCommandClipEnd,     // after a clip node's subnodes
+} BGLDrawCommandKind;
+
+
+typedef struct {
+    uint64_t sortKey;           // partition << 32 | order within it
+    uint32_t node;              // slot index
+    uint32_t drawKey;
+    uint32_t kind;
+    BGLMatrix modelView;        // for a subtree, the parent's
+    BGLMatrix modelViewProjection;
+} BGLDrawCommand;
+
+
+typedef struct {
+    BGLDrawCommand *commands;
+    uint32_t count;
+    uint32_t capacity;
+} BGLDrawList;
+
+
+typedef struct {
+    uint32_t drawKey;
+    BGLMatrix projection;
+} BGLDrawProjection;
+
+
+typedef struct {
+    uint32_t node;
+    uint32_t siblingCount;      // 0: the node alone; else that many siblings from it, with subnodes
+    BGLMatrix parentMatrix;     // model-view above the node
+    uint32_t list;              // where its commands were recorded
+    uint32_t start;
+    uint32_t count;
+} BGLDrawPartition;
+
+
+typedef struct {
+    struct BGLDrawRecorder *recorder;
+    uint32_t index;
+    pthread_t thread;
+} BGLDrawWorker;
+
+
+typedef struct BGLDrawRecorder {
+    BGLNodeStore *store;
+    const BGLDrawProjection *projections;
+    uint32_t projectionCount;
+    BGLDrawPartition *partitions;
+    uint32_t partitionCount;
+    uint32_t partitionCapacity;
+    BGLDrawPartition *scratch;  // for cutting; same capacity
+    BGLDrawList lists[kBGLDrawThreadMax];
+    BGLDrawList merged;
+    uint32_t threadCount;
+    // Worker threads (all but the caller's)
+    BGLDrawWorker workers[kBGLDrawThreadMax];
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint32_t generation;
+    uint32_t running;
+    uint32_t nextPartition;
+    int stopping;
+} BGLDrawRecorder;
+
+
+// threadCount 0 uses one thread per core; 1 records on the caller's alone.
+void BGLDrawRecorderInit(BGLDrawRecorder *r, uint32_t threadCount);
+void BGLDrawRecorderFree(BGLDrawRecorder *r);
+
+// The list is the recorder's, valid until the next call. A draw key with no
+// projection given draws with the identity. Out of memory, commands are
+// dropped rather than the frame: a clip whose begin can't be recorded is
+// left out with its subnodes, and if the merged list can't grow it's empty.
+const BGLDrawList *BGLDrawRecorderRecord(BGLDrawRecorder *r, BGLNodeStore *store, BGLNodeHandle root,
+                                         const BGLDrawProjection *projections, uint32_t projectionCount);
+
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ See BGLGLDispatch.h.
+
+ Client-side vertex arrays are only readable at draw time, so the capture
+ dispatch shadows attribute array state and writes out the bytes of each
+ enabled client array just before the draw that reads them.
+ */
+
+#define BGL_GL_NO_DISPATCH
+#include "BGLGLDispatch.h"
+#include "BGLCommandStream.h"
+
+#include <string.h>
+
+
+const BGLGLDispatch BGLGLDirect = {
+    glActiveTexture,
+    glBindTexture,
+    glTexParameteri,
+    glTexImage2D,
+    glBindBuffer,
+    glBufferData,
+    glBufferSubData,
+    glBindFramebuffer,
+    glBindRenderbuffer,
+    glViewport,
+    glScissor,
+    glEnable,
+    glDisable,
+    glBlendFunc,
+    glBlendFuncSeparate,
+    glClearColor,
+    glClear,
+    glUseProgram,
+    glUniform1i,
+    glUniform1f,
+    glUniform4fv,
+    glUniformMatrix4fv,
+    glEnableVertexAttribArray,
+    glDisableVertexAttribArray,
+    glVertexAttribPointer,
+    glVertexAttribDivisorEXT,
+    glDrawArrays,
+    glDrawArraysInstancedEXT,
+    glDiscardFramebufferEXT,
+    glResolveMultisampleFramebufferAPPLE,
+};
+
+
+const BGLGLDispatch *BGLGL = &BGLGLDirect;
+
+
+#pragma mark Capture
+
+
+enum { kAttribMax = 16 };
+
+
+typedef struct {
+    GLboolean enabled;
+    GLboolean client;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    GLuint divisor;
+    const GLvoid *pointer;
+} CaptureAttrib;
+
+
+static struct {
+    BGLCommandStreamWriter writer;
+    uint32_t frameIndex;
+    GLuint arrayBuffer;
+    CaptureAttrib attribs[kAttribMax];
+} capture;
+
+
+#define RECORD(op, ...) do { \
+    const uint32_t _args[] = { __VA_ARGS__ }; \
+    BGLCommandStreamWrite(&capture.writer, op, _args, sizeof(_args) / sizeof(uint32_t), NULL, 0); \
+} while (0)
+
+#define RECORD_DATA(op, data, length, ...) do { \
+    const uint32_t _args[] = { __VA_ARGS__ }; \
+    BGLCommandStreamWrite(&capture.writer, op, _args, sizeof(_args) / sizeof(uint32_t), data, length); \
+} while (0)
+
+#define F(x) BGLCommandFloatBits(x)
+
+
+static GLsizei BytesPerComponent(GLenum type)
+{
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+
+static GLsizei BytesPerPixel(GLenum format, GLenum type)
+{
+    if (type != GL_UNSIGNED_BYTE) return 2; // packed 16-bit formats
+    switch (format) {
+        case GL_RGBA: return 4;
+        case GL_RGB: return 3;
+        case GL_LUMINANCE_ALPHA: return 2;
+        default: return 1;
+    }
+}
+
+
+static void CaptureClientArrays(GLint first, GLsizei count, GLsizei primcount)
+{
+    for (GLuint i = 0; i < kAttribMax; i++) {
+        const CaptureAttrib *a = &capture.attribs[i];
+        if (!a->enabled || !a->client || a->pointer == NULL) continue;
+        GLsizei elementSize = a->size * BytesPerComponent(a->type);
+        GLsizei stride = a->stride ? a->stride : elementSize;
+        GLsizei elements = a->divisor ? (primcount + a->divisor - 1) / a->divisor : first + count;
+        if (elements <= 0) continue;
+        uint32_t length = (elements - 1) * stride + elementSize;
+        RECORD_DATA(kBGLCommandAttribData, a->pointer, length, i);
+    }
+}
+
+
+static void CaptureActiveTexture(GLenum texture)
+{
+    RECORD(kBGLCommandActiveTexture, texture);
+    glActiveTexture(texture);
+}
+
+
+static void CaptureBindTexture(GLenum target, GLuint texture)
+{
+    RECORD(kBGLCommandBindTexture, target, texture);
+    glBindTexture(target, texture);
+}
+
+
+static void CaptureTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    RECORD(kBGLCommandTexParameteri, target, pname, param);
+    glTexParameteri(target, pname, param);
+}
+
+
+static void CaptureTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
+{
+    // Rows are padded to the default unpack alignment of 4.
+    uint32_t rowBytes = (width * BytesPerPixel(format, type) + 3) & ~3;
+    RECORD_DATA(kBGLCommandTexImage2D, pixels, pixels ? rowBytes * height : 0,
+                target, level, internalformat, width, height, format, type);
+    glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+
+static void CaptureBindBuffer(GLenum target, GLuint buffer)
+{
+    if (target == GL_ARRAY_BUFFER) capture.arrayBuffer = buffer;
+    RECORD(kBGLCommandBindBuffer, target, buffer);
+    glBindBuffer(target, buffer);
+}
+
+
+static void CaptureBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+    RECORD_DATA(kBGLCommandBufferData, data, data ? size : 0, target, size, usage);
+    glBufferData(target, size, data, usage);
+}
+
+
+static void CaptureBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
+{
+    RECORD_DATA(kBGLCommandBufferSubData, data, size, target, offset);
+    glBufferSubData(target, offset, size, data);
+}
+
+
+static void CaptureBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    RECORD(kBGLCommandBindFramebuffer, target, framebuffer);
+    glBindFramebuffer(target, framebuffer);
+}
+
+
+static void CaptureBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+    RECORD(kBGLCommandBindRenderbuffer, target, renderbuffer);
+    glBindRenderbuffer(target, renderbuffer);
+}
+
+
+static void CaptureViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    RECORD(kBGLCommandViewport, x, y, width, height);
+    glViewport(x, y, width, height);
+}
+
+
+static void CaptureScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    RECORD(kBGLCommandScissor, x, y, width, height);
+    glScissor(x, y, width, height);
+}
+
+
+static void CaptureEnable(GLenum cap)
+{
+    RECORD(kBGLCommandEnable, cap);
+    glEnable(cap);
+}
+
+
+static void CaptureDisable(GLenum cap)
+{
+    RECORD(kBGLCommandDisable, cap);
+    glDisable(cap);
+}
+
+
+static void CaptureBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    RECORD(kBGLCommandBlendFunc, sfactor, dfactor);
+    glBlendFunc(sfactor, dfactor);
+}
+
+
+static void CaptureBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha)
+{
+    RECORD(kBGLCommandBlendFuncSeparate, srcRGB, dstRGB, srcAlpha, dstAlpha);
+    glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+}
+
+
+static void CaptureClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+    RECORD(kBGLCommandClearColor, F(red), F(green), F(blue), F(alpha));
+    glClearColor(red, green, blue, alpha);
+}
+
+
+static void CaptureClear(GLbitfield mask)
+{
+    RECORD(kBGLCommandClear, mask);
+    glClear(mask);
+}
+
+
+static void CaptureUseProgram(GLuint program)
+{
+    RECORD(kBGLCommandUseProgram, program);
+    glUseProgram(program);
+}
+
+
+static void CaptureUniform1i(GLint location, GLint x)
+{
+    RECORD(kBGLCommandUniform1i, location, x);
+    glUniform1i(location, x);
+}
+
+
+static void CaptureUniform1f(GLint location, GLfloat x)
+{
+    RECORD(kBGLCommandUniform1f, location, F(x));
+    glUniform1f(location, x);
+}
+
+
+static void CaptureUniform4fv(GLint location, GLsizei count, const GLfloat *v)
+{
+    RECORD_DATA(kBGLCommandUniform4fv, v, count * 4 * sizeof(GLfloat), location, count);
+    glUniform4fv(location, count, v);
+}
+
+
+static void CaptureUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    RECORD_DATA(kBGLCommandUniformMatrix4fv, value, count * 16 * sizeof(GLfloat), location, count, transpose);
+    glUniformMatrix4fv(location, count, transpose, value);
+}
+
+
+static void CaptureEnableVertexAttribArray(GLuint index)
+{
+    if (index < kAttribMax) capture.attribs[index].enabled = GL_TRUE;
+    RECORD(kBGLCommandEnableVertexAttribArray, index);
+    glEnableVertexAttribArray(index);
+}
+
+
+static void CaptureDisableVertexAttribArray(GLuint index)
+{
+    if (index < kAttribMax) capture.attribs[index].enabled = GL_FALSE;
+    RECORD(kBGLCommandDisableVertexAttribArray, index);
+    glDisableVertexAttribArray(index);
+}
+
+
+static void CaptureVertexAttribPointer(GLuint indx, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *ptr)
+{
+    GLboolean client = (capture.arrayBuffer == 0);
+    if (indx < kAttribMax) {
+        CaptureAttrib *a = &capture.attribs[indx];
+        a->client = client;
+        a->size = size;
+        a->type = type;
+        a->stride = stride;
+        a->pointer = ptr;
+    }
+    RECORD(kBGLCommandVertexAttribPointer, indx, size, type, normalized, stride, client,
+           client ? 0 : (uint32_t)(uintptr_t)ptr);
+    glVertexAttribPointer(indx, size, type, normalized, stride, ptr);
+}
+
+
+static void CaptureVertexAttribDivisorEXT(GLuint index, GLuint divisor)
+{
+    if (index < kAttribMax) capture.attribs[index].divisor = divisor;
+    RECORD(kBGLCommandVertexAttribDivisor, index, divisor);
+    glVertexAttribDivisorEXT(index, divisor);
+}
+
+
+static void CaptureDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    CaptureClientArrays(first, count, 0);
+    RECORD(kBGLCommandDrawArrays, mode, first, count);
+    glDrawArrays(mode, first, count);
+}
+
+
+static void CaptureDrawArraysInstancedEXT(GLenum mode, GLint first, GLsizei count, GLsizei primcount)
+{
+    CaptureClientArrays(first, count, primcount);
+    RECORD(kBGLCommandDrawArraysInstanced, mode, first, count, primcount);
+    glDrawArraysInstancedEXT(mode, first, count, primcount);
+}
+
+
+static void CaptureDiscardFramebufferEXT(GLenum target, GLsizei numAttachments, const GLenum *attachments)
+{
+    RECORD_DATA(kBGLCommandDiscardFramebuffer, attachments, numAttachments * sizeof(GLenum), target);
+    glDiscardFramebufferEXT(target, numAttachments, attachments);
+}
+
+
+static void CaptureResolveMultisampleFramebufferAPPLE(void)
+{
+    BGLCommandStreamWrite(&capture.writer, kBGLCommandResolveMultisampleFramebuffer, NULL, 0, NULL, 0);
+    glResolveMultisampleFramebufferAPPLE();
+}
+
+
+static const BGLGLDispatch BGLGLCapture = {
+    CaptureActiveTexture,
+    CaptureBindTexture,
+    CaptureTexParameteri,
+    CaptureTexImage2D,
+    CaptureBindBuffer,
+    CaptureBufferData,
+    CaptureBufferSubData,
+    CaptureBindFramebuffer,
+    CaptureBindRenderbuffer,
+    CaptureViewport,
+    CaptureScissor,
+    CaptureEnable,
+    CaptureDisable,
+    CaptureBlendFunc,
+    CaptureBlendFuncSeparate,
+    CaptureClearColor,
+    CaptureClear,
+    CaptureUseProgram,
+    CaptureUniform1i,
+    CaptureUniform1f,
+    CaptureUniform4fv,
+    CaptureUniformMatrix4fv,
+    CaptureEnableVertexAttribArray,
+    CaptureDisableVertexAttribArray,
+    CaptureVertexAttribPointer,
+    CaptureVertexAttribDivisorEXT,
+    CaptureDrawArrays,
+    CaptureDrawArraysInstancedEXT,
+    CaptureDiscardFramebufferEXT,
+    CaptureResolveMultisampleFramebufferAPPLE,
+};
+
+
+int BGLGLCaptureBegin(const char *path)
+{
+    if (BGLGL == &BGLGLCapture) return 0;
+    memset(&capture, 0, sizeof(capture));
+    if (! BGLCommandStreamWriterOpen(&capture.writer, path)) return 0;
+
+    // Shadow the attribute state that is already set, which the renderer
+    // relies on across frames.
+    GLint buffer;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &buffer);
+    capture.arrayBuffer = buffer;
+    for (GLuint i = 0; i < kAttribMax; i++) {
+        CaptureAttrib *a = &capture.attribs[i];
+        GLint value;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &value);
+        a->enabled = value;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &a->size);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &value);
+        a->type = value;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &a->stride);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_DIVISOR_EXT, &value);
+        a->divisor = value;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &value);
+        a->client = (value == 0);
+        glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, (GLvoid **)&a->pointer);
+    }
+
+    BGLGL = &BGLGLCapture;
+    return 1;
+}
+
+
+void BGLGLCaptureFrame(void)
+{
+    if (BGLGL != &BGLGLCapture) return;
+    RECORD(kBGLCommandFrame, capture.frameIndex);
+    capture.frameIndex += 1;
+}
+
+
+void BGLGLCaptureEnd(void)
+{
+    if (BGLGL != &BGLGLCapture) return;
+    BGLGL = &BGLGLDirect;
+    BGLCommandStreamWriterClose(&capture.writer);
+}
+
+
+int BGLGLIsCapturing(void)
+{
+    return (BGLGL == &BGLGLCapture);
+}
@@ -0,0 +1,97 @@
+/*
+ Indirection for the GL calls made while drawing a frame, so a frame's
+ command stream can be captured (see BGLCommandStream.h).
+
+ Including this header redirects those gl* names through BGLGL, which
+ normally points at BGLGLDirect and costs one indirect call. Setup calls
+ (shader compilation, object creation, queries) are not redirected. Import
+ it after the GL headers; every header that imports them does so.
+ */
+
+#ifndef BGLGLDISPATCH_H
+#define BGLGLDISPATCH_H
+
+#include <OpenGLES/ES2/gl.h>
+#include <OpenGLES/ES2/glext.h>
+
+
+typedef struct {
+    void (*ActiveTexture)(GLenum texture);
+    void (*BindTexture)(GLenum target, GLuint texture);
+    void (*TexParameteri)(GLenum target, GLenum pname, GLint param);
+    void (*TexImage2D)(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels);
+    void (*BindBuffer)(GLenum target, GLuint buffer);
+    void (*BufferData)(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage);
+    void (*BufferSubData)(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data);
+    void (*BindFramebuffer)(GLenum target, GLuint framebuffer);
+    void (*BindRenderbuffer)(GLenum target, GLuint renderbuffer);
+    void (*Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+    void (*Scissor)(GLint x, GLint y, GLsizei width, GLsizei height);
+    void (*Enable)(GLenum cap);
+    void (*Disable)(GLenum cap);
+    void (*BlendFunc)(GLenum sfactor, GLenum dfactor);
+    void (*BlendFuncSeparate)(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
+    void (*ClearColor)(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
+    void (*Clear)(GLbitfield mask);
+    void (*UseProgram)(GLuint program);
+    void (*Uniform1i)(GLint location, GLint x);
+    void (*Uniform1f)(GLint location, GLfloat x);
+    void (*Uniform4fv)(GLint location, GLsizei count, const GLfloat *v);
+    void (*UniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+    void (*EnableVertexAttribArray)(GLuint index);
+    void (*DisableVertexAttribArray)(GLuint index);
+    void (*VertexAttribPointer)(GLuint indx, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *ptr);
+    void (*VertexAttribDivisorEXT)(GLuint index, GLuint divisor);
+    void (*DrawArrays)(GLenum mode, GLint first, GLsizei count);
+    void (*DrawArraysInstancedEXT)(GLenum mode, GLint first, GLsizei count, GLsizei primcount);
+    void (*DiscardFramebufferEXT)(GLenum target, GLsizei numAttachments, const GLenum *attachments);
+    void (*ResolveMultisampleFramebufferAPPLE)(void);
+} BGLGLDispatch;
+
+
+extern const BGLGLDispatch BGLGLDirect;
+extern const BGLGLDispatch *BGLGL;
+
+
+// Capture installs a dispatch that records each call before forwarding it.
+int BGLGLCaptureBegin(const char *path);
+void BGLGLCaptureFrame(void); // marks the start of a frame
+void BGLGLCaptureEnd(void);
+int BGLGLIsCapturing(void);
+
+
+#ifndef BGL_GL_NO_DISPATCH
+#define glActiveTexture BGLGL->ActiveTexture
+#define glBindTexture BGLGL->BindTexture
+#define glTexParameteri BGLGL->TexParameteri
+#define glTexImage2D BGLGL->TexImage2D
+#define glBindBuffer BGLGL->BindBuffer
+#define glBufferData BGLGL->BufferData
+#define glBufferSubData BGLGL->BufferSubData
+#define glBindFramebuffer BGLGL->BindFramebuffer
+#define glBindRenderbuffer BGLGL->BindRenderbuffer
+#define glViewport BGLGL->Viewport
+#define glScissor BGLGL->Scissor
+#define glEnable BGLGL->Enable
+#define glDisable BGLGL->Disable
+#define glBlendFunc BGLGL->BlendFunc
+#define glBlendFuncSeparate BGLGL->BlendFuncSeparate
+#define glClearColor BGLGL->ClearColor
+#define glClear BGLGL->Clear
+#define glUseProgram BGLGL->UseProgram
+#define glUniform1i BGLGL->Uniform1i
+#define glUniform1f BGLGL->Uniform1f
+#define glUniform4fv BGLGL->Uniform4fv
+#define glUniformMatrix4fv BGLGL->UniformMatrix4fv
+#define glEnableVertexAttribArray BGLGL->EnableVertexAttribArray
+#define glDisableVertexAttribArray BGLGL->DisableVertexAttribArray
+#define glVertexAttribPointer BGLGL->VertexAttribPointer
+#define glVertexAttribDivisorEXT BGLGL->VertexAttribDivisorEXT
+#define glDrawArrays BGLGL->DrawArrays
+#define glDrawArraysInstancedEXT BGLGL->DrawArraysInstancedEXT
+#define glDiscardFramebufferEXT BGLGL->DiscardFramebufferEXT
+#define glResolveMultisampleFramebufferAPPLE BGLGL->ResolveMultisampleFramebufferAPPLE
+#endif
+
+
+#endif
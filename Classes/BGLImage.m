@@ -9,7 +9,7 @@
 #import "BGLImage.h"
 #import "BGLProgram.h"
 #import "BGLTexture.h"
-#import "BGLManifest.h"
+#import "BGLProgramBindings.h"
 
 
 @implementation BGLImage
@@ -20,6 +20,9 @@
     if ((self = [super init])) {
         self.program = [BGLProgram programNamed:@"Text"];
         texture = tx;
+        // Held for as long as the image is, so a memory warning can't
+        // delete it out from under us.
+        [BGLProgram retainTexture:texture];
         
         CGFloat x0 = 0;
         CGFloat y0 = 0;
@@ -42,27 +45,42 @@
 }
 
 
+- (void)dealloc
+{
+    [BGLProgram releaseTexture:texture];
+    [super dealloc];
+}
+
+
 #pragma mark Renderable
 
 
+- (BOOL)getDrawBounds:(CGRect *)bounds
+{
+    *bounds = CGRectStandardize(CGRectMake(vertexes[0].x, vertexes[0].y,
+                                           vertexes[3].x - vertexes[0].x, vertexes[3].y - vertexes[0].y));
+    return YES;
+}
+
+
 - (void)render
 {
     glEnable(GL_BLEND);
     glDisable(GL_DEPTH_TEST);
     
-    BGLUniformColor(SHU[shu_Text_color], &BGLColorBlack);
+    BGLTextSetColor((const GLfloat *)&BGLColorBlack);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glUniform1i(SHU[shu_Text_sampler], 0);
+    BGLTextSetSampler(0);
 
-    glVertexAttribPointer(sha_Text_vertexPosition, 2, GL_FLOAT, GL_FALSE, 
+    glVertexAttribPointer(kBGLTextAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, 
                           sizeof(BGLImageVertex), &vertexes[0].x);
-    glEnableVertexAttribArray(sha_Text_vertexPosition);
+    glEnableVertexAttribArray(kBGLTextAttributeVertexPosition);
 
-    glVertexAttribPointer(sha_Text_vertexTexCoord, 2, GL_FLOAT, GL_FALSE,
+    glVertexAttribPointer(kBGLTextAttributeVertexTexCoord, 2, GL_FLOAT, GL_FALSE,
                           sizeof(BGLImageVertex), &vertexes[0].tx);
-    glEnableVertexAttribArray(sha_Text_vertexTexCoord);
+    glEnableVertexAttribArray(kBGLTextAttributeVertexTexCoord);
     
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
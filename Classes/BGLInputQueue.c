@@ -0,0 +1,173 @@
+/*
+ See BGLInputQueue.h.
+ */
+
+#include "BGLInputQueue.h"
+
+#include <string.h>
+
+
+static const float kDefaultVelocityWindow = 0.05f;
+static const double kMinimumFitSpan = 0.002; // seconds; shorter fits are noise
+
+
+void BGLInputQueueInit(BGLInputQueue *q)
+{
+    memset(q, 0, sizeof(BGLInputQueue));
+    q->velocityWindow = kDefaultVelocityWindow;
+}
+
+
+static BGLInputTrack *BGLInputQueueFindTrack(BGLInputQueue *q, uintptr_t key)
+{
+    for (int i = 0; i < kBGLInputTrackMax; i++) {
+        if (q->tracks[i].key == key) return &q->tracks[i];
+    }
+    return NULL;
+}
+
+
+static void BGLInputTrackPush(BGLInputTrack *track, double time, float x, float y)
+{
+    track->head = (track->head + 1) % kBGLInputHistoryMax;
+    track->history[track->head].time = time;
+    track->history[track->head].x = x;
+    track->history[track->head].y = y;
+    if (track->count < kBGLInputHistoryMax) track->count += 1;
+}
+
+
+int BGLInputQueueBegin(BGLInputQueue *q, uintptr_t key, double time, float x, float y)
+{
+    if (key == 0) return 0;
+    BGLInputTrack *track = BGLInputQueueFindTrack(q, key);
+    if (track == NULL) track = BGLInputQueueFindTrack(q, 0);
+    if (track == NULL) return 0;
+    memset(track, 0, sizeof(BGLInputTrack));
+    track->key = key;
+    BGLInputTrackPush(track, time, x, y);
+    return 1;
+}
+
+
+void BGLInputQueueAddSample(BGLInputQueue *q, uintptr_t key, double time, float x, float y)
+{
+    BGLInputTrack *track = key ? BGLInputQueueFindTrack(q, key) : NULL;
+    if (track == NULL) return;
+    if (track->pendingCount == 0) track->pendingSince = time;
+    track->pendingCount += 1;
+    BGLInputTrackPush(track, time, x, y);
+}
+
+
+static void BGLInputTrackMakeEvent(const BGLInputTrack *track, BGLInputEvent *event)
+{
+    const BGLInputSample *s = &track->history[track->head];
+    memset(event, 0, sizeof(BGLInputEvent));
+    event->key = track->key;
+    event->x = s->x;
+    event->y = s->y;
+    event->sampleTime = s->time;
+    event->oldestSampleTime = track->pendingSince;
+    event->sampleCount = track->pendingCount;
+}
+
+
+int BGLInputQueueEnd(BGLInputQueue *q, uintptr_t key, BGLInputEvent *event)
+{
+    BGLInputTrack *track = key ? BGLInputQueueFindTrack(q, key) : NULL;
+    if (track == NULL) return 0;
+    int pending = (track->pendingCount > 0 || track->predicted);
+    if (pending && event) BGLInputTrackMakeEvent(track, event);
+    track->key = 0;
+    return pending;
+}
+
+
+int BGLInputQueueHasPending(const BGLInputQueue *q)
+{
+    for (int i = 0; i < kBGLInputTrackMax; i++) {
+        if (q->tracks[i].key && q->tracks[i].pendingCount) return 1;
+    }
+    return 0;
+}
+
+
+int BGLInputTrackGetVelocity(const BGLInputTrack *track, float window, float *vx, float *vy)
+{
+    // Least squares over the samples in the window, relative to the newest.
+    const double t0 = track->history[track->head].time;
+    double st = 0, sx = 0, sy = 0, stt = 0, stx = 0, sty = 0, oldest = 0;
+    uint32_t n = 0;
+    for (uint32_t k = 0; k < track->count; k++) {
+        const BGLInputSample *s = &track->history[(track->head + kBGLInputHistoryMax - k) % kBGLInputHistoryMax];
+        double t = s->time - t0;
+        if (t < -window) break;
+        st += t; sx += s->x; sy += s->y;
+        stt += t * t; stx += t * s->x; sty += t * s->y;
+        oldest = t;
+        n += 1;
+    }
+    if (n < 2 || -oldest < kMinimumFitSpan) return 0;
+    double d = n * stt - st * st;
+    if (d <= 0) return 0;
+    *vx = (n * stx - st * sx) / d;
+    *vy = (n * sty - st * sy) / d;
+    return 1;
+}
+
+
+uint32_t BGLInputQueueDrain(BGLInputQueue *q, double presentTime, BGLInputEvent *events)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < kBGLInputTrackMax; i++) {
+        BGLInputTrack *track = &q->tracks[i];
+        if (track->key == 0 || track->pendingCount == 0) continue;
+        BGLInputEvent *e = &events[n++];
+        BGLInputTrackMakeEvent(track, e);
+        track->pendingCount = 0;
+        track->predicted = 0;
+
+        // A touch with no recent samples has stopped; don't carry it on.
+        double ahead = presentTime - e->sampleTime;
+        float vx, vy;
+        if (q->predictionLimit > 0 && ahead > 0 && ahead < q->velocityWindow &&
+            BGLInputTrackGetVelocity(track, q->velocityWindow, &vx, &vy)) {
+            if (ahead > q->predictionLimit) ahead = q->predictionLimit;
+            e->predictedTime = ahead;
+            e->predictedX = vx * ahead;
+            e->predictedY = vy * ahead;
+            e->x += e->predictedX;
+            e->y += e->predictedY;
+            track->predicted = 1;
+        }
+    }
+    memcpy(q->drained, events, n * sizeof(BGLInputEvent));
+    q->drainedCount = n;
+    return n;
+}
+
+
+void BGLInputQueueFramePresented(BGLInputQueue *q, double presentTime)
+{
+    if (q->drainedCount == 0) return;
+    BGLInputLatencyStats *stats = &q->stats;
+    stats->frameCount += 1;
+    for (uint32_t i = 0; i < q->drainedCount; i++) {
+        const BGLInputEvent *e = &q->drained[i];
+        double latency = presentTime - e->sampleTime;
+        stats->eventCount += 1;
+        stats->sampleCount += e->sampleCount;
+        stats->totalLatency += latency;
+        stats->totalOldestLatency += presentTime - e->oldestSampleTime;
+        stats->totalPredictedLatency += latency - e->predictedTime;
+        if (latency > stats->maxLatency) stats->maxLatency = latency;
+    }
+    q->drainedCount = 0;
+}
+
+
+void BGLInputQueueResetStats(BGLInputQueue *q)
+{
+    memset(&q->stats, 0, sizeof(BGLInputLatencyStats));
+}
@@ -0,0 +1,118 @@
+/*
+ Buffers timestamped touch samples until the frame that will show them.
+
+ Each touch is a track keyed by an opaque pointer-sized value (a UITouch,
+ or a made-up ID in a test). Samples are recorded as they arrive, but not
+ delivered: BGLInputQueueDrain, called as late as possible before drawing,
+ returns one event per moved touch, at its newest position, so the frame
+ uses the freshest input and coalesces anything older.
+
+ With a nonzero predictionLimit, a drained position is extrapolated toward
+ the frame's expected presentation time. The velocity is a least-squares
+ fit over the last velocityWindow seconds of samples, so one jittery sample
+ doesn't throw it. A touch that hasn't produced a sample within the window
+ is treated as stationary, since a finger at rest generates no moves. The
+ extrapolation never goes more than predictionLimit ahead of the sample.
+
+ Latency is accounted once the frame is presented: for every drained event,
+ the time from its newest sample to presentation, and the same less the
+ time predicted ahead, which is what the user perceives if the prediction
+ holds.
+
+ This is plain C; drive it with synthetic samples to exercise it headlessly.
+ */
+
+#ifndef BGLINPUTQUEUE_H
+#define BGLINPUTQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define kBGLInputTrackMax 16
+#define kBGLInputHistoryMax 8
+
+
+typedef struct {
+    double time;
+    float x, y;
+} BGLInputSample;
+
+
+typedef struct {
+    uintptr_t key;              // 0 if the track is free
+    BGLInputSample history[kBGLInputHistoryMax]; // a ring; head is the newest
+    uint32_t head;
+    uint32_t count;
+    uint32_t pendingCount;      // samples since the last drain
+    double pendingSince;        // time of the oldest of them
+    uint8_t predicted;          // last drained position was extrapolated
+} BGLInputTrack;
+
+
+typedef struct {
+    uintptr_t key;
+    float x, y;                 // including the prediction
+    float predictedX, predictedY; // offset added by prediction
+    double sampleTime;          // of the newest sample
+    double oldestSampleTime;    // of the oldest sample coalesced into this
+    double predictedTime;       // how far ahead the prediction reaches
+    uint32_t sampleCount;       // samples coalesced into this
+} BGLInputEvent;
+
+
+typedef struct {
+    uint32_t frameCount;        // presented frames that delivered input
+    uint32_t eventCount;
+    uint32_t sampleCount;       // samples behind those events
+    double totalLatency;        // newest sample to presentation
+    double totalOldestLatency;  // oldest coalesced sample to presentation
+    double totalPredictedLatency; // latency less the time predicted ahead
+    double maxLatency;
+} BGLInputLatencyStats;
+
+
+typedef struct {
+    // Parameters
+    float predictionLimit;      // seconds; 0 (the default) disables prediction
+    float velocityWindow;       // seconds
+    // State
+    BGLInputTrack tracks[kBGLInputTrackMax];
+    BGLInputEvent drained[kBGLInputTrackMax]; // awaiting presentation
+    uint32_t drainedCount;
+    BGLInputLatencyStats stats;
+} BGLInputQueue;
+
+
+void BGLInputQueueInit(BGLInputQueue *q);
+
+// Returns 0 if every track is in use. The first sample isn't pending; the
+// caller delivers touch beginnings itself.
+int BGLInputQueueBegin(BGLInputQueue *q, uintptr_t key, double time, float x, float y);
+void BGLInputQueueAddSample(BGLInputQueue *q, uintptr_t key, double time, float x, float y);
+// Frees the track. Returns 1, with the newest sample unpredicted, if the
+// caller hasn't yet delivered that exact position.
+int BGLInputQueueEnd(BGLInputQueue *q, uintptr_t key, BGLInputEvent *event);
+
+int BGLInputQueueHasPending(const BGLInputQueue *q);
+// Fills events (room for kBGLInputTrackMax) and returns how many.
+uint32_t BGLInputQueueDrain(BGLInputQueue *q, double presentTime, BGLInputEvent *events);
+void BGLInputQueueFramePresented(BGLInputQueue *q, double presentTime);
+
+// Fit over the window ending at the newest sample; returns 0 if too few samples.
+int BGLInputTrackGetVelocity(const BGLInputTrack *track, float window, float *vx, float *vy);
+
+void BGLInputQueueResetStats(BGLInputQueue *q);
+
+static inline double BGLInputLatencyStatsMean(const BGLInputLatencyStats *stats)
+{
+    return stats->eventCount ? stats->totalLatency / stats->eventCount : 0;
+}
+
+static inline double BGLInputLatencyStatsMeanPredicted(const BGLInputLatencyStats *stats)
+{
+    return stats->eventCount ? stats->totalPredictedLatency / stats->eventCount : 0;
+}
+
+
+#endif
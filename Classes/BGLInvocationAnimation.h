@@ -10,6 +10,8 @@
 #import "BGLAnimation.h"
 
 
+// For a delayed call, prefer -[BGLScene scheduleAfter:node:block:], which
+// costs nothing per frame while it waits.
 @interface BGLInvocationAnimation : BGLAnimation {
     NSInvocation *invocation;
 }
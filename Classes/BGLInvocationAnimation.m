@@ -7,6 +7,8 @@
 //
 
 #import "BGLInvocationAnimation.h"
+#import "BGLAccounting.h"
+#import <objc/runtime.h>
 
 
 @implementation BGLInvocationAnimation
@@ -16,11 +18,13 @@
 {
     NSMethodSignature *sig = [aTarget methodSignatureForSelector:aSelector];
     NSInvocation *inv = [NSInvocation invocationWithMethodSignature:sig];
+    BGLAccountAutorelease(class_getInstanceSize([NSInvocation class]));
     [inv setTarget:aTarget];
     [inv setSelector:aSelector];
     if (anObject) {
         [inv setArgument:&anObject atIndex:2];
     }
+    BGLAccountAutorelease(class_getInstanceSize([BGLInvocationAnimation class]));
     return [[[BGLInvocationAnimation alloc] initWithInvocation:inv] autorelease];
 }
 
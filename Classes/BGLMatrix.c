@@ -197,27 +197,26 @@ BGLVector3 BGLMatrixApplyTransform(const BGLMatrix m, const BGLVector3 v)
 
 void BGLMatrixTranslate(BGLMatrix m, float x, float y, float z)
 {
-    BGLMatrix a, b;
-    BGLMatrixCopy(a, m);
-    memcpy(b, BGLMatrixIdentity, 12*sizeof(float));
-    BGLMatrixAt(b,0,3) = x;
-    BGLMatrixAt(b,1,3) = y;
-    BGLMatrixAt(b,2,3) = z;
-    BGLMatrixAt(b,3,3) = 1;
-    BGLMatrixMultiply(m, b, a);
+    // m = T * m: each of the first three rows gains a multiple of the last.
+    // For an affine m that only touches the translation column.
+    for (int c = 0; c < 4; c++) {
+        const float w = BGLMatrixAt(m,3,c);
+        if (w == 0) continue;
+        BGLMatrixAt(m,0,c) += x * w;
+        BGLMatrixAt(m,1,c) += y * w;
+        BGLMatrixAt(m,2,c) += z * w;
+    }
 }
 
 
 void BGLMatrixScale(BGLMatrix m, float x, float y, float z)
 {
-    BGLMatrix a, b;
-    BGLMatrixCopy(a, m);
-    BGLMatrixZero(b);
-    BGLMatrixAt(b,0,0) = x;
-    BGLMatrixAt(b,1,1) = y;
-    BGLMatrixAt(b,2,2) = z;
-    BGLMatrixAt(b,3,3) = 1;
-    BGLMatrixMultiply(m, b, a);
+    // m = S * m: scale each of the first three rows.
+    for (int c = 0; c < 4; c++) {
+        BGLMatrixAt(m,0,c) *= x;
+        BGLMatrixAt(m,1,c) *= y;
+        BGLMatrixAt(m,2,c) *= z;
+    }
 }
 
 
@@ -231,9 +230,6 @@ void BGLMatrixRotate(BGLMatrix m, float degrees, float x, float y, float z)
     }
 #endif
     
-    BGLMatrix a, b;
-    BGLMatrixCopy(a, m);
-    
     const float radians = degrees * (M_PI/180.0);
     
     const float s = sinf(radians);
@@ -244,27 +240,88 @@ void BGLMatrixRotate(BGLMatrix m, float degrees, float x, float y, float z)
     const float ys = y * s;
     const float zs = z * s;
     
-    BGLMatrixAt(b,0,0) = x*x*one_minus_c + c;
-    BGLMatrixAt(b,0,1) = x*y*one_minus_c - zs;
-    BGLMatrixAt(b,0,2) = x*z*one_minus_c + ys;
-    BGLMatrixAt(b,0,3) = 0;
-    
-    BGLMatrixAt(b,1,0) = y*x*one_minus_c + zs;
-    BGLMatrixAt(b,1,1) = y*y*one_minus_c + c;
-    BGLMatrixAt(b,1,2) = y*z*one_minus_c - xs;
-    BGLMatrixAt(b,1,3) = 0;
+    // 3x3 rotation R, applied as m = R * m; the last row of m is unchanged.
+    const float r00 = x*x*one_minus_c + c;
+    const float r01 = x*y*one_minus_c - zs;
+    const float r02 = x*z*one_minus_c + ys;
+    const float r10 = y*x*one_minus_c + zs;
+    const float r11 = y*y*one_minus_c + c;
+    const float r12 = y*z*one_minus_c - xs;
+    const float r20 = x*z*one_minus_c - ys;
+    const float r21 = y*z*one_minus_c + xs;
+    const float r22 = z*z*one_minus_c + c;
+    
+    for (int j = 0; j < 4; j++) {
+        const float m0 = BGLMatrixAt(m,0,j);
+        const float m1 = BGLMatrixAt(m,1,j);
+        const float m2 = BGLMatrixAt(m,2,j);
+        BGLMatrixAt(m,0,j) = r00*m0 + r01*m1 + r02*m2;
+        BGLMatrixAt(m,1,j) = r10*m0 + r11*m1 + r12*m2;
+        BGLMatrixAt(m,2,j) = r20*m0 + r21*m1 + r22*m2;
+    }
+}
 
-    BGLMatrixAt(b,2,0) = x*z*one_minus_c - ys;
-    BGLMatrixAt(b,2,1) = y*z*one_minus_c + xs;
-    BGLMatrixAt(b,2,2) = z*z*one_minus_c + c;
-    BGLMatrixAt(b,2,3) = 0;
 
-    BGLMatrixAt(b,3,0) = 0;
-    BGLMatrixAt(b,3,1) = 0;
-    BGLMatrixAt(b,3,2) = 0;
-    BGLMatrixAt(b,3,3) = 1;
+void BGLMatrixMultiplyAffine(BGLMatrix m, const BGLMatrix a, const BGLMatrix b)
+{
+    // Both a and b have a last row of <0,0,0,1>, so the product does too.
+    BGLMatrix r;
+    for (int j = 0; j < 4; j++) {
+        const float b0 = BGLMatrixAt(b,0,j);
+        const float b1 = BGLMatrixAt(b,1,j);
+        const float b2 = BGLMatrixAt(b,2,j);
+        for (int i = 0; i < 3; i++) {
+            BGLMatrixAt(r,i,j) = (BGLMatrixAt(a,i,0)*b0 +
+                                  BGLMatrixAt(a,i,1)*b1 +
+                                  BGLMatrixAt(a,i,2)*b2);
+        }
+        BGLMatrixAt(r,3,j) = 0;
+    }
+    BGLMatrixAt(r,0,3) += BGLMatrixAt(a,0,3);
+    BGLMatrixAt(r,1,3) += BGLMatrixAt(a,1,3);
+    BGLMatrixAt(r,2,3) += BGLMatrixAt(a,2,3);
+    BGLMatrixAt(r,3,3) = 1;
+    BGLMatrixCopy(m, r);
+}
+
+
+int BGLMatrixInvertAffine(BGLMatrix r, const BGLMatrix m)
+{
+    // Invert the upper 3x3 by cofactors, then the translation is -inv(A) * t.
+    const float a = m[0], b = m[4], c = m[8];
+    const float d = m[1], e = m[5], f = m[9];
+    const float g = m[2], h = m[6], k = m[10];
     
-    BGLMatrixMultiply(m, b, a);
+    const float c00 = e*k - f*h;
+    const float c01 = f*g - d*k;
+    const float c02 = d*h - e*g;
+    
+    float det = a*c00 + b*c01 + c*c02;
+    if (det == 0) return 0;
+    det = 1.0f / det;
+    
+    BGLMatrix inv;
+    BGLMatrixAt(inv,0,0) = c00 * det;
+    BGLMatrixAt(inv,0,1) = (c*h - b*k) * det;
+    BGLMatrixAt(inv,0,2) = (b*f - c*e) * det;
+    BGLMatrixAt(inv,1,0) = c01 * det;
+    BGLMatrixAt(inv,1,1) = (a*k - c*g) * det;
+    BGLMatrixAt(inv,1,2) = (c*d - a*f) * det;
+    BGLMatrixAt(inv,2,0) = c02 * det;
+    BGLMatrixAt(inv,2,1) = (b*g - a*h) * det;
+    BGLMatrixAt(inv,2,2) = (a*e - b*d) * det;
+    
+    const float tx = m[12], ty = m[13], tz = m[14];
+    for (int i = 0; i < 3; i++) {
+        BGLMatrixAt(inv,i,3) = -(BGLMatrixAt(inv,i,0)*tx +
+                                 BGLMatrixAt(inv,i,1)*ty +
+                                 BGLMatrixAt(inv,i,2)*tz);
+        BGLMatrixAt(inv,3,i) = 0;
+    }
+    BGLMatrixAt(inv,3,3) = 1;
+    
+    BGLMatrixCopy(r, inv);
+    return 1;
 }
 
 
@@ -380,6 +437,8 @@ void BGLMatrixLookAt(BGLMatrix m,
 
 int BGLMatrixInvert(BGLMatrix r, const BGLMatrix m)
 {
+    if (BGLMatrixIsAffine(m)) return BGLMatrixInvertAffine(r, m);
+    
     // Adapted from mesa project code.
     
     BGLMatrix inv;
@@ -415,6 +474,136 @@ int BGLMatrixInvert(BGLMatrix r, const BGLMatrix m)
 }
 
 
+#pragma mark BGLQuaternion
+
+
+BGLQuaternion BGLQuaternionMakeWithAngleAxis(float degrees, float x, float y, float z)
+{
+    // Same sense as BGLMatrixRotate.
+    const float half = degrees * (M_PI/360.0);
+    const float s = sinf(half);
+    BGLQuaternion q = { x * s, y * s, z * s, cosf(half) };
+    return q;
+}
+
+
+BGLQuaternion BGLQuaternionMultiply(const BGLQuaternion a, const BGLQuaternion b)
+{
+    BGLQuaternion q;
+    q.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
+    q.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
+    q.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
+    q.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
+    return q;
+}
+
+
+void BGLQuaternionNormalize(BGLQuaternion *q)
+{
+    const float n = sqrtf(q->x*q->x + q->y*q->y + q->z*q->z + q->w*q->w);
+    if (n == 0) {
+        *q = BGLQuaternionIdentity();
+        return;
+    }
+    const float r = 1.0f / n;
+    q->x *= r; q->y *= r; q->z *= r; q->w *= r;
+}
+
+
+void BGLMatrixLoadTransformComponents(BGLMatrix m, const BGLTransformComponents *tc)
+{
+    const BGLQuaternion q = tc->rotation;
+    const float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    const float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    const float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    const float sx = tc->scale.x, sy = tc->scale.y, sz = tc->scale.z;
+    
+    // T * R * S
+    BGLMatrixAt(m,0,0) = (1 - 2*(yy + zz)) * sx;
+    BGLMatrixAt(m,1,0) = 2*(xy + wz) * sx;
+    BGLMatrixAt(m,2,0) = 2*(xz - wy) * sx;
+    BGLMatrixAt(m,3,0) = 0;
+    
+    BGLMatrixAt(m,0,1) = 2*(xy - wz) * sy;
+    BGLMatrixAt(m,1,1) = (1 - 2*(xx + zz)) * sy;
+    BGLMatrixAt(m,2,1) = 2*(yz + wx) * sy;
+    BGLMatrixAt(m,3,1) = 0;
+    
+    BGLMatrixAt(m,0,2) = 2*(xz + wy) * sz;
+    BGLMatrixAt(m,1,2) = 2*(yz - wx) * sz;
+    BGLMatrixAt(m,2,2) = (1 - 2*(xx + yy)) * sz;
+    BGLMatrixAt(m,3,2) = 0;
+    
+    BGLMatrixAt(m,0,3) = tc->translation.x;
+    BGLMatrixAt(m,1,3) = tc->translation.y;
+    BGLMatrixAt(m,2,3) = tc->translation.z;
+    BGLMatrixAt(m,3,3) = 1;
+}
+
+
+int BGLMatrixGetTransformComponents(const BGLMatrix m, BGLTransformComponents *tc)
+{
+    if (! BGLMatrixIsAffine(m)) return 0;
+    
+    BGLVector3 c0 = BGLVector3Make(m[0], m[1], m[2]);
+    BGLVector3 c1 = BGLVector3Make(m[4], m[5], m[6]);
+    BGLVector3 c2 = BGLVector3Make(m[8], m[9], m[10]);
+    float sx = BGLVector3Length(c0);
+    float sy = BGLVector3Length(c1);
+    float sz = BGLVector3Length(c2);
+    if (sx == 0 || sy == 0 || sz == 0) return 0;
+    // Scale and rotation can't express shear, which a non-uniform scale
+    // applied after a rotation makes: the columns must be orthogonal, to
+    // within what float rounding leaves after many edits.
+    const float tolerance = kBGLMatrixOrthogonalityTolerance;
+    if (fabsf(BGLVector3Dot(c0, c1)) > tolerance * sx * sy ||
+        fabsf(BGLVector3Dot(c0, c2)) > tolerance * sx * sz ||
+        fabsf(BGLVector3Dot(c1, c2)) > tolerance * sy * sz) return 0;
+    // A reflection is folded into the x scale so the rest is a rotation.
+    if (BGLVector3Dot(BGLVector3Cross(c0, c1), c2) < 0) sx = -sx;
+    
+    // Rotation matrix entries, then Shepperd's method.
+    const float r00 = c0.x / sx, r10 = c0.y / sx, r20 = c0.z / sx;
+    const float r01 = c1.x / sy, r11 = c1.y / sy, r21 = c1.z / sy;
+    const float r02 = c2.x / sz, r12 = c2.y / sz, r22 = c2.z / sz;
+    const float trace = r00 + r11 + r22;
+    BGLQuaternion q;
+    if (trace > 0) {
+        float s = 2 * sqrtf(trace + 1);
+        q.w = 0.25f * s;
+        q.x = (r21 - r12) / s;
+        q.y = (r02 - r20) / s;
+        q.z = (r10 - r01) / s;
+    } else if (r00 > r11 && r00 > r22) {
+        float s = 2 * sqrtf(1 + r00 - r11 - r22);
+        q.w = (r21 - r12) / s;
+        q.x = 0.25f * s;
+        q.y = (r01 + r10) / s;
+        q.z = (r02 + r20) / s;
+    } else if (r11 > r22) {
+        float s = 2 * sqrtf(1 + r11 - r00 - r22);
+        q.w = (r02 - r20) / s;
+        q.x = (r01 + r10) / s;
+        q.y = 0.25f * s;
+        q.z = (r12 + r21) / s;
+    } else {
+        float s = 2 * sqrtf(1 + r22 - r00 - r11);
+        q.w = (r10 - r01) / s;
+        q.x = (r02 + r20) / s;
+        q.y = (r12 + r21) / s;
+        q.z = 0.25f * s;
+    }
+    BGLQuaternionNormalize(&q);
+    tc->translation = BGLVector3Make(m[12], m[13], m[14]);
+    tc->rotation = q;
+    tc->scale = BGLVector3Make(sx, sy, sz);
+    return 1;
+}
+
+
+#pragma mark BGLMatrix3
+
+
 #define BGLMatrix3At(m,r,c) m[(r)+(c)*3]
 
 
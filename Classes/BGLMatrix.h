@@ -2,6 +2,9 @@
  A matrix transformation library, to fill the gap left by OpenGL ES 2.0.
  */
 
+#ifndef BGLMATRIX_H
+#define BGLMATRIX_H
+
 #include <string.h>
 #include <math.h>
 
@@ -122,7 +125,67 @@ void BGLMatrixLookAt(BGLMatrix m,
                      float eyeX, float eyeY, float eyeZ,
                      float centerX, float centerY, float centerZ,
                      float upX, float upY, float upZ);
-int BGLMatrixInvert(BGLMatrix r, const BGLMatrix m);
+int BGLMatrixInvert(BGLMatrix r, const BGLMatrix m); // uses BGLMatrixInvertAffine when it can
+
+
+// Affine matrices have a last row of <0,0,0,1>; translate, scale and rotate
+// keep them that way. These skip the work the last row would need.
+
+static inline int BGLMatrixIsAffine(const BGLMatrix m)
+{
+    return m[3] == 0 && m[7] == 0 && m[11] == 0 && m[15] == 1;
+}
+
+void BGLMatrixMultiplyAffine(BGLMatrix m, const BGLMatrix a, const BGLMatrix b);
+int BGLMatrixInvertAffine(BGLMatrix r, const BGLMatrix m);
+
+
+#pragma mark BGLQuaternion
+
+
+typedef struct {
+    float x;
+    float y;
+    float z;
+    float w;
+} BGLQuaternion;
+
+
+static inline BGLQuaternion BGLQuaternionIdentity(void)
+{
+    BGLQuaternion q = { 0, 0, 0, 1 };
+    return q;
+}
+
+
+BGLQuaternion BGLQuaternionMakeWithAngleAxis(float degrees, float x, float y, float z);
+BGLQuaternion BGLQuaternionMultiply(const BGLQuaternion a, const BGLQuaternion b); // b, then a
+void BGLQuaternionNormalize(BGLQuaternion *q);
+
+
+// Translation, rotation and scale kept apart, composed as T * R * S.
+
+typedef struct {
+    BGLVector3 translation;
+    BGLQuaternion rotation;
+    BGLVector3 scale;
+} BGLTransformComponents;
+
+
+static inline void BGLTransformComponentsLoadIdentity(BGLTransformComponents *tc)
+{
+    tc->translation = BGLVector3Make(0, 0, 0);
+    tc->rotation = BGLQuaternionIdentity();
+    tc->scale = BGLVector3Make(1, 1, 1);
+}
+
+
+void BGLMatrixLoadTransformComponents(BGLMatrix m, const BGLTransformComponents *tc);
+
+#define kBGLMatrixOrthogonalityTolerance 1e-3f
+// Returns 0, leaving tc alone, unless m is affine, invertible and free of
+// shear: its columns orthogonal to within the tolerance, as a cosine.
+int BGLMatrixGetTransformComponents(const BGLMatrix m, BGLTransformComponents *tc);
 
 
 #pragma mark BGLMatrix3
@@ -138,3 +201,6 @@ void BGLMatrix3ComputeNormalMatrix(BGLMatrix3 normalMatrix, BGLMatrix transforma
 
 
 BGLVector3 BGLMatrixApplyTransform(const BGLMatrix m, const BGLVector3 v);
+
+
+#endif
@@ -0,0 +1,42 @@
+//
+//  BGLMesh.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLNode.h"
+#import "BGLUtilities.h"
+#import "BGLMeshBuilder.h"
+#import "BGLResourceRegistry.h"
+
+
+/*
+ Draws indexed geometry made by a BGLMeshBuilder with the Polygon program.
+ The vertex and index data are uploaded to buffer objects on first draw and
+ the client copies dropped, so a mesh costs only its compact GPU data.
+ 
+ +meshByMergingPolygons:layout: flattens polygons (with their transforms)
+ into one mesh, drawn in a single call; it returns nil if they need more
+ than kBGLMeshVertexCountMax distinct vertexes or don't fit the layout's
+ range (see BGLMeshBuilder.h).
+ */
+
+@interface BGLMesh : BGLNode {
+    BGLVertexLayout layout;
+    GLenum mode;
+    GLsizei indexCount;
+    float positionScale;
+    NSData *vertexData; // until uploaded
+    NSData *indexData;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    BGLResourceID bufferResource; // both buffers
+    BGLMeshStats stats;
+}
++ (BOOL)supportsLayout:(BGLVertexLayout)layout;
++ (BGLMesh *)meshByMergingPolygons:(NSArray *)polygons layout:(BGLVertexLayout)layout;
+- (id)initWithBuilder:(const BGLMeshBuilder *)builder;
+@property (nonatomic,readonly) BGLVertexLayout layout;
+@property (nonatomic,readonly) float positionScale;
+@property (nonatomic,readonly) BGLMeshStats stats;
+@end
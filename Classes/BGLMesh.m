@@ -0,0 +1,167 @@
+//
+//  BGLMesh.m
+//  FingerPaintBall
+//
+
+#import "BGLMesh.h"
+#import "BGLPolygon.h"
+#import "BGLProgram.h"
+
+#import "BGLProgramBindings.h"
+
+
+@implementation BGLMesh
+
+
+@synthesize layout;
+@synthesize positionScale;
+@synthesize stats;
+
+
++ (BOOL)supportsLayout:(BGLVertexLayout)aLayout
+{
+    if (aLayout != kBGLVertexLayoutHalfUByte) return YES;
+    static int supported = -1;
+    if (supported < 0) {
+        const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+        supported = (extensions && strstr(extensions, "GL_OES_vertex_half_float")) ? 1 : 0;
+    }
+    return supported;
+}
+
+
+static BGLPrimitive BGLPrimitiveForMode(GLenum mode)
+{
+    switch (mode) {
+        case GL_TRIANGLE_STRIP: return kBGLPrimitiveTriangleStrip;
+        case GL_TRIANGLE_FAN: return kBGLPrimitiveTriangleFan;
+        default: return kBGLPrimitiveTriangles;
+    }
+}
+
+
++ (BGLMesh *)meshByMergingPolygons:(NSArray *)polygons layout:(BGLVertexLayout)aLayout
+{
+    // Strips stay strips; anything else becomes a triangle list.
+    BGLPrimitive primitive = kBGLPrimitiveTriangleStrip;
+    for (BGLPolygon *polygon in polygons) {
+        if (polygon.mode != GL_TRIANGLE_STRIP) primitive = kBGLPrimitiveTriangles;
+    }
+    
+    BGLMeshBuilder builder;
+    BGLMeshBuilderInit(&builder, aLayout, primitive);
+    BGLNodeStore *store = BGLNodeStoreGetDefault();
+    BGLMesh *mesh = nil;
+    BOOL fits = YES;
+    for (BGLPolygon *polygon in polygons) {
+        fits = BGLMeshBuilderAdd(&builder, (const BGLMeshVertex *)[polygon vertexes], [polygon vertexCount],
+                                 BGLPrimitiveForMode(polygon.mode), BGLNodeStoreLocalMatrix(store, polygon.handle));
+        if (! fits) break;
+    }
+    if (fits) {
+        mesh = [[[BGLMesh alloc] initWithBuilder:&builder] autorelease];
+    } else {
+        DLog(@"Can't merge %d polygons: too many vertexes, or out of the layout's range", [polygons count]);
+    }
+    BGLMeshBuilderFree(&builder);
+    return mesh;
+}
+
+
+- (id)initWithBuilder:(const BGLMeshBuilder *)builder
+{
+    if ((self = [super init])) {
+        self.program = [BGLProgram programNamed:@"Polygon"];
+        layout = builder->layout;
+        mode = (builder->primitive == kBGLPrimitiveTriangleStrip) ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+        indexCount = builder->indexCount;
+        positionScale = BGLMeshBuilderPositionScale(builder);
+        vertexData = [[NSData alloc] initWithBytes:builder->vertexes length:builder->vertexCount * builder->vertexSize];
+        indexData = [[NSData alloc] initWithBytes:builder->indexes length:builder->indexCount * sizeof(uint16_t)];
+        BGLMeshBuilderGetStats(builder, &stats);
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    if (vertexBuffer) glDeleteBuffers(1, &vertexBuffer);
+    if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+    BGLResourceUnregister(BGLResourceRegistryGetDefault(), bufferResource);
+    [vertexData release];
+    [indexData release];
+    [super dealloc];
+}
+
+
+#pragma mark BGLNode
+
+
+- (float)contentScale
+{
+    // Fixed-point positions are in fractional units; scale them first.
+    return positionScale;
+}
+
+
+- (void)render
+{
+    if (indexCount == 0) return;
+    
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    
+    if (vertexBuffer == 0) {
+        glGenBuffers(1, &vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, [vertexData length], [vertexData bytes], GL_STATIC_DRAW);
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, [indexData length], [indexData bytes], GL_STATIC_DRAW);
+        bufferResource = BGLResourceRegister(BGLResourceRegistryGetDefault(), kBGLResourceBuffer, "BGLMesh",
+                                             [vertexData length] + [indexData length], NULL, NULL);
+        [vertexData release];
+        vertexData = nil;
+        [indexData release];
+        indexData = nil;
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    }
+    
+    BGLVertexLayoutInfo info;
+    BGLVertexLayoutGetInfo(layout, &info);
+    const GLvoid *colorOffset = (const GLvoid *)info.colorOffset;
+    
+    switch (layout) {
+        case kBGLVertexLayoutFloat:
+        case kBGLVertexLayoutFloatUByte:
+            glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, info.size, 0);
+            break;
+        case kBGLVertexLayoutHalfUByte:
+            glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_HALF_FLOAT_OES, GL_FALSE, info.size, 0);
+            break;
+        case kBGLVertexLayoutFixedUByte:
+            glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_SHORT, GL_FALSE, info.size, 0);
+            break;
+    }
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexPosition);
+    if (layout == kBGLVertexLayoutFloat) {
+        glVertexAttribPointer(kBGLPolygonAttributeVertexColor, 4, GL_FLOAT, GL_FALSE, info.size, colorOffset);
+    } else {
+        glVertexAttribPointer(kBGLPolygonAttributeVertexColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, info.size, colorOffset);
+    }
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexColor);
+    
+    DAssert([self.program validate], @"Failed to validate program.");
+    
+    glDrawElements(mode, indexCount, GL_UNSIGNED_SHORT, 0);
+    
+    // Everything else draws from client memory.
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+
+@end
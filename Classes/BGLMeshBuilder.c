@@ -0,0 +1,374 @@
+/*
+ See BGLMeshBuilder.h.
+
+ Vertexes are deduplicated on their encoded bytes, so two vertexes that
+ differ only below the precision of the layout share an index. Triangles
+ that become degenerate through that sharing are dropped from triangle
+ lists; in strips they are harmless and kept.
+ */
+
+#include "BGLMeshBuilder.h"
+#include "BGLAccounting.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const int kDefaultFixedPointBits = 4;
+
+
+void BGLVertexLayoutGetInfo(BGLVertexLayout layout, BGLVertexLayoutInfo *info)
+{
+    switch (layout) {
+        case kBGLVertexLayoutFloat:
+        default:
+            info->size = 24;
+            info->colorOffset = 8;
+            break;
+        case kBGLVertexLayoutFloatUByte:
+            info->size = 12;
+            info->colorOffset = 8;
+            break;
+        case kBGLVertexLayoutHalfUByte:
+        case kBGLVertexLayoutFixedUByte:
+            info->size = 8;
+            info->colorOffset = 4;
+            break;
+    }
+}
+
+
+void BGLMeshBuilderInit(BGLMeshBuilder *b, BGLVertexLayout layout, BGLPrimitive primitive)
+{
+    memset(b, 0, sizeof(BGLMeshBuilder));
+    BGLVertexLayoutInfo info;
+    BGLVertexLayoutGetInfo(layout, &info);
+    b->layout = layout;
+    b->primitive = (primitive == kBGLPrimitiveTriangleStrip) ? kBGLPrimitiveTriangleStrip : kBGLPrimitiveTriangles;
+    b->fixedPointBits = kDefaultFixedPointBits;
+    b->vertexSize = info.size;
+}
+
+
+void BGLMeshBuilderFree(BGLMeshBuilder *b)
+{
+    free(b->vertexes);
+    free(b->indexes);
+    free(b->table);
+    b->vertexes = NULL;
+    b->indexes = NULL;
+    b->table = NULL;
+    b->vertexCapacity = 0;
+    b->indexCapacity = 0;
+    b->tableCapacity = 0;
+    BGLMeshBuilderReset(b);
+}
+
+
+void BGLMeshBuilderReset(BGLMeshBuilder *b)
+{
+    b->vertexCount = 0;
+    b->indexCount = 0;
+    b->sourceVertexCount = 0;
+    if (b->table) memset(b->table, 0, b->tableCapacity * sizeof(uint32_t));
+}
+
+
+void BGLMeshBuilderSetFixedPointBits(BGLMeshBuilder *b, int bits)
+{
+    b->fixedPointBits = bits;
+}
+
+
+float BGLMeshBuilderPositionScale(const BGLMeshBuilder *b)
+{
+    return (b->layout == kBGLVertexLayoutFixedUByte) ? ldexpf(1.0f, -b->fixedPointBits) : 1.0f;
+}
+
+
+#pragma mark Encoding
+
+
+static uint16_t BGLFloatToHalf(float f)
+{
+    union { float f; uint32_t u; } v = { f };
+    uint32_t sign = (v.u >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((v.u >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = v.u & 0x007FFFFF;
+
+    if (exponent <= 0) {
+        if (exponent < -10) return sign; // too small; flush to zero
+        mantissa |= 0x00800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half += 1; // round
+        return sign | half;
+    }
+    if (exponent >= 31) {
+        return sign | 0x7C00; // overflow to infinity (NaN isn't expected)
+    }
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x00001000) half += 1; // round; a carry correctly bumps the exponent
+    return half;
+}
+
+
+// The caller has checked the range with BGLMeshPositionFits.
+static inline int16_t BGLFloatToFixed(float f, float scale)
+{
+    return (int16_t)roundf(f * scale);
+}
+
+
+// Whether the layout can hold p: fixed point within 16 bits, half floats
+// short of infinity. Positions past the range are refused, not clamped.
+static int BGLMeshPositionFits(const BGLMeshBuilder *b, BGLVector2 p)
+{
+    switch (b->layout) {
+        case kBGLVertexLayoutHalfUByte:
+            return fabsf(p.x) <= 65504.0f && fabsf(p.y) <= 65504.0f; // the largest half
+        case kBGLVertexLayoutFixedUByte: {
+            float scale = ldexpf(1.0f, b->fixedPointBits);
+            float x = roundf(p.x * scale), y = roundf(p.y * scale);
+            return x >= -32768.0f && x <= 32767.0f && y >= -32768.0f && y <= 32767.0f;
+        }
+        default:
+            return 1;
+    }
+}
+
+
+static inline uint8_t BGLFloatToUByte(float f)
+{
+    if (f <= 0) return 0;
+    if (f >= 1) return 255;
+    return (uint8_t)(f * 255.0f + 0.5f);
+}
+
+
+static void BGLMeshEncode(const BGLMeshBuilder *b, const BGLMeshVertex *v, BGLVector2 p, uint8_t *out)
+{
+    uint8_t *color;
+    switch (b->layout) {
+        case kBGLVertexLayoutFloat:
+            memcpy(out, &p, 8);
+            memcpy(out + 8, v->color, 16);
+            return;
+        case kBGLVertexLayoutFloatUByte:
+            memcpy(out, &p, 8);
+            color = out + 8;
+            break;
+        case kBGLVertexLayoutHalfUByte: {
+            uint16_t h[2] = { BGLFloatToHalf(p.x), BGLFloatToHalf(p.y) };
+            memcpy(out, h, 4);
+            color = out + 4;
+            break;
+        }
+        case kBGLVertexLayoutFixedUByte: {
+            float scale = ldexpf(1.0f, b->fixedPointBits);
+            int16_t s[2] = { BGLFloatToFixed(p.x, scale), BGLFloatToFixed(p.y, scale) };
+            memcpy(out, s, 4);
+            color = out + 4;
+            break;
+        }
+        default:
+            return;
+    }
+    for (int k = 0; k < 4; k++) {
+        color[k] = BGLFloatToUByte(v->color[k]);
+    }
+}
+
+
+#pragma mark Deduplication
+
+
+static inline uint32_t BGLMeshHash(const uint8_t *bytes, size_t size)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+static int BGLMeshRehash(BGLMeshBuilder *b, uint32_t capacity)
+{
+    uint32_t *table = calloc(capacity, sizeof(uint32_t));
+    if (table == NULL) return 0;
+    BGLAccountAllocation(capacity * sizeof(uint32_t));
+    free(b->table);
+    b->table = table;
+    b->tableCapacity = capacity;
+    for (uint32_t i = 0; i < b->vertexCount; i++) {
+        const uint8_t *bytes = b->vertexes + i * b->vertexSize;
+        uint32_t slot = BGLMeshHash(bytes, b->vertexSize) & (capacity - 1);
+        while (b->table[slot]) slot = (slot + 1) & (capacity - 1);
+        b->table[slot] = i + 1;
+    }
+    return 1;
+}
+
+
+static uint16_t BGLMeshIndexForVertex(BGLMeshBuilder *b, const uint8_t *bytes)
+{
+    uint32_t mask = b->tableCapacity - 1;
+    uint32_t slot = BGLMeshHash(bytes, b->vertexSize) & mask;
+    while (b->table[slot]) {
+        uint32_t i = b->table[slot] - 1;
+        if (memcmp(b->vertexes + i * b->vertexSize, bytes, b->vertexSize) == 0) return i;
+        slot = (slot + 1) & mask;
+    }
+    uint32_t i = b->vertexCount++;
+    memcpy(b->vertexes + i * b->vertexSize, bytes, b->vertexSize);
+    b->table[slot] = i + 1;
+    return i;
+}
+
+
+#pragma mark Indexes
+
+
+static inline void BGLMeshPushIndex(BGLMeshBuilder *b, uint16_t i)
+{
+    b->indexes[b->indexCount++] = i;
+}
+
+
+static void BGLMeshPushTriangle(BGLMeshBuilder *b, uint16_t i0, uint16_t i1, uint16_t i2)
+{
+    if (b->primitive == kBGLPrimitiveTriangles) {
+        if (i0 == i1 || i1 == i2 || i2 == i0) return;
+    } else if (b->indexCount > 0) {
+        // Stitch on as a separate strip; the extra index keeps the winding.
+        BGLMeshPushIndex(b, b->indexes[b->indexCount - 1]);
+        BGLMeshPushIndex(b, i0);
+        if (b->indexCount % 2) BGLMeshPushIndex(b, i0);
+    }
+    BGLMeshPushIndex(b, i0);
+    BGLMeshPushIndex(b, i1);
+    BGLMeshPushIndex(b, i2);
+}
+
+
+static void BGLMeshPushStrip(BGLMeshBuilder *b, const uint16_t *strip, size_t count)
+{
+    if (b->primitive == kBGLPrimitiveTriangleStrip) {
+        if (b->indexCount > 0) {
+            BGLMeshPushIndex(b, b->indexes[b->indexCount - 1]);
+            BGLMeshPushIndex(b, strip[0]);
+            if (b->indexCount % 2) BGLMeshPushIndex(b, strip[0]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            BGLMeshPushIndex(b, strip[i]);
+        }
+    } else {
+        for (size_t i = 2; i < count; i++) {
+            if (i % 2) {
+                BGLMeshPushTriangle(b, strip[i - 1], strip[i - 2], strip[i]);
+            } else {
+                BGLMeshPushTriangle(b, strip[i - 2], strip[i - 1], strip[i]);
+            }
+        }
+    }
+}
+
+
+int BGLMeshBuilderAdd(BGLMeshBuilder *b, const BGLMeshVertex *vertexes, size_t count,
+                      BGLPrimitive primitive, const BGLMatrix matrix)
+{
+    if (count < 3) return 1;
+    if (b->vertexCount + count > kBGLMeshVertexCountMax) return 0;
+
+    // Reserve for the worst case: every vertex new, and every triangle
+    // stitched on separately (3 indexes plus 3 to join).
+    if (b->vertexCount + count > b->vertexCapacity) {
+        uint32_t capacity = 2 * (b->vertexCount + count);
+        if (capacity > kBGLMeshVertexCountMax) capacity = kBGLMeshVertexCountMax;
+        uint8_t *grown = realloc(b->vertexes, capacity * b->vertexSize);
+        if (grown == NULL) return 0;
+        BGLAccountAllocation(capacity * b->vertexSize);
+        b->vertexes = grown;
+        b->vertexCapacity = capacity;
+    }
+    size_t indexesNeeded = 6 * count;
+    if (b->indexCount + indexesNeeded > b->indexCapacity) {
+        uint32_t capacity = 2 * (b->indexCount + indexesNeeded);
+        uint16_t *grown = realloc(b->indexes, capacity * sizeof(uint16_t));
+        if (grown == NULL) return 0;
+        BGLAccountAllocation(capacity * sizeof(uint16_t));
+        b->indexes = grown;
+        b->indexCapacity = capacity;
+    }
+    if (2 * (b->vertexCount + count) > b->tableCapacity) {
+        uint32_t capacity = b->tableCapacity ? b->tableCapacity : 64;
+        while (capacity < 2 * (b->vertexCount + count)) capacity *= 2;
+        if (! BGLMeshRehash(b, capacity)) return 0;
+    }
+
+    // Stack buffer for the common case of a quad or a small polygon.
+    BGLVector2 positionBuffer[64];
+    uint16_t mapBuffer[64];
+    BGLVector2 *positions = positionBuffer;
+    uint16_t *map = mapBuffer;
+    if (count > 64) {
+        positions = malloc(count * (sizeof(BGLVector2) + sizeof(uint16_t)));
+        if (positions == NULL) return 0;
+        BGLAccountAllocation(count * (sizeof(BGLVector2) + sizeof(uint16_t)));
+        map = (uint16_t *)(positions + count);
+    }
+    // Transform and check them all first, so a polygon that doesn't fit
+    // leaves nothing behind.
+    int fits = 1;
+    for (size_t i = 0; i < count && fits; i++) {
+        BGLVector2 p = vertexes[i].position;
+        if (matrix) {
+            BGLVector3 q = BGLMatrixApplyTransform(matrix, BGLVector3Make(p.x, p.y, 0));
+            p = BGLVector2Make(q.x, q.y);
+        }
+        positions[i] = p;
+        fits = BGLMeshPositionFits(b, p);
+    }
+    if (! fits) {
+        if (positions != positionBuffer) free(positions);
+        return 0;
+    }
+    uint8_t encoded[24];
+    for (size_t i = 0; i < count; i++) {
+        BGLMeshEncode(b, &vertexes[i], positions[i], encoded);
+        map[i] = BGLMeshIndexForVertex(b, encoded);
+    }
+
+    switch (primitive) {
+        case kBGLPrimitiveTriangles:
+            for (size_t i = 0; i + 2 < count; i += 3) {
+                BGLMeshPushTriangle(b, map[i], map[i + 1], map[i + 2]);
+            }
+            break;
+        case kBGLPrimitiveTriangleStrip:
+            BGLMeshPushStrip(b, map, count);
+            break;
+        case kBGLPrimitiveTriangleFan:
+            for (size_t i = 2; i < count; i++) {
+                BGLMeshPushTriangle(b, map[0], map[i - 1], map[i]);
+            }
+            break;
+    }
+
+    if (positions != positionBuffer) free(positions);
+    b->sourceVertexCount += count;
+    return 1;
+}
+
+
+void BGLMeshBuilderGetStats(const BGLMeshBuilder *b, BGLMeshStats *stats)
+{
+    stats->sourceVertexCount = b->sourceVertexCount;
+    stats->vertexCount = b->vertexCount;
+    stats->indexCount = b->indexCount;
+    stats->sourceBytes = b->sourceVertexCount * sizeof(BGLMeshVertex);
+    stats->vertexBytes = b->vertexCount * b->vertexSize;
+    stats->indexBytes = b->indexCount * sizeof(uint16_t);
+}
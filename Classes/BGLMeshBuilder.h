@@ -0,0 +1,105 @@
+/*
+ Packs polygon vertexes into compact layouts and indexes them.
+
+ Polygons are built from BGLMeshVertex (float position, float RGBA color,
+ 24 bytes, the same layout as BGLPolygonVertex). A builder re-encodes each
+ vertex in a smaller layout, looks the encoded bytes up in a hash table so
+ identical vertexes are stored once, and records 16-bit indexes for either
+ a triangle list or a single triangle strip. Any number of polygons, in any
+ of the three triangle modes and each with its own transform, can be added
+ to one builder and drawn as one mesh; strips are joined with degenerate
+ triangles, since ES 2.0 has no primitive restart.
+
+ In kBGLVertexLayoutFixedUByte, positions are stored as 16-bit integers in
+ units of 1/2^fixedPointBits; whoever draws the mesh scales by
+ BGLMeshBuilderPositionScale. A polygon with a position the layout can't
+ hold (past 16 bits of fixed point, or the largest half float) is refused
+ rather than clamped.
+
+ This is plain C with no GL calls.
+ */
+
+#ifndef BGLMESHBUILDER_H
+#define BGLMESHBUILDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BGLMatrix.h"
+
+
+typedef enum {
+    kBGLVertexLayoutFloat,      // float2 position, float4 color: 24 bytes
+    kBGLVertexLayoutFloatUByte, // float2 position, normalized ubyte4 color: 12 bytes
+    kBGLVertexLayoutHalfUByte,  // half2 position, ubyte4 color: 8 bytes
+    kBGLVertexLayoutFixedUByte, // short2 fixed-point position, ubyte4 color: 8 bytes
+} BGLVertexLayout;
+
+
+typedef enum {
+    kBGLPrimitiveTriangles,
+    kBGLPrimitiveTriangleStrip,
+    kBGLPrimitiveTriangleFan,   // input only
+} BGLPrimitive;
+
+
+typedef struct {
+    BGLVector2 position;
+    float color[4];
+} BGLMeshVertex;
+
+
+typedef struct {
+    size_t size;
+    size_t colorOffset;         // position is always at 0
+} BGLVertexLayoutInfo;
+
+
+typedef struct {
+    size_t sourceBytes;         // as unindexed BGLMeshVertex arrays
+    size_t vertexBytes;
+    size_t indexBytes;
+    uint32_t sourceVertexCount;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+} BGLMeshStats;
+
+
+#define kBGLMeshVertexCountMax 65536
+
+
+typedef struct {
+    BGLVertexLayout layout;
+    BGLPrimitive primitive;     // triangles or strip
+    int fixedPointBits;
+    size_t vertexSize;
+    uint8_t *vertexes;
+    uint32_t vertexCount;
+    uint32_t vertexCapacity;
+    uint16_t *indexes;
+    uint32_t indexCount;
+    uint32_t indexCapacity;
+    uint32_t *table;            // vertex index + 1, or 0 for empty
+    uint32_t tableCapacity;
+    uint32_t sourceVertexCount;
+} BGLMeshBuilder;
+
+
+void BGLVertexLayoutGetInfo(BGLVertexLayout layout, BGLVertexLayoutInfo *info);
+
+void BGLMeshBuilderInit(BGLMeshBuilder *b, BGLVertexLayout layout, BGLPrimitive primitive);
+void BGLMeshBuilderFree(BGLMeshBuilder *b);
+void BGLMeshBuilderReset(BGLMeshBuilder *b);
+// Must be called before adding; the default, 4, covers +/-2048 at 1/16 unit.
+void BGLMeshBuilderSetFixedPointBits(BGLMeshBuilder *b, int bits);
+
+// Adds a polygon, transformed by matrix unless it is NULL. Returns 0, adding
+// nothing, if the mesh might run out of 16-bit indexes, a position is out of
+// the layout's range, or memory runs out.
+int BGLMeshBuilderAdd(BGLMeshBuilder *b, const BGLMeshVertex *vertexes, size_t count,
+                      BGLPrimitive primitive, const BGLMatrix matrix);
+
+float BGLMeshBuilderPositionScale(const BGLMeshBuilder *b);
+void BGLMeshBuilderGetStats(const BGLMeshBuilder *b, BGLMeshStats *stats);
+
+
+#endif
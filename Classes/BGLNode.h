@@ -8,37 +8,79 @@
 
 #import <Foundation/Foundation.h>
 #import "BGLMatrix.h"
+#import "BGLNodeStore.h"
+#import "BGLOcclusion.h"
+#import "BGLDrawRecorder.h"
 
 
 @class BGLScene;
 @class BGLProgram;
 @class BGLRenderState;
 @class BGLAnimation;
+@class BGLRasterCache;
+@class BGLNode;
+
+
+static const NSUInteger kBGLHitTestBatchMax = 16;
+
+
+// Structural edits made while the scene is animating are queued as these
+// and replayed in order once the pass is over; see -[BGLScene deferEdit:].
+typedef enum {
+    kBGLNodeEditAdd,            // place by zOrder, after equal siblings
+    kBGLNodeEditBringToFront,   // same, but only if still a subnode of parent
+    kBGLNodeEditSendToBack,     // place by zOrder, before equal siblings, if still a subnode
+    kBGLNodeEditInsertAbove,
+    kBGLNodeEditInsertBelow,
+    kBGLNodeEditRemove,
+    kBGLNodeEditRemoveAll,
+} BGLNodeEditKind;
+
+
+typedef struct {
+    BGLNodeEditKind kind;
+    BGLNode *parent;
+    BGLNode *node;
+    BGLNode *sibling;
+} BGLNodeEdit;
 
 
 @interface BGLNode : NSObject {
     BGLScene *scene;
     BGLProgram *program;
     BGLNode *supernode;
-    NSMutableArray *subnodes;
-    NSMutableArray *pendingSubnodes;
-    BOOL isAnimating;
+    BGLNode *pendingSupernode;  // where queued edits will leave it, if hasPendingSupernode
+    BOOL hasPendingSupernode;
     NSMutableArray *animations;
-    BGLMatrix modelViewMatrix;
-    BOOL hidden;
-    BOOL paused;
+    BGLNodeHandle handle; // matrix, flags and links live in the node store
     int tag;
+    int zOrder;
+    BGLRasterCache *rasterCache;
 }
 @property (nonatomic,readonly) BGLScene *scene;
 @property (nonatomic,retain) BGLProgram *program;
-@property (nonatomic,readonly) BGLNode *supernode;
-@property (nonatomic,readonly) NSArray *subnodes;
+@property (nonatomic,readonly) BGLNode *supernode; // counting edits not yet applied
+@property (nonatomic,readonly) NSArray *subnodes; // a copy; prefer firstSubnode and nextSibling
+@property (nonatomic,readonly) BGLNode *firstSubnode;
+@property (nonatomic,readonly) BGLNode *lastSubnode;
+@property (nonatomic,readonly) BGLNode *nextSibling;
+@property (nonatomic,readonly) BGLNode *previousSibling;
+@property (nonatomic,readonly) NSUInteger subnodeCount;
+@property (nonatomic) int zOrder; // siblings draw in increasing order, ties in insertion order
 @property (nonatomic,getter=isHidden) BOOL hidden;
 @property (nonatomic,getter=isPaused) BOOL paused;
 @property (nonatomic) int tag;
+@property (nonatomic,readonly) BGLNodeHandle handle;
 @property (nonatomic) BGLVector3 position;
+@property (nonatomic) BOOL shouldRasterize; // draw subtree from an offscreen image until it changes
+@property (nonatomic) BOOL usesTransformComponents; // keep translation, rotation and scale apart
+@property (nonatomic) BGLTransformComponents transformComponents;
 // Nodes
 - (void)addSubnode:(BGLNode *)node;
+- (void)insertSubnode:(BGLNode *)node aboveSubnode:(BGLNode *)sibling; // takes the sibling's zOrder
+- (void)insertSubnode:(BGLNode *)node belowSubnode:(BGLNode *)sibling;
+- (void)bringToFront; // of siblings with the same zOrder
+- (void)sendToBack;
 - (void)removeFromSupernode;
 - (void)removeAllSubnodes;
 - (id)nodeWithTag:(int)searchTag;
@@ -51,10 +93,25 @@
 - (void)scaleBy:(BGLVector3)vector;
 - (void)rotateBy:(float)degrees about:(BGLVector3)vector;
 // Misc
+- (void)setNeedsDisplay; // subclasses call when a property affecting appearance changes
 - (BGLNode *)hitTest:(BGLVector3)p0;
+- (void)hitTestPoints:(const BGLVector3 *)points results:(BGLNode **)results count:(NSUInteger)count;
+- (void)getInverseRootTransform:(BGLMatrix)matrix;
 - (BGLVector3)transformPointFromRoot:(BGLVector3)p0;
 // Abstract (for subclasses to override)
 - (BOOL)containsPoint:(BGLVector3)p;
+// In the coordinates render draws in; return NO if unknown. The opaque rect
+// is an area render covers completely with opaque pixels, hiding what's behind.
+- (BOOL)getDrawBounds:(CGRect *)bounds;
+- (BOOL)getOpaqueRect:(CGRect *)rect;
+// Nodes flagged kBGLNodeFlagClips only: the rect, in the node's own
+// coordinates, its subnodes are scissored to. See BGLClipNode.h.
+- (BOOL)getClipRect:(CGRect *)rect;
+// Scale from the coordinates render draws in to the node's own, applied to
+// this node alone; 1 unless the vertexes are packed (see BGLMesh).
+- (float)contentScale;
+// Recorded drawing (see BGLDrawRecorder.h) applies only the node's matrix, so
+// nodes drawn that way must not override these two to do anything else.
 - (void)prepareRenderState:(BGLRenderState *)state;
 - (void)render;
 - (void)restoreRenderState:(BGLRenderState *)state;
@@ -63,6 +120,18 @@
 
 @interface BGLNode (Private)
 - (void)didAddToScene:(BGLScene *)aScene;
++ (void)applyEdit:(const BGLNodeEdit *)edit;
++ (void)applyDeferredEdits:(const BGLNodeEdit *)edits count:(NSUInteger)count;
 - (void)renderSelfAndSubnodesWithState:(BGLRenderState *)state;
+- (void)beginClippingWithState:(BGLRenderState *)state modelViewProjectionMatrix:(const BGLMatrix)mvp;
+- (void)endClippingWithState:(BGLRenderState *)state;
+- (void)addToOcclusionBuffer:(BGLOcclusionBuffer *)buffer parentMatrix:(const BGLMatrix)parentMatrix;
+// Adds the pixels the visible subtree draws to, within the viewport, to
+// pixels (empty if its max is not past its min). Returns NO if some node
+// that draws doesn't know its bounds.
+- (BOOL)getSubtreePixelBounds:(BGLOcclusionRect *)pixels parentMatrix:(const BGLMatrix)parentMatrix
+                  viewportSize:(CGSize)size;
++ (void)markOccludedNodes:(const BGLOcclusionBuffer *)buffer;
++ (void)submitDrawList:(const BGLDrawList *)list state:(BGLRenderState *)state;
 - (void)animateWithElapsedTime:(CFTimeInterval)t;
 @end
@@ -10,10 +10,63 @@
 #import "BGLProgram.h"
 #import "BGLRenderState.h"
 #import "BGLAnimation.h"
+#import "BGLRasterCache.h"
+#import "BGLScene.h"
+#import "BGLAccounting.h"
+#import <objc/runtime.h>
 
 
 static const int kAnimationCountMax = 8;
-static const int kNodeCountMax = 8;
+
+
+static BGLNodeStore *nodeStore;
+
+
+// Subnodes are the node store's child lists; these follow them back to objects.
+
+static inline BGLNode *BGLNodeAtIndex(uint32_t i)
+{
+    return BGLNodeStoreOwnerAtIndex(nodeStore, i);
+}
+
+
+static inline BGLNode *BGLNodeFirstSubnode(BGLNode *node)
+{
+    return BGLNodeAtIndex(nodeStore->firstChild[BGLNodeHandleIndex(node->handle)]);
+}
+
+
+static inline BGLNode *BGLNodeNextSibling(BGLNode *node)
+{
+    return BGLNodeAtIndex(nodeStore->nextSibling[BGLNodeHandleIndex(node->handle)]);
+}
+
+
+static void BGLNodeApplyClip(BGLRenderState *state)
+{
+    BGLOcclusionRect r;
+    if ([state getClipRect:&r]) {
+        CGPoint origin = [state framebufferOrigin];
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(r.minX - origin.x, r.minY - origin.y, r.maxX - r.minX, r.maxY - r.minY);
+    } else {
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+
+static inline BGLOcclusionRect BGLOcclusionRectFromCGRect(CGRect r)
+{
+    BGLOcclusionRect o = { CGRectGetMinX(r), CGRectGetMinY(r), CGRectGetMaxX(r), CGRectGetMaxY(r) };
+    return o;
+}
+
+
+@interface BGLNode ()
+- (void)attachSubnode:(BGLNode *)node before:(BGLNode *)sibling;
+- (void)detachFromSupernode;
+- (void)edit:(BGLNodeEditKind)kind subnode:(BGLNode *)node sibling:(BGLNode *)sibling;
+@end
 
 
 @implementation BGLNode
@@ -21,16 +74,29 @@ static const int kNodeCountMax = 8;
 
 @synthesize scene;
 @synthesize program;
-@synthesize supernode;
-@synthesize subnodes;
-@synthesize hidden;
-@synthesize paused;
 @synthesize tag;
+@synthesize zOrder;
+@synthesize handle;
+
+
++ (void)initialize
+{
+    if (nodeStore == NULL) {
+        nodeStore = BGLNodeStoreGetDefault();
+    }
+}
 
 
 - (id)init
 {
     if ((self = [super init])) {
+        BGLAccountAllocation(class_getInstanceSize([self class]));
+        handle = BGLNodeStoreAlloc(nodeStore);
+        if (handle == 0) { // out of memory or node slots
+            [self release];
+            return nil;
+        }
+        nodeStore->owner[BGLNodeHandleIndex(handle)] = self;
         [self resetModelViewMatrix];
     }
     return self;
@@ -39,10 +105,17 @@ static const int kNodeCountMax = 8;
 
 - (void)dealloc
 {
+    BGLNode *n;
+    while (handle && (n = BGLNodeFirstSubnode(self))) {
+        n->supernode = nil;
+        BGLNodeStoreUnlink(nodeStore, n->handle);
+        [n release];
+    }
+    BGLNodeStoreFree(nodeStore, handle);
     supernode = nil;
-    [subnodes release];
     [animations release];
     [program release];
+    [rasterCache release];
     [super dealloc];
 }
 
@@ -52,8 +125,8 @@ static const int kNodeCountMax = 8;
     [string appendString:prefix];
     [string appendFormat:@"%@:%p (%d)\n", [self class], self, tag];
     NSString *subprefix = [prefix stringByAppendingString:@"  "];
-    for (BGLNode *node in subnodes) {
-        [node descriptionIntoString:string withPrefix:subprefix];
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        [n descriptionIntoString:string withPrefix:subprefix];
     }
 }
 
@@ -66,59 +139,263 @@ static const int kNodeCountMax = 8;
 }
 
 
+- (void)setProgram:(BGLProgram *)aProgram
+{
+    if (program != aProgram) {
+        [program release];
+        program = [aProgram retain];
+        nodeStore->drawKey[BGLNodeHandleIndex(handle)] = program.name;
+        [self setNeedsDisplay];
+    }
+}
+
+
+- (BOOL)isHidden
+{
+    return BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagHidden) != 0;
+}
+
+
+- (void)setHidden:(BOOL)flag
+{
+    if ([self isHidden] != flag) {
+        BGLNodeStoreSetFlag(nodeStore, handle, kBGLNodeFlagHidden, flag);
+        [self setNeedsDisplay];
+    }
+}
+
+
+- (BOOL)isPaused
+{
+    return BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagPaused) != 0;
+}
+
+
+- (void)setPaused:(BOOL)flag
+{
+    BGLNodeStoreSetFlag(nodeStore, handle, kBGLNodeFlagPaused, flag);
+    [scene nodeDidChangePaused:self];
+    // Force one pass so any animations in the subtree are noticed again.
+    if (! flag) [scene setNeedsAnimation];
+}
+
+
 #pragma mark Nodes
 
 
-- (id)mutableSubnodes
+- (NSArray *)subnodes
+{
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:[self subnodeCount]];
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        [array addObject:n];
+    }
+    return array;
+}
+
+
+- (BGLNode *)firstSubnode
+{
+    return BGLNodeFirstSubnode(self);
+}
+
+
+- (BGLNode *)lastSubnode
+{
+    return BGLNodeAtIndex(nodeStore->lastChild[BGLNodeHandleIndex(handle)]);
+}
+
+
+- (BGLNode *)nextSibling
+{
+    return BGLNodeNextSibling(self);
+}
+
+
+- (BGLNode *)previousSibling
+{
+    return BGLNodeAtIndex(nodeStore->prevSibling[BGLNodeHandleIndex(handle)]);
+}
+
+
+- (BGLNode *)supernode
+{
+    return hasPendingSupernode ? pendingSupernode : supernode;
+}
+
+
+- (NSUInteger)subnodeCount
+{
+    NSUInteger count = 0;
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) count++;
+    return count;
+}
+
+
+- (void)setZOrder:(int)z
+{
+    if (zOrder != z) {
+        zOrder = z;
+        [[self supernode] edit:kBGLNodeEditBringToFront subnode:self sibling:nil];
+    }
+}
+
+
+- (void)addSubnode:(BGLNode *)node
 {
-    if (isAnimating) {
-        if (pendingSubnodes == nil) {
-            pendingSubnodes = [subnodes mutableCopy];
+    [self edit:kBGLNodeEditAdd subnode:node sibling:nil];
+}
+
+
+- (void)insertSubnode:(BGLNode *)node aboveSubnode:(BGLNode *)sibling
+{
+    [self edit:kBGLNodeEditInsertAbove subnode:node sibling:sibling];
+}
+
+
+- (void)insertSubnode:(BGLNode *)node belowSubnode:(BGLNode *)sibling
+{
+    [self edit:kBGLNodeEditInsertBelow subnode:node sibling:sibling];
+}
+
+
+- (void)bringToFront
+{
+    [[self supernode] edit:kBGLNodeEditBringToFront subnode:self sibling:nil];
+}
+
+
+- (void)sendToBack
+{
+    [[self supernode] edit:kBGLNodeEditSendToBack subnode:self sibling:nil];
+}
+
+
+- (void)removeFromSupernode
+{
+    [[self supernode] edit:kBGLNodeEditRemove subnode:self sibling:nil];
+}
+
+
+- (void)removeAllSubnodes
+{
+    [self edit:kBGLNodeEditRemoveAll subnode:nil sibling:nil];
+}
+
+
+- (void)edit:(BGLNodeEditKind)kind subnode:(BGLNode *)node sibling:(BGLNode *)sibling
+{
+    // Defer while the scene is walking the tree, so no traversal ever sees
+    // its sibling list change underneath it.
+    BGLNodeEdit edit = { kind, self, node, sibling };
+    if ([scene isDeferringEdits]) {
+        // Remember where the node is headed, so that e.g. reordering it
+        // after removing it doesn't queue an edit against its old parent.
+        if (kind == kBGLNodeEditRemove) {
+            node->pendingSupernode = nil;
+            node->hasPendingSupernode = YES;
+        } else if (kind == kBGLNodeEditAdd || kind == kBGLNodeEditInsertAbove || kind == kBGLNodeEditInsertBelow) {
+            node->pendingSupernode = self;
+            node->hasPendingSupernode = YES;
         }
-        return pendingSubnodes;
+        [scene deferEdit:&edit];
     } else {
-        return subnodes;
+        [BGLNode applyEdit:&edit];
     }
 }
 
 
-- (void)addSubnode:(BGLNode *)node
++ (void)applyEdit:(const BGLNodeEdit *)edit
+{
+    BGLNode *parent = edit->parent;
+    BGLNode *node = edit->node;
+    BGLNode *sibling = edit->sibling;
+    BGLNode *n;
+    
+    switch (edit->kind) {
+        case kBGLNodeEditBringToFront:
+            // Reordering, unlike adding, leaves alone a node that has moved
+            // or been removed since the edit was queued.
+            if (node->supernode != parent) break;
+            // fall through
+        case kBGLNodeEditAdd:
+            // Scan back from the end, so the usual append is O(1).
+            for (n = [parent lastSubnode]; n; n = [n previousSibling]) {
+                if (n == node) continue;
+                if (n->zOrder <= node->zOrder) break;
+                sibling = n;
+            }
+            [parent attachSubnode:node before:sibling];
+            break;
+        case kBGLNodeEditSendToBack:
+            if (node->supernode != parent) break;
+            for (n = BGLNodeFirstSubnode(parent); n && (n == node || n->zOrder < node->zOrder); n = BGLNodeNextSibling(n));
+            [parent attachSubnode:node before:n];
+            break;
+        case kBGLNodeEditInsertAbove:
+        case kBGLNodeEditInsertBelow:
+            if (sibling->supernode != parent || sibling == node) break;
+            node->zOrder = sibling->zOrder;
+            if (edit->kind == kBGLNodeEditInsertAbove) {
+                sibling = BGLNodeNextSibling(sibling);
+            }
+            [parent attachSubnode:node before:sibling];
+            break;
+        case kBGLNodeEditRemove:
+            // The node may have moved since the edit was queued.
+            if (node->supernode == parent) [node detachFromSupernode];
+            break;
+        case kBGLNodeEditRemoveAll:
+            while ((n = BGLNodeFirstSubnode(parent))) {
+                [n detachFromSupernode];
+            }
+            break;
+    }
+}
+
+
++ (void)applyDeferredEdits:(const BGLNodeEdit *)edits count:(NSUInteger)count
 {
-    if (subnodes == nil) {
-        subnodes = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < count; i++) {
+        [BGLNode applyEdit:&edits[i]];
     }
+    // Only now is every node where its queued edits said it would be.
+    for (NSUInteger i = 0; i < count; i++) {
+        BGLNode *node = edits[i].node;
+        if (node) node->hasPendingSupernode = NO;
+    }
+}
+
+
+- (void)attachSubnode:(BGLNode *)node before:(BGLNode *)sibling
+{
+    if (sibling == node) sibling = BGLNodeNextSibling(node);
+    [node retain];
+    [node detachFromSupernode];
     node->supernode = self;
-    [[self mutableSubnodes] addObject:node];
+    BGLNodeStoreLinkBefore(nodeStore, handle, node->handle, sibling ? sibling->handle : 0);
     [node didAddToScene:self.scene];
+    [self setNeedsDisplay];
 }
 
 
-- (void)removeFromSupernode
+- (void)detachFromSupernode
 {
     BGLNode *s = supernode;
     if (s) {
+        [s setNeedsDisplay];
         [self didAddToScene:nil];
         supernode = nil;
-        [[s mutableSubnodes] removeObject:self];
+        BGLNodeStoreUnlink(nodeStore, handle);
+        [self release];
     }
 }
 
 
-- (void)removeAllSubnodes
-{
-    for (BGLNode *sub in subnodes) {
-        [sub didAddToScene:nil];
-        sub->supernode = nil;
-    }
-    [[self mutableSubnodes] removeAllObjects];
-}
-
-
 - (id)nodeWithTag:(int)searchTag
 {
     if (tag == searchTag) return self;
-    for (BGLNode *testNode in subnodes) {
-        BGLNode *foundNode = [testNode nodeWithTag:searchTag];
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        BGLNode *foundNode = [n nodeWithTag:searchTag];
         if (foundNode) return foundNode;
     }
     return nil;
@@ -132,6 +409,7 @@ static const int kNodeCountMax = 8;
 {
     if (animations == nil) {
         animations = [[NSMutableArray alloc] initWithCapacity:kAnimationCountMax];
+        BGLAccountAllocation(kAnimationCountMax * sizeof(id));
     }
 #if DEBUG
     else {
@@ -139,6 +417,7 @@ static const int kNodeCountMax = 8;
     }
 #endif
     [animations addObject:animation];
+    [scene setNeedsAnimation];
 }
 
 
@@ -153,14 +432,14 @@ static const int kNodeCountMax = 8;
 
 - (void)animateWithElapsedTime:(CFTimeInterval)t
 {
-    if (paused) return;
-    isAnimating = YES;
+    if (BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagPaused)) return;
     if (animations) {
         NSRange ar = NSMakeRange(0, [animations count]);
         if (ar.length) {
             // Copy elements so that the array object may be modified in-loop.
             BGLAnimation *aa[kAnimationCountMax];
             [animations getObjects:aa range:ar];
+            BGLAccountMessages(ar.length + 4); // each animation, and the bookkeeping around them
             for (int i = 0; i < ar.length; i++) {
                 BGLAnimation *a = aa[i];
                 BOOL keep = [a animateWithElapsedTime:t];
@@ -170,19 +449,15 @@ static const int kNodeCountMax = 8;
                     [self removeAnimation:a];
                 }
             }
+            // Animations may set any property, so assume appearance changed.
+            [self setNeedsDisplay];
+            if ([animations count]) [scene setNeedsAnimation];
         }
     }
-    if (subnodes) {
-        for (BGLNode *n in subnodes) {
-            [n animateWithElapsedTime:t];
-        }
-        if (pendingSubnodes) {
-            [subnodes release];
-            subnodes = pendingSubnodes;
-            pendingSubnodes = nil;
-        }
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        BGLAccountMessages(1);
+        [n animateWithElapsedTime:t];
     }
-    isAnimating = NO;
 }
 
 
@@ -191,47 +466,176 @@ static const int kNodeCountMax = 8;
 
 - (void)resetModelViewMatrix
 {
-    BGLMatrixLoadIdentity(modelViewMatrix);
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc) {
+        BGLTransformComponentsLoadIdentity(tc);
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    } else {
+        BGLMatrixLoadIdentity(BGLNodeStoreLocalMatrix(nodeStore, handle));
+    }
+    [self setNeedsDisplay];
 }
 
 
 - (void)setModelViewMatrix:(BGLMatrix)matrix
 {
-    BGLMatrixCopy(modelViewMatrix, matrix);
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc == NULL || ! BGLMatrixGetTransformComponents(matrix, tc)) {
+        // Not expressible as components, so stop using them.
+        BGLNodeStoreSetUsesComponents(nodeStore, handle, NO);
+        BGLMatrixCopy(BGLNodeStoreLocalMatrix(nodeStore, handle), matrix);
+    } else {
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    }
+    [self setNeedsDisplay];
+}
+
+
+- (BOOL)usesTransformComponents
+{
+    return BGLNodeStoreGetComponents(nodeStore, handle) != NULL;
+}
+
+
+- (void)setUsesTransformComponents:(BOOL)flag
+{
+    if (! BGLNodeStoreSetUsesComponents(nodeStore, handle, flag)) {
+        DLog(@"Cannot decompose transform of %@", self);
+    }
+}
+
+
+- (BGLTransformComponents)transformComponents
+{
+    BGLTransformComponents tc;
+    BGLTransformComponents *stored = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (stored) {
+        tc = *stored;
+    } else if (! BGLMatrixGetTransformComponents(BGLNodeStoreLocalMatrix(nodeStore, handle), &tc)) {
+        BGLTransformComponentsLoadIdentity(&tc);
+    }
+    return tc;
+}
+
+
+- (void)setTransformComponents:(BGLTransformComponents)tc
+{
+    BGLTransformComponents *stored = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (stored) {
+        *stored = tc;
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    } else {
+        BGLMatrixLoadTransformComponents(BGLNodeStoreLocalMatrix(nodeStore, handle), &tc);
+    }
+    [self setNeedsDisplay];
 }
 
 
 - (BGLVector3)position
 {
-    return BGLVector3Make(modelViewMatrix[kBGLMatrixOffsetTranslateX],
-                          modelViewMatrix[kBGLMatrixOffsetTranslateY],
-                          modelViewMatrix[kBGLMatrixOffsetTranslateZ]);
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc) return tc->translation;
+    const float *m = BGLNodeStoreLocalMatrix(nodeStore, handle);
+    return BGLVector3Make(m[kBGLMatrixOffsetTranslateX],
+                          m[kBGLMatrixOffsetTranslateY],
+                          m[kBGLMatrixOffsetTranslateZ]);
 }
 
 
 - (void)setPosition:(BGLVector3)vector
 {
-    modelViewMatrix[kBGLMatrixOffsetTranslateX] = vector.x;
-    modelViewMatrix[kBGLMatrixOffsetTranslateY] = vector.y;
-    modelViewMatrix[kBGLMatrixOffsetTranslateZ] = vector.z;
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc) {
+        tc->translation = vector;
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    } else {
+        float *m = BGLNodeStoreLocalMatrix(nodeStore, handle);
+        m[kBGLMatrixOffsetTranslateX] = vector.x;
+        m[kBGLMatrixOffsetTranslateY] = vector.y;
+        m[kBGLMatrixOffsetTranslateZ] = vector.z;
+    }
+    [self setNeedsDisplay];
 }
 
 
 - (void)translateBy:(BGLVector3)vector
 {
-    BGLMatrixTranslate(modelViewMatrix, vector.x, vector.y, vector.z);
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc) {
+        tc->translation = BGLVector3Add(tc->translation, vector);
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    } else {
+        BGLMatrixTranslate(BGLNodeStoreLocalMatrix(nodeStore, handle), vector.x, vector.y, vector.z);
+    }
+    [self setNeedsDisplay];
 }
 
 
 - (void)scaleBy:(BGLVector3)vector
 {
-    BGLMatrixScale(modelViewMatrix, vector.x, vector.y, vector.z);
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc) {
+        // Same as the matrix path when unrotated or scaling uniformly;
+        // otherwise the scale applies along the node's rotated axes.
+        tc->translation = BGLVector3Multiply(tc->translation, vector);
+        tc->scale = BGLVector3Multiply(tc->scale, vector);
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    } else {
+        BGLMatrixScale(BGLNodeStoreLocalMatrix(nodeStore, handle), vector.x, vector.y, vector.z);
+    }
+    [self setNeedsDisplay];
 }
 
 
 - (void)rotateBy:(float)degrees about:(BGLVector3)vector
 {
-    BGLMatrixRotate(modelViewMatrix, degrees, vector.x, vector.y, vector.z);
+    BGLTransformComponents *tc = BGLNodeStoreGetComponents(nodeStore, handle);
+    if (tc) {
+        // R * T * R0 * S = (R t) * (R R0) * S; renormalizing keeps repeated
+        // small rotations from drifting into a scale or shear.
+        BGLQuaternion q = BGLQuaternionMakeWithAngleAxis(degrees, vector.x, vector.y, vector.z);
+        BGLMatrix r;
+        BGLMatrixLoadIdentity(r);
+        BGLMatrixRotate(r, degrees, vector.x, vector.y, vector.z);
+        tc->translation = BGLMatrixApplyTransform(r, tc->translation);
+        tc->rotation = BGLQuaternionMultiply(q, tc->rotation);
+        BGLQuaternionNormalize(&tc->rotation);
+        BGLNodeStoreComponentsChanged(nodeStore, handle);
+    } else {
+        BGLMatrixRotate(BGLNodeStoreLocalMatrix(nodeStore, handle), degrees, vector.x, vector.y, vector.z);
+    }
+    [self setNeedsDisplay];
+}
+
+
+#pragma mark Rasterization
+
+
+- (BOOL)shouldRasterize
+{
+    return (rasterCache != nil);
+}
+
+
+- (void)setShouldRasterize:(BOOL)flag
+{
+    if (flag && rasterCache == nil) {
+        rasterCache = [[BGLRasterCache alloc] init];
+    } else if (!flag && rasterCache != nil) {
+        [rasterCache release];
+        rasterCache = nil;
+    }
+    BGLNodeStoreSetFlag(nodeStore, handle, kBGLNodeFlagRasterized, flag);
+}
+
+
+- (void)setNeedsDisplay
+{
+    // Any cached image containing this node is now stale.
+    for (BGLNode *n = self; n != nil; n = n->supernode) {
+        [n->rasterCache invalidate];
+    }
+    [scene setNeedsDisplay];
 }
 
 
@@ -241,12 +645,12 @@ static const int kNodeCountMax = 8;
 - (BGLNode *)hitTest:(BGLVector3)p0
 {
     BGLMatrix m;
-    if (BGLMatrixInvert(m, modelViewMatrix)) {
+    if (BGLMatrixInvert(m, BGLNodeStoreLocalMatrix(nodeStore, handle))) {
         BGLVector3 p1 = BGLMatrixApplyTransform(m, p0);
         if ([self containsPoint:p1]) {
             return self;
         }
-        for (BGLNode *node in subnodes) {
+        for (BGLNode *node = BGLNodeFirstSubnode(self); node; node = BGLNodeNextSibling(node)) {
             BGLNode *n = [node hitTest:p1];
             if (n) return n;
         }
@@ -255,17 +659,73 @@ static const int kNodeCountMax = 8;
 }
 
 
-- (BGLVector3)transformPointFromRoot:(BGLVector3)p0
+- (void)hitTestPoints:(const BGLVector3 *)points results:(BGLNode **)results count:(NSUInteger)count
 {
-    BGLVector3 p1;
-    if (supernode) {
-        p1 = [supernode transformPointFromRoot:p0];
-    } else {
-        p1 = p0;
+    // Same rules as -hitTest: for each point, but the tree is walked once and
+    // each matrix inverted once. Only points without a result yet are tested;
+    // those that miss this node are carried down to the subnodes together.
+    DAssert(count <= kBGLHitTestBatchMax, @"Too many points (%d) for one hit test batch", count);
+    
+    BGLMatrix m;
+    if (! BGLMatrixInvert(m, BGLNodeStoreLocalMatrix(nodeStore, handle))) return;
+    
+    BGLVector3 local[kBGLHitTestBatchMax];
+    BGLNode **slots[kBGLHitTestBatchMax];
+    NSUInteger n = 0;
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        if (results[i]) continue;
+        BGLVector3 p1 = BGLMatrixApplyTransform(m, points[i]);
+        if ([self containsPoint:p1]) {
+            results[i] = self;
+        } else {
+            local[n] = p1;
+            slots[n] = &results[i];
+            n++;
+        }
+    }
+    
+    for (BGLNode *node = BGLNodeFirstSubnode(self); node; node = BGLNodeNextSibling(node)) {
+        if (n == 0) break;
+        BGLNode *found[kBGLHitTestBatchMax];
+        memset(found, 0, n * sizeof(BGLNode *));
+        [node hitTestPoints:local results:found count:n];
+        NSUInteger remaining = 0;
+        for (NSUInteger j = 0; j < n; j++) {
+            if (found[j]) {
+                *slots[j] = found[j];
+            } else {
+                local[remaining] = local[j];
+                slots[remaining] = slots[j];
+                remaining++;
+            }
+        }
+        n = remaining;
     }
+}
+
+
+- (void)getRootTransform:(BGLMatrix)matrix
+{
+    BGLNodeStoreGetRootTransform(nodeStore, handle, matrix);
+}
+
+
+- (void)getInverseRootTransform:(BGLMatrix)matrix
+{
+    // Compose the chain first and invert once, rather than inverting every
+    // ancestor's matrix.
+    BGLMatrix t;
+    [self getRootTransform:t];
+    BGLMatrixInvert(matrix, t);
+}
+
+
+- (BGLVector3)transformPointFromRoot:(BGLVector3)p0
+{
     BGLMatrix t;
-    BGLMatrixInvert(t, modelViewMatrix);
-    return BGLMatrixApplyTransform(t, p1);
+    [self getInverseRootTransform:t];
+    return BGLMatrixApplyTransform(t, p0);
 }
 
 
@@ -278,10 +738,34 @@ static const int kNodeCountMax = 8;
 }
 
 
+- (BOOL)getDrawBounds:(CGRect *)bounds
+{
+    return NO;
+}
+
+
+- (BOOL)getOpaqueRect:(CGRect *)rect
+{
+    return NO;
+}
+
+
+- (BOOL)getClipRect:(CGRect *)rect
+{
+    return NO;
+}
+
+
 - (void)prepareRenderState:(BGLRenderState *)state
 {
     [state pushModelViewMatrix];
-    [state multiplyModelViewMatrixBy:modelViewMatrix];
+    [state multiplyModelViewMatrixBy:BGLNodeStoreLocalMatrix(nodeStore, handle)];
+}
+
+
+- (float)contentScale
+{
+    return 1;
 }
 
 
@@ -302,27 +786,250 @@ static const int kNodeCountMax = 8;
 - (void)didAddToScene:(BGLScene *)aScene
 {
     scene = aScene;
-    [subnodes makeObjectsPerformSelector:@selector(didAddToScene:) withObject:scene];
+    if ([animations count]) [scene setNeedsAnimation];
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        [n didAddToScene:scene];
+    }
 }
 
 
 - (void)renderSelfAndSubnodesWithState:(BGLRenderState *)state
 {
-    if (hidden) return;
+    if (BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagHidden)) return;
+    if (rasterCache) {
+        BGLMatrix m;
+        [state getModelViewMatrix:m];
+        CGSize viewportSize = [state viewportSize];
+        if (! [rasterCache isValidForMatrix:m viewportSize:viewportSize]) {
+            // The image holds the whole subtree, and is clipped when drawn;
+            // the scissor must be off before the cache is cleared.
+            BGLOcclusionRect bounds = { 0, 0, 0, 0 };
+            if (! [self getSubtreePixelBounds:&bounds parentMatrix:m viewportSize:viewportSize]) {
+                bounds = (BGLOcclusionRect){ 0, 0, viewportSize.width, viewportSize.height };
+            }
+            BOOL clipped = [state getClipRect:NULL];
+            if (clipped) {
+                [state pushUnclipped];
+                BGLNodeApplyClip(state);
+            }
+            if ([rasterCache beginWithMatrix:m viewportSize:viewportSize pixelBounds:bounds]) {
+                CGPoint origin = [state framebufferOrigin];
+                [state setFramebufferOrigin:CGPointMake(floorf(bounds.minX), floorf(bounds.minY))];
+                [self renderSubtreeWithState:state];
+                [state setFramebufferOrigin:origin];
+                [rasterCache end];
+            }
+            if (clipped) {
+                [state popClipRect];
+                BGLNodeApplyClip(state);
+            }
+        }
+        [rasterCache draw];
+    } else {
+        [self renderSubtreeWithState:state];
+    }
+}
+
+
+- (void)renderSubtreeWithState:(BGLRenderState *)state
+{
 #if DEBUG
     NSUInteger size = [state stackSize];
 #endif
-    [program use];
     [self prepareRenderState:state];
-    [program applyUniformsFromState:state];
-    [self render];
-    [subnodes makeObjectsPerformSelector:@selector(renderSelfAndSubnodesWithState:) 
-                              withObject:state];
+    const BOOL clips = (program && BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagClips));
+    if (clips) {
+        // Draws nothing itself; its program gives the projection.
+        BGLMatrix mvp, modelView;
+        [program getProjectionMatrix:mvp];
+        [state getModelViewMatrix:modelView];
+        BGLMatrixMultiply(mvp, mvp, modelView);
+        [self beginClippingWithState:state modelViewProjectionMatrix:mvp];
+    } else if (BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagOccluded)) {
+        // Covered by a later opaque node; the mark is good for one frame.
+        BGLNodeStoreSetFlag(nodeStore, handle, kBGLNodeFlagOccluded, 0);
+    } else {
+        [program use];
+        float scale = [self contentScale];
+        if (scale != 1) {
+            [state pushModelViewMatrix];
+            BGLMatrix m;
+            BGLMatrixLoadIdentity(m);
+            BGLMatrixScale(m, scale, scale, 1);
+            [state premultiplyModelViewMatrixBy:m]; // before the node's matrix
+            [program applyUniformsFromState:state];
+            [state popModelViewMatrix];
+        } else {
+            [program applyUniformsFromState:state];
+        }
+        [self render];
+        BGLAccountMessages(4);
+    }
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        BGLAccountMessages(2); // and its renderSubtreeWithState:
+        [n renderSelfAndSubnodesWithState:state];
+    }
+    if (clips) [self endClippingWithState:state];
     [self restoreRenderState:state];
+    BGLAccountMessages(2);
 #if DEBUG
     NSAssert1(size == [state stackSize], @"Stack size mismatch: %d", [state stackSize] - size);
 #endif
 }
 
 
+- (void)addToOcclusionBuffer:(BGLOcclusionBuffer *)buffer parentMatrix:(const BGLMatrix)parentMatrix
+{
+    if (BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagHidden)) return;
+    
+    // Mirrors renderSubtreeWithState: and -[BGLProgram applyUniformsFromState:].
+    BGLMatrix m;
+    BGLMatrixMultiply(m, BGLNodeStoreLocalMatrix(nodeStore, handle), parentMatrix);
+    if (rasterCache) {
+        // Its image stands in for the whole subtree, at unknown bounds.
+        BGLOcclusionAdd(buffer, handle, m, NULL, NULL);
+        return;
+    }
+    const BOOL clips = (program && BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagClips));
+    if (clips) {
+        BGLMatrix mvp;
+        [program getProjectionMatrix:mvp];
+        BGLMatrixMultiply(mvp, mvp, m);
+        CGRect r;
+        BGLOcclusionRect clip;
+        BOOL hasClip = [self getClipRect:&r];
+        if (hasClip) clip = BGLOcclusionRectFromCGRect(r);
+        BGLOcclusionPushClip(buffer, mvp, hasClip ? &clip : NULL);
+    } else if (program) {
+        BGLMatrix mvp;
+        [program getProjectionMatrix:mvp];
+        BGLMatrixMultiply(mvp, mvp, m);
+        CGRect r;
+        BGLOcclusionRect bounds, opaque;
+        BOOL hasBounds = [self getDrawBounds:&r];
+        if (hasBounds) bounds = BGLOcclusionRectFromCGRect(r);
+        BOOL hasOpaque = [self getOpaqueRect:&r];
+        if (hasOpaque) opaque = BGLOcclusionRectFromCGRect(r);
+        BGLOcclusionAdd(buffer, handle, mvp, hasBounds ? &bounds : NULL, hasOpaque ? &opaque : NULL);
+    }
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        [n addToOcclusionBuffer:buffer parentMatrix:m];
+    }
+    if (clips) BGLOcclusionPopClip(buffer);
+}
+
+
+- (BOOL)getSubtreePixelBounds:(BGLOcclusionRect *)pixels parentMatrix:(const BGLMatrix)parentMatrix
+                  viewportSize:(CGSize)size
+{
+    if (BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagHidden)) return YES;
+    
+    // Mirrors addToOcclusionBuffer:parentMatrix:; clip nodes are ignored,
+    // which can only make the bounds larger than they need to be.
+    BGLMatrix m;
+    BGLMatrixMultiply(m, BGLNodeStoreLocalMatrix(nodeStore, handle), parentMatrix);
+    if (program && ! BGLNodeStoreGetFlag(nodeStore, handle, kBGLNodeFlagClips)) {
+        CGRect r;
+        if (! [self getDrawBounds:&r]) return NO;
+        BGLMatrix mvp;
+        [program getProjectionMatrix:mvp];
+        BGLMatrixMultiply(mvp, mvp, m);
+        BGLOcclusionRect bounds = BGLOcclusionRectFromCGRect(r);
+        BGLOcclusionRect viewport = { 0, 0, size.width, size.height };
+        BGLOcclusionRect drawn;
+        BGLOcclusionGetClipRect(mvp, &bounds, size.width, size.height, &viewport, &drawn);
+        if (drawn.maxX > drawn.minX && drawn.maxY > drawn.minY) {
+            if (pixels->maxX <= pixels->minX) {
+                *pixels = drawn;
+            } else {
+                pixels->minX = MIN(pixels->minX, drawn.minX);
+                pixels->minY = MIN(pixels->minY, drawn.minY);
+                pixels->maxX = MAX(pixels->maxX, drawn.maxX);
+                pixels->maxY = MAX(pixels->maxY, drawn.maxY);
+            }
+        }
+    }
+    for (BGLNode *n = BGLNodeFirstSubnode(self); n; n = BGLNodeNextSibling(n)) {
+        if (! [n getSubtreePixelBounds:pixels parentMatrix:m viewportSize:size]) return NO;
+    }
+    return YES;
+}
+
+
+- (void)beginClippingWithState:(BGLRenderState *)state modelViewProjectionMatrix:(const BGLMatrix)mvp
+{
+    CGRect r;
+    if (! [self getClipRect:&r]) r = CGRectInfinite;
+    [state pushClipRect:r modelViewProjectionMatrix:mvp];
+    BGLNodeApplyClip(state);
+}
+
+
+- (void)endClippingWithState:(BGLRenderState *)state
+{
+    [state popClipRect];
+    BGLNodeApplyClip(state);
+}
+
+
++ (void)submitDrawList:(const BGLDrawList *)list state:(BGLRenderState *)state
+{
+    // Equivalent to renderSelfAndSubnodesWithState: on the recorded root.
+    BGLProgram *current = nil;
+    for (uint32_t i = 0; i < list->count; i++) {
+        const BGLDrawCommand *c = &list->commands[i];
+        BGLNode *node = BGLNodeAtIndex(c->node);
+        if (c->kind == kBGLDrawCommandClipBegin) {
+            [node beginClippingWithState:state modelViewProjectionMatrix:c->modelViewProjection];
+            BGLAccountMessages(1);
+            continue;
+        }
+        if (c->kind == kBGLDrawCommandClipEnd) {
+            [node endClippingWithState:state];
+            BGLAccountMessages(1);
+            continue;
+        }
+        if (c->kind == kBGLDrawCommandSubtree) {
+            [state setModelViewMatrix:(float *)c->modelView];
+            [node renderSelfAndSubnodesWithState:state];
+            current = nil; // its nodes may use any program
+            BGLAccountMessages(2);
+            continue;
+        }
+        BGLProgram *program = node->program;
+        if (program != current) {
+            [program use];
+            current = program;
+            BGLAccountMessages(1);
+        }
+        float scale = [node contentScale];
+        if (scale != 1) {
+            BGLMatrix contentScale, modelView, modelViewProjection;
+            BGLMatrixLoadIdentity(contentScale);
+            BGLMatrixScale(contentScale, scale, scale, 1);
+            BGLMatrixMultiply(modelView, c->modelView, contentScale);
+            [program getProjectionMatrix:modelViewProjection];
+            BGLMatrixMultiply(modelViewProjection, modelViewProjection, modelView);
+            [program applyModelViewMatrix:modelView modelViewProjectionMatrix:modelViewProjection];
+            BGLAccountMessages(1);
+        } else {
+            [program applyModelViewMatrix:c->modelView modelViewProjectionMatrix:c->modelViewProjection];
+        }
+        [node render];
+        BGLAccountMessages(3);
+    }
+}
+
+
++ (void)markOccludedNodes:(const BGLOcclusionBuffer *)buffer
+{
+    // Every node added is visited by the next render, which clears the mark.
+    for (uint32_t i = 0; i < buffer->count; i++) {
+        if (buffer->items[i].culled) {
+            BGLNodeStoreSetFlag(nodeStore, buffer->items[i].key, kBGLNodeFlagOccluded, 1);
+        }
+    }
+}
+
+
 @end
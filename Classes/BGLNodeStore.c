@@ -0,0 +1,282 @@
+/*
+ See BGLNodeStore.h.
+ */
+
+#include "BGLNodeStore.h"
+#include "BGLAccounting.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static const uint32_t kDefaultCapacity = 256;
+static const uint32_t kIndexMax = kBGLNodeHandleIndexMask - 1;
+
+
+// Returns 0 if out of memory, leaving the capacity as it was; arrays that did
+// grow keep their new size, which is harmless.
+static int BGLNodeStoreGrow(BGLNodeStore *s, uint32_t capacity)
+{
+    size_t bytes = 0;
+#define GROW(array) \
+    do { \
+        void *grown = realloc(s->array, capacity * sizeof(*s->array)); \
+        if (grown == NULL) return 0; \
+        s->array = grown; \
+        bytes += capacity * sizeof(*s->array); \
+    } while (0)
+    GROW(local);
+    GROW(world);
+    GROW(parent);
+    GROW(firstChild);
+    GROW(lastChild);
+    GROW(nextSibling);
+    GROW(prevSibling);
+    GROW(drawKey);
+    GROW(owner);
+    GROW(components);
+    GROW(flags);
+    GROW(generation);
+#undef GROW
+    BGLAccountAllocation(bytes);
+    memset(&s->generation[s->capacity], 0, (capacity - s->capacity) * sizeof(*s->generation));
+    s->capacity = capacity;
+    return 1;
+}
+
+
+BGLNodeStore *BGLNodeStoreCreate(uint32_t capacity)
+{
+    BGLNodeStore *s = calloc(1, sizeof(BGLNodeStore));
+    if (s == NULL) return NULL;
+    s->freeHead = kBGLNodeIndexNone;
+    if (capacity > kIndexMax + 1) capacity = kIndexMax + 1;
+    if (! BGLNodeStoreGrow(s, capacity ? capacity : kDefaultCapacity)) {
+        BGLNodeStoreDestroy(s);
+        return NULL;
+    }
+    return s;
+}
+
+
+void BGLNodeStoreDestroy(BGLNodeStore *s)
+{
+    free(s->local);
+    free(s->world);
+    free(s->parent);
+    free(s->firstChild);
+    free(s->lastChild);
+    free(s->nextSibling);
+    free(s->prevSibling);
+    free(s->drawKey);
+    free(s->owner);
+    for (uint32_t i = 0; i < s->end; i++) {
+        free(s->components[i]);
+    }
+    free(s->components);
+    free(s->flags);
+    free(s->generation);
+    free(s);
+}
+
+
+BGLNodeStore *BGLNodeStoreGetDefault(void)
+{
+    static BGLNodeStore *defaultStore = NULL;
+    if (defaultStore == NULL) {
+        defaultStore = BGLNodeStoreCreate(0);
+    }
+    return defaultStore;
+}
+
+
+BGLNodeHandle BGLNodeStoreAlloc(BGLNodeStore *s)
+{
+    uint32_t i;
+    if (s->freeHead != kBGLNodeIndexNone) {
+        i = s->freeHead;
+        s->freeHead = s->nextSibling[i];
+    } else {
+        if (s->end == s->capacity) {
+            if (s->capacity > kIndexMax) return 0;
+            uint32_t capacity = (s->capacity > kIndexMax / 2) ? kIndexMax + 1 : 2 * s->capacity;
+            if (! BGLNodeStoreGrow(s, capacity)) return 0;
+        }
+        i = s->end++;
+    }
+    s->count += 1;
+
+    BGLMatrixLoadIdentity(s->local[i]);
+    BGLMatrixLoadIdentity(s->world[i]);
+    s->parent[i] = kBGLNodeIndexNone;
+    s->firstChild[i] = kBGLNodeIndexNone;
+    s->lastChild[i] = kBGLNodeIndexNone;
+    s->nextSibling[i] = kBGLNodeIndexNone;
+    s->prevSibling[i] = kBGLNodeIndexNone;
+    s->drawKey[i] = 0;
+    s->owner[i] = NULL;
+    s->components[i] = NULL;
+    s->flags[i] = kBGLNodeFlagInUse;
+    return BGLNodeHandleMake(i, s->generation[i]);
+}
+
+
+int BGLNodeStoreIsValid(const BGLNodeStore *s, BGLNodeHandle h)
+{
+    if (h == 0) return 0;
+    uint32_t i = BGLNodeHandleIndex(h);
+    return (i < s->capacity &&
+            (s->flags[i] & kBGLNodeFlagInUse) &&
+            s->generation[i] == BGLNodeHandleGeneration(h));
+}
+
+
+void BGLNodeStoreFree(BGLNodeStore *s, BGLNodeHandle h)
+{
+    if (! BGLNodeStoreIsValid(s, h)) return;
+    uint32_t i = BGLNodeHandleIndex(h);
+
+    BGLNodeStoreUnlink(s, h);
+    // Orphan any children still linked; their owners free them separately.
+    for (uint32_t c = s->firstChild[i]; c != kBGLNodeIndexNone; ) {
+        uint32_t next = s->nextSibling[c];
+        s->parent[c] = kBGLNodeIndexNone;
+        s->nextSibling[c] = kBGLNodeIndexNone;
+        s->prevSibling[c] = kBGLNodeIndexNone;
+        c = next;
+    }
+
+    free(s->components[i]);
+    s->components[i] = NULL;
+    s->owner[i] = NULL;
+    s->flags[i] = 0;
+    s->count -= 1;
+    if (s->generation[i] == kBGLNodeGenerationMax) {
+        s->retiredCount += 1; // a new generation would wrap around to old handles
+        return;
+    }
+    s->generation[i] += 1;
+    s->nextSibling[i] = s->freeHead;
+    s->freeHead = i;
+}
+
+
+void BGLNodeStoreUnlink(BGLNodeStore *s, BGLNodeHandle h)
+{
+    uint32_t i = BGLNodeHandleIndex(h);
+    uint32_t p = s->parent[i];
+    if (p == kBGLNodeIndexNone) return;
+
+    uint32_t prev = s->prevSibling[i];
+    uint32_t next = s->nextSibling[i];
+    if (prev != kBGLNodeIndexNone) s->nextSibling[prev] = next; else s->firstChild[p] = next;
+    if (next != kBGLNodeIndexNone) s->prevSibling[next] = prev; else s->lastChild[p] = prev;
+
+    s->parent[i] = kBGLNodeIndexNone;
+    s->prevSibling[i] = kBGLNodeIndexNone;
+    s->nextSibling[i] = kBGLNodeIndexNone;
+}
+
+
+void BGLNodeStoreLink(BGLNodeStore *s, BGLNodeHandle parent, BGLNodeHandle child)
+{
+    BGLNodeStoreLinkBefore(s, parent, child, 0);
+}
+
+
+void BGLNodeStoreLinkBefore(BGLNodeStore *s, BGLNodeHandle parent, BGLNodeHandle child, BGLNodeHandle sibling)
+{
+    BGLNodeStoreUnlink(s, child);
+    uint32_t p = BGLNodeHandleIndex(parent);
+    uint32_t c = BGLNodeHandleIndex(child);
+    uint32_t next = sibling ? BGLNodeHandleIndex(sibling) : kBGLNodeIndexNone;
+    uint32_t prev = sibling ? s->prevSibling[next] : s->lastChild[p];
+
+    s->parent[c] = p;
+    s->prevSibling[c] = prev;
+    s->nextSibling[c] = next;
+    if (prev != kBGLNodeIndexNone) s->nextSibling[prev] = c; else s->firstChild[p] = c;
+    if (next != kBGLNodeIndexNone) s->prevSibling[next] = c; else s->lastChild[p] = c;
+}
+
+
+BGLTransformComponents *BGLNodeStoreGetComponents(BGLNodeStore *s, BGLNodeHandle h)
+{
+    return s->components[BGLNodeHandleIndex(h)];
+}
+
+
+int BGLNodeStoreSetUsesComponents(BGLNodeStore *s, BGLNodeHandle h, int flag)
+{
+    uint32_t i = BGLNodeHandleIndex(h);
+    if (flag && s->components[i] == NULL) {
+        BGLTransformComponents tc;
+        if (! BGLMatrixGetTransformComponents(s->local[i], &tc)) return 0;
+        s->components[i] = malloc(sizeof(BGLTransformComponents));
+        BGLAccountAllocation(sizeof(BGLTransformComponents));
+        *s->components[i] = tc;
+    } else if (!flag && s->components[i] != NULL) {
+        BGLNodeStoreLocalMatrixAtIndex(s, i); // bring the matrix up to date
+        free(s->components[i]);
+        s->components[i] = NULL;
+    }
+    return 1;
+}
+
+
+void BGLNodeStoreComposeLocalMatrix(BGLNodeStore *s, uint32_t i)
+{
+    BGLMatrixLoadTransformComponents(s->local[i], s->components[i]);
+    s->flags[i] &= ~kBGLNodeFlagComponentsChanged;
+}
+
+
+void BGLNodeStoreGetRootTransform(BGLNodeStore *s, BGLNodeHandle h, BGLMatrix m)
+{
+    uint32_t i = BGLNodeHandleIndex(h);
+    BGLMatrixCopy(m, BGLNodeStoreLocalMatrixAtIndex(s, i));
+    for (uint32_t p = s->parent[i]; p != kBGLNodeIndexNone; p = s->parent[p]) {
+        BGLMatrixMultiply(m, BGLNodeStoreLocalMatrixAtIndex(s, p), m);
+    }
+}
+
+
+void BGLNodeStoreUpdateWorldMatrices(BGLNodeStore *s, BGLNodeHandle root, const BGLMatrix rootParent)
+{
+    uint32_t r = BGLNodeHandleIndex(root);
+    if (rootParent) {
+        BGLMatrixMultiply(s->world[r], rootParent, BGLNodeStoreLocalMatrixAtIndex(s, r));
+    } else {
+        BGLMatrixCopy(s->world[r], BGLNodeStoreLocalMatrixAtIndex(s, r));
+    }
+
+    // Preorder walk without a stack: descend to the first child, otherwise
+    // move to the next sibling, climbing back up as far as needed.
+    uint32_t i = s->firstChild[r];
+    while (i != kBGLNodeIndexNone) {
+        BGLMatrixMultiply(s->world[i], s->world[s->parent[i]], BGLNodeStoreLocalMatrixAtIndex(s, i));
+        if (s->firstChild[i] != kBGLNodeIndexNone) {
+            i = s->firstChild[i];
+            continue;
+        }
+        while (i != r && s->nextSibling[i] == kBGLNodeIndexNone) {
+            i = s->parent[i];
+        }
+        i = (i == r) ? kBGLNodeIndexNone : s->nextSibling[i];
+    }
+}
+
+
+void BGLNodeStoreGetStats(const BGLNodeStore *s, BGLNodeStoreStats *stats)
+{
+    stats->count = s->count;
+    stats->capacity = s->capacity;
+    stats->retiredCount = s->retiredCount;
+    stats->bytesPerNode = (2 * sizeof(BGLMatrix) +
+                           6 * sizeof(uint32_t) +
+                           sizeof(BGLTransformComponents *) +
+                           sizeof(void *) +
+                           sizeof(uint8_t) +
+                           sizeof(uint16_t));
+    stats->totalBytes = sizeof(BGLNodeStore) + s->capacity * stats->bytesPerNode;
+}
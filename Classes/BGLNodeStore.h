@@ -0,0 +1,174 @@
+/*
+ Contiguous storage for the per-node data that traversals touch.
+
+ Each node occupies one slot of a set of parallel arrays: local and world
+ matrices, flags, a draw key, and parent/child/sibling links by index. Slots
+ are handed out and returned in O(1) through a free list, and named by
+ handles that carry a generation count, so a handle to a freed slot is
+ detected instead of silently aliasing whatever reuses it. A handle packs
+ the slot's index into its low 20 bits and the generation into the high
+ 12; a slot whose generation has run out is retired instead of reused, so
+ no handle ever comes back to life. That leaks a slot per 4096 reuses of
+ it, and limits a store to about a million nodes.
+
+ BGLNode keeps its matrix and flags here and mirrors its subnode structure,
+ so walking a subtree (see BGLNodeStoreUpdateWorldMatrices) reads a few
+ dense arrays instead of visiting one heap object per node. Inserting,
+ removing and reordering children are O(1) list splices; each slot's owner
+ pointer leads from a link back to its node.
+
+ A node may instead keep its transform as separate translation, rotation
+ and scale (BGLTransformComponents). Its local matrix is then rebuilt from
+ them the next time it is read after they change.
+
+ Pointers returned by the accessors are invalidated when a slot is
+ allocated, since the arrays may move as they grow.
+
+ This is plain C with no GL calls.
+ */
+
+#ifndef BGLNODESTORE_H
+#define BGLNODESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BGLMatrix.h"
+
+
+typedef uint32_t BGLNodeHandle; // 0 is never a valid handle
+
+
+#define kBGLNodeIndexNone 0xFFFFFFFFu
+#define kBGLNodeHandleIndexBits 20
+#define kBGLNodeHandleIndexMask ((1u << kBGLNodeHandleIndexBits) - 1)
+#define kBGLNodeGenerationMax (0xFFFFFFFFu >> kBGLNodeHandleIndexBits)
+
+
+enum {
+    kBGLNodeFlagHidden = 1 << 0,
+    kBGLNodeFlagPaused = 1 << 1,
+    kBGLNodeFlagComponentsChanged = 1 << 2,
+    kBGLNodeFlagOccluded = 1 << 3, // skip drawing once; see BGLOcclusion.h
+    kBGLNodeFlagRasterized = 1 << 4, // draws through a raster cache; see BGLDrawRecorder.h
+    kBGLNodeFlagClips = 1 << 5, // scissors its subnodes; see BGLClipNode.h
+    kBGLNodeFlagInUse = 1 << 7,
+};
+
+
+typedef struct {
+    BGLMatrix *local;
+    BGLMatrix *world;       // valid after BGLNodeStoreUpdateWorldMatrices
+    uint32_t *parent;
+    uint32_t *firstChild;
+    uint32_t *lastChild;
+    uint32_t *nextSibling;  // also links the free list
+    uint32_t *prevSibling;
+    uint32_t *drawKey;
+    void **owner;           // object the slot belongs to, e.g. its BGLNode
+    BGLTransformComponents **components; // NULL unless the node uses them
+    uint8_t *flags;
+    uint16_t *generation;
+    uint32_t capacity;
+    uint32_t count;         // slots in use
+    uint32_t end;           // slots below this are in use, free-listed or retired
+    uint32_t freeHead;
+    uint32_t retiredCount;  // slots out of generations, never reused
+} BGLNodeStore;
+
+
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t retiredCount;
+    size_t bytesPerNode;
+    size_t totalBytes;
+} BGLNodeStoreStats;
+
+
+// Returns NULL if out of memory.
+BGLNodeStore *BGLNodeStoreCreate(uint32_t capacity);
+void BGLNodeStoreDestroy(BGLNodeStore *s);
+BGLNodeStore *BGLNodeStoreGetDefault(void);
+
+// Returns 0 if out of memory or slots.
+BGLNodeHandle BGLNodeStoreAlloc(BGLNodeStore *s);
+void BGLNodeStoreFree(BGLNodeStore *s, BGLNodeHandle h);
+int BGLNodeStoreIsValid(const BGLNodeStore *s, BGLNodeHandle h);
+
+// Appends child as the last child of parent, unlinking it first if needed.
+void BGLNodeStoreLink(BGLNodeStore *s, BGLNodeHandle parent, BGLNodeHandle child);
+// Same, but inserts ahead of sibling, which must be a child of parent (0 appends).
+void BGLNodeStoreLinkBefore(BGLNodeStore *s, BGLNodeHandle parent, BGLNodeHandle child, BGLNodeHandle sibling);
+void BGLNodeStoreUnlink(BGLNodeStore *s, BGLNodeHandle h);
+
+// Returns NULL unless enabled; call BGLNodeStoreComponentsChanged after editing.
+BGLTransformComponents *BGLNodeStoreGetComponents(BGLNodeStore *s, BGLNodeHandle h);
+// Enabling starts from the current local matrix; returns 0 if it can't be decomposed.
+int BGLNodeStoreSetUsesComponents(BGLNodeStore *s, BGLNodeHandle h, int flag);
+void BGLNodeStoreComposeLocalMatrix(BGLNodeStore *s, uint32_t index);
+
+// Composes local matrices from the root down to h.
+void BGLNodeStoreGetRootTransform(BGLNodeStore *s, BGLNodeHandle h, BGLMatrix m);
+// Sets world = parent world * local for h and its descendants, in preorder.
+void BGLNodeStoreUpdateWorldMatrices(BGLNodeStore *s, BGLNodeHandle root, const BGLMatrix rootParent);
+
+void BGLNodeStoreGetStats(const BGLNodeStore *s, BGLNodeStoreStats *stats);
+
+
+static inline uint32_t BGLNodeHandleIndex(BGLNodeHandle h)
+{
+    return (h & kBGLNodeHandleIndexMask) - 1;
+}
+
+
+static inline uint32_t BGLNodeHandleGeneration(BGLNodeHandle h)
+{
+    return h >> kBGLNodeHandleIndexBits;
+}
+
+
+static inline BGLNodeHandle BGLNodeHandleMake(uint32_t index, uint32_t generation)
+{
+    return (generation << kBGLNodeHandleIndexBits) | (index + 1);
+}
+
+
+static inline float *BGLNodeStoreLocalMatrixAtIndex(BGLNodeStore *s, uint32_t i)
+{
+    if (s->flags[i] & kBGLNodeFlagComponentsChanged) BGLNodeStoreComposeLocalMatrix(s, i);
+    return s->local[i];
+}
+
+
+static inline float *BGLNodeStoreLocalMatrix(BGLNodeStore *s, BGLNodeHandle h)
+{
+    return BGLNodeStoreLocalMatrixAtIndex(s, BGLNodeHandleIndex(h));
+}
+
+
+static inline void BGLNodeStoreComponentsChanged(BGLNodeStore *s, BGLNodeHandle h)
+{
+    s->flags[BGLNodeHandleIndex(h)] |= kBGLNodeFlagComponentsChanged;
+}
+
+
+static inline void *BGLNodeStoreOwnerAtIndex(const BGLNodeStore *s, uint32_t i)
+{
+    return (i == kBGLNodeIndexNone) ? NULL : s->owner[i];
+}
+
+
+static inline uint8_t BGLNodeStoreGetFlag(const BGLNodeStore *s, BGLNodeHandle h, uint8_t flag)
+{
+    return s->flags[BGLNodeHandleIndex(h)] & flag;
+}
+
+
+static inline void BGLNodeStoreSetFlag(BGLNodeStore *s, BGLNodeHandle h, uint8_t flag, int on)
+{
+    uint8_t *f = &s->flags[BGLNodeHandleIndex(h)];
+    *f = on ? (*f | flag) : (*f & ~flag);
+}
+
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ See BGLOcclusion.h.
+
+ The occluder set is capped, keeping the largest rects, so resolving is
+ linear in the number of draws. A scene whose big opaque layers are few
+ (backgrounds, panels) loses nothing to the cap.
+ */
+
+#include "BGLOcclusion.h"
+#include "BGLAccounting.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const float kAxisAlignedEpsilon = 0.01f; // pixels
+static const float kRoundingEpsilon = 0.001f; // pixels; projection error mustn't round out a whole one
+
+
+static inline float BGLOcclusionRectArea(const BGLOcclusionRect *r)
+{
+    return (r->maxX > r->minX && r->maxY > r->minY) ? (r->maxX - r->minX) * (r->maxY - r->minY) : 0;
+}
+
+
+static inline int BGLOcclusionRectContains(const BGLOcclusionRect *outer, const BGLOcclusionRect *inner)
+{
+    return (inner->minX >= outer->minX && inner->maxX <= outer->maxX &&
+            inner->minY >= outer->minY && inner->maxY <= outer->maxY);
+}
+
+
+static inline void BGLOcclusionRectClip(BGLOcclusionRect *r, const BGLOcclusionRect *clip)
+{
+    r->minX = fmaxf(r->minX, clip->minX);
+    r->minY = fmaxf(r->minY, clip->minY);
+    r->maxX = fminf(r->maxX, clip->maxX);
+    r->maxY = fminf(r->maxY, clip->maxY);
+}
+
+
+void BGLOcclusionBufferFree(BGLOcclusionBuffer *b)
+{
+    free(b->items);
+    free(b->opaque);
+    memset(b, 0, sizeof(BGLOcclusionBuffer));
+}
+
+
+void BGLOcclusionBegin(BGLOcclusionBuffer *b, float viewportWidth, float viewportHeight)
+{
+    b->count = 0;
+    b->viewport.minX = 0;
+    b->viewport.minY = 0;
+    b->viewport.maxX = viewportWidth;
+    b->viewport.maxY = viewportHeight;
+    memset(&b->stats, 0, sizeof(BGLOcclusionStats));
+    b->stats.viewportArea = viewportWidth * viewportHeight;
+    b->clipDepth = 0;
+}
+
+
+static inline const BGLOcclusionRect *BGLOcclusionCurrentClip(const BGLOcclusionBuffer *b)
+{
+    if (b->clipDepth == 0) return &b->viewport;
+    uint32_t depth = b->clipDepth < kBGLOcclusionClipDepthMax ? b->clipDepth : kBGLOcclusionClipDepthMax;
+    return &b->clips[depth - 1];
+}
+
+
+// Projects the rect's corners to pixels. Returns 0 if any lands behind the
+// eye; otherwise sets *axisAligned if the corners still form an upright rect.
+static int BGLOcclusionProject(const BGLMatrix m, const BGLOcclusionRect *r, float width, float height,
+                               BGLOcclusionRect *out, int *axisAligned)
+{
+    const float xs[4] = { r->minX, r->maxX, r->minX, r->maxX };
+    const float ys[4] = { r->minY, r->minY, r->maxY, r->maxY };
+    float px[4], py[4];
+    for (int i = 0; i < 4; i++) {
+        float x = m[0] * xs[i] + m[4] * ys[i] + m[12];
+        float y = m[1] * xs[i] + m[5] * ys[i] + m[13];
+        float w = m[3] * xs[i] + m[7] * ys[i] + m[15];
+        if (w <= 0) return 0;
+        px[i] = (x / w + 1) * 0.5f * width;
+        py[i] = (y / w + 1) * 0.5f * height;
+    }
+    out->minX = fminf(fminf(px[0], px[1]), fminf(px[2], px[3]));
+    out->maxX = fmaxf(fmaxf(px[0], px[1]), fmaxf(px[2], px[3]));
+    out->minY = fminf(fminf(py[0], py[1]), fminf(py[2], py[3]));
+    out->maxY = fmaxf(fmaxf(py[0], py[1]), fmaxf(py[2], py[3]));
+    // Upright either way round: corners 0,2 share x and 0,1 share y, or the transpose.
+    *axisAligned = ((fabsf(px[0] - px[2]) < kAxisAlignedEpsilon && fabsf(px[1] - px[3]) < kAxisAlignedEpsilon &&
+                     fabsf(py[0] - py[1]) < kAxisAlignedEpsilon && fabsf(py[2] - py[3]) < kAxisAlignedEpsilon) ||
+                    (fabsf(px[0] - px[1]) < kAxisAlignedEpsilon && fabsf(px[2] - px[3]) < kAxisAlignedEpsilon &&
+                     fabsf(py[0] - py[2]) < kAxisAlignedEpsilon && fabsf(py[1] - py[3]) < kAxisAlignedEpsilon));
+    return 1;
+}
+
+
+void BGLOcclusionAdd(BGLOcclusionBuffer *b, uint32_t key, const BGLMatrix mvp,
+                     const BGLOcclusionRect *bounds, const BGLOcclusionRect *opaqueRect)
+{
+    if (b->count == b->capacity) {
+        // Out of memory, the draw goes unlisted: never culled, never an occluder.
+        uint32_t capacity = b->capacity ? 2 * b->capacity : 256;
+        BGLOcclusionItem *items = realloc(b->items, capacity * sizeof(BGLOcclusionItem));
+        if (items == NULL) return;
+        BGLAccountAllocation(capacity * sizeof(BGLOcclusionItem));
+        b->items = items;
+        BGLOcclusionRect *opaque = realloc(b->opaque, capacity * sizeof(BGLOcclusionRect));
+        if (opaque == NULL) return;
+        BGLAccountAllocation(capacity * sizeof(BGLOcclusionRect));
+        b->opaque = opaque;
+        b->capacity = capacity;
+    }
+    BGLOcclusionItem *item = &b->items[b->count];
+    BGLOcclusionRect *opaque = &b->opaque[b->count];
+    b->count += 1;
+
+    int axisAligned;
+    float width = b->viewport.maxX, height = b->viewport.maxY;
+    const BGLOcclusionRect *clip = BGLOcclusionCurrentClip(b);
+    item->key = key;
+    item->culled = 0;
+    item->clipped = 0;
+    item->clippedArea = 0;
+    item->bounded = bounds && BGLOcclusionProject(mvp, bounds, width, height, &item->bounds, &axisAligned);
+    if (item->bounded) {
+        BGLOcclusionRectClip(&item->bounds, &b->viewport);
+        if (b->clipDepth > 0) {
+            float area = BGLOcclusionRectArea(&item->bounds);
+            BGLOcclusionRectClip(&item->bounds, clip);
+            item->clippedArea = area - BGLOcclusionRectArea(&item->bounds);
+            item->clipped = (area > 0 && item->clippedArea == area);
+        }
+    }
+
+    if (opaqueRect && BGLOcclusionProject(mvp, opaqueRect, width, height, opaque, &axisAligned) && axisAligned) {
+        BGLOcclusionRectClip(opaque, clip);
+    } else {
+        memset(opaque, 0, sizeof(BGLOcclusionRect));
+    }
+}
+
+
+void BGLOcclusionGetClipRect(const BGLMatrix mvp, const BGLOcclusionRect *rect, float viewportWidth, float viewportHeight,
+                             const BGLOcclusionRect *within, BGLOcclusionRect *pixels)
+{
+    int axisAligned;
+    BGLOcclusionRect r;
+    if (! BGLOcclusionProject(mvp, rect, viewportWidth, viewportHeight, &r, &axisAligned)) {
+        *pixels = *within;
+        return;
+    }
+    // A rotated clip scissors to its bounding box; the scissor test has no other shape.
+    r.minX = floorf(r.minX + kRoundingEpsilon);
+    r.minY = floorf(r.minY + kRoundingEpsilon);
+    r.maxX = ceilf(r.maxX - kRoundingEpsilon);
+    r.maxY = ceilf(r.maxY - kRoundingEpsilon);
+    BGLOcclusionRectClip(&r, within);
+    if (r.maxX < r.minX) r.maxX = r.minX;
+    if (r.maxY < r.minY) r.maxY = r.minY;
+    *pixels = r;
+}
+
+
+void BGLOcclusionPushClip(BGLOcclusionBuffer *b, const BGLMatrix mvp, const BGLOcclusionRect *rect)
+{
+    if (b->clipDepth < kBGLOcclusionClipDepthMax) {
+        const BGLOcclusionRect *within = BGLOcclusionCurrentClip(b);
+        if (rect) {
+            BGLOcclusionGetClipRect(mvp, rect, b->viewport.maxX, b->viewport.maxY, within, &b->clips[b->clipDepth]);
+        } else {
+            b->clips[b->clipDepth] = *within;
+        }
+    }
+    b->clipDepth += 1;
+    b->stats.clipCount += 1;
+}
+
+
+void BGLOcclusionPopClip(BGLOcclusionBuffer *b)
+{
+    if (b->clipDepth > 0) b->clipDepth -= 1;
+}
+
+
+void BGLOcclusionResolve(BGLOcclusionBuffer *b)
+{
+    BGLOcclusionRect occluders[kBGLOcclusionOccluderMax];
+    float areas[kBGLOcclusionOccluderMax];
+    int occluderCount = 0;
+    BGLOcclusionStats *stats = &b->stats;
+
+    stats->drawCount = b->count;
+    for (uint32_t i = b->count; i-- > 0; ) {
+        BGLOcclusionItem *item = &b->items[i];
+        if (! item->bounded) {
+            stats->unboundedCount += 1;
+        } else {
+            float area = BGLOcclusionRectArea(&item->bounds);
+            int hidden = (area == 0);
+            stats->clippedArea += item->clippedArea;
+            for (int k = 0; k < occluderCount && ! hidden; k++) {
+                hidden = BGLOcclusionRectContains(&occluders[k], &item->bounds);
+            }
+            if (hidden) {
+                item->culled = 1;
+                stats->culledCount += 1;
+                if (item->clipped) stats->clippedCount += 1;
+                stats->culledArea += area;
+                continue; // a culled draw can't occlude anything
+            }
+            stats->drawnArea += area;
+        }
+
+        // Keep the opaque rect if it adds coverage, evicting the smallest.
+        float area = BGLOcclusionRectArea(&b->opaque[i]);
+        if (area == 0) continue;
+        int redundant = 0, smallest = 0;
+        for (int k = 0; k < occluderCount && ! redundant; k++) {
+            redundant = BGLOcclusionRectContains(&occluders[k], &b->opaque[i]);
+            if (areas[k] < areas[smallest]) smallest = k;
+        }
+        if (redundant) continue;
+        stats->occluderCount += 1;
+        if (occluderCount < kBGLOcclusionOccluderMax) {
+            smallest = occluderCount++;
+        } else if (areas[smallest] >= area) {
+            continue;
+        }
+        occluders[smallest] = b->opaque[i];
+        areas[smallest] = area;
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ Finds draws hidden behind later opaque draws, and estimates overdraw.
+
+ Before a frame is drawn, every node that draws is added in draw order
+ with its model-view-projection matrix, its bounds in its own coordinates
+ (if it knows them) and the rect it covers with opaque pixels (if any).
+ Resolving then sweeps the list backwards, keeping the largest opaque rects
+ seen so far as occluders: a draw whose pixel bounds fall inside one of
+ them, or entirely off the viewport, is marked culled. Only an opaque rect
+ that stays axis-aligned on screen becomes an occluder, and only draws with
+ known bounds are ever culled, so the test is conservative.
+
+ Overdraw is estimated from the same bounds: the pixels each draw touches,
+ summed and divided by the viewport's pixels. Draws without bounds are
+ counted separately rather than guessed at.
+
+ Clip rects (see BGLClipNode.h) are pushed and popped around the draws they
+ scissor. A draw's bounds are cut down to the current clip, so one left
+ with nothing is culled, and an opaque rect only hides what is behind its
+ visible part. The pixels cut off are counted as fill the scissor saved.
+
+ This is plain C with no GL calls.
+ */
+
+#ifndef BGLOCCLUSION_H
+#define BGLOCCLUSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BGLMatrix.h"
+
+
+#define kBGLOcclusionOccluderMax 16
+#define kBGLOcclusionClipDepthMax 16 // deeper clips are treated as their ancestor's
+
+
+typedef struct {
+    float minX, minY, maxX, maxY;
+} BGLOcclusionRect;
+
+
+typedef struct {
+    BGLOcclusionRect bounds;    // in pixels, clipped to the viewport
+    uint32_t key;               // caller's, e.g. a node handle
+    float clippedArea;          // pixels of the bounds outside the clip rect
+    uint8_t bounded;
+    uint8_t clipped;            // nothing left inside the clip rect
+    uint8_t culled;
+} BGLOcclusionItem;
+
+
+typedef struct {
+    uint32_t drawCount;         // draws added
+    uint32_t culledCount;
+    uint32_t unboundedCount;    // draws whose area isn't known
+    uint32_t occluderCount;     // opaque rects that could hide others
+    uint32_t clipCount;         // clip rects pushed
+    uint32_t clippedCount;      // of the culled draws, those outside their clip rect
+    float viewportArea;         // pixels
+    float drawnArea;            // pixels touched by draws not culled
+    float culledArea;           // pixels culling saved
+    float clippedArea;          // pixels clip rects kept draws from touching
+} BGLOcclusionStats;
+
+
+typedef struct {
+    BGLOcclusionItem *items;
+    uint32_t count;
+    uint32_t capacity;
+    BGLOcclusionRect *opaque;   // parallel to items; empty unless an occluder
+    BGLOcclusionRect viewport;
+    BGLOcclusionRect clips[kBGLOcclusionClipDepthMax];
+    uint32_t clipDepth;
+    BGLOcclusionStats stats;
+} BGLOcclusionBuffer;
+
+
+void BGLOcclusionBufferFree(BGLOcclusionBuffer *b);
+void BGLOcclusionBegin(BGLOcclusionBuffer *b, float viewportWidth, float viewportHeight);
+
+// bounds and opaqueRect are in the coordinates mvp maps to clip space;
+// either may be NULL. If the list can't grow, the draw is left out of it,
+// and so never culled.
+void BGLOcclusionAdd(BGLOcclusionBuffer *b, uint32_t key, const BGLMatrix mvp,
+                     const BGLOcclusionRect *bounds, const BGLOcclusionRect *opaqueRect);
+
+// Until the matching pop, draws are clipped as by BGLOcclusionGetClipRect;
+// a NULL rect clips no further.
+void BGLOcclusionPushClip(BGLOcclusionBuffer *b, const BGLMatrix mvp, const BGLOcclusionRect *rect);
+void BGLOcclusionPopClip(BGLOcclusionBuffer *b);
+
+void BGLOcclusionResolve(BGLOcclusionBuffer *b);
+
+// The scissor rect for a clip rect: its bounding box in pixels, rounded out
+// to whole pixels and cut down to within, which may be empty. rect is in the
+// coordinates mvp maps to clip space; if it can't be projected, the result
+// is within, unchanged.
+void BGLOcclusionGetClipRect(const BGLMatrix mvp, const BGLOcclusionRect *rect, float viewportWidth, float viewportHeight,
+                             const BGLOcclusionRect *within, BGLOcclusionRect *pixels);
+
+// Draws per viewport pixel, before and after culling.
+static inline float BGLOcclusionStatsOverdraw(const BGLOcclusionStats *stats)
+{
+    return (stats->viewportArea > 0) ? stats->drawnArea / stats->viewportArea : 0;
+}
+
+static inline float BGLOcclusionStatsOverdrawWithoutCulling(const BGLOcclusionStats *stats)
+{
+    return (stats->viewportArea > 0) ? (stats->drawnArea + stats->culledArea) / stats->viewportArea : 0;
+}
+
+
+#endif
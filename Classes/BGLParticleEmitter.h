@@ -0,0 +1,33 @@
+//
+//  BGLParticleEmitter.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLNode.h"
+#import "BGLUtilities.h"
+#import "BGLParticleSystem.h"
+#import "BGLResourceRegistry.h"
+
+
+// Emits particles at its origin and draws them all in one call. Particles
+// move in the emitter's coordinate space and are simulated in the scene's
+// animation pass; an emitter with live particles keeps the scene animating.
+
+@interface BGLParticleEmitter : BGLNode {
+    BGLParticleSystem system;
+    BGLParticleVertex *vertexes;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    BGLResourceID bufferResource; // both buffers
+    size_t indexBufferSize;
+    BOOL emitting;
+}
+@property (nonatomic) BGLParticleConfig config;
+@property (nonatomic,getter=isEmitting) BOOL emitting;
+@property (nonatomic,readonly) NSUInteger particleCount;
+@property (nonatomic,readonly) NSUInteger maxParticleCount;
+- (id)initWithMaxParticleCount:(NSUInteger)count config:(const BGLParticleConfig *)config;
+- (void)burst:(NSUInteger)count; // spawns at once, as many as the pool allows
+- (void)removeAllParticles;
+@end
@@ -0,0 +1,164 @@
+//
+//  BGLParticleEmitter.m
+//  FingerPaintBall
+//
+
+#import "BGLParticleEmitter.h"
+#import "BGLProgram.h"
+#import "BGLScene.h"
+
+#import "BGLProgramBindings.h"
+
+
+static const NSUInteger kDefaultParticleCountMax = 256;
+
+
+@implementation BGLParticleEmitter
+
+
+@synthesize emitting;
+
+
+- (id)initWithMaxParticleCount:(NSUInteger)count config:(const BGLParticleConfig *)config
+{
+    if ((self = [super init])) {
+        self.program = [BGLProgram programNamed:@"Polygon"];
+        BGLParticleSystemInit(&system, MIN(count, kBGLParticleCountMax), config);
+        vertexes = malloc(4 * system.capacity * sizeof(BGLParticleVertex));
+    }
+    return self;
+}
+
+
+- (id)init
+{
+    return [self initWithMaxParticleCount:kDefaultParticleCountMax config:NULL];
+}
+
+
+- (void)dealloc
+{
+    if (vertexBuffer) glDeleteBuffers(1, &vertexBuffer);
+    if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+    BGLResourceUnregister(BGLResourceRegistryGetDefault(), bufferResource);
+    free(vertexes);
+    BGLParticleSystemFree(&system);
+    [super dealloc];
+}
+
+
+- (BGLParticleConfig)config
+{
+    return system.config;
+}
+
+
+- (void)setConfig:(BGLParticleConfig)config
+{
+    system.config = config;
+}
+
+
+- (void)setEmitting:(BOOL)flag
+{
+    emitting = flag;
+    if (emitting) [scene setNeedsAnimation];
+}
+
+
+- (NSUInteger)particleCount
+{
+    return system.count;
+}
+
+
+- (NSUInteger)maxParticleCount
+{
+    return system.capacity;
+}
+
+
+- (void)burst:(NSUInteger)count
+{
+    BGLParticleSystemSpawn(&system, MIN(count, system.capacity));
+    [scene setNeedsAnimation];
+    [self setNeedsDisplay];
+}
+
+
+- (void)removeAllParticles
+{
+    BGLParticleSystemReset(&system);
+    [self setNeedsDisplay];
+}
+
+
+#pragma mark BGLNode
+
+
+- (void)didAddToScene:(BGLScene *)aScene
+{
+    [super didAddToScene:aScene];
+    if (emitting || system.count) [scene setNeedsAnimation];
+}
+
+
+- (void)animateWithElapsedTime:(CFTimeInterval)t
+{
+    [super animateWithElapsedTime:t];
+    if ([self isPaused]) return;
+    if (emitting || system.count) {
+        BGLParticleSystemStep(&system, t, emitting);
+        [self setNeedsDisplay];
+        if (emitting || system.count) [scene setNeedsAnimation];
+    }
+}
+
+
+- (void)render
+{
+    if (system.count == 0) return;
+    
+    glEnable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    
+    if (vertexBuffer == 0) {
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        // Every frame uses a prefix of the same quad indexes.
+        size_t size = 6 * system.capacity * sizeof(uint16_t);
+        uint16_t *indexes = malloc(size);
+        BGLParticleWriteQuadIndexes(indexes, system.capacity);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indexes, GL_STATIC_DRAW);
+        free(indexes);
+        indexBufferSize = size;
+        bufferResource = BGLResourceRegister(BGLResourceRegistryGetDefault(), kBGLResourceBuffer,
+                                             "BGLParticleEmitter", size, NULL, NULL);
+    }
+    
+    // Respecifying the whole store each frame lets the driver hand back
+    // fresh memory instead of waiting for last frame's draw to finish.
+    size_t n = BGLParticleSystemWriteVertexes(&system, vertexes);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, n * sizeof(BGLParticleVertex), vertexes, GL_STREAM_DRAW);
+    BGLResourceSetSize(BGLResourceRegistryGetDefault(), bufferResource,
+                       indexBufferSize + n * sizeof(BGLParticleVertex));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    
+    glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, sizeof(BGLParticleVertex),
+                          (const GLvoid *)offsetof(BGLParticleVertex, position));
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexPosition);
+    glVertexAttribPointer(kBGLPolygonAttributeVertexColor, 4, GL_FLOAT, GL_FALSE, sizeof(BGLParticleVertex),
+                          (const GLvoid *)offsetof(BGLParticleVertex, color));
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexColor);
+    
+    glDrawElements(GL_TRIANGLES, 6 * system.count, GL_UNSIGNED_SHORT, 0);
+    
+    // Everything else draws from client memory.
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+
+@end
@@ -0,0 +1,221 @@
+/*
+ See BGLParticleSystem.h.
+
+ Each step is: integrate (velocity, position and age for every particle),
+ compact (swap dead particles out), spawn. Integrating before spawning means
+ a new particle is drawn once at its birth position before it moves.
+ */
+
+#include "BGLParticleSystem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+
+void BGLParticleConfigLoadDefaults(BGLParticleConfig *c)
+{
+    memset(c, 0, sizeof(BGLParticleConfig));
+    c->spawnRate = 60;
+    c->life = 1;
+    c->velocityVariance = BGLVector2Make(50, 50);
+    c->startSize = 8;
+    c->endSize = 8;
+    for (int i = 0; i < 4; i++) {
+        c->startColor[i] = 1;
+        c->endColor[i] = 1;
+    }
+    c->endColor[3] = 0;
+}
+
+
+void BGLParticleSystemInit(BGLParticleSystem *ps, uint32_t capacity, const BGLParticleConfig *config)
+{
+    memset(ps, 0, sizeof(BGLParticleSystem));
+    if (capacity > kBGLParticleCountMax) capacity = kBGLParticleCountMax;
+    ps->capacity = capacity;
+    ps->x = malloc(capacity * sizeof(float));
+    ps->y = malloc(capacity * sizeof(float));
+    ps->vx = malloc(capacity * sizeof(float));
+    ps->vy = malloc(capacity * sizeof(float));
+    ps->age = malloc(capacity * sizeof(float));
+    ps->ageRate = malloc(capacity * sizeof(float));
+    if (config) {
+        ps->config = *config;
+    } else {
+        BGLParticleConfigLoadDefaults(&ps->config);
+    }
+    BGLParticleSystemSeed(ps, 1);
+}
+
+
+void BGLParticleSystemFree(BGLParticleSystem *ps)
+{
+    free(ps->x);
+    free(ps->y);
+    free(ps->vx);
+    free(ps->vy);
+    free(ps->age);
+    free(ps->ageRate);
+    memset(ps, 0, sizeof(BGLParticleSystem));
+}
+
+
+void BGLParticleSystemReset(BGLParticleSystem *ps)
+{
+    ps->count = 0;
+    ps->spawnDebt = 0;
+}
+
+
+void BGLParticleSystemSeed(BGLParticleSystem *ps, uint32_t seed)
+{
+    ps->random = seed ? seed : 1;
+}
+
+
+// Uniform in [-1, 1]; xorshift is plenty for scattering particles.
+static inline float BGLParticleRandom(uint32_t *state)
+{
+    uint32_t r = *state;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    *state = r;
+    return (float)(r >> 8) * (2.0f / 16777215.0f) - 1.0f;
+}
+
+
+uint32_t BGLParticleSystemSpawn(BGLParticleSystem *ps, uint32_t n)
+{
+    const BGLParticleConfig *c = &ps->config;
+    if (n > ps->capacity - ps->count) n = ps->capacity - ps->count;
+    for (uint32_t i = ps->count; i < ps->count + n; i++) {
+        ps->x[i] = c->positionVariance.x * BGLParticleRandom(&ps->random);
+        ps->y[i] = c->positionVariance.y * BGLParticleRandom(&ps->random);
+        ps->vx[i] = c->velocity.x + c->velocityVariance.x * BGLParticleRandom(&ps->random);
+        ps->vy[i] = c->velocity.y + c->velocityVariance.y * BGLParticleRandom(&ps->random);
+        float life = c->life + c->lifeVariance * BGLParticleRandom(&ps->random);
+        ps->age[i] = 0;
+        ps->ageRate[i] = (life > 0.001f) ? 1.0f / life : 1000.0f;
+    }
+    ps->count += n;
+    return n;
+}
+
+
+static void BGLParticleIntegrate(float *restrict x, float *restrict y,
+                                 float *restrict vx, float *restrict vy,
+                                 float *restrict age, const float *restrict ageRate,
+                                 uint32_t count, float dt, BGLVector2 a)
+{
+    const float adx = a.x * dt;
+    const float ady = a.y * dt;
+    uint32_t i = 0;
+#ifdef __ARM_NEON__
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    const float32x4_t vadx = vdupq_n_f32(adx);
+    const float32x4_t vady = vdupq_n_f32(ady);
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t u = vaddq_f32(vld1q_f32(&vx[i]), vadx);
+        float32x4_t v = vaddq_f32(vld1q_f32(&vy[i]), vady);
+        vst1q_f32(&vx[i], u);
+        vst1q_f32(&vy[i], v);
+        vst1q_f32(&x[i], vmlaq_f32(vld1q_f32(&x[i]), u, vdt));
+        vst1q_f32(&y[i], vmlaq_f32(vld1q_f32(&y[i]), v, vdt));
+        vst1q_f32(&age[i], vmlaq_f32(vld1q_f32(&age[i]), vld1q_f32(&ageRate[i]), vdt));
+    }
+#endif
+    // Written so that compilers vectorize it where NEON isn't available.
+    for (; i < count; i++) {
+        vx[i] += adx;
+        vy[i] += ady;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        age[i] += ageRate[i] * dt;
+    }
+}
+
+
+static void BGLParticleCompact(BGLParticleSystem *ps)
+{
+    uint32_t i = 0;
+    while (i < ps->count) {
+        if (ps->age[i] < 1.0f) {
+            i++;
+            continue;
+        }
+        uint32_t last = --ps->count;
+        ps->x[i] = ps->x[last];
+        ps->y[i] = ps->y[last];
+        ps->vx[i] = ps->vx[last];
+        ps->vy[i] = ps->vy[last];
+        ps->age[i] = ps->age[last];
+        ps->ageRate[i] = ps->ageRate[last];
+    }
+}
+
+
+void BGLParticleSystemStep(BGLParticleSystem *ps, float dt, int emitting)
+{
+    BGLParticleIntegrate(ps->x, ps->y, ps->vx, ps->vy, ps->age, ps->ageRate,
+                         ps->count, dt, ps->config.acceleration);
+    BGLParticleCompact(ps);
+    if (emitting) {
+        ps->spawnDebt += ps->config.spawnRate * dt;
+        uint32_t n = (uint32_t)ps->spawnDebt;
+        ps->spawnDebt -= n;
+        BGLParticleSystemSpawn(ps, n);
+    } else {
+        ps->spawnDebt = 0;
+    }
+}
+
+
+size_t BGLParticleSystemWriteVertexes(const BGLParticleSystem *ps, BGLParticleVertex *vertexes)
+{
+    const BGLParticleConfig *c = &ps->config;
+    const float halfSize0 = 0.5f * c->startSize;
+    const float halfSizeDelta = 0.5f * (c->endSize - c->startSize);
+    float colorDelta[4];
+    for (int k = 0; k < 4; k++) {
+        colorDelta[k] = c->endColor[k] - c->startColor[k];
+    }
+
+    BGLParticleVertex *v = vertexes;
+    for (uint32_t i = 0; i < ps->count; i++) {
+        const float t = ps->age[i];
+        const float h = halfSize0 + halfSizeDelta * t;
+        float color[4];
+        for (int k = 0; k < 4; k++) {
+            color[k] = c->startColor[k] + colorDelta[k] * t;
+        }
+        v[0].position = BGLVector2Make(ps->x[i] - h, ps->y[i] - h);
+        v[1].position = BGLVector2Make(ps->x[i] + h, ps->y[i] - h);
+        v[2].position = BGLVector2Make(ps->x[i] - h, ps->y[i] + h);
+        v[3].position = BGLVector2Make(ps->x[i] + h, ps->y[i] + h);
+        for (int j = 0; j < 4; j++) {
+            memcpy(v[j].color, color, sizeof(color));
+        }
+        v += 4;
+    }
+    return v - vertexes;
+}
+
+
+void BGLParticleWriteQuadIndexes(uint16_t *indexes, uint32_t quadCount)
+{
+    for (uint32_t q = 0; q < quadCount; q++) {
+        uint16_t base = 4 * q;
+        indexes[0] = base;
+        indexes[1] = base + 1;
+        indexes[2] = base + 2;
+        indexes[3] = base + 2;
+        indexes[4] = base + 1;
+        indexes[5] = base + 3;
+        indexes += 6;
+    }
+}
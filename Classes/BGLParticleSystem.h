@@ -0,0 +1,84 @@
+/*
+ Simulation of a pool of short-lived particles for BGLParticleEmitter.
+
+ Particle state is kept as parallel arrays (x, y, vx, vy, age, ageRate)
+ holding only live particles, so one step is a single pass of multiply-adds
+ over dense floats, four particles at a time with NEON. A particle's age
+ runs from 0 at birth to 1 at death; size and color are interpolated from
+ it when vertexes are written rather than stored. Dead particles are
+ replaced by the last live one, so the arrays stay packed without shifting.
+
+ Vertexes are written as one quad (four vertexes) per particle, to be drawn
+ as indexed triangles; BGLParticleWriteQuadIndexes fills a matching index
+ array once. kBGLParticleCountMax keeps every index within 16 bits.
+
+ This is plain C with no GL calls.
+ */
+
+#ifndef BGLPARTICLESYSTEM_H
+#define BGLPARTICLESYSTEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BGLMatrix.h"
+
+
+#define kBGLParticleCountMax 16384
+
+
+typedef struct {
+    float spawnRate;            // particles per second while emitting
+    float life;                 // seconds
+    float lifeVariance;         // +/- seconds
+    BGLVector2 positionVariance; // +/- around the emitter origin
+    BGLVector2 velocity;
+    BGLVector2 velocityVariance;
+    BGLVector2 acceleration;
+    float startSize;
+    float endSize;
+    float startColor[4];
+    float endColor[4];
+} BGLParticleConfig;
+
+
+typedef struct {
+    BGLVector2 position;
+    float color[4];
+} BGLParticleVertex;
+
+
+typedef struct {
+    float *x;
+    float *y;
+    float *vx;
+    float *vy;
+    float *age;                 // 0 at birth, 1 at death
+    float *ageRate;             // 1 / life
+    uint32_t count;             // live particles, packed at the front
+    uint32_t capacity;          // spawns beyond this are dropped
+    BGLParticleConfig config;
+    float spawnDebt;            // fraction of a particle owed by earlier steps
+    uint32_t random;
+} BGLParticleSystem;
+
+
+void BGLParticleConfigLoadDefaults(BGLParticleConfig *c);
+
+void BGLParticleSystemInit(BGLParticleSystem *ps, uint32_t capacity, const BGLParticleConfig *config);
+void BGLParticleSystemFree(BGLParticleSystem *ps);
+void BGLParticleSystemReset(BGLParticleSystem *ps);
+void BGLParticleSystemSeed(BGLParticleSystem *ps, uint32_t seed);
+
+// Returns the number actually spawned, which is less when the pool is full.
+uint32_t BGLParticleSystemSpawn(BGLParticleSystem *ps, uint32_t n);
+// Ages and moves every particle by dt, drops the dead, then spawns at the
+// configured rate if emitting.
+void BGLParticleSystemStep(BGLParticleSystem *ps, float dt, int emitting);
+
+// Writes 4 * count vertexes; returns the count written.
+size_t BGLParticleSystemWriteVertexes(const BGLParticleSystem *ps, BGLParticleVertex *vertexes);
+// Writes 6 * quadCount indexes for quads laid out as above.
+void BGLParticleWriteQuadIndexes(uint16_t *indexes, uint32_t quadCount);
+
+
+#endif
@@ -10,6 +10,10 @@
 #import "BGLNode.h"
 #import "BGLUtilities.h"
 #import "BGLMatrix.h"
+#import "BGLMeshBuilder.h"
+
+
+@class BGLMesh;
 
 
 typedef struct {
@@ -19,13 +23,21 @@ typedef struct {
 
 
 @interface BGLPolygon : BGLNode {
-    NSMutableData *vertexData;
+    NSData *vertexData; // mutable unless supplied by the caller
     BGLPolygonVertex nextVertex;
     GLenum mode;
+    BGLVertexLayout vertexLayout;
+    BGLMesh *packedMesh; // built on demand unless the layout is float
 }
 + (BGLPolygon *)polygonWithRect:(CGRect)rect color:(BGLColor)color;
 + (BGLPolygon *)polygonWithRect:(CGRect)rect topColor:(BGLColor)topColor bottomColor:(BGLColor)bottomColor;
 @property (nonatomic) GLenum mode;
+// How it's drawn; vertexes are always float. A half layout the GPU lacks
+// becomes float/ubyte, and any layout float if the vertexes don't fit it.
+@property (nonatomic) BGLVertexLayout vertexLayout;
+- (id)initWithVertexData:(NSData *)data mode:(GLenum)aMode;
 - (void)setColor:(BGLColor)color;
 - (void)addVertexAtPosition:(BGLVector2)position;
+- (const BGLPolygonVertex *)vertexes;
+- (NSUInteger)vertexCount;
 @end
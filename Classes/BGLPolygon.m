@@ -7,8 +7,15 @@
 //
 
 #import "BGLPolygon.h"
-#import "BGLManifest.h"
+#import "BGLProgramBindings.h"
 #import "BGLProgram.h"
+#import "BGLMesh.h"
+
+
+@interface BGLPolygon ()
+- (void)invalidatePackedMesh;
+- (BGLMesh *)packedMesh;
+@end
 
 
 @implementation BGLPolygon
@@ -34,27 +41,88 @@
 
 
 @synthesize mode;
+@synthesize vertexLayout;
 
 
-- (id)init
+- (id)initWithVertexData:(NSData *)data mode:(GLenum)aMode
 {
     if ((self = [super init])) {
         self.program = [BGLProgram programNamed:@"Polygon"];
-        mode = GL_TRIANGLE_STRIP;
-        vertexData = [[NSMutableData alloc] init];
+        mode = aMode;
+        vertexData = [data retain];
         nextVertex.color = BGLColorWhite;
     }
     return self;
 }
 
 
+- (id)init
+{
+    NSMutableData *data = [[NSMutableData alloc] init];
+    self = [self initWithVertexData:data mode:GL_TRIANGLE_STRIP];
+    [data release];
+    return self;
+}
+
+
 - (void)dealloc
 {
     [vertexData release];
+    [packedMesh release];
     [super dealloc];
 }
 
 
+- (void)setMode:(GLenum)aMode
+{
+    mode = aMode;
+    [self invalidatePackedMesh];
+    [self setNeedsDisplay];
+}
+
+
+- (void)setVertexLayout:(BGLVertexLayout)layout
+{
+    if (! [BGLMesh supportsLayout:layout]) {
+        // Fixed point would be the same size, but could lose precision or range.
+        DLog(@"Vertex layout %d unsupported; using float positions, ubyte colors", layout);
+        layout = kBGLVertexLayoutFloatUByte;
+    }
+    vertexLayout = layout;
+    [self invalidatePackedMesh];
+    [self setNeedsDisplay];
+}
+
+
+- (void)invalidatePackedMesh
+{
+    [packedMesh release];
+    packedMesh = nil;
+}
+
+
+- (BGLMesh *)packedMesh
+{
+    // Other modes (lines, points) always draw from the float vertexes.
+    if (packedMesh == nil && vertexLayout != kBGLVertexLayoutFloat &&
+        (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLES || mode == GL_TRIANGLE_FAN)) {
+        BGLPrimitive primitive = ((mode == GL_TRIANGLE_STRIP) ? kBGLPrimitiveTriangleStrip :
+                                  (mode == GL_TRIANGLE_FAN) ? kBGLPrimitiveTriangleFan : kBGLPrimitiveTriangles);
+        BGLMeshBuilder builder;
+        BGLMeshBuilderInit(&builder, vertexLayout, primitive);
+        if (BGLMeshBuilderAdd(&builder, (const BGLMeshVertex *)[self vertexes], [self vertexCount], primitive, NULL)) {
+            packedMesh = [[BGLMesh alloc] initWithBuilder:&builder];
+        } else {
+            // Out of the layout's range; draw the float vertexes from now on.
+            DLog(@"Vertexes don't fit layout %d; drawing them as floats", vertexLayout);
+            vertexLayout = kBGLVertexLayoutFloat;
+        }
+        BGLMeshBuilderFree(&builder);
+    }
+    return packedMesh;
+}
+
+
 - (void)setColor:(BGLColor)color
 {
     nextVertex.color = color;
@@ -64,25 +132,94 @@
 - (void)addVertexAtPosition:(BGLVector2)position
 {
     nextVertex.position = position;
-    [vertexData appendBytes:(const void *)&nextVertex 
-                     length:sizeof(BGLPolygonVertex)];
+    if (! [vertexData isKindOfClass:[NSMutableData class]]) {
+        NSData *data = vertexData;
+        vertexData = [data mutableCopy];
+        [data release];
+    }
+    [(NSMutableData *)vertexData appendBytes:(const void *)&nextVertex 
+                                      length:sizeof(BGLPolygonVertex)];
+    [self invalidatePackedMesh];
+    [self setNeedsDisplay];
+}
+
+
+- (const BGLPolygonVertex *)vertexes
+{
+    return [vertexData bytes];
+}
+
+
+- (NSUInteger)vertexCount
+{
+    return [vertexData length] / sizeof(BGLPolygonVertex);
 }
 
 
 #pragma mark Renderable
 
 
+- (BOOL)getDrawBounds:(CGRect *)bounds
+{
+    // Lines and points may spill past their vertexes.
+    NSUInteger count = [self vertexCount];
+    if (count == 0 || (mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLES && mode != GL_TRIANGLE_FAN)) return NO;
+    const BGLPolygonVertex *v = [self vertexes];
+    float minX = v[0].position.x, maxX = minX;
+    float minY = v[0].position.y, maxY = minY;
+    for (NSUInteger i = 1; i < count; i++) {
+        minX = MIN(minX, v[i].position.x); maxX = MAX(maxX, v[i].position.x);
+        minY = MIN(minY, v[i].position.y); maxY = MAX(maxY, v[i].position.y);
+    }
+    *bounds = CGRectMake(minX, minY, maxX - minX, maxY - minY);
+    return YES;
+}
+
+
+- (BOOL)getOpaqueRect:(CGRect *)rect
+{
+    // Drawn without blending, so opaque wherever it draws; but only a quad
+    // covering its whole bounding box has an opaque rect.
+    if ([self vertexCount] != 4 || ! [self getDrawBounds:rect]) return NO;
+    if (mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLE_FAN) return NO;
+    const BGLPolygonVertex *v = [self vertexes];
+    int corners[4], seen = 0;
+    for (int i = 0; i < 4; i++) {
+        BOOL atMinX = (v[i].position.x == CGRectGetMinX(*rect)), atMaxX = (v[i].position.x == CGRectGetMaxX(*rect));
+        BOOL atMinY = (v[i].position.y == CGRectGetMinY(*rect)), atMaxY = (v[i].position.y == CGRectGetMaxY(*rect));
+        if (! (atMinX || atMaxX) || ! (atMinY || atMaxY)) return NO;
+        corners[i] = (atMaxX ? 1 : 0) | (atMaxY ? 2 : 0);
+        seen |= 1 << corners[i];
+    }
+    // Each triangle pair must split the quad along a diagonal.
+    int a = corners[0], b = (mode == GL_TRIANGLE_STRIP) ? corners[3] : corners[2];
+    return (seen == 0xF && (a ^ b) == 3 && ! CGRectIsEmpty(*rect));
+}
+
+
+- (float)contentScale
+{
+    BGLMesh *mesh = [self packedMesh];
+    return mesh ? mesh.positionScale : 1;
+}
+
+
 - (void)render
 {
+    if (packedMesh) {
+        [packedMesh render];
+        return;
+    }
+    
     glDisable(GL_BLEND);
     glDisable(GL_DEPTH_TEST);
     
     const BGLPolygonVertex *data = [vertexData bytes];
     
-    glVertexAttribPointer(sha_Polygon_vertexPosition, 2, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &data->position);
-    glEnableVertexAttribArray(sha_Polygon_vertexPosition);
-    glVertexAttribPointer(sha_Polygon_vertexColor, 3, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &data->color);
-    glEnableVertexAttribArray(sha_Polygon_vertexColor);
+    glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &data->position);
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexPosition);
+    glVertexAttribPointer(kBGLPolygonAttributeVertexColor, 3, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &data->color);
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexColor);
     
     DAssert([self.program validate], @"Failed to validate program.");
     
@@ -0,0 +1,47 @@
+//
+//  BGLPolygonBatch.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLNode.h"
+#import "BGLPolygon.h"
+#import "BGLUtilities.h"
+#import "BGLMatrix.h"
+
+
+typedef struct {
+    BGLColor color;     // multiplied with the vertex colors
+    BGLMatrix matrix;   // relative to the batch node
+} BGLPolygonInstance;
+
+
+/*
+ Draws many copies of one polygon, each with its own transform and color, in
+ a single draw call. Where EXT_instanced_arrays is available the copies are
+ drawn with glDrawArraysInstancedEXT and the InstancedPolygon program, which
+ expects attributes in the order vertexPosition, vertexColor, instanceColor,
+ instanceMatrix (the matrix takes four consecutive locations, so it has to
+ come last). Elsewhere the copies are transformed on the CPU into one vertex
+ array and drawn with the Polygon program; that array is only rebuilt when an
+ instance changes.
+ 
+ Prototype polygons must use GL_TRIANGLES or GL_TRIANGLE_STRIP.
+ */
+
+@interface BGLPolygonBatch : BGLNode {
+    NSData *prototypeData;
+    GLenum mode;
+    NSMutableData *instanceData;
+    NSMutableData *expandedData;
+    BOOL instanced;
+    BOOL expandedDataIsStale;
+}
++ (BOOL)supportsInstancing;
+- (id)initWithPolygon:(BGLPolygon *)polygon;
+@property (nonatomic,readonly) NSUInteger instanceCount;
+- (NSUInteger)addInstanceWithMatrix:(BGLMatrix)matrix color:(BGLColor)color;
+- (void)setMatrix:(BGLMatrix)matrix forInstanceAtIndex:(NSUInteger)index;
+- (void)setColor:(BGLColor)color forInstanceAtIndex:(NSUInteger)index;
+- (void)removeAllInstances;
+@end
@@ -0,0 +1,214 @@
+//
+//  BGLPolygonBatch.m
+//  FingerPaintBall
+//
+
+#import "BGLPolygonBatch.h"
+#import "BGLProgram.h"
+
+#import "BGLProgramBindings.h"
+
+
+@implementation BGLPolygonBatch
+
+
++ (BOOL)supportsInstancing
+{
+    static int supported = -1;
+    if (supported < 0) {
+        const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+        supported = (extensions && strstr(extensions, "GL_EXT_instanced_arrays")) ? 1 : 0;
+    }
+    return supported;
+}
+
+
+- (id)initWithPolygon:(BGLPolygon *)polygon
+{
+    if ((self = [super init])) {
+        mode = polygon.mode;
+        DAssert(mode == GL_TRIANGLES || mode == GL_TRIANGLE_STRIP, @"Unsupported polygon mode %d", mode);
+        prototypeData = [[NSData alloc] initWithBytes:[polygon vertexes]
+                                               length:[polygon vertexCount] * sizeof(BGLPolygonVertex)];
+        instanceData = [[NSMutableData alloc] init];
+        instanced = [BGLPolygonBatch supportsInstancing];
+        if (instanced) {
+            self.program = [BGLProgram programNamed:@"InstancedPolygon"];
+        } else {
+            self.program = [BGLProgram programNamed:@"Polygon"];
+            expandedData = [[NSMutableData alloc] init];
+        }
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    [prototypeData release];
+    [instanceData release];
+    [expandedData release];
+    [super dealloc];
+}
+
+
+- (NSUInteger)instanceCount
+{
+    return [instanceData length] / sizeof(BGLPolygonInstance);
+}
+
+
+- (BGLPolygonInstance *)instanceAtIndex:(NSUInteger)index
+{
+    DAssert(index < self.instanceCount, @"Instance index %d out of range", index);
+    return &((BGLPolygonInstance *)[instanceData mutableBytes])[index];
+}
+
+
+- (NSUInteger)addInstanceWithMatrix:(BGLMatrix)matrix color:(BGLColor)color
+{
+    BGLPolygonInstance instance;
+    instance.color = color;
+    BGLMatrixCopy(instance.matrix, matrix);
+    [instanceData appendBytes:&instance length:sizeof(BGLPolygonInstance)];
+    expandedDataIsStale = YES;
+    [self setNeedsDisplay];
+    return self.instanceCount - 1;
+}
+
+
+- (void)setMatrix:(BGLMatrix)matrix forInstanceAtIndex:(NSUInteger)index
+{
+    BGLMatrixCopy([self instanceAtIndex:index]->matrix, matrix);
+    expandedDataIsStale = YES;
+    [self setNeedsDisplay];
+}
+
+
+- (void)setColor:(BGLColor)color forInstanceAtIndex:(NSUInteger)index
+{
+    [self instanceAtIndex:index]->color = color;
+    expandedDataIsStale = YES;
+    [self setNeedsDisplay];
+}
+
+
+- (void)removeAllInstances
+{
+    [instanceData setLength:0];
+    expandedDataIsStale = YES;
+    [self setNeedsDisplay];
+}
+
+
+#pragma mark Rendering
+
+
+- (void)renderInstanced
+{
+    const BGLPolygonVertex *vertexes = [prototypeData bytes];
+    const BGLPolygonInstance *instances = [instanceData bytes];
+    const GLsizei vertexCount = [prototypeData length] / sizeof(BGLPolygonVertex);
+    const GLsizei instanceCount = self.instanceCount;
+    
+    glVertexAttribPointer(kBGLInstancedPolygonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &vertexes->position);
+    glEnableVertexAttribArray(kBGLInstancedPolygonAttributeVertexPosition);
+    glVertexAttribPointer(kBGLInstancedPolygonAttributeVertexColor, 3, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &vertexes->color);
+    glEnableVertexAttribArray(kBGLInstancedPolygonAttributeVertexColor);
+    
+    glVertexAttribPointer(kBGLInstancedPolygonAttributeInstanceColor, 4, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonInstance), &instances->color);
+    glEnableVertexAttribArray(kBGLInstancedPolygonAttributeInstanceColor);
+    glVertexAttribDivisorEXT(kBGLInstancedPolygonAttributeInstanceColor, 1);
+    for (int column = 0; column < 4; column++) {
+        GLuint location = kBGLInstancedPolygonAttributeInstanceMatrix + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonInstance), &instances->matrix[4 * column]);
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisorEXT(location, 1);
+    }
+    
+    glDrawArraysInstancedEXT(mode, 0, vertexCount, instanceCount);
+    
+    // Attribute locations are shared by every program; leave them per-vertex
+    // and disabled for the next node.
+    glVertexAttribDivisorEXT(kBGLInstancedPolygonAttributeInstanceColor, 0);
+    glDisableVertexAttribArray(kBGLInstancedPolygonAttributeInstanceColor);
+    for (int column = 0; column < 4; column++) {
+        GLuint location = kBGLInstancedPolygonAttributeInstanceMatrix + column;
+        glVertexAttribDivisorEXT(location, 0);
+        glDisableVertexAttribArray(location);
+    }
+}
+
+
+- (void)rebuildExpandedData
+{
+    const BGLPolygonVertex *vertexes = [prototypeData bytes];
+    const BGLPolygonInstance *instances = [instanceData bytes];
+    const NSUInteger vertexCount = [prototypeData length] / sizeof(BGLPolygonVertex);
+    const NSUInteger instanceCount = self.instanceCount;
+    
+    // Strips are stitched together by repeating the last vertex of one copy
+    // and the first of the next, which produces degenerate triangles.
+    const BOOL strip = (mode == GL_TRIANGLE_STRIP);
+    const NSUInteger perInstance = strip ? vertexCount + 2 : vertexCount;
+    
+    [expandedData setLength:perInstance * instanceCount * sizeof(BGLPolygonVertex)];
+    BGLPolygonVertex *out = [expandedData mutableBytes];
+    
+    for (NSUInteger i = 0; i < instanceCount; i++) {
+        const BGLPolygonInstance *inst = &instances[i];
+        BGLPolygonVertex *first = out;
+        if (strip) out++;
+        for (NSUInteger j = 0; j < vertexCount; j++) {
+            BGLVector3 p = BGLMatrixApplyTransform(inst->matrix, BGLVector3Make(vertexes[j].position.x, vertexes[j].position.y, 0));
+            out->position = BGLVector2Make(p.x, p.y);
+            out->color = BGLColorMultiply(vertexes[j].color, inst->color);
+            out++;
+        }
+        if (strip) {
+            *first = first[1];
+            *out = out[-1];
+            out++;
+        }
+    }
+    expandedDataIsStale = NO;
+}
+
+
+- (void)renderExpanded
+{
+    if (expandedDataIsStale) {
+        [self rebuildExpandedData];
+    }
+    
+    const BGLPolygonVertex *data = [expandedData bytes];
+    
+    glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &data->position);
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexPosition);
+    glVertexAttribPointer(kBGLPolygonAttributeVertexColor, 3, GL_FLOAT, GL_FALSE, sizeof(BGLPolygonVertex), &data->color);
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexColor);
+    
+    GLenum drawMode = (mode == GL_TRIANGLE_STRIP) ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    glDrawArrays(drawMode, 0, [expandedData length] / sizeof(BGLPolygonVertex));
+}
+
+
+#pragma mark BGLNode
+
+
+- (void)render
+{
+    if (self.instanceCount == 0) return;
+    
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    
+    if (instanced) {
+        [self renderInstanced];
+    } else {
+        [self renderExpanded];
+    }
+}
+
+
+@end
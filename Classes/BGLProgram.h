@@ -10,8 +10,10 @@
 
 #import <OpenGLES/ES2/gl.h>
 #import <OpenGLES/ES2/glext.h>
+#import "BGLGLDispatch.h"
 
 #import "BGLMatrix.h"
+#import "BGLDrawRecorder.h"
 
 extern GLint *SHU;
 
@@ -22,6 +24,7 @@ extern GLint *SHU;
 
 @interface BGLProgram : NSObject {
     GLuint name;
+    NSString *programName;
     NSMutableArray *shadersArray;
     BGLMatrix projectionMatrix;
     GLint projectionMatrixUniformLocation;
@@ -29,8 +32,18 @@ extern GLint *SHU;
     GLint modelViewProjectionMatrixUniformLocation;
 }
 + (BOOL)loadManifestNamed:(NSString *)manifestName;
-+ (GLuint)textureNamed:(NSString *)textureName;
++ (GLuint)textureNamed:(NSString *)textureName; // call per use if texture is Evictable
+// Pins a texture returned by +textureNamed: so it can't be evicted, and its
+// name go stale, while something holds on to it. Unknown names are ignored.
++ (void)retainTexture:(GLuint)texture;
++ (void)releaseTexture:(GLuint)texture;
 + (BGLProgram *)programNamed:(NSString *)programName;
+// Goes up whenever any program's projection changes, so that anything
+// cached from a render can tell it was made with another projection.
++ (NSUInteger)projectionChangeCount;
++ (uint32_t)getDrawProjections:(BGLDrawProjection *)projections max:(uint32_t)max; // of loaded programs, for recording
+@property (nonatomic,readonly) GLuint name;
+@property (nonatomic,readonly) NSString *programName; // as given in the manifest
 - (void)attachShader:(BGLShader *)shader;
 - (void)bindAttributeLocation:(GLuint)location toName:(const GLchar *)str;
 - (BOOL)link;
@@ -41,6 +54,9 @@ extern GLint *SHU;
 - (GLint)attributeLocationNamed:(const GLchar *)str;
 - (GLint)uniformLocationNamed:(const GLchar *)str;
 - (NSString *)infoLog;
+- (void)getProjectionMatrix:(BGLMatrix)matrix;
 - (void)setProjectionMatrix:(BGLMatrix)matrix;
 - (void)applyUniformsFromState:(BGLRenderState *)state;
+// Subclasses with more uniforms override this; the above calls it.
+- (void)applyModelViewMatrix:(const BGLMatrix)modelView modelViewProjectionMatrix:(const BGLMatrix)modelViewProjection;
 @end
@@ -11,20 +11,156 @@
 #import "BGLUtilities.h"
 #import "BGLRenderState.h"
 #import "BGLTexture.h"
+#import "BGLTextureContainer.h"
+#import "BGLResourceRegistry.h"
+#import "BGLProgramBindings.h"
 
 
 static NSDictionary *loadedPrograms = nil;
 static NSMutableDictionary *loadedVertexShaders = nil;
 static NSMutableDictionary *loadedFragmentShaders = nil;
 static NSMutableDictionary *loadedTextures = nil;
+static NSUInteger projectionChangeCount = 0;
 
 
 GLint *SHU = nil;
 
 
+// Texture bookkeeping for the resource registry. Textures the manifest marks
+// Evictable (and gives a Width and Height for) may be unloaded under memory
+// pressure and are reloaded by +textureNamed:; all others stay resident.
+// A texture loaded from a compressed variant remembers the file it came from.
+
+@interface BGLTextureResource : NSObject {
+@public
+    NSString *name;
+    NSString *path;
+    GLenum format;
+    GLuint texture;
+    size_t bytes;
+    BGLResourceID resourceID;
+}
+@end
+
+
+@implementation BGLTextureResource
+
+- (void)dealloc
+{
+    [name release];
+    [path release];
+    [super dealloc];
+}
+
+@end
+
+
+static GLuint BGLTextureLoadContainerAtPath(NSString *path, size_t *outBytes)
+{
+    NSData *data = [[NSData alloc] initWithContentsOfFile:path options:NSDataReadingMapped error:NULL];
+    BGLTextureContainer c;
+    if (data == nil || ! BGLTextureContainerParse([data bytes], [data length], &c)) {
+        [data release];
+        return 0;
+    }
+    
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (uint32_t i = 0; i < c.levelCount; i++) {
+        const BGLTextureLevel *level = &c.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, c.format, level->width, level->height, 0,
+                               level->size, (const uint8_t *)[data bytes] + level->offset);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (c.levelCount > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    [data release];
+    
+    if (glGetError() != GL_NO_ERROR) {
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    if (outBytes) *outBytes = c.dataSize;
+    return texture;
+}
+
+
+// Returns the path of the first variant whose compressed format the GL
+// supports, or nil to use the uncompressed image. Only headers are read.
+static NSString *BGLTextureSelectVariantPath(NSArray *variants, const char *extensions)
+{
+    NSUInteger count = [variants count];
+    if (count == 0) return nil;
+    
+    NSMutableArray *paths = [NSMutableArray arrayWithCapacity:count];
+    uint32_t formats[count];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString *file = [[variants objectAtIndex:i] objectForKey:@"File"];
+        NSString *path = [[NSBundle mainBundle] pathForResource:file ofType:nil];
+        NSData *data = path ? [[NSData alloc] initWithContentsOfFile:path options:NSDataReadingMapped error:NULL] : nil;
+        BGLTextureContainer c;
+        formats[i] = (data && BGLTextureContainerParse([data bytes], [data length], &c)) ? c.format : 0;
+        [data release];
+        [paths addObject:(path ? path : (id)[NSNull null])];
+        if (formats[i] == 0) DLog(@"Texture variant %@ is missing or unreadable", file);
+    }
+    
+    int index = BGLTextureSelectVariant(formats, count, extensions);
+    return (index < 0) ? nil : [paths objectAtIndex:index];
+}
+
+
+static void BGLTextureResourceUnload(void *info)
+{
+    BGLTextureResource *tr = (BGLTextureResource *)info;
+    glDeleteTextures(1, &tr->texture);
+    tr->texture = 0;
+}
+
+
+static size_t BGLTextureResourceReload(void *info)
+{
+    BGLTextureResource *tr = (BGLTextureResource *)info;
+    if (tr->path) {
+        tr->texture = BGLTextureLoadContainerAtPath(tr->path, NULL);
+    } else {
+        tr->texture = BGLTextureLoadByName((CFStringRef)tr->name, tr->format);
+    }
+    return tr->texture ? tr->bytes : 0;
+}
+
+
+static const BGLResourceCallbacks kTextureCallbacks = {
+    BGLTextureResourceUnload,
+    BGLTextureResourceReload
+};
+
+
+static size_t BGLTextureBytesPerPixel(GLenum format)
+{
+    switch (format) {
+        case GL_ALPHA:
+        case GL_LUMINANCE:
+            return 1;
+        case GL_LUMINANCE_ALPHA:
+            return 2;
+        case GL_RGB:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+
 @implementation BGLProgram
 
 
+@synthesize name;
+@synthesize programName;
+
+
 + (BGLShader *)vertexShaderNamed:(NSString *)name
 {
     BGLShader *shader = [loadedVertexShaders objectForKey:name];
@@ -73,12 +209,48 @@ GLint *SHU = nil;
 
     NSMutableDictionary *loaded = [NSMutableDictionary dictionary];
     
+    BGLResourceRegistryRef registry = BGLResourceRegistryGetDefault();
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    
+    // A texture may list compressed Variants (each a dictionary with a File
+    // key naming a .ktx or .pvr resource), best first; the first one whose
+    // format this GL supports is used, and the Name/Format image otherwise.
+    
     for (NSDictionary *txInfo in [manifest objectForKey:@"Textures"]) {
         NSString *name = [txInfo objectForKey:@"Name"];
         GLenum format = [[txInfo objectForKey:@"Format"] unsignedIntValue];
-        GLuint t = BGLTextureLoadByName((CFStringRef)name, format);
+        NSString *variantPath = BGLTextureSelectVariantPath([txInfo objectForKey:@"Variants"], extensions);
+        size_t compressedBytes = 0;
+        GLuint t = 0;
+        if (variantPath) {
+            t = BGLTextureLoadContainerAtPath(variantPath, &compressedBytes);
+            if (t == 0) {
+                DLog(@"Couldn't load %@; using uncompressed texture %@", variantPath, name);
+                variantPath = nil;
+            }
+        }
+        if (t == 0) {
+            t = BGLTextureLoadByName((CFStringRef)name, format);
+        }
         if (t) {
-            [loaded setObject:[NSNumber numberWithUnsignedInt:t] forKey:name];
+            BGLTextureResource *tr = [[BGLTextureResource alloc] init];
+            tr->name = [name copy];
+            tr->path = [variantPath copy];
+            tr->format = format;
+            tr->texture = t;
+            if (variantPath) {
+                tr->bytes = compressedBytes;
+            } else {
+                tr->bytes = ([[txInfo objectForKey:@"Width"] unsignedIntValue] *
+                             [[txInfo objectForKey:@"Height"] unsignedIntValue] *
+                             BGLTextureBytesPerPixel(format));
+            }
+            tr->resourceID = BGLResourceRegister(registry, kBGLResourceTexture, [name UTF8String],
+                                                 tr->bytes, &kTextureCallbacks, tr);
+            BOOL evictable = [[txInfo objectForKey:@"Evictable"] boolValue] && tr->bytes > 0;
+            BGLResourceSetResident(registry, tr->resourceID, !evictable);
+            [loaded setObject:tr forKey:name];
+            [tr release];
         } else {
             [NSException raise:@"BGLProgramException"
                         format:@"Couldn't load texture %@", name];
@@ -113,6 +285,7 @@ GLint *SHU = nil;
         } else {
             program = [[BGLProgram alloc] init];
         }
+        program->programName = [programName copy];
         [program attachShader:[self vertexShaderNamed:vshName]];
         [program attachShader:[self fragmentShaderNamed:fshName]];
         // Bind Attribute Locations
@@ -127,7 +300,11 @@ GLint *SHU = nil;
             for (NSString *unifName in uniformNames) {
                 SHU[unifLoc++] = [program uniformLocationNamed:[unifName UTF8String]];
             }
+            BGLProgramBindingsResolve([programName UTF8String], program->name);
             [loaded setObject:program forKey:programName];
+            BGLResourceID rid = BGLResourceRegister(registry, kBGLResourceProgram, [programName UTF8String],
+                                                    0, NULL, program);
+            BGLResourceSetResident(registry, rid, 1);
         } else {
             DLog(@"Failed to load program %@", programName);
             [program release];
@@ -144,9 +321,34 @@ GLint *SHU = nil;
 
 + (GLuint)textureNamed:(NSString *)textureName
 {
-    NSNumber *n = [loadedTextures objectForKey:textureName];
-    ZAssert(n, @"No such texture named '%@'", textureName);
-    return [n unsignedIntValue];
+    BGLTextureResource *tr = [loadedTextures objectForKey:textureName];
+    ZAssert(tr, @"No such texture named '%@'", textureName);
+    if (! BGLResourceTouch(BGLResourceRegistryGetDefault(), tr->resourceID)) {
+        ALog(@"Failed to reload texture '%@'", textureName);
+    }
+    return tr->texture;
+}
+
+
++ (void)retainTexture:(GLuint)texture
+{
+    for (BGLTextureResource *tr in [loadedTextures objectEnumerator]) {
+        if (tr->texture == texture) {
+            BGLResourceRetain(BGLResourceRegistryGetDefault(), tr->resourceID);
+            return;
+        }
+    }
+}
+
+
++ (void)releaseTexture:(GLuint)texture
+{
+    for (BGLTextureResource *tr in [loadedTextures objectEnumerator]) {
+        if (tr->texture == texture) {
+            BGLResourceRelease(BGLResourceRegistryGetDefault(), tr->resourceID);
+            return;
+        }
+    }
 }
 
 
@@ -158,6 +360,25 @@ GLint *SHU = nil;
 }
 
 
++ (NSUInteger)projectionChangeCount
+{
+    return projectionChangeCount;
+}
+
+
++ (uint32_t)getDrawProjections:(BGLDrawProjection *)projections max:(uint32_t)max
+{
+    uint32_t count = 0;
+    for (BGLProgram *program in [loadedPrograms objectEnumerator]) {
+        if (count == max) break;
+        projections[count].drawKey = program->name;
+        BGLMatrixCopy(projections[count].projection, program->projectionMatrix);
+        count += 1;
+    }
+    return count;
+}
+
+
 - (id)init
 {
     if ((self = [super init])) {
@@ -179,6 +400,7 @@ GLint *SHU = nil;
 - (void)dealloc
 {
     [shadersArray release];
+    [programName release];
     glDeleteProgram(name);
     [super dealloc];
 }
@@ -276,27 +498,41 @@ GLint *SHU = nil;
 }
 
 
+- (void)getProjectionMatrix:(BGLMatrix)matrix
+{
+    BGLMatrixCopy(matrix, projectionMatrix);
+}
+
+
 - (void)setProjectionMatrix:(BGLMatrix)matrix
 {
+    if (memcmp(projectionMatrix, matrix, sizeof(BGLMatrix)) == 0) return;
+    projectionChangeCount += 1;
     BGLMatrixCopy(projectionMatrix, matrix);
 }
 
 
 - (void)applyUniformsFromState:(BGLRenderState *)state
+{
+    BGLMatrix modelView, modelViewProjection;
+    [state getModelViewMatrix:modelView];
+    if (modelViewProjectionMatrixUniformLocation > -1) {
+        BGLMatrixMultiply(modelViewProjection, projectionMatrix, modelView);
+    }
+    [self applyModelViewMatrix:modelView modelViewProjectionMatrix:modelViewProjection];
+}
+
+
+- (void)applyModelViewMatrix:(const BGLMatrix)modelView modelViewProjectionMatrix:(const BGLMatrix)modelViewProjection
 {
     if (projectionMatrixUniformLocation > -1) {
         glUniformMatrix4fv(projectionMatrixUniformLocation, 1, GL_FALSE, projectionMatrix);
     }
-    if (modelViewMatrixUniformLocation > -1 || modelViewProjectionMatrixUniformLocation > -1) {
-        BGLMatrix matrix;
-        [state getModelViewMatrix:matrix];
-        if (modelViewMatrixUniformLocation > -1) {
-            glUniformMatrix4fv(modelViewMatrixUniformLocation, 1, GL_FALSE, matrix);
-        }
-        if (modelViewProjectionMatrixUniformLocation > -1) {
-            BGLMatrixMultiply(matrix, projectionMatrix, matrix);
-            glUniformMatrix4fv(modelViewProjectionMatrixUniformLocation, 1, GL_FALSE, matrix);
-        }
+    if (modelViewMatrixUniformLocation > -1) {
+        glUniformMatrix4fv(modelViewMatrixUniformLocation, 1, GL_FALSE, modelView);
+    }
+    if (modelViewProjectionMatrixUniformLocation > -1) {
+        glUniformMatrix4fv(modelViewProjectionMatrixUniformLocation, 1, GL_FALSE, modelViewProjection);
     }
 }
 
@@ -0,0 +1,55 @@
+//
+//  BGLRasterCache.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+
+#import <OpenGLES/ES2/gl.h>
+#import <OpenGLES/ES2/glext.h>
+#import "BGLGLDispatch.h"
+
+#import "BGLMatrix.h"
+#import "BGLOcclusion.h"
+
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int cacheCount;
+    size_t bytes;
+} BGLRasterCacheStats;
+
+
+/*
+ Offscreen framebuffer holding the rendered image of a node's subtree. Only
+ the pixels the subtree covers are kept: the caller passes their bounds, in
+ viewport pixels, and the image is drawn back as a quad over them. It stays
+ valid only as long as the transform, the programs' projections and the
+ viewport size it was rendered with. The texture only grows, so contents
+ that change size don't reallocate it every time.
+ */
+
+@interface BGLRasterCache : NSObject {
+    GLuint framebuffer;
+    GLuint texture;
+    GLint width;
+    GLint height;
+    GLint savedFramebuffer;
+    GLint savedViewport[4];
+    BGLMatrix matrix;
+    NSUInteger projectionChangeCount;
+    CGSize viewportSize;
+    BGLOcclusionRect pixelBounds; // whole pixels, within the viewport
+    BOOL valid;
+}
++ (void)getStatistics:(BGLRasterCacheStats *)stats;
++ (void)resetStatistics;
+- (void)invalidate;
+- (BOOL)isValidForMatrix:(const BGLMatrix)m viewportSize:(CGSize)size;
+// Returns NO if the bounds are empty; the cache is then valid and draws
+// nothing, and the caller renders nothing and skips -end.
+- (BOOL)beginWithMatrix:(const BGLMatrix)m viewportSize:(CGSize)size pixelBounds:(BGLOcclusionRect)bounds;
+- (void)end;
+- (void)draw; // with the viewport it was rendered for
+@end
@@ -0,0 +1,181 @@
+//
+//  BGLRasterCache.m
+//  FingerPaintBall
+//
+
+#import "BGLRasterCache.h"
+#import "BGLProgram.h"
+#import "BGLUtilities.h"
+
+#import "BGLProgramBindings.h"
+
+
+static BGLRasterCacheStats stats;
+
+
+@implementation BGLRasterCache
+
+
++ (void)getStatistics:(BGLRasterCacheStats *)outStats
+{
+    *outStats = stats;
+}
+
+
++ (void)resetStatistics
+{
+    stats.hits = 0;
+    stats.misses = 0;
+}
+
+
+- (id)init
+{
+    if ((self = [super init])) {
+        stats.cacheCount += 1;
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+    if (texture) glDeleteTextures(1, &texture);
+    stats.bytes -= width * height * 4;
+    stats.cacheCount -= 1;
+    [super dealloc];
+}
+
+
+- (void)invalidate
+{
+    valid = NO;
+}
+
+
+- (BOOL)isValidForMatrix:(const BGLMatrix)m viewportSize:(CGSize)size
+{
+    if (valid && memcmp(matrix, m, sizeof(BGLMatrix)) == 0 &&
+        projectionChangeCount == [BGLProgram projectionChangeCount] &&
+        CGSizeEqualToSize(viewportSize, size)) {
+        stats.hits += 1;
+        return YES;
+    }
+    stats.misses += 1;
+    return NO;
+}
+
+
+- (BOOL)beginWithMatrix:(const BGLMatrix)m viewportSize:(CGSize)size pixelBounds:(BGLOcclusionRect)bounds
+{
+    BGLMatrixCopy(matrix, m);
+    projectionChangeCount = [BGLProgram projectionChangeCount];
+    viewportSize = size;
+    pixelBounds.minX = floorf(bounds.minX);
+    pixelBounds.minY = floorf(bounds.minY);
+    pixelBounds.maxX = ceilf(bounds.maxX);
+    pixelBounds.maxY = ceilf(bounds.maxY);
+    
+    GLint w = pixelBounds.maxX - pixelBounds.minX;
+    GLint h = pixelBounds.maxY - pixelBounds.minY;
+    if (w <= 0 || h <= 0) {
+        valid = YES;
+        return NO;
+    }
+    
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    
+    if (framebuffer == 0) {
+        glGenFramebuffers(1, &framebuffer);
+        glGenTextures(1, &texture);
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    
+    if (w > width || h > height) {
+        stats.bytes -= width * height * 4;
+        width = MAX(w, width);
+        height = MAX(h, height);
+        stats.bytes += width * height * 4;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        DAssert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
+                @"Failed to make complete raster cache framebuffer %x", glCheckFramebufferStatus(GL_FRAMEBUFFER));
+    }
+    
+    // The projection still maps to the whole viewport; shift it so the
+    // bounds land at the texture's origin. Only they need clearing.
+    glViewport(-pixelBounds.minX, -pixelBounds.minY, size.width, size.height);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, w, h);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+    
+    // Accumulate premultiplied color and a proper alpha, so that the image
+    // composites the same way its contents would have.
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    return YES;
+}
+
+
+- (void)end
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    valid = YES;
+}
+
+
+- (void)draw
+{
+    if (pixelBounds.maxX <= pixelBounds.minX || pixelBounds.maxY <= pixelBounds.minY) return;
+    
+    // The bounds in clip space, and the part of the texture they were
+    // rendered to.
+    GLfloat x0 = 2 * pixelBounds.minX / viewportSize.width - 1;
+    GLfloat y0 = 2 * pixelBounds.minY / viewportSize.height - 1;
+    GLfloat x1 = 2 * pixelBounds.maxX / viewportSize.width - 1;
+    GLfloat y1 = 2 * pixelBounds.maxY / viewportSize.height - 1;
+    GLfloat tx = (pixelBounds.maxX - pixelBounds.minX) / width;
+    GLfloat ty = (pixelBounds.maxY - pixelBounds.minY) / height;
+    const GLfloat quad[] = {
+        // x, y, tx, ty
+        x0, y0, 0, 0,
+        x1, y0, tx, 0,
+        x0, y1, 0, ty,
+        x1, y1, tx, ty,
+    };
+    
+    [[BGLProgram programNamed:@"Rasterized"] use];
+    
+    glEnable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    BGLRasterizedSetSampler(0);
+    
+    glVertexAttribPointer(kBGLRasterizedAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, 
+                          4 * sizeof(GLfloat), &quad[0]);
+    glEnableVertexAttribArray(kBGLRasterizedAttributeVertexPosition);
+    glVertexAttribPointer(kBGLRasterizedAttributeVertexTexCoord, 2, GL_FLOAT, GL_FALSE, 
+                          4 * sizeof(GLfloat), &quad[2]);
+    glEnableVertexAttribArray(kBGLRasterizedAttributeVertexTexCoord);
+    
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+
+@end
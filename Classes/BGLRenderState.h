@@ -8,13 +8,28 @@
 
 #import <Foundation/Foundation.h>
 #import "BGLMatrix.h"
+#import "BGLOcclusion.h"
 
 
 @interface BGLRenderState : NSObject {
     BGLMatrix modelViewMatrix;
-    NSMutableData *matrixStack;
+    BGLMatrix *matrixStack;
+    NSUInteger stackSize;
+    NSUInteger stackCapacity;
+    float viewportWidth, viewportHeight;
+    CGPoint framebufferOrigin;
+    BGLOcclusionRect *clipStack;
+    NSUInteger clipDepth;
+    NSUInteger clipCapacity;
 }
+- (void)resetWithViewportWidth:(float)width height:(float)height;
 - (NSUInteger)stackSize;
+- (CGSize)viewportSize;
+// The viewport pixel at the bound framebuffer's origin: zero, but for a
+// raster cache, which holds only the part of the viewport its nodes cover.
+// Scissor rects must be offset by it.
+- (CGPoint)framebufferOrigin;
+- (void)setFramebufferOrigin:(CGPoint)origin;
 - (void)pushModelViewMatrix;
 - (void)popModelViewMatrix;
 - (void)getModelViewMatrix:(BGLMatrix)matrix;
@@ -24,4 +39,12 @@
 - (void)translateBy:(BGLVector3)vector;
 - (void)scaleBy:(BGLVector3)vector;
 - (void)rotateBy:(float)degrees about:(BGLVector3)vector;
+// Clip rects, in pixels; each pushed is intersected with the one below it,
+// see BGLOcclusionGetClipRect; an infinite rect clips no further. Making
+// the GL calls is up to the caller.
+- (void)pushClipRect:(CGRect)rect modelViewProjectionMatrix:(const BGLMatrix)mvp;
+- (void)pushUnclipped; // the whole viewport, whatever is below
+- (void)popClipRect;
+// Returns NO if nothing is clipped; pixels may be NULL.
+- (BOOL)getClipRect:(BGLOcclusionRect *)pixels;
 @end
@@ -7,6 +7,7 @@
 //
 
 #import "BGLRenderState.h"
+#import "BGLAccounting.h"
 
 
 @implementation BGLRenderState
@@ -16,7 +17,6 @@
 {
     if ((self = [super init])) {
         BGLMatrixLoadIdentity(modelViewMatrix);
-        matrixStack = [[NSMutableData alloc] init];
     }
     return self;
 }
@@ -24,7 +24,8 @@
 
 - (void)dealloc
 {
-    [matrixStack release];
+    free(matrixStack);
+    free(clipStack);
     [super dealloc];
 }
 
@@ -44,23 +45,56 @@
 }
 
 
+- (void)resetWithViewportWidth:(float)width height:(float)height
+{
+    // Keeps the stacks' storage, which is as deep as the deepest tree seen.
+    BGLMatrixLoadIdentity(modelViewMatrix);
+    stackSize = 0;
+    viewportWidth = width;
+    viewportHeight = height;
+    framebufferOrigin = CGPointZero;
+    clipDepth = 0;
+}
+
+
 - (NSUInteger)stackSize
 {
-    return [matrixStack length] / sizeof(BGLMatrix);
+    return stackSize;
+}
+
+
+- (CGSize)viewportSize
+{
+    return CGSizeMake(viewportWidth, viewportHeight);
+}
+
+
+- (CGPoint)framebufferOrigin
+{
+    return framebufferOrigin;
+}
+
+
+- (void)setFramebufferOrigin:(CGPoint)origin
+{
+    framebufferOrigin = origin;
 }
 
 
 - (void)pushModelViewMatrix
 {
-    [matrixStack appendBytes:modelViewMatrix length:sizeof(BGLMatrix)];
+    if (stackSize == stackCapacity) {
+        stackCapacity = stackCapacity ? 2 * stackCapacity : 16;
+        matrixStack = realloc(matrixStack, stackCapacity * sizeof(BGLMatrix));
+        BGLAccountAllocation(stackCapacity * sizeof(BGLMatrix));
+    }
+    BGLMatrixCopy(matrixStack[stackSize++], modelViewMatrix);
 }
 
 
 - (void)popModelViewMatrix
 {
-    NSInteger offset = [matrixStack length] - sizeof(BGLMatrix);
-    [matrixStack getBytes:modelViewMatrix range:NSMakeRange(offset, sizeof(BGLMatrix))];
-    [matrixStack setLength:offset];
+    BGLMatrixCopy(modelViewMatrix, matrixStack[--stackSize]);
 }
 
 
@@ -106,4 +140,54 @@
 }
 
 
+- (BGLOcclusionRect *)nextClipRect
+{
+    if (clipDepth == clipCapacity) {
+        clipCapacity = clipCapacity ? 2 * clipCapacity : 8;
+        clipStack = realloc(clipStack, clipCapacity * sizeof(BGLOcclusionRect));
+        BGLAccountAllocation(clipCapacity * sizeof(BGLOcclusionRect));
+    }
+    return &clipStack[clipDepth++];
+}
+
+
+- (void)pushClipRect:(CGRect)rect modelViewProjectionMatrix:(const BGLMatrix)mvp
+{
+    BGLOcclusionRect viewport = { 0, 0, viewportWidth, viewportHeight };
+    BGLOcclusionRect within = clipDepth ? clipStack[clipDepth - 1] : viewport;
+    BGLOcclusionRect *pixels = [self nextClipRect]; // may move the stack
+    if (CGRectIsInfinite(rect)) {
+        *pixels = within;
+    } else {
+        BGLOcclusionRect r = {
+            CGRectGetMinX(rect), CGRectGetMinY(rect), CGRectGetMaxX(rect), CGRectGetMaxY(rect)
+        };
+        BGLOcclusionGetClipRect(mvp, &r, viewportWidth, viewportHeight, &within, pixels);
+    }
+}
+
+
+- (void)pushUnclipped
+{
+    BGLOcclusionRect viewport = { 0, 0, viewportWidth, viewportHeight };
+    *[self nextClipRect] = viewport;
+}
+
+
+- (void)popClipRect
+{
+    clipDepth--;
+}
+
+
+- (BOOL)getClipRect:(BGLOcclusionRect *)pixels
+{
+    if (clipDepth == 0) return NO;
+    const BGLOcclusionRect *r = &clipStack[clipDepth - 1];
+    if (r->minX <= 0 && r->minY <= 0 && r->maxX >= viewportWidth && r->maxY >= viewportHeight) return NO;
+    if (pixels) *pixels = *r;
+    return YES;
+}
+
+
 @end
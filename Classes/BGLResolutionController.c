@@ -0,0 +1,51 @@
+/*
+ See BGLResolutionController.h.
+ */
+
+#include "BGLResolutionController.h"
+
+
+void BGLResolutionControllerInit(BGLResolutionController *c, float budget)
+{
+    c->budget = budget;
+    c->headroom = 0.7f;
+    c->minScale = 0.5f;
+    c->maxScale = 1.0f;
+    c->step = 0.125f;
+    c->smoothing = 0.1f;
+    c->cooldown = 30;
+    c->scale = 1.0f;
+    c->average = 0;
+    c->framesSinceChange = 0;
+}
+
+
+int BGLResolutionControllerUpdate(BGLResolutionController *c, float frameTime)
+{
+    if (c->average == 0) {
+        c->average = frameTime;
+    } else {
+        c->average += c->smoothing * (frameTime - c->average);
+    }
+    
+    c->framesSinceChange += 1;
+    if (c->framesSinceChange < c->cooldown) return 0;
+    
+    float scale = c->scale;
+    if (c->average > c->budget) {
+        scale -= c->step;
+    } else if (c->average < c->budget * c->headroom) {
+        scale += c->step;
+    }
+    if (scale < c->minScale) scale = c->minScale;
+    if (scale > c->maxScale) scale = c->maxScale;
+    
+    if (scale == c->scale) return 0;
+    
+    // Cost scales with pixel count, so predict the average at the new scale
+    // rather than waiting for it to decay.
+    c->average *= (scale * scale) / (c->scale * c->scale);
+    c->scale = scale;
+    c->framesSinceChange = 0;
+    return 1;
+}
@@ -0,0 +1,44 @@
+/*
+ Chooses an internal render scale from observed frame times.
+ 
+ Frame times are smoothed with an exponential moving average. When the
+ average exceeds the budget the scale drops by one step; when it stays below
+ budget * headroom the scale rises by one step. After any change the
+ controller waits `cooldown` frames before changing again, so that a single
+ slow frame or the cost of reallocating buffers doesn't cause oscillation.
+ 
+ What counts as a frame time is the caller's. ES2Renderer passes the CPU
+ time from the start of -renderRootNode: through presenting the renderbuffer,
+ not the GPU's frame time: GPU load only shows in it once the GPU falls far
+ enough behind to block the present, so the scale responds to a GPU-bound
+ scene late, if at all.
+
+ This is plain C; feed it synthetic frame times to exercise it headlessly.
+ */
+
+#ifndef BGLRESOLUTIONCONTROLLER_H
+#define BGLRESOLUTIONCONTROLLER_H
+
+
+typedef struct {
+    // Parameters
+    float budget;       // seconds per frame
+    float headroom;     // fraction of budget under which scale may rise
+    float minScale;
+    float maxScale;
+    float step;
+    float smoothing;    // weight of newest sample in the average, (0,1]
+    unsigned int cooldown;
+    // State
+    float scale;
+    float average;
+    unsigned int framesSinceChange;
+} BGLResolutionController;
+
+
+void BGLResolutionControllerInit(BGLResolutionController *c, float budget);
+// Returns nonzero if the scale changed.
+int BGLResolutionControllerUpdate(BGLResolutionController *c, float frameTime);
+
+
+#endif
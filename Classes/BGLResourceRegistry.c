@@ -0,0 +1,301 @@
+/*
+ See BGLResourceRegistry.h.
+ 
+ Entries live in a flat array. An ID is an entry's index + 1 in its low
+ bits and the entry's generation above them, so an unregistered entry goes
+ on a free list for the next registration without its old ID coming back to
+ name the new resource. Eviction scans for the oldest candidate each time;
+ with slots reused, the array is only as long as the most resources ever
+ registered at once, which is small enough that this beats maintaining a
+ separate LRU list.
+ */
+
+#include "BGLResourceRegistry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct {
+    BGLResourceType type;
+    char name[32];
+    size_t bytes;
+    unsigned int lastUsedFrame;
+    int refCount;
+    int resident;
+    int loaded;
+    int registered;
+    unsigned int generation;
+    unsigned int nextFree;
+    BGLResourceCallbacks callbacks;
+    void *info;
+} BGLResourceEntry;
+
+
+struct BGLResourceRegistry {
+    BGLResourceEntry *entries;
+    unsigned int count;         // entries below this are registered or free-listed
+    unsigned int capacity;
+    unsigned int freeHead;
+    unsigned int frame;
+    size_t budget;
+    size_t loadedBytes;
+    unsigned int evictionCount;
+    unsigned int reloadCount;
+};
+
+
+#define kIndexBits 20
+#define kIndexMask ((1u << kIndexBits) - 1)
+#define kGenerationMax ((1u << (32 - kIndexBits)) - 1)
+#define kNone 0xFFFFFFFFu
+
+
+static const char *kTypeNames[kBGLResourceTypeCount] = {
+    "texture", "buffer", "font", "program"
+};
+
+
+static inline BGLResourceEntry *BGLResourceEntryGet(BGLResourceRegistryRef reg, BGLResourceID rid)
+{
+    unsigned int index = rid & kIndexMask;
+    if (index == 0 || index > reg->count) return NULL;
+    BGLResourceEntry *e = &reg->entries[index - 1];
+    return (e->registered && e->generation == rid >> kIndexBits) ? e : NULL;
+}
+
+
+static inline int BGLResourceEntryIsEvictable(const BGLResourceEntry *e)
+{
+    return e->registered && e->loaded && !e->resident && e->refCount == 0 && e->callbacks.reload != NULL;
+}
+
+
+static void BGLResourceEntryUnload(BGLResourceRegistryRef reg, BGLResourceEntry *e)
+{
+    if (e->callbacks.unload) e->callbacks.unload(e->info);
+    e->loaded = 0;
+    reg->loadedBytes -= e->bytes;
+    reg->evictionCount += 1;
+}
+
+
+BGLResourceRegistryRef BGLResourceRegistryCreate(size_t budget)
+{
+    BGLResourceRegistryRef reg = calloc(1, sizeof(struct BGLResourceRegistry));
+    if (reg == NULL) return NULL;
+    reg->budget = budget;
+    reg->freeHead = kNone;
+    return reg;
+}
+
+
+void BGLResourceRegistryDestroy(BGLResourceRegistryRef reg)
+{
+    if (reg == NULL) return;
+    free(reg->entries);
+    free(reg);
+}
+
+
+BGLResourceRegistryRef BGLResourceRegistryGetDefault(void)
+{
+    static BGLResourceRegistryRef defaultRegistry = NULL;
+    if (defaultRegistry == NULL) {
+        defaultRegistry = BGLResourceRegistryCreate((size_t)-1);
+    }
+    return defaultRegistry;
+}
+
+
+void BGLResourceRegistrySetBudget(BGLResourceRegistryRef reg, size_t budget)
+{
+    reg->budget = budget;
+    BGLResourceRegistryEnforceBudget(reg);
+}
+
+
+void BGLResourceRegistryAdvanceFrame(BGLResourceRegistryRef reg)
+{
+    reg->frame += 1;
+}
+
+
+void BGLResourceRegistryEnforceBudget(BGLResourceRegistryRef reg)
+{
+    while (reg->loadedBytes > reg->budget) {
+        BGLResourceEntry *victim = NULL;
+        for (unsigned int i = 0; i < reg->count; i++) {
+            BGLResourceEntry *e = &reg->entries[i];
+            // Never evict something used this frame; it is about to be drawn.
+            if (BGLResourceEntryIsEvictable(e) && e->lastUsedFrame != reg->frame) {
+                if (victim == NULL || e->lastUsedFrame < victim->lastUsedFrame) {
+                    victim = e;
+                }
+            }
+        }
+        if (victim == NULL) break;
+        BGLResourceEntryUnload(reg, victim);
+    }
+}
+
+
+void BGLResourceRegistryPurge(BGLResourceRegistryRef reg)
+{
+    for (unsigned int i = 0; i < reg->count; i++) {
+        BGLResourceEntry *e = &reg->entries[i];
+        if (BGLResourceEntryIsEvictable(e)) {
+            BGLResourceEntryUnload(reg, e);
+        }
+    }
+}
+
+
+void BGLResourceRegistryGetStats(BGLResourceRegistryRef reg, BGLResourceStats *stats)
+{
+    memset(stats, 0, sizeof(BGLResourceStats));
+    stats->budget = reg->budget;
+    stats->loadedBytes = reg->loadedBytes;
+    stats->evictionCount = reg->evictionCount;
+    stats->reloadCount = reg->reloadCount;
+    stats->slotCount = reg->count;
+    for (unsigned int i = 0; i < reg->count; i++) {
+        BGLResourceEntry *e = &reg->entries[i];
+        if (! e->registered) continue;
+        stats->totalCount += 1;
+        stats->totalBytes += e->bytes;
+        if (e->loaded) {
+            stats->loadedCount += 1;
+            stats->loadedBytesByType[e->type] += e->bytes;
+        }
+    }
+}
+
+
+void BGLResourceRegistryPrint(BGLResourceRegistryRef reg)
+{
+    BGLResourceStats stats;
+    BGLResourceRegistryGetStats(reg, &stats);
+    printf("Resources: %u/%u loaded, %zu/%zu bytes, budget %zu, %u evictions, %u reloads\n",
+           stats.loadedCount, stats.totalCount, stats.loadedBytes, stats.totalBytes,
+           stats.budget, stats.evictionCount, stats.reloadCount);
+    for (unsigned int i = 0; i < reg->count; i++) {
+        BGLResourceEntry *e = &reg->entries[i];
+        if (! e->registered) continue;
+        printf("  %-8s %-32s %10zu bytes  refs %d  last frame %u%s%s\n",
+               kTypeNames[e->type], e->name, e->bytes, e->refCount, e->lastUsedFrame,
+               e->resident ? "  resident" : "",
+               e->loaded ? "" : "  (unloaded)");
+    }
+}
+
+
+BGLResourceID BGLResourceRegister(BGLResourceRegistryRef reg, BGLResourceType type, const char *name,
+                                  size_t bytes, const BGLResourceCallbacks *callbacks, void *info)
+{
+    unsigned int index, generation = 0;
+    if (reg->freeHead != kNone) {
+        index = reg->freeHead;
+        reg->freeHead = reg->entries[index].nextFree;
+        generation = reg->entries[index].generation;
+    } else {
+        if (reg->count == reg->capacity) {
+            if (reg->capacity > kIndexMask / 2) return 0;
+            unsigned int capacity = reg->capacity ? 2 * reg->capacity : 32;
+            BGLResourceEntry *entries = realloc(reg->entries, capacity * sizeof(BGLResourceEntry));
+            if (entries == NULL) return 0;
+            reg->entries = entries;
+            reg->capacity = capacity;
+        }
+        index = reg->count++;
+    }
+    BGLResourceEntry *e = &reg->entries[index];
+    memset(e, 0, sizeof(BGLResourceEntry));
+    e->generation = generation;
+    e->type = type;
+    if (name) strncpy(e->name, name, sizeof(e->name) - 1);
+    e->bytes = bytes;
+    e->lastUsedFrame = reg->frame;
+    e->loaded = 1;
+    e->registered = 1;
+    if (callbacks) e->callbacks = *callbacks;
+    e->info = info;
+    reg->loadedBytes += bytes;
+    BGLResourceRegistryEnforceBudget(reg);
+    return (generation << kIndexBits) | (index + 1);
+}
+
+
+void BGLResourceUnregister(BGLResourceRegistryRef reg, BGLResourceID rid)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    if (e == NULL) return;
+    if (e->loaded) reg->loadedBytes -= e->bytes;
+    e->registered = 0;
+    // Like a node slot, an entry out of generations is retired, not reused.
+    if (e->generation < kGenerationMax) {
+        e->generation += 1;
+        e->nextFree = reg->freeHead;
+        reg->freeHead = (unsigned int)(e - reg->entries);
+    }
+}
+
+
+void BGLResourceRetain(BGLResourceRegistryRef reg, BGLResourceID rid)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    if (e) e->refCount += 1;
+}
+
+
+void BGLResourceRelease(BGLResourceRegistryRef reg, BGLResourceID rid)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    if (e && e->refCount > 0) e->refCount -= 1;
+}
+
+
+void BGLResourceSetResident(BGLResourceRegistryRef reg, BGLResourceID rid, int resident)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    if (e) e->resident = resident;
+}
+
+
+void BGLResourceSetSize(BGLResourceRegistryRef reg, BGLResourceID rid, size_t bytes)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    if (e == NULL || e->bytes == bytes) return;
+    size_t oldBytes = e->bytes;
+    e->bytes = bytes;
+    if (e->loaded) {
+        reg->loadedBytes = reg->loadedBytes - oldBytes + bytes;
+        if (bytes > oldBytes) BGLResourceRegistryEnforceBudget(reg);
+    }
+}
+
+
+int BGLResourceTouch(BGLResourceRegistryRef reg, BGLResourceID rid)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    if (e == NULL) return 0;
+    e->lastUsedFrame = reg->frame;
+    if (! e->loaded) {
+        size_t bytes = e->callbacks.reload(e->info);
+        if (bytes == 0) return 0;
+        e->bytes = bytes;
+        e->loaded = 1;
+        reg->loadedBytes += bytes;
+        reg->reloadCount += 1;
+        BGLResourceRegistryEnforceBudget(reg);
+    }
+    return 1;
+}
+
+
+int BGLResourceIsLoaded(BGLResourceRegistryRef reg, BGLResourceID rid)
+{
+    BGLResourceEntry *e = BGLResourceEntryGet(reg, rid);
+    return e ? e->loaded : 0;
+}
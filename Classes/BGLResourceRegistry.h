@@ -0,0 +1,82 @@
+/*
+ Bookkeeping for GPU resources (textures, buffers, font atlases, programs).
+ 
+ Every resource is registered with its size in bytes and a pair of callbacks
+ that unload and reload it. The registry tracks a reference count and the last
+ frame each resource was used, and keeps the total size of loaded resources
+ under a budget by unloading the least recently used ones that are neither
+ referenced nor marked resident. An unloaded resource is reloaded the next time
+ it is touched.
+ 
+ This is plain C and makes no GL calls itself; all GL work happens in the
+ callbacks, so the policy can be exercised with stub callbacks.
+ */
+
+#ifndef BGLRESOURCEREGISTRY_H
+#define BGLRESOURCEREGISTRY_H
+
+#include <stddef.h>
+
+
+typedef enum {
+    kBGLResourceTexture,
+    kBGLResourceBuffer,
+    kBGLResourceFont,
+    kBGLResourceProgram,
+    kBGLResourceTypeCount
+} BGLResourceType;
+
+
+typedef unsigned int BGLResourceID; // 0 is never a valid ID
+
+
+typedef struct {
+    void (*unload)(void *info);
+    size_t (*reload)(void *info); // returns new size in bytes, 0 on failure
+} BGLResourceCallbacks;
+
+
+typedef struct {
+    size_t budget;
+    size_t loadedBytes;
+    size_t totalBytes; // as if everything were loaded
+    unsigned int loadedCount;
+    unsigned int totalCount;
+    unsigned int slotCount;     // entries registered or kept for reuse
+    unsigned int evictionCount;
+    unsigned int reloadCount;
+    size_t loadedBytesByType[kBGLResourceTypeCount];
+} BGLResourceStats;
+
+
+typedef struct BGLResourceRegistry *BGLResourceRegistryRef;
+
+
+// Returns NULL if out of memory.
+BGLResourceRegistryRef BGLResourceRegistryCreate(size_t budget);
+void BGLResourceRegistryDestroy(BGLResourceRegistryRef reg);
+BGLResourceRegistryRef BGLResourceRegistryGetDefault(void);
+
+void BGLResourceRegistrySetBudget(BGLResourceRegistryRef reg, size_t budget);
+void BGLResourceRegistryAdvanceFrame(BGLResourceRegistryRef reg);
+void BGLResourceRegistryEnforceBudget(BGLResourceRegistryRef reg);
+void BGLResourceRegistryPurge(BGLResourceRegistryRef reg); // unload everything evictable
+void BGLResourceRegistryGetStats(BGLResourceRegistryRef reg, BGLResourceStats *stats);
+void BGLResourceRegistryPrint(BGLResourceRegistryRef reg);
+
+// Returns 0 if out of memory. A resource without a reload callback is never
+// evicted.
+BGLResourceID BGLResourceRegister(BGLResourceRegistryRef reg, BGLResourceType type, const char *name,
+                                  size_t bytes, const BGLResourceCallbacks *callbacks, void *info);
+// The ID is then invalid, even once its slot is reused for another resource.
+void BGLResourceUnregister(BGLResourceRegistryRef reg, BGLResourceID rid);
+void BGLResourceRetain(BGLResourceRegistryRef reg, BGLResourceID rid);
+void BGLResourceRelease(BGLResourceRegistryRef reg, BGLResourceID rid);
+void BGLResourceSetResident(BGLResourceRegistryRef reg, BGLResourceID rid, int resident);
+// For a loaded resource whose storage was respecified, like a growing buffer.
+void BGLResourceSetSize(BGLResourceRegistryRef reg, BGLResourceID rid, size_t bytes);
+int BGLResourceTouch(BGLResourceRegistryRef reg, BGLResourceID rid); // returns 0 if reload failed
+int BGLResourceIsLoaded(BGLResourceRegistryRef reg, BGLResourceID rid);
+
+
+#endif
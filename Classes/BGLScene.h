@@ -12,19 +12,57 @@
 #import "ESRenderer.h"
 #import "BGLAnimation.h"
 #import "BGLUtilities.h"
-
-@class BGLNode;
+#import "BGLNode.h"
+#import "BGLTimerWheel.h"
 
 @interface BGLScene : NSObject {
     BGLNode *rootNode;
     CGSize viewportSize;
     CFTimeInterval previousFrameTime;
+    unsigned int changeCount;
+    unsigned int renderedChangeCount;
+    BOOL animationsPending;
+    unsigned int renderCount;
+    unsigned int skippedFrameCount;
+    id changeTarget;
+    SEL changeAction;
+    BOOL deferringEdits;
+    BGLNodeEdit *edits;
+    NSUInteger editCount;
+    NSUInteger editCapacity;
+    BGLTimerWheel timers;
 }
 @property (nonatomic,retain) BGLNode *rootNode;
+@property (nonatomic,readonly) unsigned int changeCount; // bumped whenever anything visible changes
+@property (nonatomic,readonly) unsigned int renderCount;
+@property (nonatomic,readonly) unsigned int skippedFrameCount;
+- (void)setNeedsDisplay;
+- (BOOL)needsDisplay;
+- (void)skipFrame;
+- (void)setChangeTarget:(id)target action:(SEL)action; // sent when an idle scene changes
 - (void)updateViewportSize:(CGSize)size;
 - (void)renderWithRenderer:(id <ESRenderer>)renderer;
 - (void)syncAnimationClock; // must be called before starting animations
 - (void)performAnimations;
 - (void)animateWithElapsedTime:(CFTimeInterval)t;
 - (id <Touchable>)touchableForPoint:(CGPoint)p;
+- (void)getTouchables:(id <Touchable> *)touchables forPoints:(const CGPoint *)points count:(NSUInteger)count;
+// Timers (see BGLTimerWheel.h) run on the scene's animation clock, firing
+// among the animations. One given a node waits while that node or one above
+// it is paused, and is dropped once the node is freed. Blocks are copied;
+// the function form allocates nothing once the wheel has grown.
+- (BGLTimerHandle)scheduleAfter:(CFTimeInterval)delay node:(BGLNode *)node block:(void (^)(void))block;
+- (BGLTimerHandle)scheduleAfter:(CFTimeInterval)delay repeatingEvery:(CFTimeInterval)interval node:(BGLNode *)node block:(void (^)(void))block;
+- (BGLTimerHandle)scheduleAfter:(CFTimeInterval)delay repeatingEvery:(CFTimeInterval)interval node:(BGLNode *)node function:(BGLTimerFunction)function context:(void *)context;
+- (BOOL)cancelTimer:(BGLTimerHandle)timer;
+- (BOOL)hasScheduledTimers; // the clock must keep running, even with nothing to draw
+@end
+
+
+@interface BGLScene (Private)
+- (void)setNeedsAnimation;
+- (BOOL)isDeferringEdits;
+- (void)deferEdit:(const BGLNodeEdit *)edit;
+- (void)applyDeferredEdits;
+- (void)nodeDidChangePaused:(BGLNode *)node;
 @end
@@ -8,29 +8,141 @@
 
 #import "BGLScene.h"
 #import "BGLButton.h"
+#import "BGLNode.h"
+#import "BGLResourceRegistry.h"
+#import "BGLAccounting.h"
+#import <Block.h>
+
+
+static void BGLSceneCallBlock(void *context, BGLTimerHandle timer)
+{
+    void (^block)(void) = context;
+    block();
+}
+
+
+static void BGLSceneReleaseBlock(void *context)
+{
+    Block_release(context);
+}
+
+
+@interface BGLScene ()
+- (BOOL)isIdle;
+- (void)wakeIfWasIdle:(BOOL)wasIdle;
+@end
 
 
 @implementation BGLScene
 
 
 @synthesize rootNode;
+@synthesize changeCount;
+@synthesize renderCount;
+@synthesize skippedFrameCount;
+
+
+- (id)init
+{
+    if ((self = [super init])) {
+        BGLTimerWheelInit(&timers, BGLNodeStoreGetDefault());
+    }
+    return self;
+}
 
 
 - (void)dealloc
 {
+    [self applyDeferredEdits];
+    BGLTimerWheelFree(&timers);
+    free(edits);
     [rootNode release];
     [super dealloc];
 }
 
 
+- (void)setRootNode:(BGLNode *)node
+{
+    if (rootNode != node) {
+        [rootNode didAddToScene:nil];
+        [rootNode release];
+        rootNode = [node retain];
+        [rootNode didAddToScene:self];
+        [self setNeedsDisplay];
+    }
+}
+
+
 - (void)updateViewportSize:(CGSize)size
 {
+    [self setNeedsDisplay];
+}
+
+
+- (void)setChangeTarget:(id)target action:(SEL)action
+{
+    changeTarget = target;
+    changeAction = action;
+}
+
+
+- (void)setNeedsDisplay
+{
+    BOOL wasIdle = [self isIdle];
+    changeCount += 1;
+    [self wakeIfWasIdle:wasIdle];
+}
+
+
+- (BOOL)isIdle
+{
+    return ! [self needsDisplay] && BGLTimerWheelScheduledCount(&timers) == 0;
+}
+
+
+- (void)wakeIfWasIdle:(BOOL)wasIdle
+{
+    if (wasIdle && ! [self isIdle] && changeAction) {
+        [changeTarget performSelector:changeAction withObject:self];
+    }
+}
+
+
+- (void)setNeedsAnimation
+{
+    BOOL wasIdle = [self isIdle];
+    animationsPending = YES;
+    [self wakeIfWasIdle:wasIdle];
+}
+
+
+- (BOOL)needsDisplay
+{
+    return animationsPending || (changeCount != renderedChangeCount);
+}
+
+
+- (void)skipFrame
+{
+    // Keep the clock current so the next animation step isn't one huge jump,
+    // but let timers see the time go by.
+    CFTimeInterval now = CACurrentMediaTime();
+    if (BGLTimerWheelScheduledCount(&timers)) {
+        deferringEdits = YES;
+        BGLTimerWheelAdvance(&timers, now - previousFrameTime);
+        deferringEdits = NO;
+        [self applyDeferredEdits];
+    }
+    previousFrameTime = now;
+    skippedFrameCount += 1;
 }
 
 
 - (void)renderWithRenderer:(id <ESRenderer>)renderer
 {
     [renderer renderRootNode:rootNode];
+    renderedChangeCount = changeCount;
+    renderCount += 1;
 }
 
 
@@ -47,6 +159,7 @@
 #if DEBUG
     if (t > 1.f/20.f) t = 1.f/20.f;
 #endif
+    BGLResourceRegistryAdvanceFrame(BGLResourceRegistryGetDefault());
     [self animateWithElapsedTime:t];
     previousFrameTime = now;
 }
@@ -54,7 +167,103 @@
 
 - (void)animateWithElapsedTime:(CFTimeInterval)t
 {
+    // Nodes that still have animations afterwards set this again.
+    animationsPending = NO;
+    deferringEdits = YES;
     [rootNode animateWithElapsedTime:t];
+    BGLTimerWheelAdvance(&timers, t);
+    deferringEdits = NO;
+    [self applyDeferredEdits];
+}
+
+
+#pragma mark Timers
+
+
+- (BGLTimerHandle)scheduleAfter:(CFTimeInterval)delay node:(BGLNode *)node block:(void (^)(void))block
+{
+    return [self scheduleAfter:delay repeatingEvery:0 node:node block:block];
+}
+
+
+- (BGLTimerHandle)scheduleAfter:(CFTimeInterval)delay repeatingEvery:(CFTimeInterval)interval node:(BGLNode *)node block:(void (^)(void))block
+{
+    BOOL wasIdle = [self isIdle];
+    void (^copy)(void) = Block_copy(block);
+    BGLTimerHandle timer = BGLTimerWheelSchedule(&timers, delay, interval, node.handle,
+                                                 BGLSceneCallBlock, copy, BGLSceneReleaseBlock);
+    if (timer == 0) Block_release(copy);
+    [self wakeIfWasIdle:wasIdle];
+    return timer;
+}
+
+
+- (BGLTimerHandle)scheduleAfter:(CFTimeInterval)delay repeatingEvery:(CFTimeInterval)interval node:(BGLNode *)node function:(BGLTimerFunction)function context:(void *)context
+{
+    BOOL wasIdle = [self isIdle];
+    BGLTimerHandle timer = BGLTimerWheelSchedule(&timers, delay, interval, node.handle, function, context, NULL);
+    [self wakeIfWasIdle:wasIdle];
+    return timer;
+}
+
+
+- (BOOL)cancelTimer:(BGLTimerHandle)timer
+{
+    return BGLTimerWheelCancel(&timers, timer);
+}
+
+
+- (BOOL)hasScheduledTimers
+{
+    return BGLTimerWheelScheduledCount(&timers) != 0;
+}
+
+
+- (void)nodeDidChangePaused:(BGLNode *)node
+{
+    if ([node isPaused]) {
+        BGLTimerWheelSuspendNode(&timers, node.handle);
+    } else {
+        BOOL wasIdle = [self isIdle];
+        BGLTimerWheelResumeNode(&timers, node.handle);
+        [self wakeIfWasIdle:wasIdle];
+    }
+}
+
+
+- (BOOL)isDeferringEdits
+{
+    return deferringEdits;
+}
+
+
+- (void)deferEdit:(const BGLNodeEdit *)edit
+{
+    if (editCount == editCapacity) {
+        editCapacity = editCapacity ? 2 * editCapacity : 64;
+        edits = realloc(edits, editCapacity * sizeof(BGLNodeEdit));
+        BGLAccountAllocation(editCapacity * sizeof(BGLNodeEdit));
+    }
+    BGLNodeEdit *e = &edits[editCount++];
+    *e = *edit;
+    [e->parent retain];
+    [e->node retain];
+    [e->sibling retain];
+}
+
+
+- (void)applyDeferredEdits
+{
+    // Applied in the order made, so e.g. an add followed by a remove of the
+    // same node cancels out.
+    [BGLNode applyDeferredEdits:edits count:editCount];
+    for (NSUInteger i = 0; i < editCount; i++) {
+        BGLNodeEdit *e = &edits[i];
+        [e->parent release];
+        [e->node release];
+        [e->sibling release];
+    }
+    editCount = 0;
 }
 
 
@@ -69,4 +278,29 @@
 }
 
 
+- (void)getTouchables:(id <Touchable> *)touchables forPoints:(const CGPoint *)points count:(NSUInteger)count
+{
+    while (count > 0) {
+        NSUInteger n = MIN(count, kBGLHitTestBatchMax);
+        BGLVector3 p[kBGLHitTestBatchMax];
+        BGLNode *nodes[kBGLHitTestBatchMax];
+        for (NSUInteger i = 0; i < n; i++) {
+            p[i] = BGLVector3Make(points[i].x, points[i].y, 0);
+            nodes[i] = nil;
+        }
+        [self.rootNode hitTestPoints:p results:nodes count:n];
+        for (NSUInteger i = 0; i < n; i++) {
+            if ([nodes[i] conformsToProtocol:@protocol(Touchable)]) {
+                touchables[i] = (id <Touchable>)nodes[i];
+            } else {
+                touchables[i] = nil;
+            }
+        }
+        touchables += n;
+        points += n;
+        count -= n;
+    }
+}
+
+
 @end
@@ -10,6 +10,7 @@
 
 #import <OpenGLES/ES2/gl.h>
 #import <OpenGLES/ES2/glext.h>
+#import "BGLGLDispatch.h"
 
 @interface BGLShader : NSObject {
     GLuint name;
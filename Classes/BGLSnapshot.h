@@ -0,0 +1,33 @@
+//
+//  BGLSnapshot.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLNode.h"
+
+/*
+ Binary scene snapshots.
+ 
+ A snapshot records a node tree in preorder as fixed size records, followed by
+ a table of strings (class, program, font names and text) and a blob of
+ polygon vertex data. Files are memory mapped when loaded; polygons reference
+ their vertex data inside the mapping rather than copying it.
+ 
+ Node types with dedicated records are BGLNode, BGLPolygon and BGLTextNode.
+ Any other class is recorded by name and recreated with -init, keeping only
+ what BGLNode itself knows (tag, flags, matrix, program).
+ 
+ Snapshots are written in native byte order and are not portable between
+ architectures of different endianness.
+ */
+
+static const uint32_t kBGLSnapshotVersion = 1;
+
+
+@interface BGLNode (Snapshot)
++ (id)nodeWithSnapshotData:(NSData *)data;
++ (id)nodeWithContentsOfSnapshotFile:(NSString *)path;
+- (NSData *)snapshotData;
+- (BOOL)writeSnapshotToFile:(NSString *)path;
+@end
@@ -0,0 +1,472 @@
+//
+//  BGLSnapshot.m
+//  FingerPaintBall
+//
+
+#import "BGLSnapshot.h"
+#import "BGLPolygon.h"
+#import "BGLTextNode.h"
+#import "BGLProgram.h"
+#import "BGLUtilities.h"
+
+
+/*
+ File layout:
+
+    BGLSnapshotHeader
+    BGLSnapshotNode[nodeCount]          preorder
+    BGLSnapshotString[stringCount]      offset/length into string data
+    string data                         UTF-8, padded to 4 bytes
+    vertex data                         raw BGLPolygonVertex arrays
+ */
+
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t stringCount;
+    uint32_t stringTableOffset;
+    uint32_t stringDataOffset;
+    uint32_t vertexDataOffset;
+    uint32_t vertexDataLength;
+} BGLSnapshotHeader;
+
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} BGLSnapshotString;
+
+
+enum {
+    kBGLSnapshotNodeGeneric = 0,
+    kBGLSnapshotNodePolygon = 1,
+    kBGLSnapshotNodeText = 2,
+};
+
+
+enum {
+    kBGLSnapshotFlagHidden = 1 << 0,
+    kBGLSnapshotFlagPaused = 1 << 1,
+    kBGLSnapshotFlagDistanceField = 1 << 2,
+};
+
+
+static const uint32_t kBGLSnapshotNoString = 0xFFFFFFFF;
+static const char kBGLSnapshotMagic[4] = { 'B', 'G', 'L', 'S' };
+
+
+typedef struct {
+    uint16_t type;
+    uint16_t flags;
+    int32_t tag;
+    uint32_t subnodeCount;
+    uint32_t className;
+    uint32_t programName;
+    float matrix[16];
+    // Polygon
+    uint32_t mode;
+    uint32_t vertexOffset;      // relative to vertex data
+    uint32_t vertexLength;
+    // Text
+    uint32_t fontName;
+    uint32_t text;
+    float color[4];
+} BGLSnapshotNode;
+
+
+#pragma mark -
+
+
+// Immutable view of a range of another NSData, which it keeps alive. Lets
+// polygons point into a mapped snapshot without copying their vertexes.
+
+@interface BGLSnapshotSubdata : NSData {
+    NSData *parent;
+    const void *bytes;
+    NSUInteger length;
+}
+- (id)initWithParent:(NSData *)data range:(NSRange)range;
+@end
+
+
+@implementation BGLSnapshotSubdata
+
+- (id)initWithParent:(NSData *)data range:(NSRange)range
+{
+    if ((self = [super init])) {
+        parent = [data retain];
+        bytes = (const char *)[data bytes] + range.location;
+        length = range.length;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [parent release];
+    [super dealloc];
+}
+
+- (const void *)bytes { return bytes; }
+- (NSUInteger)length { return length; }
+
+@end
+
+
+#pragma mark -
+
+
+@interface BGLSnapshotWriter : NSObject {
+    NSMutableData *nodeData;
+    NSMutableData *vertexData;
+    NSMutableArray *strings;
+    NSMutableDictionary *stringIndexes;
+}
+- (uint32_t)indexForString:(NSString *)string;
+- (uint32_t)appendVertexData:(NSData *)data;
+- (void)writeNode:(BGLNode *)node;
+- (NSData *)data;
+@end
+
+
+@interface BGLNode (SnapshotPrivate)
+- (void)fillSnapshotRecord:(BGLSnapshotNode *)r writer:(BGLSnapshotWriter *)writer;
+@end
+
+
+@implementation BGLSnapshotWriter
+
+- (id)init
+{
+    if ((self = [super init])) {
+        nodeData = [[NSMutableData alloc] init];
+        vertexData = [[NSMutableData alloc] init];
+        strings = [[NSMutableArray alloc] init];
+        stringIndexes = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    [nodeData release];
+    [vertexData release];
+    [strings release];
+    [stringIndexes release];
+    [super dealloc];
+}
+
+
+- (uint32_t)indexForString:(NSString *)string
+{
+    if (string == nil) return kBGLSnapshotNoString;
+    NSNumber *n = [stringIndexes objectForKey:string];
+    if (n == nil) {
+        n = [NSNumber numberWithUnsignedInt:[strings count]];
+        [strings addObject:string];
+        [stringIndexes setObject:n forKey:string];
+    }
+    return [n unsignedIntValue];
+}
+
+
+- (uint32_t)appendVertexData:(NSData *)data
+{
+    uint32_t offset = [vertexData length];
+    [vertexData appendData:data];
+    return offset;
+}
+
+
+- (void)writeNode:(BGLNode *)node
+{
+    BGLSnapshotNode r;
+    memset(&r, 0, sizeof(r));
+    r.fontName = kBGLSnapshotNoString;
+    r.text = kBGLSnapshotNoString;
+    [node fillSnapshotRecord:&r writer:self];
+    [nodeData appendBytes:&r length:sizeof(r)];
+    for (BGLNode *sub = node.firstSubnode; sub; sub = sub.nextSibling) {
+        [self writeNode:sub];
+    }
+}
+
+
+- (NSData *)data
+{
+    NSMutableData *table = [NSMutableData data];
+    NSMutableData *stringData = [NSMutableData data];
+    for (NSString *string in strings) {
+        const char *utf8 = [string UTF8String];
+        BGLSnapshotString s;
+        s.offset = [stringData length];
+        s.length = strlen(utf8);
+        [table appendBytes:&s length:sizeof(s)];
+        [stringData appendBytes:utf8 length:s.length];
+    }
+    // Keep vertex data 4-byte aligned.
+    [stringData increaseLengthBy:(4 - [stringData length] % 4) % 4];
+
+    BGLSnapshotHeader h;
+    memcpy(h.magic, kBGLSnapshotMagic, 4);
+    h.version = kBGLSnapshotVersion;
+    h.nodeCount = [nodeData length] / sizeof(BGLSnapshotNode);
+    h.stringCount = [strings count];
+    h.stringTableOffset = sizeof(h) + [nodeData length];
+    h.stringDataOffset = h.stringTableOffset + [table length];
+    h.vertexDataOffset = h.stringDataOffset + [stringData length];
+    h.vertexDataLength = [vertexData length];
+
+    NSMutableData *data = [NSMutableData dataWithCapacity:h.vertexDataOffset + h.vertexDataLength];
+    [data appendBytes:&h length:sizeof(h)];
+    [data appendData:nodeData];
+    [data appendData:table];
+    [data appendData:stringData];
+    [data appendData:vertexData];
+    return data;
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation BGLNode (SnapshotPrivate)
+
+- (void)fillSnapshotRecord:(BGLSnapshotNode *)r writer:(BGLSnapshotWriter *)writer
+{
+    r->type = kBGLSnapshotNodeGeneric;
+    r->flags = ([self isHidden] ? kBGLSnapshotFlagHidden : 0) | ([self isPaused] ? kBGLSnapshotFlagPaused : 0);
+    r->tag = tag;
+    r->subnodeCount = [self subnodeCount];
+    r->className = [writer indexForString:NSStringFromClass([self class])];
+    r->programName = [writer indexForString:program.programName];
+    memcpy(r->matrix, BGLNodeStoreLocalMatrix(BGLNodeStoreGetDefault(), handle), sizeof(r->matrix));
+}
+
+@end
+
+
+@implementation BGLPolygon (SnapshotPrivate)
+
+- (void)fillSnapshotRecord:(BGLSnapshotNode *)r writer:(BGLSnapshotWriter *)writer
+{
+    [super fillSnapshotRecord:r writer:writer];
+    r->type = kBGLSnapshotNodePolygon;
+    r->mode = mode;
+    r->vertexOffset = [writer appendVertexData:vertexData];
+    r->vertexLength = [vertexData length];
+}
+
+@end
+
+
+@implementation BGLTextNode (SnapshotPrivate)
+
+- (void)fillSnapshotRecord:(BGLSnapshotNode *)r writer:(BGLSnapshotWriter *)writer
+{
+    [super fillSnapshotRecord:r writer:writer];
+    r->type = kBGLSnapshotNodeText;
+    if (distanceField) r->flags |= kBGLSnapshotFlagDistanceField;
+    r->fontName = [writer indexForString:fontName];
+    r->text = [writer indexForString:string];
+    memcpy(r->color, &color, sizeof(r->color));
+}
+
+@end
+
+
+#pragma mark -
+
+
+static NSString *BGLSnapshotStringAtIndex(uint32_t i, NSString **cache, uint32_t count,
+                                          const BGLSnapshotString *table, const char *data, uint32_t dataLength)
+{
+    if (i >= count) return nil;
+    if (cache[i] == nil && table[i].offset + table[i].length <= dataLength) {
+        cache[i] = [[NSString alloc] initWithBytes:data + table[i].offset
+                                            length:table[i].length
+                                          encoding:NSUTF8StringEncoding];
+    }
+    return cache[i];
+}
+
+
+@implementation BGLNode (Snapshot)
+
+
++ (id)nodeWithSnapshotData:(NSData *)data
+{
+    const char *bytes = [data bytes];
+    const NSUInteger length = [data length];
+
+    if (length < sizeof(BGLSnapshotHeader)) return nil;
+    const BGLSnapshotHeader *h = (const BGLSnapshotHeader *)bytes;
+    if (memcmp(h->magic, kBGLSnapshotMagic, 4) != 0) {
+        DLog(@"Not a snapshot");
+        return nil;
+    }
+    if (h->version != kBGLSnapshotVersion) {
+        DLog(@"Unsupported snapshot version %u", h->version);
+        return nil;
+    }
+    if (h->nodeCount == 0 ||
+        h->stringTableOffset != sizeof(BGLSnapshotHeader) + h->nodeCount * sizeof(BGLSnapshotNode) ||
+        h->stringDataOffset != h->stringTableOffset + h->stringCount * sizeof(BGLSnapshotString) ||
+        h->vertexDataOffset < h->stringDataOffset ||
+        h->vertexDataOffset + h->vertexDataLength > length) {
+        DLog(@"Snapshot is truncated or corrupt");
+        return nil;
+    }
+
+    const BGLSnapshotNode *records = (const BGLSnapshotNode *)(bytes + sizeof(BGLSnapshotHeader));
+    const BGLSnapshotString *stringTable = (const BGLSnapshotString *)(bytes + h->stringTableOffset);
+    const char *stringData = bytes + h->stringDataOffset;
+    const uint32_t stringDataLength = h->vertexDataOffset - h->stringDataOffset;
+
+    // Strings, classes and programs repeat across many nodes; decode each once.
+    NSString **strings = calloc(h->stringCount, sizeof(NSString *));
+    Class *classes = calloc(h->stringCount, sizeof(Class));
+    BGLProgram **programs = calloc(h->stringCount, sizeof(BGLProgram *));
+
+#define STRING(i) BGLSnapshotStringAtIndex((i), strings, h->stringCount, stringTable, stringData, stringDataLength)
+
+    // Stack of nodes still waiting for subnodes.
+    BGLNode **parents = malloc(h->nodeCount * sizeof(BGLNode *));
+    uint32_t *remaining = malloc(h->nodeCount * sizeof(uint32_t));
+    NSUInteger depth = 0;
+
+    BGLNode *root = nil;
+    BOOL failed = NO;
+
+    for (uint32_t i = 0; i < h->nodeCount; i++) {
+        const BGLSnapshotNode *r = &records[i];
+
+        if (i > 0 && depth == 0) {
+            failed = YES; // more than one root
+            break;
+        }
+
+        uint32_t ci = r->className;
+        Class cls = (ci < h->stringCount) ? classes[ci] : Nil;
+        if (cls == Nil) {
+            NSString *className = STRING(ci);
+            cls = className ? NSClassFromString(className) : Nil;
+            if (cls == Nil) {
+                DLog(@"Snapshot references unknown class %@", className);
+                failed = YES;
+                break;
+            }
+            classes[ci] = cls;
+        }
+
+        BGLNode *node;
+        if (r->type == kBGLSnapshotNodePolygon) {
+            if (r->vertexOffset + r->vertexLength > h->vertexDataLength) {
+                failed = YES;
+                break;
+            }
+            NSRange range = NSMakeRange(h->vertexDataOffset + r->vertexOffset, r->vertexLength);
+            NSData *vertexes = [[BGLSnapshotSubdata alloc] initWithParent:data range:range];
+            node = [[cls alloc] initWithVertexData:vertexes mode:r->mode];
+            [vertexes release];
+        } else if (r->type == kBGLSnapshotNodeText) {
+            NSString *fontName = STRING(r->fontName);
+            if (r->flags & kBGLSnapshotFlagDistanceField) {
+                node = [[cls alloc] initWithDistanceFieldFontName:fontName];
+            } else {
+                node = [[cls alloc] initWithFontName:fontName];
+            }
+            NSString *text = STRING(r->text);
+            if (text) [(BGLTextNode *)node setString:text];
+            [(BGLTextNode *)node setColor:BGLColorMake4f(r->color[0], r->color[1], r->color[2], r->color[3])];
+        } else {
+            node = [[cls alloc] init];
+        }
+
+        node->tag = r->tag;
+        BGLNodeStore *store = BGLNodeStoreGetDefault();
+        BGLNodeStoreSetFlag(store, node->handle, kBGLNodeFlagHidden, r->flags & kBGLSnapshotFlagHidden);
+        BGLNodeStoreSetFlag(store, node->handle, kBGLNodeFlagPaused, r->flags & kBGLSnapshotFlagPaused);
+        memcpy(BGLNodeStoreLocalMatrix(store, node->handle), r->matrix, sizeof(BGLMatrix));
+
+        uint32_t pi = r->programName;
+        if (pi < h->stringCount) {
+            if (programs[pi] == nil) {
+                programs[pi] = [BGLProgram programNamed:STRING(pi)];
+            }
+            if (node->program != programs[pi]) {
+                node.program = programs[pi];
+            }
+        }
+
+        // Attach directly; nothing is in a scene yet, so the bookkeeping in
+        // -addSubnode: isn't needed. The parent owns the reference from alloc.
+        if (depth == 0) {
+            root = node;
+        } else {
+            BGLNode *parent = parents[depth - 1];
+            node->supernode = parent;
+            BGLNodeStoreLink(BGLNodeStoreGetDefault(), parent->handle, node->handle);
+            remaining[depth - 1] -= 1;
+        }
+
+        if (r->subnodeCount > 0) {
+            parents[depth] = node;
+            remaining[depth] = r->subnodeCount;
+            depth++;
+        } else {
+            while (depth > 0 && remaining[depth - 1] == 0) depth--;
+        }
+    }
+
+#undef STRING
+
+    if (depth != 0) failed = YES; // truncated tree
+
+    for (uint32_t i = 0; i < h->stringCount; i++) {
+        [strings[i] release];
+    }
+    free(strings);
+    free(classes);
+    free(programs);
+    free(parents);
+    free(remaining);
+
+    if (failed) {
+        [root release];
+        return nil;
+    }
+    return [root autorelease];
+}
+
+
++ (id)nodeWithContentsOfSnapshotFile:(NSString *)path
+{
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMapped error:NULL];
+    if (data == nil) return nil;
+    return [self nodeWithSnapshotData:data];
+}
+
+
+- (NSData *)snapshotData
+{
+    BGLSnapshotWriter *writer = [[BGLSnapshotWriter alloc] init];
+    [writer writeNode:self];
+    NSData *data = [writer data];
+    [writer release];
+    return data;
+}
+
+
+- (BOOL)writeSnapshotToFile:(NSString *)path
+{
+    return [[self snapshotData] writeToFile:path atomically:YES];
+}
+
+
+@end
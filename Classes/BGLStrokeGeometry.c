@@ -0,0 +1,208 @@
+/*
+ See BGLStrokeGeometry.h.
+
+ For point i with incoming segment normal n0 and outgoing normal n1, the
+ miter direction is m = normalize(n0 + n1) and the offset along m that keeps
+ both edges at half width is halfWidth / dot(m, n1). When that exceeds the
+ miter limit, the join is bevelled instead: the point gets one vertex pair
+ along n0 and another along n1, and the strip fills the gap between them.
+ */
+
+#include "BGLStrokeGeometry.h"
+#include "BGLAccounting.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+
+static const float kDefaultMiterLimit = 4.0f;
+
+
+void BGLStrokeGeometryInit(BGLStrokeGeometry *g, float width)
+{
+    memset(g, 0, sizeof(BGLStrokeGeometry));
+    g->halfWidth = 0.5f * width;
+    g->miterLimit = kDefaultMiterLimit;
+    g->cap = kBGLStrokeCapButt;
+    g->join = kBGLStrokeJoinMiter;
+}
+
+
+void BGLStrokeGeometryFree(BGLStrokeGeometry *g)
+{
+    free(g->vertexes);
+    g->vertexes = NULL;
+    g->capacity = 0;
+    BGLStrokeGeometryReset(g);
+}
+
+
+void BGLStrokeGeometryReset(BGLStrokeGeometry *g)
+{
+    g->vertexCount = 0;
+    g->committedCount = 0;
+    g->pointCount = 0;
+    g->dirtyStart = 0;
+}
+
+
+void BGLStrokeGeometryClearDirty(BGLStrokeGeometry *g)
+{
+    g->dirtyStart = g->vertexCount;
+}
+
+
+void BGLStrokeComputeSegmentNormals(const BGLVector2 *points, BGLVector2 *normals, size_t count)
+{
+    size_t i = 0;
+#ifdef __ARM_NEON__
+    // Four segments at a time: load x/y deinterleaved, take differences,
+    // estimate 1/length with vrsqrte plus one Newton-Raphson step.
+    for (; i + 4 <= count; i += 4) {
+        float32x4x2_t p0 = vld2q_f32((const float *)&points[i]);
+        float32x4x2_t p1 = vld2q_f32((const float *)&points[i + 1]);
+        float32x4_t dx = vsubq_f32(p1.val[0], p0.val[0]);
+        float32x4_t dy = vsubq_f32(p1.val[1], p0.val[1]);
+        float32x4_t lsq = vmlaq_f32(vmulq_f32(dx, dx), dy, dy);
+        float32x4_t r = vrsqrteq_f32(lsq);
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(lsq, r), r));
+        // Zero length gives an infinite estimate; mask those lanes to zero.
+        uint32x4_t nonzero = vcgtq_f32(lsq, vdupq_n_f32(0));
+        r = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(r), nonzero));
+        float32x4x2_t n;
+        n.val[0] = vnegq_f32(vmulq_f32(dy, r));
+        n.val[1] = vmulq_f32(dx, r);
+        vst2q_f32((float *)&normals[i], n);
+    }
+#endif
+    for (; i < count; i++) {
+        float dx = points[i + 1].x - points[i].x;
+        float dy = points[i + 1].y - points[i].y;
+        float lsq = dx * dx + dy * dy;
+        if (lsq > 0) {
+            float r = 1.0f / sqrtf(lsq);
+            normals[i] = BGLVector2Make(-dy * r, dx * r);
+        } else {
+            normals[i] = BGLVector2Make(0, 0);
+        }
+    }
+}
+
+
+static inline void BGLStrokeGeometryReserve(BGLStrokeGeometry *g, size_t extra)
+{
+    size_t needed = g->vertexCount + extra;
+    if (needed > g->capacity) {
+        size_t capacity = g->capacity ? g->capacity : 256;
+        while (capacity < needed) capacity *= 2;
+        g->vertexes = realloc(g->vertexes, capacity * sizeof(BGLStrokeVertex));
+        BGLAccountAllocation(capacity * sizeof(BGLStrokeVertex));
+        g->capacity = capacity;
+    }
+}
+
+
+static inline void BGLStrokeGeometryEmitPair(BGLStrokeGeometry *g, BGLVector2 p, BGLVector2 offset, const float color[4])
+{
+    BGLStrokeVertex *v = &g->vertexes[g->vertexCount];
+    v[0].position = BGLVector2Make(p.x + offset.x, p.y + offset.y);
+    v[1].position = BGLVector2Make(p.x - offset.x, p.y - offset.y);
+    memcpy(v[0].color, color, 4 * sizeof(float));
+    memcpy(v[1].color, color, 4 * sizeof(float));
+    g->vertexCount += 2;
+}
+
+
+static void BGLStrokeGeometryEmitCap(BGLStrokeGeometry *g, BGLVector2 p, BGLVector2 n, float direction, const float color[4])
+{
+    const float hw = g->halfWidth;
+    if (g->cap == kBGLStrokeCapSquare) {
+        // Tangent is the normal rotated back by 90 degrees.
+        p.x += direction * n.y * hw;
+        p.y -= direction * n.x * hw;
+    }
+    BGLStrokeGeometryEmitPair(g, p, BGLVector2Make(n.x * hw, n.y * hw), color);
+}
+
+
+static void BGLStrokeGeometryEmitJoin(BGLStrokeGeometry *g, BGLVector2 p, BGLVector2 n0, BGLVector2 n1, const float color[4])
+{
+    const float hw = g->halfWidth;
+    BGLVector2 m = BGLVector2Make(n0.x + n1.x, n0.y + n1.y);
+    float mlen = BGLVector2Length(m);
+    float cosine = (mlen > 0) ? (m.x * n1.x + m.y * n1.y) / mlen : 0;
+
+    if (g->join == kBGLStrokeJoinMiter && cosine * g->miterLimit > 1.0f) {
+        float s = hw / (cosine * mlen);
+        BGLStrokeGeometryEmitPair(g, p, BGLVector2Make(m.x * s, m.y * s), color);
+    } else {
+        BGLStrokeGeometryEmitPair(g, p, BGLVector2Make(n0.x * hw, n0.y * hw), color);
+        BGLStrokeGeometryEmitPair(g, p, BGLVector2Make(n1.x * hw, n1.y * hw), color);
+    }
+}
+
+
+void BGLStrokeGeometryAddPoints(BGLStrokeGeometry *g, const BGLVector2 *points, const float (*colors)[4], size_t count)
+{
+    static const float kWhite[4] = { 1, 1, 1, 1 };
+
+    if (count == 0) return;
+
+    size_t i = 0;
+    if (g->pointCount == 0) {
+        g->lastPoint = points[0];
+        memcpy(g->lastColor, colors ? colors[0] : kWhite, sizeof(g->lastColor));
+        g->pointCount = 1;
+        i = 1;
+    }
+    if (i == count) return;
+
+    // Segment normals for lastPoint -> points[i] ... points[count-2] -> points[count-1],
+    // computed in one batch. Stack buffer for the common case of a few points per frame.
+    size_t segmentCount = count - i;
+    BGLVector2 pathBuffer[33], normalBuffer[32];
+    BGLVector2 *path = pathBuffer, *normals = normalBuffer;
+    if (segmentCount > 32) {
+        path = malloc((segmentCount + 1) * sizeof(BGLVector2));
+        normals = malloc(segmentCount * sizeof(BGLVector2));
+        BGLAccountAllocation((2 * segmentCount + 1) * sizeof(BGLVector2));
+    }
+    path[0] = g->lastPoint;
+    memcpy(&path[1], &points[i], segmentCount * sizeof(BGLVector2));
+    BGLStrokeComputeSegmentNormals(path, normals, segmentCount);
+
+    // Worst case is four vertexes per point plus the two in the tail.
+    BGLStrokeGeometryReserve(g, 4 * segmentCount + 2);
+
+    // Discard the provisional tail; it gets rewritten as a join below.
+    g->vertexCount = g->committedCount;
+    if (g->dirtyStart > g->vertexCount) g->dirtyStart = g->vertexCount;
+
+    for (size_t k = 0; k < segmentCount; k++) {
+        BGLVector2 n = normals[k];
+        if (n.x == 0 && n.y == 0) continue; // duplicate point
+        if (g->pointCount == 1) {
+            BGLStrokeGeometryEmitCap(g, g->lastPoint, n, -1, g->lastColor);
+        } else {
+            BGLStrokeGeometryEmitJoin(g, g->lastPoint, g->lastNormal, n, g->lastColor);
+        }
+        g->lastPoint = path[k + 1];
+        g->lastNormal = n;
+        memcpy(g->lastColor, colors ? colors[i + k] : kWhite, sizeof(g->lastColor));
+        g->pointCount += 1;
+    }
+
+    g->committedCount = g->vertexCount;
+    if (g->pointCount > 1) {
+        BGLStrokeGeometryEmitCap(g, g->lastPoint, g->lastNormal, 1, g->lastColor);
+    }
+
+    if (path != pathBuffer) {
+        free(path);
+        free(normals);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ Incremental tessellation of a growing polyline into triangle strip geometry.
+
+ Each point contributes two vertices, offset to either side of the line by
+ half the stroke width (four at a bevelled join). Only the vertices of the
+ last point are provisional, since they depend on the direction of the next
+ segment; everything before that is final once written. Appending points
+ therefore costs time proportional to the number of new points, and
+ dirtyStart tells the caller where to begin re-uploading vertex data.
+
+ This is plain C with no GL calls.
+ */
+
+#ifndef BGLSTROKEGEOMETRY_H
+#define BGLSTROKEGEOMETRY_H
+
+#include <stddef.h>
+#include "BGLMatrix.h"
+
+
+typedef enum {
+    kBGLStrokeCapButt,
+    kBGLStrokeCapSquare,
+} BGLStrokeCap;
+
+
+typedef enum {
+    kBGLStrokeJoinMiter, // bevels anyway when the miter limit is exceeded
+    kBGLStrokeJoinBevel,
+} BGLStrokeJoin;
+
+
+typedef struct {
+    BGLVector2 position;
+    float color[4];
+} BGLStrokeVertex;
+
+
+typedef struct {
+    // Output
+    BGLStrokeVertex *vertexes;
+    size_t vertexCount;
+    size_t capacity;
+    size_t dirtyStart; // first vertex changed since BGLStrokeGeometryClearDirty
+    // Style
+    float halfWidth;
+    float miterLimit;
+    BGLStrokeCap cap;
+    BGLStrokeJoin join;
+    // Tessellation state
+    size_t pointCount;
+    size_t committedCount; // vertexes before the provisional tail
+    BGLVector2 lastPoint;
+    BGLVector2 lastNormal;
+    float lastColor[4];
+} BGLStrokeGeometry;
+
+
+void BGLStrokeGeometryInit(BGLStrokeGeometry *g, float width);
+void BGLStrokeGeometryFree(BGLStrokeGeometry *g);
+void BGLStrokeGeometryReset(BGLStrokeGeometry *g);
+void BGLStrokeGeometryAddPoints(BGLStrokeGeometry *g, const BGLVector2 *points, const float (*colors)[4], size_t count);
+void BGLStrokeGeometryClearDirty(BGLStrokeGeometry *g);
+
+// Unit normals of segments points[i] -> points[i+1], for i in [0, count).
+// Zero-length segments produce a zero normal.
+void BGLStrokeComputeSegmentNormals(const BGLVector2 *points, BGLVector2 *normals, size_t count);
+
+
+#endif
@@ -0,0 +1,29 @@
+//
+//  BGLStrokeNode.h
+//  FingerPaintBall
+//
+
+#import <Foundation/Foundation.h>
+#import "BGLNode.h"
+#import "BGLUtilities.h"
+#import "BGLMatrix.h"
+#import "BGLStrokeGeometry.h"
+#import "BGLResourceRegistry.h"
+
+
+@interface BGLStrokeNode : BGLNode {
+    BGLStrokeGeometry geometry;
+    BGLColor color;
+    GLuint vertexBuffer;
+    size_t vertexBufferCapacity;
+    BGLResourceID bufferResource;
+}
+@property (nonatomic) BGLColor color; // applies to points added afterwards
+@property (nonatomic) BGLStrokeCap cap;
+@property (nonatomic) BGLStrokeJoin join;
+@property (nonatomic) float miterLimit;
+- (id)initWithWidth:(float)width;
+- (void)addPoint:(BGLVector2)point;
+- (void)addPoints:(const BGLVector2 *)points count:(NSUInteger)count;
+- (void)removeAllPoints;
+@end
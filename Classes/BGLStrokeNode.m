@@ -0,0 +1,134 @@
+//
+//  BGLStrokeNode.m
+//  FingerPaintBall
+//
+
+#import "BGLStrokeNode.h"
+#import "BGLProgram.h"
+
+#import "BGLProgramBindings.h"
+
+
+static const NSUInteger kColorBatchCount = 32;
+
+
+@implementation BGLStrokeNode
+
+
+@synthesize color;
+
+
+- (id)initWithWidth:(float)width
+{
+    if ((self = [super init])) {
+        self.program = [BGLProgram programNamed:@"Polygon"];
+        BGLStrokeGeometryInit(&geometry, width);
+        color = BGLColorWhite;
+    }
+    return self;
+}
+
+
+- (id)init
+{
+    return [self initWithWidth:1];
+}
+
+
+- (void)dealloc
+{
+    if (vertexBuffer) glDeleteBuffers(1, &vertexBuffer);
+    BGLResourceUnregister(BGLResourceRegistryGetDefault(), bufferResource);
+    BGLStrokeGeometryFree(&geometry);
+    [super dealloc];
+}
+
+
+- (BGLStrokeCap)cap { return geometry.cap; }
+- (BGLStrokeJoin)join { return geometry.join; }
+- (float)miterLimit { return geometry.miterLimit; }
+
+- (void)setCap:(BGLStrokeCap)cap { geometry.cap = cap; }
+- (void)setJoin:(BGLStrokeJoin)join { geometry.join = join; }
+- (void)setMiterLimit:(float)limit { geometry.miterLimit = limit; }
+
+
+- (void)addPoint:(BGLVector2)point
+{
+    [self addPoints:&point count:1];
+}
+
+
+- (void)addPoints:(const BGLVector2 *)points count:(NSUInteger)count
+{
+    float colors[kColorBatchCount][4];
+    for (NSUInteger i = 0; i < MIN(count, kColorBatchCount); i++) {
+        memcpy(colors[i], &color, sizeof(colors[i]));
+    }
+    while (count > 0) {
+        NSUInteger n = MIN(count, kColorBatchCount);
+        BGLStrokeGeometryAddPoints(&geometry, points, (const float (*)[4])colors, n);
+        points += n;
+        count -= n;
+    }
+    [self setNeedsDisplay];
+}
+
+
+- (void)removeAllPoints
+{
+    BGLStrokeGeometryReset(&geometry);
+    [self setNeedsDisplay];
+}
+
+
+#pragma mark BGLNode
+
+
+- (void)render
+{
+    if (geometry.vertexCount < 4) return;
+    
+    glEnable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    
+    if (vertexBuffer == 0) {
+        glGenBuffers(1, &vertexBuffer);
+        bufferResource = BGLResourceRegister(BGLResourceRegistryGetDefault(), kBGLResourceBuffer,
+                                             "BGLStrokeNode", 0, NULL, NULL);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    
+    // Only vertexes past dirtyStart have changed since the last upload.
+    // When the geometry outgrows the buffer, reallocate at the geometry's
+    // capacity so that growth is amortized like the CPU side.
+    if (geometry.capacity > vertexBufferCapacity) {
+        vertexBufferCapacity = geometry.capacity;
+        glBufferData(GL_ARRAY_BUFFER, vertexBufferCapacity * sizeof(BGLStrokeVertex), NULL, GL_DYNAMIC_DRAW);
+        BGLResourceSetSize(BGLResourceRegistryGetDefault(), bufferResource,
+                           vertexBufferCapacity * sizeof(BGLStrokeVertex));
+        geometry.dirtyStart = 0;
+    }
+    if (geometry.dirtyStart < geometry.vertexCount) {
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        geometry.dirtyStart * sizeof(BGLStrokeVertex),
+                        (geometry.vertexCount - geometry.dirtyStart) * sizeof(BGLStrokeVertex),
+                        &geometry.vertexes[geometry.dirtyStart]);
+    }
+    BGLStrokeGeometryClearDirty(&geometry);
+    
+    glVertexAttribPointer(kBGLPolygonAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, sizeof(BGLStrokeVertex), 
+                          (const GLvoid *)offsetof(BGLStrokeVertex, position));
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexPosition);
+    glVertexAttribPointer(kBGLPolygonAttributeVertexColor, 4, GL_FLOAT, GL_FALSE, sizeof(BGLStrokeVertex), 
+                          (const GLvoid *)offsetof(BGLStrokeVertex, color));
+    glEnableVertexAttribArray(kBGLPolygonAttributeVertexColor);
+    
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, geometry.vertexCount);
+    
+    // Everything else draws from client memory.
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+@end
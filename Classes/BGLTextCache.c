@@ -0,0 +1,98 @@
+/*
+ See BGLTextCache.h.
+ */
+
+#include "BGLTextCache.h"
+#include "BGLAccounting.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static uint32_t BGLTextCacheHash(const uint16_t *chars, uint32_t length)
+{
+    // FNV-1a over the UTF-16 code units.
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        h = (h ^ (chars[i] & 0xFF)) * 16777619u;
+        h = (h ^ (chars[i] >> 8)) * 16777619u;
+    }
+    return h;
+}
+
+
+static void BGLTextCacheEmpty(BGLTextCache *c, BGLTextCacheEntry *e)
+{
+    if (e->text == NULL) return;
+    c->callbacks.releaseText(e->text);
+    c->callbacks.releaseFont(e->font);
+    free(e->chars);
+    memset(e, 0, sizeof(BGLTextCacheEntry));
+}
+
+
+void BGLTextCacheInit(BGLTextCache *c, const BGLTextCacheCallbacks *callbacks)
+{
+    memset(c, 0, sizeof(BGLTextCache));
+    c->callbacks = *callbacks;
+}
+
+
+void BGLTextCacheFree(BGLTextCache *c)
+{
+    for (int i = 0; i < kBGLTextCacheCapacity; i++) {
+        BGLTextCacheEmpty(c, &c->entries[i]);
+    }
+}
+
+
+const BGLTextCacheEntry *BGLTextCacheLookup(BGLTextCache *c, void *font, const uint16_t *chars, uint32_t length)
+{
+    uint32_t hash = BGLTextCacheHash(chars, length);
+    BGLTextCacheEntry *victim = &c->entries[0];
+
+    c->clock += 1;
+
+    for (int i = 0; i < kBGLTextCacheCapacity; i++) {
+        BGLTextCacheEntry *e = &c->entries[i];
+        if (e->text == NULL) {
+            victim = e;
+            continue;
+        }
+        if (e->font == font && e->hash == hash && e->length == length &&
+            memcmp(e->chars, chars, length * sizeof(uint16_t)) == 0) {
+            e->lastUse = c->clock;
+            c->hitCount += 1;
+            return e;
+        }
+        if (victim->text && e->lastUse < victim->lastUse) {
+            victim = e;
+        }
+    }
+
+    c->missCount += 1;
+    BGLTextCacheEmpty(c, victim);
+
+    uint16_t *copy = malloc(length ? length * sizeof(uint16_t) : 1);
+    if (copy == NULL) return NULL;
+    BGLAccountAllocation(length * sizeof(uint16_t));
+    memcpy(copy, chars, length * sizeof(uint16_t));
+
+    float width = 0, height = 0;
+    void *text = c->callbacks.createText(font, chars, length, &width, &height);
+    if (text == NULL) {
+        free(copy);
+        return NULL;
+    }
+
+    c->callbacks.retainFont(font);
+    victim->font = font;
+    victim->chars = copy;
+    victim->length = length;
+    victim->hash = hash;
+    victim->text = text;
+    victim->width = width;
+    victim->height = height;
+    victim->lastUse = c->clock;
+    return victim;
+}
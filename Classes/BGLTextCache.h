@@ -0,0 +1,66 @@
+/*
+ A small LRU cache of laid-out text, keyed by (font, characters).
+
+ Laying out a string is expensive, and labels tend to cycle through the same
+ handful of strings (scores, timers), so finished layouts are kept in a
+ fixed table and the least recently used one is replaced on a miss. Fonts
+ and texts are opaque here; the callbacks lay text out and manage their
+ lifetimes. An entry retains its font, so a font can't be freed, and
+ another allocated at its address, while a layout made with it is cached.
+
+ An entry owns one reference to its text; callers retain the text they go
+ on drawing, since the entry may be replaced by the next lookup. Main
+ thread only. This is plain C with no GL calls.
+ */
+
+#ifndef BGLTEXTCACHE_H
+#define BGLTEXTCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define kBGLTextCacheCapacity 64
+
+
+typedef struct {
+    // Returns NULL if layout fails; otherwise a text the cache then owns.
+    void *(*createText)(void *font, const uint16_t *chars, uint32_t length, float *width, float *height);
+    void (*releaseText)(void *text);
+    void (*retainFont)(void *font);
+    void (*releaseFont)(void *font);
+} BGLTextCacheCallbacks;
+
+
+typedef struct {
+    void *font;                 // retained
+    uint16_t *chars;            // the cache's own copy
+    uint32_t length;
+    uint32_t hash;
+    void *text;                 // NULL if the entry is empty
+    float width;
+    float height;
+    uint32_t lastUse;
+} BGLTextCacheEntry;
+
+
+typedef struct {
+    BGLTextCacheCallbacks callbacks;
+    BGLTextCacheEntry entries[kBGLTextCacheCapacity];
+    uint32_t clock;
+    uint32_t hitCount;
+    uint32_t missCount;
+} BGLTextCache;
+
+
+void BGLTextCacheInit(BGLTextCache *c, const BGLTextCacheCallbacks *callbacks);
+// Releases every entry's text and font.
+void BGLTextCacheFree(BGLTextCache *c);
+
+// The entry stays valid until the next lookup. Returns NULL if out of
+// memory or the text can't be laid out; the cache is unchanged but for the
+// entry that would have been replaced, which is emptied.
+const BGLTextCacheEntry *BGLTextCacheLookup(BGLTextCache *c, void *font, const uint16_t *chars, uint32_t length);
+
+
+#endif
@@ -15,14 +15,32 @@
 @class BGLAnimation;
 
 @interface BGLTextNode : BGLNode {
+    NSString *fontName;
     BGLFontRef font;
     BGLTextRef text;
+    NSString *string;
+    float textWidth;
+    float textHeight;
     BGLColor color;
+    BOOL distanceField;
+    BGLColor outlineColor;
+    float outlineWidth;
+    BGLColor glowColor;
+    float glowWidth;
 }
 @property (nonatomic) BGLColor color;
+@property (nonatomic,readonly) NSString *fontName;
+@property (nonatomic,readonly) NSString *string;
+@property (nonatomic,readonly,getter=isDistanceField) BOOL distanceField;
+// Effects, only available with distance field fonts.
+@property (nonatomic) BGLColor outlineColor;
+@property (nonatomic) float outlineWidth;
+@property (nonatomic) BGLColor glowColor;
+@property (nonatomic) float glowWidth;
 @property (nonatomic,readonly) float width;
 @property (nonatomic,readonly) float height;
 - (id)initWithFontName:(NSString *)fontName;
+- (id)initWithDistanceFieldFontName:(NSString *)fontName;
 - (void)setString:(NSString *)string;
 - (BGLAnimation *)pulseAnimation;
 - (void)centerAt:(BGLVector3)position;
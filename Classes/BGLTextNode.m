@@ -15,13 +15,84 @@
 #import "BGLUtilities.h"
 #import "BGLTexture.h"
 #import "BGLScene.h"
+#import "BGLResourceRegistry.h"
+#import "BGLAccounting.h"
+#import "BGLTextCache.h"
 
-#import "BGLManifest.h"
+#import "BGLProgramBindings.h"
 
 
 static NSMutableDictionary *loadedFonts = nil;
 
 
+// Layouts are cached by (font, string); see BGLTextCache.h. Nodes retain the
+// text they are currently drawing.
+
+static void *BGLTextNodeCreateText(void *font, const uint16_t *chars, uint32_t length, float *width, float *height)
+{
+    BGLTextRef text = BGLTextCreate((BGLFontRef)font, (const unichar *)chars, length);
+    if (text == NULL) return NULL;
+    BGLAccountAllocation(0); // the text library doesn't say how much
+    *width = BGLTextGetWidth(text);
+    *height = BGLTextGetHeight(text);
+    return text;
+}
+
+
+static void BGLTextNodeReleaseText(void *text)
+{
+    BGLTextRelease((BGLTextRef)text);
+}
+
+
+static void BGLTextNodeRetainFont(void *font)
+{
+    BGLFontRetain((BGLFontRef)font);
+}
+
+
+static void BGLTextNodeReleaseFont(void *font)
+{
+    BGLFontRelease((BGLFontRef)font);
+}
+
+
+static BGLTextCache *BGLTextNodeGetCache(void)
+{
+    static BGLTextCache cache;
+    static BOOL initialized = NO;
+    if (! initialized) {
+        BGLTextCacheCallbacks callbacks = {
+            BGLTextNodeCreateText, BGLTextNodeReleaseText, BGLTextNodeRetainFont, BGLTextNodeReleaseFont
+        };
+        BGLTextCacheInit(&cache, &callbacks);
+        initialized = YES;
+    }
+    return &cache;
+}
+
+
+// Scratch buffer for characters, grown as needed but never freed.
+static unichar *charBuffer = NULL;
+static NSUInteger charBufferLength = 0;
+
+
+static const BGLTextCacheEntry *BGLTextNodeLookup(BGLFontRef font, NSString *string)
+{
+    NSUInteger length = [string length];
+    if (length > charBufferLength) {
+        NSUInteger newLength = MAX(length, 2 * charBufferLength);
+        unichar *buffer = realloc(charBuffer, newLength * sizeof(unichar));
+        if (buffer == NULL) return NULL;
+        BGLAccountAllocation(newLength * sizeof(unichar));
+        charBuffer = buffer;
+        charBufferLength = newLength;
+    }
+    [string getCharacters:charBuffer range:NSMakeRange(0, length)];
+    return BGLTextCacheLookup(BGLTextNodeGetCache(), font, (const uint16_t *)charBuffer, length);
+}
+
+
 @implementation BGLTextNode
 
 
@@ -37,57 +108,126 @@ static NSMutableDictionary *loadedFonts = nil;
         DAssert(font != NULL, @"No font named '%@'", fontName);
         value = [NSValue valueWithPointer:font];
         [loadedFonts setObject:value forKey:fontName];
+        // Atlas size is private to BGLFont, so fonts are recorded but not sized.
+        BGLResourceRegistryRef registry = BGLResourceRegistryGetDefault();
+        BGLResourceID rid = BGLResourceRegister(registry, kBGLResourceFont, [fontName UTF8String], 0, NULL, font);
+        BGLResourceSetResident(registry, rid, 1);
     }
     return (BGLFontRef)[value pointerValue];
 }
 
 
 @synthesize color;
+@synthesize fontName;
+@synthesize string;
+@synthesize distanceField;
+@synthesize outlineColor;
+@synthesize outlineWidth;
+@synthesize glowColor;
+@synthesize glowWidth;
 
 
-- (id)initWithFontName:(NSString *)fontName
+- (void)setColor:(BGLColor)aColor
+{
+    color = aColor;
+    [self setNeedsDisplay];
+}
+
+
+- (void)setOutlineColor:(BGLColor)aColor
+{
+    outlineColor = aColor;
+    [self setNeedsDisplay];
+}
+
+
+- (void)setOutlineWidth:(float)w
+{
+    outlineWidth = w;
+    [self setNeedsDisplay];
+}
+
+
+- (void)setGlowColor:(BGLColor)aColor
+{
+    glowColor = aColor;
+    [self setNeedsDisplay];
+}
+
+
+- (void)setGlowWidth:(float)w
+{
+    glowWidth = w;
+    [self setNeedsDisplay];
+}
+
+
+- (id)initWithFontName:(NSString *)aFontName
 {
     if ((self = [super init])) {
         self.program = [BGLProgram programNamed:@"Text"];
+        fontName = [aFontName copy];
         font = BGLFontRetain([BGLTextNode fontNamed:fontName]);
     }
     return self;
 }
 
 
+- (id)initWithDistanceFieldFontName:(NSString *)aFontName
+{
+    if ((self = [self initWithFontName:aFontName])) {
+        self.program = [BGLProgram programNamed:@"DistanceFieldText"];
+        distanceField = YES;
+    }
+    return self;
+}
+
+
 - (void)dealloc
 {
     BGLFontRelease(font);
     BGLTextRelease(text);
+    [string release];
+    [fontName release];
     [super dealloc];
 }
 
 
 - (float)width
 {
-    return BGLTextGetWidth(text);
+    return textWidth;
 }
 
 
 - (float)height
 {
-    return BGLTextGetHeight(text);
+    return textHeight;
 }
 
 
-- (void)setString:(NSString *)string
+- (void)setString:(NSString *)aString
 {
+    if (string == aString || [string isEqualToString:aString]) return;
+    [string release];
+    string = [aString copy];
+    if (string != aString) {
+        // Only a mutable string is actually copied, by Foundation; its size isn't ours to see.
+        BGLAccountAllocation(0);
+    }
+    
+    const BGLTextCacheEntry *e = BGLTextNodeLookup(font, string);
     if (text) BGLTextRelease(text);
-    unichar *buffer = malloc([string length] * sizeof(unichar));
-    [string getCharacters:buffer range:NSMakeRange(0, [string length])];
-    text = BGLTextCreate(font, buffer, [string length]);
-    free(buffer);
+    text = e ? BGLTextRetain((BGLTextRef)e->text) : NULL;
+    textWidth = e ? e->width : 0;
+    textHeight = e ? e->height : 0;
+    [self setNeedsDisplay];
 }
 
 
 - (void)setAlpha:(float)f
 {
     color.a = f;
+    [self setNeedsDisplay];
 }
 
 
@@ -106,8 +246,8 @@ static NSMutableDictionary *loadedFonts = nil;
 - (void)centerAt:(BGLVector3)position
 {
     [self resetModelViewMatrix];
-    [self translateBy:BGLVector3Make(position.x - 0.5f * BGLTextGetWidth(text),
-                                     position.y - 0.5f * BGLTextGetHeight(text),
+    [self translateBy:BGLVector3Make(position.x - 0.5f * textWidth,
+                                     position.y - 0.5f * textHeight,
                                      position.z)];
 }
 
@@ -116,7 +256,7 @@ static NSMutableDictionary *loadedFonts = nil;
 {
     [self resetModelViewMatrix];
     [self translateBy:BGLVector3Make(position.x,
-                                     position.y - 0.5f * BGLTextGetHeight(text),
+                                     position.y - 0.5f * textHeight,
                                      position.z)];
 }
 
@@ -124,8 +264,8 @@ static NSMutableDictionary *loadedFonts = nil;
 - (void)rightAlignAt:(BGLVector3)position
 {
     [self resetModelViewMatrix];
-    [self translateBy:BGLVector3Make(position.x - BGLTextGetWidth(text),
-                                     position.y - 0.5f * BGLTextGetHeight(text),
+    [self translateBy:BGLVector3Make(position.x - textWidth,
+                                     position.y - 0.5f * textHeight,
                                      position.z)];
 }
 
@@ -135,11 +275,24 @@ static NSMutableDictionary *loadedFonts = nil;
 
 - (void)render
 {
+    if (text == NULL) return;
     glEnable(GL_BLEND);
     glDisable(GL_DEPTH_TEST);
-    BGLUniformColor(SHU[shu_Text_color], &color);
-    BGLTextDraw(text, sha_Text_vertexPosition, sha_Text_vertexTexCoord, 
-                SHU[shu_Text_sampler]);
+    if (distanceField) {
+        BGLDistanceFieldTextSetColor((const GLfloat *)&color);
+        BGLDistanceFieldTextSetOutlineColor((const GLfloat *)&outlineColor);
+        BGLDistanceFieldTextSetOutlineWidth(outlineWidth);
+        BGLDistanceFieldTextSetGlowColor((const GLfloat *)&glowColor);
+        BGLDistanceFieldTextSetGlowWidth(glowWidth);
+        BGLTextDraw(text, kBGLDistanceFieldTextAttributeVertexPosition,
+                    kBGLDistanceFieldTextAttributeVertexTexCoord,
+                    BGLDistanceFieldTextUniforms.sampler);
+    } else {
+        BGLTextSetColor((const GLfloat *)&color);
+        BGLTextDraw(text, kBGLTextAttributeVertexPosition,
+                    kBGLTextAttributeVertexTexCoord,
+                    BGLTextUniforms.sampler);
+    }
 }
 
 
@@ -0,0 +1,250 @@
+/*
+ See BGLTextureContainer.h.
+
+ KTX 1.1: 12-byte identifier, then thirteen 32-bit header fields, key/value
+ data, and per level a 32-bit imageSize followed by the image, padded to 4
+ bytes. Files written with the other byte order are rejected rather than
+ swapped; our tools write little-endian.
+
+ PVR 3: a 52-byte header with a 64-bit pixel format, metadata, then the
+ levels largest first with no size prefixes, so sizes come from the format.
+ */
+
+#include "BGLTextureContainer.h"
+
+#include <string.h>
+
+
+static const uint8_t kKTXIdentifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+static const uint32_t kKTXEndianness = 0x04030201;
+static const size_t kKTXHeaderSize = 64;
+
+static const uint32_t kPVRVersion = 0x03525650; // "PVR\3"
+static const size_t kPVRHeaderSize = 52;
+
+
+static inline uint32_t BGLReadUInt32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static inline uint32_t BGLMax(uint32_t a, uint32_t b)
+{
+    return (a > b) ? a : b;
+}
+
+
+#pragma mark Formats
+
+
+static int BGLTextureGetBlockSize(uint32_t format, uint32_t *blockWidth, uint32_t *blockHeight, uint32_t *blockBytes)
+{
+    static const uint8_t astcBlocks[][2] = {
+        {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+        {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12},
+    };
+    switch (format) {
+        case kBGLTextureFormatETC1_RGB8:
+        case kBGLTextureFormatETC2_RGB8:
+        case kBGLTextureFormatETC2_RGB8_A1:
+            *blockWidth = 4; *blockHeight = 4; *blockBytes = 8;
+            return 1;
+        case kBGLTextureFormatETC2_RGBA8:
+            *blockWidth = 4; *blockHeight = 4; *blockBytes = 16;
+            return 1;
+        default:
+            if (format >= kBGLTextureFormatASTC_4x4 && format <= kBGLTextureFormatASTC_12x12) {
+                *blockWidth = astcBlocks[format - kBGLTextureFormatASTC_4x4][0];
+                *blockHeight = astcBlocks[format - kBGLTextureFormatASTC_4x4][1];
+                *blockBytes = 16;
+                return 1;
+            }
+            return 0;
+    }
+}
+
+
+size_t BGLTextureCompressedImageSize(uint32_t format, uint32_t width, uint32_t height)
+{
+    switch (format) {
+        // PVRTC images are padded to a minimum size.
+        case kBGLTextureFormatPVRTC_RGB_4BPP:
+        case kBGLTextureFormatPVRTC_RGBA_4BPP:
+            return (size_t)BGLMax(width, 8) * BGLMax(height, 8) * 4 / 8;
+        case kBGLTextureFormatPVRTC_RGB_2BPP:
+        case kBGLTextureFormatPVRTC_RGBA_2BPP:
+            return (size_t)BGLMax(width, 16) * BGLMax(height, 8) * 2 / 8;
+        default: {
+            uint32_t bw, bh, bytes;
+            if (! BGLTextureGetBlockSize(format, &bw, &bh, &bytes)) return 0;
+            return (size_t)((width + bw - 1) / bw) * ((height + bh - 1) / bh) * bytes;
+        }
+    }
+}
+
+
+const char *BGLTextureFormatExtension(uint32_t format)
+{
+    switch (format) {
+        case kBGLTextureFormatPVRTC_RGB_4BPP:
+        case kBGLTextureFormatPVRTC_RGB_2BPP:
+        case kBGLTextureFormatPVRTC_RGBA_4BPP:
+        case kBGLTextureFormatPVRTC_RGBA_2BPP:
+            return "GL_IMG_texture_compression_pvrtc";
+        case kBGLTextureFormatETC1_RGB8:
+            return "GL_OES_compressed_ETC1_RGB8_texture";
+        case kBGLTextureFormatETC2_RGB8:
+            return "GL_OES_compressed_ETC2_RGB8_texture";
+        case kBGLTextureFormatETC2_RGB8_A1:
+            return "GL_OES_compressed_ETC2_punchthroughA_RGBA8_texture";
+        case kBGLTextureFormatETC2_RGBA8:
+            return "GL_OES_compressed_ETC2_RGBA8_texture";
+        default:
+            if (format >= kBGLTextureFormatASTC_4x4 && format <= kBGLTextureFormatASTC_12x12) {
+                return "GL_KHR_texture_compression_astc_ldr";
+            }
+            return NULL;
+    }
+}
+
+
+int BGLTextureFormatIsSupported(uint32_t format, const char *extensions)
+{
+    const char *name = BGLTextureFormatExtension(format);
+    if (name == NULL || extensions == NULL) return 0;
+    // Match whole names only; one extension's name may prefix another's.
+    size_t n = strlen(name);
+    for (const char *p = strstr(extensions, name); p; p = strstr(p + 1, name)) {
+        if ((p == extensions || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0')) return 1;
+    }
+    return 0;
+}
+
+
+int BGLTextureSelectVariant(const uint32_t *formats, size_t count, const char *extensions)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (BGLTextureFormatIsSupported(formats[i], extensions)) return (int)i;
+    }
+    return -1;
+}
+
+
+#pragma mark Containers
+
+
+static uint32_t BGLTextureFormatForPVRPixelFormat(uint32_t low, uint32_t high)
+{
+    if (high != 0) return 0; // uncompressed channel layouts
+    switch (low) {
+        case 0: return kBGLTextureFormatPVRTC_RGB_2BPP;
+        case 1: return kBGLTextureFormatPVRTC_RGBA_2BPP;
+        case 2: return kBGLTextureFormatPVRTC_RGB_4BPP;
+        case 3: return kBGLTextureFormatPVRTC_RGBA_4BPP;
+        case 6: return kBGLTextureFormatETC1_RGB8;
+        case 22: return kBGLTextureFormatETC2_RGB8;
+        case 23: return kBGLTextureFormatETC2_RGBA8;
+        case 24: return kBGLTextureFormatETC2_RGB8_A1;
+        default:
+            if (low >= 27 && low <= 40) return kBGLTextureFormatASTC_4x4 + (low - 27);
+            return 0;
+    }
+}
+
+
+static int BGLTextureContainerParseKTX(const uint8_t *bytes, size_t length, BGLTextureContainer *c)
+{
+    if (length < kKTXHeaderSize) return 0;
+    const uint8_t *h = bytes + 12;
+    if (BGLReadUInt32(h) != kKTXEndianness) return 0;
+    uint32_t glType = BGLReadUInt32(h + 4);
+    uint32_t glFormat = BGLReadUInt32(h + 12);
+    uint32_t depth = BGLReadUInt32(h + 32);
+    uint32_t arrayElements = BGLReadUInt32(h + 36);
+    uint32_t faces = BGLReadUInt32(h + 40);
+    uint32_t levels = BGLReadUInt32(h + 44);
+    uint32_t keyValueBytes = BGLReadUInt32(h + 48);
+
+    // Compressed data has glType and glFormat 0.
+    if (glType != 0 || glFormat != 0 || depth > 1 || arrayElements > 0 || faces != 1) return 0;
+
+    c->type = kBGLTextureContainerKTX;
+    c->format = BGLReadUInt32(h + 16);
+    c->width = BGLReadUInt32(h + 24);
+    c->height = BGLReadUInt32(h + 28);
+    c->levelCount = levels ? levels : 1;
+    if (c->levelCount > kBGLTextureLevelMax) return 0;
+
+    size_t offset = kKTXHeaderSize + keyValueBytes;
+    if (offset < kKTXHeaderSize || offset > length) return 0;
+
+    for (uint32_t i = 0; i < c->levelCount; i++) {
+        BGLTextureLevel *level = &c->levels[i];
+        level->width = BGLMax(c->width >> i, 1);
+        level->height = BGLMax(c->height >> i, 1);
+        if (length - offset < 4) return 0;
+        level->size = BGLReadUInt32(bytes + offset);
+        level->offset = offset + 4;
+        if (level->size != BGLTextureCompressedImageSize(c->format, level->width, level->height)) return 0;
+        if (length - level->offset < level->size) return 0;
+        offset = level->offset + ((level->size + 3) & ~(size_t)3);
+        c->dataSize += level->size;
+        if (offset > length) offset = length; // padding after the last level is optional
+    }
+    return 1;
+}
+
+
+static int BGLTextureContainerParsePVR(const uint8_t *bytes, size_t length, BGLTextureContainer *c)
+{
+    if (length < kPVRHeaderSize) return 0;
+    uint32_t flags = BGLReadUInt32(bytes + 4);
+    uint32_t format = BGLTextureFormatForPVRPixelFormat(BGLReadUInt32(bytes + 8), BGLReadUInt32(bytes + 12));
+    uint32_t depth = BGLReadUInt32(bytes + 32);
+    uint32_t surfaces = BGLReadUInt32(bytes + 36);
+    uint32_t faces = BGLReadUInt32(bytes + 40);
+    uint32_t levels = BGLReadUInt32(bytes + 44);
+    uint32_t metadataBytes = BGLReadUInt32(bytes + 48);
+
+    (void)flags; // premultiplied alpha is the shaders' concern
+    if (format == 0 || depth > 1 || surfaces != 1 || faces != 1) return 0;
+
+    c->type = kBGLTextureContainerPVR;
+    c->format = format;
+    c->height = BGLReadUInt32(bytes + 24);
+    c->width = BGLReadUInt32(bytes + 28);
+    c->levelCount = levels ? levels : 1;
+    if (c->levelCount > kBGLTextureLevelMax) return 0;
+
+    size_t offset = kPVRHeaderSize + metadataBytes;
+    if (offset < kPVRHeaderSize || offset > length) return 0;
+
+    for (uint32_t i = 0; i < c->levelCount; i++) {
+        BGLTextureLevel *level = &c->levels[i];
+        level->width = BGLMax(c->width >> i, 1);
+        level->height = BGLMax(c->height >> i, 1);
+        level->size = BGLTextureCompressedImageSize(format, level->width, level->height);
+        level->offset = offset;
+        if (length - offset < level->size) return 0;
+        offset += level->size;
+        c->dataSize += level->size;
+    }
+    return 1;
+}
+
+
+int BGLTextureContainerParse(const void *bytes, size_t length, BGLTextureContainer *c)
+{
+    memset(c, 0, sizeof(BGLTextureContainer));
+    int ok = 0;
+    if (length >= 12 && memcmp(bytes, kKTXIdentifier, 12) == 0) {
+        ok = BGLTextureContainerParseKTX(bytes, length, c);
+    } else if (length >= 4 && BGLReadUInt32(bytes) == kPVRVersion) {
+        ok = BGLTextureContainerParsePVR(bytes, length, c);
+    }
+    if (ok && (c->width == 0 || c->height == 0 || BGLTextureFormatExtension(c->format) == NULL)) ok = 0;
+    return ok;
+}
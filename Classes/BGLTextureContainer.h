@@ -0,0 +1,82 @@
+/*
+ Parsing of KTX (version 1) and PVR (version 3) texture containers holding
+ GPU-compressed images, and selection among compressed variants.
+
+ A container is parsed in place: BGLTextureContainer records the GL format,
+ size and the byte range of each mip level within the file, so a mapped
+ file can be handed level by level to glCompressedTexImage2D without
+ copying. Only single-face 2D textures are accepted, in PVRTC, ETC1, ETC2
+ or ASTC (LDR) formats, and every level's size is checked against its
+ dimensions and the file length.
+
+ Each compressed format needs a GL extension; BGLTextureSelectVariant picks
+ the first of several formats the extension string allows, so a manifest
+ can list e.g. ASTC, then ETC2, then PVRTC, and fall back to an
+ uncompressed image when none is usable.
+
+ This is plain C with no GL calls.
+ */
+
+#ifndef BGLTEXTURECONTAINER_H
+#define BGLTEXTURECONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define kBGLTextureLevelMax 16
+
+
+// GL enum values, so this needn't include the GL headers.
+enum {
+    kBGLTextureFormatPVRTC_RGB_4BPP = 0x8C00,
+    kBGLTextureFormatPVRTC_RGB_2BPP = 0x8C01,
+    kBGLTextureFormatPVRTC_RGBA_4BPP = 0x8C02,
+    kBGLTextureFormatPVRTC_RGBA_2BPP = 0x8C03,
+    kBGLTextureFormatETC1_RGB8 = 0x8D64,
+    kBGLTextureFormatETC2_RGB8 = 0x9274,
+    kBGLTextureFormatETC2_RGB8_A1 = 0x9276,
+    kBGLTextureFormatETC2_RGBA8 = 0x9278,
+    kBGLTextureFormatASTC_4x4 = 0x93B0, // through 12x12 at 0x93BD
+    kBGLTextureFormatASTC_12x12 = 0x93BD,
+};
+
+
+typedef enum {
+    kBGLTextureContainerKTX,
+    kBGLTextureContainerPVR,
+} BGLTextureContainerType;
+
+
+typedef struct {
+    size_t offset;
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+} BGLTextureLevel;
+
+
+typedef struct {
+    BGLTextureContainerType type;
+    uint32_t format;            // GL internal format
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    BGLTextureLevel levels[kBGLTextureLevelMax];
+    size_t dataSize;            // sum of level sizes
+} BGLTextureContainer;
+
+
+// Returns 0 if the data isn't a container this can load.
+int BGLTextureContainerParse(const void *bytes, size_t length, BGLTextureContainer *c);
+
+// Returns 0 for formats this doesn't know.
+size_t BGLTextureCompressedImageSize(uint32_t format, uint32_t width, uint32_t height);
+const char *BGLTextureFormatExtension(uint32_t format);
+int BGLTextureFormatIsSupported(uint32_t format, const char *extensions);
+
+// Index of the first supported format, or -1 if none is.
+int BGLTextureSelectVariant(const uint32_t *formats, size_t count, const char *extensions);
+
+
+#endif
@@ -0,0 +1,440 @@
+/*
+ See BGLTimerWheel.h.
+ */
+
+#include "BGLTimerWheel.h"
+#include "BGLAccounting.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define kNone 0xFFFFFFFFu
+#define kSlotNone 0xFFFF
+#define kSlotBits 8
+#define kSlotMask (kBGLTimerWheelSlots - 1)
+
+static const uint32_t kDefaultCapacity = 256;
+static const uint32_t kIndexMax = kBGLNodeHandleIndexMask - 1; // handles are laid out like node handles
+static const double kTickTolerance = 1e-6; // for seconds that sum to a tick only nearly
+
+
+enum {
+    kStateFree,
+    kStateScheduled,
+    kStateSuspended,
+    kStateFiring,
+    kStateCancelled,            // while firing
+};
+
+
+#pragma mark Timers
+
+
+static inline BGLTimerHandle BGLTimerHandleMake(uint32_t index, uint32_t generation)
+{
+    return BGLNodeHandleMake(index, generation);
+}
+
+
+static uint32_t BGLTimerIndex(const BGLTimerWheel *w, BGLTimerHandle h)
+{
+    if (h == 0) return kNone;
+    uint32_t i = BGLNodeHandleIndex(h);
+    if (i >= w->end) return kNone;
+    const BGLTimer *t = &w->timers[i];
+    if (t->state == kStateFree || t->generation != BGLNodeHandleGeneration(h)) return kNone;
+    return i;
+}
+
+
+static uint32_t BGLTimerAlloc(BGLTimerWheel *w)
+{
+    uint32_t i;
+    if (w->freeHead != kNone) {
+        i = w->freeHead;
+        w->freeHead = w->timers[i].next;
+    } else {
+        if (w->end == w->capacity) {
+            if (w->capacity > kIndexMax / 2) return kNone;
+            uint32_t capacity = w->capacity ? 2 * w->capacity : kDefaultCapacity;
+            BGLTimer *timers = realloc(w->timers, capacity * sizeof(BGLTimer));
+            if (timers == NULL) return kNone;
+            BGLAccountAllocation(capacity * sizeof(BGLTimer));
+            w->timers = timers;
+            w->capacity = capacity;
+        }
+        i = w->end++;
+        w->timers[i].generation = 0;
+    }
+    w->count += 1;
+    return i;
+}
+
+
+static int BGLTimerNodeIndexIsPaused(const BGLTimerWheel *w, uint32_t node)
+{
+    const BGLNodeStore *s = w->store;
+    for (uint32_t i = node; i != kNone; i = s->parent[i]) {
+        if (s->flags[i] & kBGLNodeFlagPaused) return 1;
+    }
+    return 0;
+}
+
+
+static int BGLTimerNodeIsPaused(const BGLTimerWheel *w, BGLNodeHandle node)
+{
+    return BGLNodeStoreIsValid(w->store, node) && BGLTimerNodeIndexIsPaused(w, BGLNodeHandleIndex(node));
+}
+
+
+static void BGLTimerDiscard(BGLTimerWheel *w, uint32_t i);
+
+
+// Returns i, or kNone if out of memory.
+static uint32_t BGLTimerLinkNode(BGLTimerWheel *w, uint32_t i)
+{
+    BGLNodeHandle node = w->timers[i].node;
+    uint32_t n = BGLNodeHandleIndex(node);
+    if (n >= w->nodeCapacity) {
+        uint32_t capacity = w->nodeCapacity ? w->nodeCapacity : kDefaultCapacity;
+        while (capacity <= n) capacity *= 2;
+        uint32_t *nodeTimers = realloc(w->nodeTimers, capacity * sizeof(uint32_t));
+        if (nodeTimers == NULL) return kNone;
+        BGLAccountAllocation(capacity * sizeof(uint32_t));
+        memset(&nodeTimers[w->nodeCapacity], 0xFF, (capacity - w->nodeCapacity) * sizeof(uint32_t));
+        w->nodeTimers = nodeTimers;
+        w->nodeCapacity = capacity;
+    }
+    // Timers left by an earlier node in this slot, which was freed, are all
+    // ahead of this node's own; drop them now that the slot is in use again.
+    for (uint32_t j = w->nodeTimers[n], next; j != kNone && w->timers[j].node != node; j = next) {
+        next = w->timers[j].nodeNext;
+        BGLTimerWheelCancel(w, BGLTimerHandleMake(j, w->timers[j].generation));
+    }
+    uint32_t first = w->nodeTimers[n];
+    w->timers[i].nodePrev = kNone;
+    w->timers[i].nodeNext = first;
+    if (first != kNone) w->timers[first].nodePrev = i;
+    w->nodeTimers[n] = i;
+    return i;
+}
+
+
+static void BGLTimerUnlinkNode(BGLTimerWheel *w, uint32_t i)
+{
+    BGLTimer *t = &w->timers[i];
+    if (t->nodePrev != kNone) {
+        w->timers[t->nodePrev].nodeNext = t->nodeNext;
+    } else {
+        w->nodeTimers[BGLNodeHandleIndex(t->node)] = t->nodeNext;
+    }
+    if (t->nodeNext != kNone) w->timers[t->nodeNext].nodePrev = t->nodePrev;
+}
+
+
+// Unlinks and returns the timer to the free list, then lets go of its context.
+static void BGLTimerDiscard(BGLTimerWheel *w, uint32_t i)
+{
+    BGLTimer *t = &w->timers[i];
+    BGLTimerRelease release = t->release;
+    void *context = t->context;
+    if (t->node) BGLTimerUnlinkNode(w, i);
+    t->state = kStateFree;
+    w->count -= 1;
+    // Like a node slot, a timer out of generations is retired, not reused.
+    if (t->generation < kBGLNodeGenerationMax) {
+        t->generation += 1;
+        t->next = w->freeHead;
+        w->freeHead = i;
+    }
+    if (release) release(context);
+}
+
+
+#pragma mark Wheel
+
+
+static void BGLTimerSlotInsert(BGLTimerWheel *w, uint32_t i)
+{
+    BGLTimer *t = &w->timers[i];
+    uint64_t delta = t->due - w->now;
+    uint64_t key = t->due;
+    unsigned level = 0;
+    while (level < kBGLTimerWheelLevels - 1 && delta >= (1ull << (kSlotBits * (level + 1)))) {
+        level += 1;
+    }
+    if (delta > 0xFFFFFFFFull) {
+        // Beyond the top level; park it in the furthest slot to be looked at again.
+        key = w->now + 0xFFFFFFFFull;
+    }
+    uint32_t s = level * kBGLTimerWheelSlots + ((key >> (kSlotBits * level)) & kSlotMask);
+
+    t->slot = s;
+    t->next = kNone;
+    t->prev = w->tail[s];
+    if (t->prev != kNone) w->timers[t->prev].next = i; else w->head[s] = i;
+    w->tail[s] = i;
+}
+
+
+static void BGLTimerSlotRemove(BGLTimerWheel *w, uint32_t i)
+{
+    BGLTimer *t = &w->timers[i];
+    uint32_t s = t->slot;
+    if (t->prev != kNone) w->timers[t->prev].next = t->next; else w->head[s] = t->next;
+    if (t->next != kNone) w->timers[t->next].prev = t->prev; else w->tail[s] = t->prev;
+    t->slot = kSlotNone;
+}
+
+
+static void BGLTimerCascade(BGLTimerWheel *w, unsigned level, uint32_t index)
+{
+    uint32_t s = level * kBGLTimerWheelSlots + index;
+    uint32_t i = w->head[s];
+    w->head[s] = kNone;
+    w->tail[s] = kNone;
+    while (i != kNone) {
+        uint32_t next = w->timers[i].next;
+        BGLTimerSlotInsert(w, i);
+        i = next;
+    }
+}
+
+
+static void BGLTimerFireSlot(BGLTimerWheel *w, uint32_t s)
+{
+    // Callbacks may add to this slot only for later revolutions, since a
+    // timer scheduled now is due a tick later at the soonest.
+    while (w->head[s] != kNone) {
+        uint32_t i = w->head[s];
+        BGLTimerSlotRemove(w, i);
+        w->scheduledCount -= 1;
+        BGLTimer *t = &w->timers[i];
+        if (t->node && ! BGLNodeStoreIsValid(w->store, t->node)) {
+            BGLTimerDiscard(w, i); // its node is gone
+            continue;
+        }
+        t->state = kStateFiring;
+        t->function(t->context, BGLTimerHandleMake(i, t->generation));
+
+        t = &w->timers[i]; // the array may have grown
+        if (t->state == kStateFiring && t->interval) {
+            if (t->node && BGLTimerNodeIsPaused(w, t->node)) {
+                t->state = kStateSuspended;
+                t->due = t->interval;
+            } else {
+                t->state = kStateScheduled;
+                t->due = w->now + t->interval;
+                BGLTimerSlotInsert(w, i);
+                w->scheduledCount += 1;
+            }
+        } else {
+            BGLTimerDiscard(w, i);
+        }
+    }
+}
+
+
+void BGLTimerWheelInit(BGLTimerWheel *w, BGLNodeStore *store)
+{
+    memset(w, 0, sizeof(BGLTimerWheel));
+    memset(w->head, 0xFF, sizeof(w->head));
+    memset(w->tail, 0xFF, sizeof(w->tail));
+    w->freeHead = kNone;
+    w->store = store;
+}
+
+
+void BGLTimerWheelFree(BGLTimerWheel *w)
+{
+    for (uint32_t i = 0; i < w->end; i++) {
+        BGLTimer *t = &w->timers[i];
+        if (t->state != kStateFree && t->release) t->release(t->context);
+    }
+    free(w->timers);
+    free(w->nodeTimers);
+    w->timers = NULL;
+    w->nodeTimers = NULL;
+}
+
+
+BGLTimerHandle BGLTimerWheelSchedule(BGLTimerWheel *w, double delay, double interval, BGLNodeHandle node,
+                                     BGLTimerFunction function, void *context, BGLTimerRelease release)
+{
+    uint32_t i = BGLTimerAlloc(w);
+    if (i == kNone) return 0;
+    BGLTimer *t = &w->timers[i];
+    t->function = function;
+    t->context = context;
+    t->release = release;
+    t->node = BGLNodeStoreIsValid(w->store, node) ? node : 0;
+    t->slot = kSlotNone;
+
+    uint64_t due = (uint64_t)ceil((w->time + (delay > 0 ? delay : 0)) * kBGLTimerTicksPerSecond - kTickTolerance);
+    if (due <= w->now) due = w->now + 1;
+    double ticks = (interval > 0) ? round(interval * kBGLTimerTicksPerSecond) : 0;
+    t->interval = (ticks >= 0xFFFFFFFFu) ? 0xFFFFFFFFu : (interval > 0 && ticks < 1) ? 1 : (uint32_t)ticks;
+
+    if (t->node && BGLTimerLinkNode(w, i) == kNone) {
+        // Never handed out, so the slot goes back as it was.
+        t->state = kStateFree;
+        t->next = w->freeHead;
+        w->freeHead = i;
+        w->count -= 1;
+        return 0;
+    }
+    if (t->node && BGLTimerNodeIsPaused(w, t->node)) {
+        t->state = kStateSuspended;
+        t->due = due - w->now;
+    } else {
+        t->state = kStateScheduled;
+        t->due = due;
+        BGLTimerSlotInsert(w, i);
+        w->scheduledCount += 1;
+    }
+    return BGLTimerHandleMake(i, t->generation);
+}
+
+
+int BGLTimerWheelCancel(BGLTimerWheel *w, BGLTimerHandle timer)
+{
+    uint32_t i = BGLTimerIndex(w, timer);
+    if (i == kNone) return 0;
+    BGLTimer *t = &w->timers[i];
+    switch (t->state) {
+        case kStateFiring:
+            // Discarded once its callback returns.
+            t->state = kStateCancelled;
+            return t->interval != 0;
+        case kStateCancelled:
+            return 0;
+        case kStateScheduled:
+            BGLTimerSlotRemove(w, i);
+            w->scheduledCount -= 1;
+            break;
+    }
+    BGLTimerDiscard(w, i);
+    return 1;
+}
+
+
+int BGLTimerWheelIsPending(const BGLTimerWheel *w, BGLTimerHandle timer)
+{
+    uint32_t i = BGLTimerIndex(w, timer);
+    if (i == kNone) return 0;
+    const BGLTimer *t = &w->timers[i];
+    return (t->state == kStateScheduled || t->state == kStateSuspended ||
+            (t->state == kStateFiring && t->interval != 0));
+}
+
+
+void BGLTimerWheelAdvance(BGLTimerWheel *w, double seconds)
+{
+    w->time += seconds;
+    uint64_t target = (uint64_t)(w->time * kBGLTimerTicksPerSecond + kTickTolerance);
+    while (w->now < target) {
+        if (w->scheduledCount == 0) {
+            // Nothing in the wheel, so no slot needs looking at.
+            w->now = target;
+            break;
+        }
+        uint64_t now = ++w->now;
+        if ((now & kSlotMask) == 0) {
+            // Level 0 wrapped: bring down the next slot above it, and so on up.
+            for (unsigned level = 1; level < kBGLTimerWheelLevels; level++) {
+                uint32_t index = (now >> (kSlotBits * level)) & kSlotMask;
+                BGLTimerCascade(w, level, index);
+                if (index != 0) break;
+            }
+        }
+        BGLTimerFireSlot(w, now & kSlotMask);
+    }
+}
+
+
+#pragma mark Nodes
+
+
+typedef void (*BGLTimerNodeVisitor)(BGLTimerWheel *w, uint32_t node);
+
+
+// Visits the node and the part of its subtree not under another paused node.
+static void BGLTimerVisitUnpausedSubtree(BGLTimerWheel *w, uint32_t r, BGLTimerNodeVisitor visit)
+{
+    const BGLNodeStore *s = w->store;
+    uint32_t i = r;
+    while (i != kNone) {
+        if (i == r || ! (s->flags[i] & kBGLNodeFlagPaused)) {
+            if (i < w->nodeCapacity && w->nodeTimers[i] != kNone) visit(w, i);
+            if (s->firstChild[i] != kNone) {
+                i = s->firstChild[i];
+                continue;
+            }
+        }
+        while (i != r && s->nextSibling[i] == kNone) {
+            i = s->parent[i];
+        }
+        i = (i == r) ? kNone : s->nextSibling[i];
+    }
+}
+
+
+static void BGLTimerSuspendTimers(BGLTimerWheel *w, uint32_t node)
+{
+    BGLNodeHandle h = BGLNodeHandleMake(node, w->store->generation[node]);
+    for (uint32_t i = w->nodeTimers[node]; i != kNone; i = w->timers[i].nodeNext) {
+        BGLTimer *t = &w->timers[i];
+        if (t->state != kStateScheduled || t->node != h) continue;
+        BGLTimerSlotRemove(w, i);
+        w->scheduledCount -= 1;
+        t->state = kStateSuspended;
+        t->due -= w->now;
+    }
+}
+
+
+static void BGLTimerResumeTimers(BGLTimerWheel *w, uint32_t node)
+{
+    BGLNodeHandle h = BGLNodeHandleMake(node, w->store->generation[node]);
+    for (uint32_t i = w->nodeTimers[node]; i != kNone; i = w->timers[i].nodeNext) {
+        BGLTimer *t = &w->timers[i];
+        if (t->state != kStateSuspended || t->node != h) continue;
+        t->state = kStateScheduled;
+        // A timer due this very tick may have been suspended before its turn.
+        t->due = w->now + (t->due ? t->due : 1);
+        BGLTimerSlotInsert(w, i);
+        w->scheduledCount += 1;
+    }
+}
+
+
+void BGLTimerWheelSuspendNode(BGLTimerWheel *w, BGLNodeHandle node)
+{
+    if (w->count == 0 || ! BGLNodeStoreIsValid(w->store, node)) return;
+    uint32_t r = BGLNodeHandleIndex(node);
+    // Under a paused node, the subtree's timers are already suspended.
+    if (BGLTimerNodeIndexIsPaused(w, w->store->parent[r])) return;
+    BGLTimerVisitUnpausedSubtree(w, r, BGLTimerSuspendTimers);
+}
+
+
+void BGLTimerWheelResumeNode(BGLTimerWheel *w, BGLNodeHandle node)
+{
+    if (w->count == 0 || ! BGLNodeStoreIsValid(w->store, node) || BGLTimerNodeIsPaused(w, node)) return;
+    BGLTimerVisitUnpausedSubtree(w, BGLNodeHandleIndex(node), BGLTimerResumeTimers);
+}
+
+
+void BGLTimerWheelCancelNode(BGLTimerWheel *w, BGLNodeHandle node)
+{
+    uint32_t n = BGLNodeHandleIndex(node);
+    if (n >= w->nodeCapacity) return;
+    uint32_t i = w->nodeTimers[n];
+    while (i != kNone) {
+        uint32_t next = w->timers[i].nodeNext;
+        if (w->timers[i].node == node) BGLTimerWheelCancel(w, BGLTimerHandleMake(i, w->timers[i].generation));
+        i = next;
+    }
+}
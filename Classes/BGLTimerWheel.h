@@ -0,0 +1,117 @@
+/*
+ Delayed and repeating callbacks, kept in a hierarchical timer wheel.
+
+ Time is counted in ticks of a millisecond. The wheel has four levels of 256
+ slots; level 0 holds timers due within 256 ticks, each by its exact tick,
+ and each higher level holds timers 256 times further out, by coarser slots.
+ Whenever the lower level wraps around, the next slot of the level above is
+ emptied into the levels below it ("cascading"). Scheduling and cancelling
+ are O(1) list splices, and advancing the clock touches one level 0 slot
+ per tick plus the occasional cascade, so a frame costs the same whether a
+ hundred timers are waiting or a hundred thousand; a timer costs nothing
+ until its slot comes round.
+
+ Timers are named by handles carrying a generation count, like node handles,
+ so cancelling one that has already fired does nothing. As with nodes, a
+ timer slot is retired once its generations run out.
+
+ A timer may belong to a node. It doesn't run while that node or any node
+ above it is paused: BGLTimerWheelSuspendNode takes the subtree's timers out
+ of the wheel with the time they have left, and BGLTimerWheelResumeNode puts
+ them back. Pausing is looked at when scheduling and on those two calls
+ only; moving a node under a paused one doesn't suspend its timers. A timer
+ whose node has been freed is dropped, without being called, when it comes
+ due or when its node's slot is reused.
+
+ Callbacks may schedule and cancel timers, including their own. Main thread
+ only. This is plain C with no GL calls.
+ */
+
+#ifndef BGLTIMERWHEEL_H
+#define BGLTIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BGLNodeStore.h"
+
+
+#define kBGLTimerTicksPerSecond 1000
+#define kBGLTimerWheelLevels 4
+#define kBGLTimerWheelSlots 256
+
+
+typedef uint32_t BGLTimerHandle; // 0 is never a valid handle
+
+typedef void (*BGLTimerFunction)(void *context, BGLTimerHandle timer);
+// Called once the timer is done with its context: after firing for the last
+// time, when cancelled, or when the wheel is freed. It must not call back
+// into the wheel.
+typedef void (*BGLTimerRelease)(void *context);
+
+
+typedef struct {
+    uint64_t due;               // tick; while suspended, ticks left
+    uint32_t interval;          // ticks between repeats; 0 fires once
+    uint32_t next;              // slot list, or the free list
+    uint32_t prev;
+    uint32_t nodeNext;          // the owning node's timers
+    uint32_t nodePrev;
+    BGLNodeHandle node;         // 0 for none
+    BGLTimerFunction function;
+    BGLTimerRelease release;
+    void *context;
+    uint16_t slot;
+    uint16_t generation;
+    uint8_t state;
+} BGLTimer;
+
+
+typedef struct {
+    BGLTimer *timers;
+    uint32_t capacity;
+    uint32_t end;               // timers below this are in use or free-listed
+    uint32_t freeHead;
+    uint32_t count;             // scheduled or suspended
+    uint32_t scheduledCount;    // in the wheel
+    uint32_t head[kBGLTimerWheelLevels * kBGLTimerWheelSlots];
+    uint32_t tail[kBGLTimerWheelLevels * kBGLTimerWheelSlots];
+    uint32_t *nodeTimers;       // first timer by node slot index
+    uint32_t nodeCapacity;
+    BGLNodeStore *store;
+    uint64_t now;               // ticks
+    double time;                // seconds, which now trails by under a tick
+} BGLTimerWheel;
+
+
+void BGLTimerWheelInit(BGLTimerWheel *w, BGLNodeStore *store);
+// Releases every timer's context without firing it.
+void BGLTimerWheelFree(BGLTimerWheel *w);
+
+// Fires first after delay, then every interval if that is positive; a delay
+// of 0 fires on the next advance. node may be 0. Returns 0 if out of handles
+// or memory, in which case context is not released.
+BGLTimerHandle BGLTimerWheelSchedule(BGLTimerWheel *w, double delay, double interval, BGLNodeHandle node,
+                                     BGLTimerFunction function, void *context, BGLTimerRelease release);
+// Returns 0 if the timer had already fired for the last time or been cancelled.
+int BGLTimerWheelCancel(BGLTimerWheel *w, BGLTimerHandle timer);
+int BGLTimerWheelIsPending(const BGLTimerWheel *w, BGLTimerHandle timer);
+
+// Fires every timer that comes due, in order of due tick; timers due on the
+// same tick fire in no particular order.
+void BGLTimerWheelAdvance(BGLTimerWheel *w, double seconds);
+
+// Call after setting or clearing the node's paused flag.
+void BGLTimerWheelSuspendNode(BGLTimerWheel *w, BGLNodeHandle node);
+void BGLTimerWheelResumeNode(BGLTimerWheel *w, BGLNodeHandle node);
+// Cancels the node's own timers, not its subnodes'.
+void BGLTimerWheelCancelNode(BGLTimerWheel *w, BGLNodeHandle node);
+
+
+// Timers that will fire if the clock runs, leaving out suspended ones.
+static inline uint32_t BGLTimerWheelScheduledCount(const BGLTimerWheel *w)
+{
+    return w->scheduledCount;
+}
+
+
+#endif
@@ -9,10 +9,22 @@
 #import <UIKit/UIKit.h>
 #import <QuartzCore/QuartzCore.h>
 #import "ESRenderer.h"
+#import "Touchable.h"
+#import "BGLInputQueue.h"
 
 
 @class BGLScene;
 
+
+enum { kEAGLViewActiveTouchMax = 16 };
+
+
+typedef struct {
+    UITouch *touch;
+    id <Touchable> touchable;
+} EAGLViewActiveTouch;
+
+
 // This class wraps the CAEAGLLayer from CoreAnimation into a convenient UIView subclass.
 // The view content is basically an EAGL surface you render your OpenGL scene into.
 // Note that setting the view non-opaque will only work if the EAGL surface has an alpha channel.
@@ -20,11 +32,15 @@
 {    
 @private
     id <ESRenderer> renderer;
-    NSMutableDictionary *activeTouchables;
+    EAGLViewActiveTouch activeTouches[kEAGLViewActiveTouchMax];
+    NSUInteger activeTouchCount;
+    BGLInputQueue inputQueue; // moves waiting for the next frame
+    BOOL lowLatencyInput;
     
     BGLScene *scene;
 
     BOOL animating;
+    BOOL pausesWhenIdle;
     NSInteger animationFrameInterval;
     id displayLink;
 }
@@ -32,6 +48,10 @@
 @property (readonly, nonatomic, getter=isAnimating) BOOL animating;
 @property (nonatomic) NSInteger animationFrameInterval;
 @property (nonatomic,retain) BGLScene *scene;
+@property (nonatomic,readonly) id <ESRenderer> renderer;
+@property (nonatomic) BOOL pausesWhenIdle; // stop the display link while the scene is unchanged
+@property (nonatomic) BOOL lowLatencyInput; // deliver moves after animating, predicted to presentation
+@property (nonatomic,readonly) BGLInputLatencyStats inputLatencyStats;
 
 - (void)startAnimation;
 - (void)stopAnimation;
@@ -12,12 +12,20 @@
 #import "FPBStroke.h"
 #import "BGLScene.h"
 #import "Touchable.h"
+#import "BGLResourceRegistry.h"
+#import "BGLAccounting.h"
+
+
+static const float kInputPredictionLimit = 1.0f / 30.0f;
 
 
 @implementation EAGLView
 
 @synthesize animating;
 @synthesize scene;
+@synthesize pausesWhenIdle;
+@synthesize lowLatencyInput;
+@synthesize renderer;
 @dynamic animationFrameInterval;
 
 
@@ -34,7 +42,6 @@
     if ((self = [super initWithCoder:coder]))
     {
         self.multipleTouchEnabled = YES;
-        activeTouchables = [[NSMutableDictionary alloc] initWithCapacity:10];
         
         // Get the layer
         CAEAGLLayer *eaglLayer = (CAEAGLLayer *)self.layer;
@@ -53,6 +60,8 @@
         animating = FALSE;
         animationFrameInterval = 1;
         displayLink = nil;
+        
+        BGLInputQueueInit(&inputQueue);
 
         NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
         [center addObserver:self
@@ -63,14 +72,86 @@
                    selector:@selector(applicationWillEnterForeground:) 
                        name:UIApplicationWillEnterForegroundNotification
                      object:nil];
+        [center addObserver:self
+                   selector:@selector(applicationDidReceiveMemoryWarning:) 
+                       name:UIApplicationDidReceiveMemoryWarningNotification
+                     object:nil];
     }
 
     return self;
 }
 
 
+- (void)setScene:(BGLScene *)aScene
+{
+    if (scene != aScene) {
+        [scene setChangeTarget:nil action:NULL];
+        [scene release];
+        scene = [aScene retain];
+        [scene setChangeTarget:self action:@selector(sceneDidChange:)];
+        [scene setNeedsDisplay];
+    }
+}
+
+
+- (void)resumeDisplayLink
+{
+    if ([displayLink isPaused]) {
+        [scene syncAnimationClock];
+        [displayLink setPaused:NO];
+    }
+}
+
+
+- (void)sceneDidChange:(BGLScene *)aScene
+{
+    [self resumeDisplayLink];
+}
+
+
+- (void)setLowLatencyInput:(BOOL)flag
+{
+    lowLatencyInput = flag;
+    inputQueue.predictionLimit = flag ? kInputPredictionLimit : 0;
+}
+
+
+- (BGLInputLatencyStats)inputLatencyStats
+{
+    return inputQueue.stats;
+}
+
+
+- (CFTimeInterval)expectedPresentationTime
+{
+    // A frame drawn now appears at the vsync after the one the link fired for.
+    if (displayLink) {
+        return [displayLink timestamp] + [displayLink duration] * animationFrameInterval;
+    }
+    return CACurrentMediaTime();
+}
+
+
 - (void)drawView:(id)sender
 {
+    CFTimeInterval presentTime = [self expectedPresentationTime];
+    
+    BGLAccountFrameBegin();
+    if (! lowLatencyInput) {
+        BGLAccountPhase(kBGLAccountingPhaseInput);
+        [self deliverTouchMovesForPresentationTime:presentTime];
+    }
+    
+    // Nothing moved and nothing changed: the last presented frame is still
+    // correct, so skip both the animation pass and the render.
+    if (sender != nil && ! [scene needsDisplay] && ! BGLInputQueueHasPending(&inputQueue)) {
+        [scene skipFrame];
+        // Pending timers need the clock, though not the renderer.
+        if (pausesWhenIdle && ! [scene hasScheduledTimers]) [displayLink setPaused:YES];
+        BGLAccountFrameEnd();
+        return;
+    }
+    
 #if DEBUG
     static int frameCount = 0;
     static CFTimeInterval animationTime = 0;
@@ -81,13 +162,23 @@
     t0 = CACurrentMediaTime();
 #endif
 
+    BGLAccountPhase(kBGLAccountingPhaseAnimate);
     [scene performAnimations];
+    
+    if (lowLatencyInput) {
+        // As late as possible, so the frame shows the freshest touches.
+        BGLAccountPhase(kBGLAccountingPhaseInput);
+        [self deliverTouchMovesForPresentationTime:presentTime];
+    }
 
 #if DEBUG
     t1 = CACurrentMediaTime();
 #endif
 
+    BGLAccountPhase(kBGLAccountingPhaseRender);
     [scene renderWithRenderer:renderer];
+    BGLInputQueueFramePresented(&inputQueue, presentTime);
+    BGLAccountFrameEnd();
 
 #if DEBUG
     t2 = CACurrentMediaTime();
@@ -102,6 +193,17 @@
         }
         NSLog(@"MEAN ANIMATION TIME: %f ms", animationTime / 128.0 * 1000.0);
         NSLog(@"MEAN RENDER TIME: %f ms", renderTime / 128.0 * 1000.0);
+        if (inputQueue.stats.eventCount > 0) {
+            NSLog(@"MEAN INPUT LATENCY: %f ms (%f ms predicted, %f ms max)",
+                  BGLInputLatencyStatsMean(&inputQueue.stats) * 1000.0,
+                  BGLInputLatencyStatsMeanPredicted(&inputQueue.stats) * 1000.0,
+                  inputQueue.stats.maxLatency * 1000.0);
+            BGLInputQueueResetStats(&inputQueue);
+        }
+#ifdef BGL_ACCOUNTING
+        BGLAccountingPrintReport(stderr);
+        BGLAccountingReset();
+#endif
         frameCount = 0;
         animationTime = 0;
         renderTime = 0;
@@ -186,10 +288,24 @@
 }
 
 
+- (void)applicationDidReceiveMemoryWarning:(NSNotification *)notification
+{
+    BGLResourceRegistryRef registry = BGLResourceRegistryGetDefault();
+    BGLResourceRegistryPurge(registry);
+#if DEBUG
+    BGLResourceRegistryPrint(registry);
+#endif
+}
+
+
 - (void)dealloc
 {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
-    [activeTouchables release];
+    [scene setChangeTarget:nil action:NULL];
+    [scene release];
+    for (NSUInteger i = 0; i < activeTouchCount; i++) {
+        [activeTouches[i].touchable release];
+    }
     [renderer release];
     [super dealloc];
 }
@@ -198,15 +314,66 @@
 #pragma mark Touch Events
 
 
+- (EAGLViewActiveTouch *)activeTouchForTouch:(UITouch *)touch
+{
+    for (NSUInteger i = 0; i < activeTouchCount; i++) {
+        if (activeTouches[i].touch == touch) return &activeTouches[i];
+    }
+    return NULL;
+}
+
+
+- (void)removeActiveTouch:(EAGLViewActiveTouch *)at
+{
+    [at->touchable release];
+    activeTouchCount -= 1;
+    *at = activeTouches[activeTouchCount];
+}
+
+
+- (void)deliverTouchMovesForPresentationTime:(CFTimeInterval)presentTime
+{
+    // Moves are coalesced: only the latest point of each touch is delivered,
+    // once per frame; see BGLInputQueue.h.
+    BGLInputEvent events[kBGLInputTrackMax];
+    uint32_t n = BGLInputQueueDrain(&inputQueue, presentTime, events);
+    for (uint32_t i = 0; i < n; i++) {
+        EAGLViewActiveTouch *at = [self activeTouchForTouch:(UITouch *)events[i].key];
+        if (at) {
+            [at->touchable touch:at->touch movedToPoint:CGPointMake(events[i].x, events[i].y)];
+        }
+    }
+}
+
+
 - (void)touchesBegan:(NSSet *)touches withEvent:(UIEvent *)event
 {
+    [self resumeDisplayLink];
+    
+    UITouch *newTouches[kEAGLViewActiveTouchMax];
+    CGPoint points[kEAGLViewActiveTouchMax];
+    id <Touchable> touchables[kEAGLViewActiveTouchMax];
+    NSUInteger n = 0;
+    
     for (UITouch *touch in touches) {
-        CGPoint p = [touch locationInView:self];
-        id <Touchable> t = [scene touchableForPoint:p];
+        if (activeTouchCount + n == kEAGLViewActiveTouchMax) break;
+        newTouches[n] = touch;
+        points[n] = [touch locationInView:self];
+        n++;
+    }
+    
+    // Resolve every new touch in one pass over the scene.
+    [scene getTouchables:touchables forPoints:points count:n];
+    
+    for (NSUInteger i = 0; i < n; i++) {
+        id <Touchable> t = touchables[i];
         if (t) {
-            id key = [NSValue valueWithPointer:touch];
-            [activeTouchables setObject:t forKey:key];
-            [t touch:touch beganAtPoint:p];
+            EAGLViewActiveTouch *at = &activeTouches[activeTouchCount++];
+            at->touch = newTouches[i];
+            at->touchable = [t retain];
+            BGLInputQueueBegin(&inputQueue, (uintptr_t)newTouches[i], [newTouches[i] timestamp],
+                               points[i].x, points[i].y);
+            [t touch:newTouches[i] beganAtPoint:points[i]];
         }
     }
 }
@@ -215,24 +382,30 @@
 - (void)touchesMoved:(NSSet *)touches withEvent:(UIEvent *)event
 {
     for (UITouch *touch in touches) {
-        id key = [NSValue valueWithPointer:touch];
-        id <Touchable> t = [activeTouchables objectForKey:key];
-        if (t) {
+        EAGLViewActiveTouch *at = [self activeTouchForTouch:touch];
+        if (at) {
             CGPoint p = [touch locationInView:self];
-            [t touch:touch movedToPoint:p];
+            BGLInputQueueAddSample(&inputQueue, (uintptr_t)touch, [touch timestamp], p.x, p.y);
         }
     }
+    [self resumeDisplayLink];
 }
 
 
 - (void)touchesEnded:(NSSet *)touches withEvent:(UIEvent *)event
 {
     for (UITouch *touch in touches) {
-        id key = [NSValue valueWithPointer:touch];
-        id <Touchable> t = [activeTouchables objectForKey:key];
-        if (t) {
+        EAGLViewActiveTouch *at = [self activeTouchForTouch:touch];
+        if (at) {
+            id <Touchable> t = at->touchable;
+            // Don't lose a move that was waiting for the next frame, and
+            // don't leave the touch at a predicted point.
+            BGLInputEvent e;
+            if (BGLInputQueueEnd(&inputQueue, (uintptr_t)touch, &e)) {
+                [t touch:touch movedToPoint:CGPointMake(e.x, e.y)];
+            }
             [t touchEnded:touch];
-            [activeTouchables removeObjectForKey:key];
+            [self removeActiveTouch:at];
         }
     }
 }
@@ -241,15 +414,14 @@
 - (void)touchesCancelled:(NSSet *)touches withEvent:(UIEvent *)event
 {
     for (UITouch *touch in touches) {
-        id key = [NSValue valueWithPointer:touch];
-        id <Touchable> t = [activeTouchables objectForKey:key];
-        if (t) {
-            [t touchCancelled:touch];
-            [activeTouchables removeObjectForKey:key];
+        EAGLViewActiveTouch *at = [self activeTouchForTouch:touch];
+        if (at) {
+            BGLInputQueueEnd(&inputQueue, (uintptr_t)touch, NULL);
+            [at->touchable touchCancelled:touch];
+            [self removeActiveTouch:at];
         }
     }
 }
 
 
 @end
-
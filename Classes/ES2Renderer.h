@@ -10,20 +10,77 @@
 
 #import <OpenGLES/ES2/gl.h>
 #import <OpenGLES/ES2/glext.h>
+#import "BGLGLDispatch.h"
+
+#import "BGLResolutionController.h"
+#import "BGLOcclusion.h"
+#import "BGLDrawRecorder.h"
+
+
+@class BGLRenderState;
+
+typedef struct {
+    GLint samples;              // 1 disables multisampling
+    GLenum colorFormat;         // format of the multisample color buffer
+    GLenum depthFormat;         // 0 for no depth buffer
+    float renderScale;          // fraction of backing resolution to render at
+    BOOL adaptiveResolution;    // vary renderScale to keep frames within frameBudget
+    float frameBudget;          // seconds
+    BOOL cullsOccludedNodes;    // skip nodes hidden behind opaque ones or clipped away; see BGLOcclusion.h
+    NSUInteger recordingThreads; // 0 renders by traversal; else records on this many, see BGLDrawRecorder.h
+} BGLRendererConfiguration;
+
+
+static inline BGLRendererConfiguration BGLRendererConfigurationDefault(void)
+{
+    BGLRendererConfiguration config;
+#if TARGET_IPHONE_SIMULATOR
+    config.samples = 1;
+#else
+    config.samples = 4;
+#endif
+    config.colorFormat = GL_RGB5_A1;
+    config.depthFormat = GL_DEPTH_COMPONENT16;
+    config.renderScale = 1;
+    config.adaptiveResolution = NO;
+    config.frameBudget = 1.0f / 60.0f;
+    config.cullsOccludedNodes = NO;
+    config.recordingThreads = 0;
+    return config;
+}
+
 
 @interface ES2Renderer : NSObject <ESRenderer>
 {
 @private
     EAGLContext *context;
 
+    BGLRendererConfiguration configuration;
+    BGLResolutionController resolutionController;
+
     // The pixel dimensions of the CAEAGLLayer
     GLint backingWidth;
     GLint backingHeight;
+    
+    // The pixel dimensions actually rendered, before upscaling
+    GLint renderWidth;
+    GLint renderHeight;
 
     // The OpenGL ES names for the framebuffer and renderbuffer used to render to this view
     GLuint defaultFramebuffer, colorRenderbuffer, depthRenderbuffer;
     GLuint displayFramebuffer, displayRenderbuffer;
-}
+    GLuint scaledFramebuffer, scaledTexture;
 
+    NSUInteger captureFramesRemaining;
+    
+    BGLOcclusionBuffer occlusion;
+    BGLRenderState *renderState;
+    BGLDrawRecorder *drawRecorder; // NULL unless recording
+}
+@property (nonatomic) BGLRendererConfiguration configuration;
+@property (nonatomic,readonly) float renderScale;
+@property (nonatomic,readonly,getter=isCapturing) BOOL capturing;
+@property (nonatomic,readonly) BGLOcclusionStats occlusionStats; // of the last frame, if culling; includes clipping
+// Records the GL calls of the next frameCount frames; see BGLCommandStream.h
+- (BOOL)captureFrames:(NSUInteger)frameCount toFile:(NSString *)path;
 @end
-
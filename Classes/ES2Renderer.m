@@ -9,10 +9,30 @@
 #import "ES2Renderer.h"
 #import "BGLNode.h"
 #import "BGLRenderState.h"
+#import "BGLProgram.h"
+#import "BGLUtilities.h"
+
+#import "BGLProgramBindings.h"
+
+
+static const GLfloat kUpscaleQuadVertexes[] = {
+    // x, y, tx, ty
+    -1, -1, 0, 0,
+     1, -1, 1, 0,
+    -1,  1, 0, 1,
+     1,  1, 1, 1,
+};
+
+
+static const uint32_t kDrawProjectionMax = 32; // programs
 
 
 @implementation ES2Renderer
 
+
+@synthesize configuration;
+
+
 // Create an OpenGL ES 2.0 context
 - (id)init
 {
@@ -26,6 +46,10 @@
             return nil;
         }
         
+        configuration = BGLRendererConfigurationDefault();
+        BGLResolutionControllerInit(&resolutionController, configuration.frameBudget);
+        renderState = [[BGLRenderState alloc] init];
+        
         [self genBuffers];
     }
 
@@ -33,16 +57,84 @@
 }
 
 
+- (void)setConfiguration:(BGLRendererConfiguration)config
+{
+    if (drawRecorder && config.recordingThreads != configuration.recordingThreads) {
+        BGLDrawRecorderFree(drawRecorder);
+        free(drawRecorder);
+        drawRecorder = NULL;
+    }
+    configuration = config;
+    BGLResolutionControllerInit(&resolutionController, configuration.frameBudget);
+    resolutionController.scale = configuration.renderScale;
+    if (backingWidth > 0) {
+        [self allocateRenderStorage];
+    }
+}
+
+
+- (float)renderScale
+{
+    return configuration.renderScale;
+}
+
+
+- (BGLOcclusionStats)occlusionStats
+{
+    return occlusion.stats;
+}
+
+
+- (BOOL)isCapturing
+{
+    return captureFramesRemaining > 0;
+}
+
+
+- (BOOL)captureFrames:(NSUInteger)frameCount toFile:(NSString *)path
+{
+    if (frameCount == 0 || captureFramesRemaining > 0) return NO;
+    if (! BGLGLCaptureBegin([path fileSystemRepresentation])) {
+        DLog(@"Could not start capture to %@", path);
+        return NO;
+    }
+    captureFramesRemaining = frameCount;
+    return YES;
+}
+
+
+- (BOOL)isMultisampled
+{
+    return configuration.samples > 1;
+}
+
+
+- (BOOL)isScaled
+{
+    return configuration.renderScale < 1;
+}
+
+
+- (GLuint)drawFramebuffer
+{
+    if ([self isMultisampled]) return defaultFramebuffer;
+    if ([self isScaled]) return scaledFramebuffer;
+    return displayFramebuffer;
+}
+
+
 - (void)genBuffers
 {
-    GLuint fbs[2];
+    GLuint fbs[3];
     GLuint rbs[3];
     
-    glGenFramebuffers(2, fbs);
+    glGenFramebuffers(3, fbs);
     glGenRenderbuffers(3, rbs);
+    glGenTextures(1, &scaledTexture);
     
     displayFramebuffer = fbs[0];
     defaultFramebuffer = fbs[1];
+    scaledFramebuffer = fbs[2];
     displayRenderbuffer = rbs[0];
     colorRenderbuffer = rbs[1];
     depthRenderbuffer = rbs[2];
@@ -54,8 +146,12 @@
     glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
     glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    
+    glBindTexture(GL_TEXTURE_2D, scaledTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
 
@@ -75,20 +171,58 @@
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &backingWidth);
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &backingHeight);
 
-#if TARGET_IPHONE_SIMULATOR
-    static const GLint samples = 1;
-#else
-    static const GLint samples = 4;
-#endif
+    return [self allocateRenderStorage];
+}
+
+
+- (BOOL)allocateRenderStorage
+{
+    const GLint samples = configuration.samples;
+    const BOOL multisampled = [self isMultisampled];
+    const BOOL scaled = [self isScaled];
+    const BOOL depth = (configuration.depthFormat != 0);
     
-    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+    renderWidth = MAX(1, (GLint)(backingWidth * configuration.renderScale + 0.5f));
+    renderHeight = MAX(1, (GLint)(backingHeight * configuration.renderScale + 0.5f));
     
-    glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
-    glRenderbufferStorageMultisampleAPPLE(GL_RENDERBUFFER, samples, GL_RGB5_A1, backingWidth, backingHeight);
+    // The depth buffer belongs to whichever framebuffer is drawn into.
+    GLuint drawFramebuffer = [self drawFramebuffer];
     
-    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
-    glRenderbufferStorageMultisampleAPPLE(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT16, backingWidth, backingHeight);
-
+    if (depth) {
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        if (multisampled) {
+            glRenderbufferStorageMultisampleAPPLE(GL_RENDERBUFFER, samples, configuration.depthFormat, renderWidth, renderHeight);
+        } else {
+            glRenderbufferStorage(GL_RENDERBUFFER, configuration.depthFormat, renderWidth, renderHeight);
+        }
+    }
+    
+    const GLuint fbs[] = { displayFramebuffer, defaultFramebuffer, scaledFramebuffer };
+    for (int i = 0; i < 3; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbs[i]);
+        GLuint rb = (depth && fbs[i] == drawFramebuffer) ? depthRenderbuffer : 0;
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rb);
+    }
+    
+    if (multisampled) {
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+        glRenderbufferStorageMultisampleAPPLE(GL_RENDERBUFFER, samples, configuration.colorFormat, renderWidth, renderHeight);
+    }
+    
+    if (scaled) {
+        glBindFramebuffer(GL_FRAMEBUFFER, scaledFramebuffer);
+        glBindTexture(GL_TEXTURE_2D, scaledTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, renderWidth, renderHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scaledTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            NSLog(@"Failed to make complete scaled framebuffer object %x", glCheckFramebufferStatus(GL_FRAMEBUFFER));
+            return NO;
+        }
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
         NSLog(@"Failed to make complete default framebuffer object %x", glCheckFramebufferStatus(GL_FRAMEBUFFER));
@@ -101,15 +235,41 @@
 
 - (void)deleteBuffers
 {
-    const GLuint fbs[] = { defaultFramebuffer, displayFramebuffer };
+    const GLuint fbs[] = { defaultFramebuffer, displayFramebuffer, scaledFramebuffer };
     const GLuint rbs[] = { colorRenderbuffer, depthRenderbuffer, displayRenderbuffer };
-    glDeleteFramebuffers(2, fbs);
+    glDeleteFramebuffers(3, fbs);
     glDeleteRenderbuffers(3, rbs);
+    glDeleteTextures(1, &scaledTexture);
     defaultFramebuffer = 0;
     displayFramebuffer = 0;
+    scaledFramebuffer = 0;
     colorRenderbuffer = 0;
     depthRenderbuffer = 0;
     displayRenderbuffer = 0;
+    scaledTexture = 0;
+}
+
+
+- (void)drawScaledTexture
+{
+    [[BGLProgram programNamed:@"Rasterized"] use];
+    
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glViewport(0, 0, backingWidth, backingHeight);
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, scaledTexture);
+    BGLRasterizedSetSampler(0);
+    
+    glVertexAttribPointer(kBGLRasterizedAttributeVertexPosition, 2, GL_FLOAT, GL_FALSE, 
+                          4 * sizeof(GLfloat), &kUpscaleQuadVertexes[0]);
+    glEnableVertexAttribArray(kBGLRasterizedAttributeVertexPosition);
+    glVertexAttribPointer(kBGLRasterizedAttributeVertexTexCoord, 2, GL_FLOAT, GL_FALSE, 
+                          4 * sizeof(GLfloat), &kUpscaleQuadVertexes[2]);
+    glEnableVertexAttribArray(kBGLRasterizedAttributeVertexTexCoord);
+    
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
 
@@ -119,38 +279,101 @@
     // This call is redundant, but needed if dealing with multiple contexts.
     // [EAGLContext setCurrentContext:context];
     
-    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+    CFTimeInterval t0 = CACurrentMediaTime();
+    const BOOL multisampled = [self isMultisampled];
+    const BOOL scaled = [self isScaled];
+    const BOOL depth = (configuration.depthFormat != 0);
+    
+    if (captureFramesRemaining > 0) BGLGLCaptureFrame();
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, [self drawFramebuffer]);
     
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glViewport(0, 0, backingWidth, backingHeight);
+    glViewport(0, 0, renderWidth, renderHeight);
     
     // Clear background
     glClearColor(0, 0, 0, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClear(depth ? (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT) : GL_COLOR_BUFFER_BIT);
     
-    BGLRenderState *state = [[BGLRenderState alloc] init];
-    [rootNode renderSelfAndSubnodesWithState:state];
-    [state release];
+    if (configuration.cullsOccludedNodes) {
+        BGLMatrix identity;
+        BGLMatrixLoadIdentity(identity);
+        BGLOcclusionBegin(&occlusion, renderWidth, renderHeight);
+        [rootNode addToOcclusionBuffer:&occlusion parentMatrix:identity];
+        BGLOcclusionResolve(&occlusion);
+        [BGLNode markOccludedNodes:&occlusion];
+    }
+    
+    // Reused, so a steady frame allocates nothing here.
+    [renderState resetWithViewportWidth:renderWidth height:renderHeight];
+    if (configuration.recordingThreads > 0) {
+        if (drawRecorder == NULL) {
+            drawRecorder = malloc(sizeof(BGLDrawRecorder));
+            BGLDrawRecorderInit(drawRecorder, configuration.recordingThreads);
+        }
+        BGLDrawProjection projections[kDrawProjectionMax];
+        uint32_t projectionCount = [BGLProgram getDrawProjections:projections max:kDrawProjectionMax];
+        const BGLDrawList *list = BGLDrawRecorderRecord(drawRecorder, BGLNodeStoreGetDefault(), rootNode.handle,
+                                                        projections, projectionCount);
+        [BGLNode submitDrawList:list state:renderState];
+    } else {
+        [rootNode renderSelfAndSubnodesWithState:renderState];
+    }
     
     glDisable(GL_SCISSOR_TEST);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER_APPLE, defaultFramebuffer);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER_APPLE, displayFramebuffer);
-    glResolveMultisampleFramebufferAPPLE();
     
-    // Hint to hardware that we're not going to look at these buffers again,
-    // so feel free to trash them for performance's sake.
-    GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
-    glDiscardFramebufferEXT(GL_READ_FRAMEBUFFER_APPLE, 2, attachments);
+    if (multisampled) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER_APPLE, defaultFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER_APPLE, scaled ? scaledFramebuffer : displayFramebuffer);
+        glResolveMultisampleFramebufferAPPLE();
+        
+        // Hint to hardware that we're not going to look at these buffers again,
+        // so feel free to trash them for performance's sake.
+        GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+        glDiscardFramebufferEXT(GL_READ_FRAMEBUFFER_APPLE, depth ? 2 : 1, attachments);
+    } else if (depth) {
+        GLenum attachments[] = { GL_DEPTH_ATTACHMENT };
+        glDiscardFramebufferEXT(GL_FRAMEBUFFER, 1, attachments);
+    }
     
     glBindFramebuffer(GL_FRAMEBUFFER, displayFramebuffer);
+    if (scaled) {
+        [self drawScaledTexture];
+    }
     glBindRenderbuffer(GL_RENDERBUFFER, displayRenderbuffer);
     [context presentRenderbuffer:GL_RENDERBUFFER];
+    
+    if (captureFramesRemaining > 0) {
+        captureFramesRemaining -= 1;
+        if (captureFramesRemaining == 0) {
+            BGLGLCaptureEnd();
+            DLog(@"Capture finished");
+        }
+    }
+    
+    if (configuration.adaptiveResolution) {
+        // CPU time through the present, which misses GPU work the driver defers; see BGLResolutionController.h.
+        float frameTime = CACurrentMediaTime() - t0;
+        if (BGLResolutionControllerUpdate(&resolutionController, frameTime)) {
+            configuration.renderScale = resolutionController.scale;
+            DLog(@"Render scale now %.3f (mean frame time %.2f ms)",
+                 configuration.renderScale, resolutionController.average * 1000.0f);
+            [self allocateRenderStorage];
+        }
+    }
 }
 
 
 - (void)dealloc
 {
+    if (captureFramesRemaining > 0) BGLGLCaptureEnd();
     [self deleteBuffers];
+    BGLOcclusionBufferFree(&occlusion);
+    [renderState release];
+    if (drawRecorder) {
+        BGLDrawRecorderFree(drawRecorder);
+        free(drawRecorder);
+    }
 
     if ([EAGLContext currentContext] == context) {
         [EAGLContext setCurrentContext:nil];
@@ -0,0 +1,1125 @@
+/*
+ bglbench: times the scene graph's plain C kernels and checks the results
+ against a stored baseline.
+
+ No GL and no Objective-C runtime are needed, so this runs anywhere. The
+ node benchmarks drive BGLNodeStore directly with the same walks BGLNode
+ makes: adding and removing subnodes is linking and unlinking, nodeWithTag:
+ and hitTest: are preorder walks over the child links (the latter inverting
+ each local matrix), and an animation tick on transform-component nodes is
+ editing components and recomposing world matrices. What this leaves out is
+ message dispatch and -render itself; bglreplay's null driver times the GL
+ side of a captured frame.
+
+ The matrix benchmarks with a _general twin time a fast path against the
+ way it was done before: translate and rotate by building the operation's
+ matrix and multiplying it in, and the general 4x4 inverse. Translating and
+ rotating run on the same matrices over and over, so they drift, harmlessly.
+
+ The draw_record benchmarks time BGLDrawRecorder's record phase on 1, 2, 4
+ and 8 threads, over a tree of nodes that all draw, to show how it scales
+ with cores. Each first checks that its merged list matches one recorded on
+ a single thread, and exits with status 3 if not.
+
+ The timer benchmarks work a BGLTimerWheel with 100,000 timers whatever -n
+ says: scheduling and cancelling them all; scheduling them over ten seconds
+ and running 60 Hz frames until every one has fired (exiting with status 3
+ if any didn't); and one frame with all of them still waiting, which should
+ cost the same as one frame with a single timer waiting.
+
+ The text_labels benchmarks are one frame of 1,000 labels setting their
+ strings through BGLTextCache, with a stand-in layout that allocates a quad
+ per character: labels cycling through a clock's 60 strings, which the
+ cache serves, and labels each counting up, which it can't.
+
+ The stroke benchmarks tessellate a 100,000 point random walk through
+ BGLStrokeGeometry, a point per call as touches arrive one at a time, and
+ 32 points per call as a frame's worth of coalesced touches do.
+
+ Build and run (any C99 compiler on a POSIX system; the library uses M_PI):
+
+    cc -std=gnu99 -O2 -I../Classes -o bglbench bglbench.c ../Classes/BGLMatrix.c \
+        ../Classes/BGLNodeStore.c ../Classes/BGLParticleSystem.c ../Classes/BGLOcclusion.c \
+        ../Classes/BGLDrawRecorder.c ../Classes/BGLTimerWheel.c ../Classes/BGLTextCache.c \
+        ../Classes/BGLStrokeGeometry.c -lm -lpthread
+    ./bglbench [-n 100,1000,10000] [-r repeat] [-f filter] [-o results.json]
+    ./bglbench -c baseline.json [-t 0.10]
+    ./bglbench -m [-n sizes]
+
+ Each benchmark runs at every scene size given with -n (the matrix kernels
+ ignore it), as many iterations as fill a 20 ms sample, and the fastest of
+ -r samples is kept. Results are JSON, one benchmark per line. With -c, the
+ run is compared against a baseline written earlier by -o; any benchmark
+ more than -t (a fraction) slower is reported and the exit status is 1.
+
+ With -m, nothing is timed; instead each -n builds the node benchmarks'
+ tree and reports the node store's memory: bytes per slot, and bytes per
+ node with the store's own struct and unused capacity counted in.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BGLMatrix.h"
+#include "BGLNodeStore.h"
+#include "BGLParticleSystem.h"
+#include "BGLOcclusion.h"
+#include "BGLDrawRecorder.h"
+#include "BGLTimerWheel.h"
+#include "BGLTextCache.h"
+#include "BGLStrokeGeometry.h"
+
+
+#define kSizeMax 16
+#define kResultMax 256
+#define kMatrixBatch 1024
+#define kFanout 8
+#define kTimerCount 100000
+#define kLabelCount 1000
+#define kStrokePointCount 100000
+
+
+static const double kSampleSeconds = 0.02;
+
+
+typedef struct {
+    const char *name;
+    int sized;                  // uses the scene size
+    void *(*setup)(unsigned n);
+    void (*run)(void *ctx, unsigned n);
+    void (*teardown)(void *ctx);
+    unsigned (*items)(unsigned n); // work items per run, for per-item times
+} Benchmark;
+
+
+typedef struct {
+    char name[64];
+    unsigned n;
+    double nsPerRun;
+    double nsPerItem;
+} Result;
+
+
+static volatile float sink; // keeps results alive past the optimizer
+
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static unsigned ItemsBatch(unsigned n)
+{
+    (void)n;
+    return kMatrixBatch;
+}
+
+
+static unsigned ItemsN(unsigned n)
+{
+    return n;
+}
+
+
+static void FreeContext(void *ctx)
+{
+    free(ctx);
+}
+
+
+// Matrix kernels
+
+
+typedef struct {
+    BGLMatrix a[kMatrixBatch];
+    BGLMatrix b[kMatrixBatch];
+    BGLMatrix out[kMatrixBatch];
+    BGLTransformComponents tc[kMatrixBatch];
+    BGLVector3 v[kMatrixBatch];
+} MatrixContext;
+
+
+static void *MatrixSetup(unsigned n)
+{
+    (void)n;
+    MatrixContext *c = malloc(sizeof(MatrixContext));
+    for (int i = 0; i < kMatrixBatch; i++) {
+        BGLMatrixLoadIdentity(c->a[i]);
+        BGLMatrixTranslate(c->a[i], i, 2 * i, 0);
+        BGLMatrixRotate(c->a[i], i % 360, 0, 0, 1);
+        BGLMatrixScale(c->a[i], 1 + i % 3, 1 + i % 5, 1);
+        BGLMatrixLoadIdentity(c->b[i]);
+        BGLMatrixRotate(c->b[i], (i * 7) % 360, 0, 0, 1);
+        BGLMatrixTranslate(c->b[i], -i, i, 0);
+        BGLMatrixGetTransformComponents(c->a[i], &c->tc[i]);
+        c->v[i] = BGLVector3Make(i, -i, 0);
+    }
+    return c;
+}
+
+
+static void MatrixMultiplyRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixMultiply(c->out[i], c->a[i], c->b[i]);
+    sink = c->out[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixMultiplyAffineRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixMultiplyAffine(c->out[i], c->a[i], c->b[i]);
+    sink = c->out[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixInvertRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixInvert(c->out[i], c->a[i]);
+    sink = c->out[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixInvertAffineRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixInvertAffine(c->out[i], c->a[i]);
+    sink = c->out[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixComposeRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixLoadTransformComponents(c->out[i], &c->tc[i]);
+    sink = c->out[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixApplyRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    float sum = 0;
+    for (int i = 0; i < kMatrixBatch; i++) sum += BGLMatrixApplyTransform(c->a[i], c->v[i]).x;
+    sink = sum;
+}
+
+
+// Translate and rotate as they were before the fast paths, for comparison:
+// build the operation's matrix and multiply it in.
+static void GeneralTranslate(BGLMatrix m, float x, float y, float z)
+{
+    BGLMatrix t;
+    BGLMatrixLoadIdentity(t);
+    t[12] = x; t[13] = y; t[14] = z;
+    BGLMatrixMultiply(m, t, m);
+}
+
+
+static void GeneralRotateZ(BGLMatrix m, float degrees)
+{
+    BGLMatrix t;
+    float radians = degrees * (3.14159265358979 / 180); // M_PI is hidden by _POSIX_C_SOURCE
+    BGLMatrixLoadIdentity(t);
+    t[0] = cosf(radians); t[4] = -sinf(radians);
+    t[1] = sinf(radians); t[5] = cosf(radians);
+    BGLMatrixMultiply(m, t, m);
+}
+
+
+static void MatrixTranslateRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixTranslate(c->a[i], 1, -1, 0);
+    sink = c->a[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixTranslateGeneralRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) GeneralTranslate(c->a[i], 1, -1, 0);
+    sink = c->a[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixRotateRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixRotate(c->a[i], 1, 0, 0, 1);
+    sink = c->a[kMatrixBatch - 1][0];
+}
+
+
+static void MatrixRotateGeneralRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) GeneralRotateZ(c->a[i], 1);
+    sink = c->a[kMatrixBatch - 1][0];
+}
+
+
+static void MatrixInvertGeneralRun(void *ctx, unsigned n)
+{
+    // The general inverse, kept from taking the affine path by a last row
+    // that is not quite <0,0,0,1>.
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) {
+        c->b[i][3] = 1e-30f;
+        BGLMatrixInvert(c->out[i], c->b[i]);
+    }
+    sink = c->out[kMatrixBatch - 1][12];
+}
+
+
+static void MatrixDecomposeRun(void *ctx, unsigned n)
+{
+    (void)n;
+    MatrixContext *c = ctx;
+    for (int i = 0; i < kMatrixBatch; i++) BGLMatrixGetTransformComponents(c->a[i], &c->tc[i]);
+    sink = c->tc[kMatrixBatch - 1].rotation.w;
+}
+
+
+// Node store
+//
+// Scenes are trees of n nodes plus a root, kFanout children per node, built
+// breadth first; every node is a unit square at an offset from its parent.
+
+
+typedef struct {
+    BGLNodeStore *store;
+    BGLNodeHandle root;
+    BGLNodeHandle *nodes;
+    int *tags;                  // by slot index, as BGLNode's tag ivar
+    BGLMatrix identity;
+} SceneContext;
+
+
+static void *SceneSetup(unsigned n)
+{
+    SceneContext *c = calloc(1, sizeof(SceneContext));
+    c->store = BGLNodeStoreCreate(n + 1);
+    c->root = BGLNodeStoreAlloc(c->store);
+    c->nodes = malloc(n * sizeof(BGLNodeHandle));
+    BGLMatrixLoadIdentity(c->identity);
+    for (unsigned i = 0; i < n; i++) {
+        BGLNodeHandle parent = (i < kFanout) ? c->root : c->nodes[i / kFanout - 1];
+        c->nodes[i] = BGLNodeStoreAlloc(c->store);
+        BGLMatrixTranslate(BGLNodeStoreLocalMatrix(c->store, c->nodes[i]), 0.5f + i % 3, 0.25f, 0);
+        BGLNodeStoreLink(c->store, parent, c->nodes[i]);
+    }
+    c->tags = calloc(c->store->capacity, sizeof(int));
+    return c;
+}
+
+
+static void SceneTeardown(void *ctx)
+{
+    SceneContext *c = ctx;
+    BGLNodeStoreDestroy(c->store);
+    free(c->nodes);
+    free(c->tags);
+    free(c);
+}
+
+
+static void *FlatSceneSetup(unsigned n)
+{
+    // Every node a child of the root, as when a layer holds many sprites.
+    SceneContext *c = calloc(1, sizeof(SceneContext));
+    c->store = BGLNodeStoreCreate(n + 1);
+    c->root = BGLNodeStoreAlloc(c->store);
+    c->nodes = malloc(n * sizeof(BGLNodeHandle));
+    for (unsigned i = 0; i < n; i++) {
+        c->nodes[i] = BGLNodeStoreAlloc(c->store);
+        BGLNodeStoreLink(c->store, c->root, c->nodes[i]);
+    }
+    return c;
+}
+
+
+static void StoreAddRemoveRun(void *ctx, unsigned n)
+{
+    // Remove every other child, then add them back at the end.
+    SceneContext *c = ctx;
+    for (unsigned i = 0; i < n; i += 2) BGLNodeStoreUnlink(c->store, c->nodes[i]);
+    for (unsigned i = 0; i < n; i += 2) BGLNodeStoreLink(c->store, c->root, c->nodes[i]);
+}
+
+
+static void StoreAllocFreeRun(void *ctx, unsigned n)
+{
+    SceneContext *c = ctx;
+    for (unsigned i = 0; i < n; i++) BGLNodeStoreUnlink(c->store, c->nodes[i]);
+    for (unsigned i = 0; i < n; i++) BGLNodeStoreFree(c->store, c->nodes[i]);
+    for (unsigned i = 0; i < n; i++) {
+        c->nodes[i] = BGLNodeStoreAlloc(c->store);
+        BGLNodeStoreLink(c->store, c->root, c->nodes[i]);
+    }
+}
+
+
+static uint32_t FindTag(const SceneContext *c, uint32_t i, int tag)
+{
+    if (c->tags[i] == tag) return i;
+    for (uint32_t k = c->store->firstChild[i]; k != kBGLNodeIndexNone; k = c->store->nextSibling[k]) {
+        uint32_t found = FindTag(c, k, tag);
+        if (found != kBGLNodeIndexNone) return found;
+    }
+    return kBGLNodeIndexNone;
+}
+
+
+static void StoreTagSearchRun(void *ctx, unsigned n)
+{
+    // A miss, so the whole tree is walked.
+    (void)n;
+    SceneContext *c = ctx;
+    sink = FindTag(c, BGLNodeHandleIndex(c->root), -1);
+}
+
+
+static uint32_t HitTest(SceneContext *c, uint32_t i, BGLVector3 p0)
+{
+    BGLMatrix m;
+    if (! BGLMatrixInvert(m, BGLNodeStoreLocalMatrixAtIndex(c->store, i))) return kBGLNodeIndexNone;
+    BGLVector3 p1 = BGLMatrixApplyTransform(m, p0);
+    if (p1.x >= 0 && p1.y >= 0 && p1.x <= 1 && p1.y <= 1 && i != BGLNodeHandleIndex(c->root)) return i;
+    for (uint32_t k = c->store->firstChild[i]; k != kBGLNodeIndexNone; k = c->store->nextSibling[k]) {
+        uint32_t found = HitTest(c, k, p1);
+        if (found != kBGLNodeIndexNone) return found;
+    }
+    return kBGLNodeIndexNone;
+}
+
+
+static void StoreHitTestRun(void *ctx, unsigned n)
+{
+    // Also a miss.
+    (void)n;
+    SceneContext *c = ctx;
+    sink = HitTest(c, BGLNodeHandleIndex(c->root), BGLVector3Make(-100, -100, 0));
+}
+
+
+static void StoreWorldMatricesRun(void *ctx, unsigned n)
+{
+    (void)n;
+    SceneContext *c = ctx;
+    BGLNodeStoreUpdateWorldMatrices(c->store, c->root, c->identity);
+    sink = c->store->world[BGLNodeHandleIndex(c->nodes[0])][12];
+}
+
+
+static void *AnimatedSceneSetup(unsigned n)
+{
+    SceneContext *c = SceneSetup(n);
+    for (unsigned i = 0; i < n; i++) BGLNodeStoreSetUsesComponents(c->store, c->nodes[i], 1);
+    return c;
+}
+
+
+static void StoreAnimateRun(void *ctx, unsigned n)
+{
+    // One tick of a rotation animation on every node, then a traversal.
+    SceneContext *c = ctx;
+    BGLQuaternion step = BGLQuaternionMakeWithAngleAxis(1, 0, 0, 1);
+    for (unsigned i = 0; i < n; i++) {
+        BGLTransformComponents *tc = BGLNodeStoreGetComponents(c->store, c->nodes[i]);
+        tc->rotation = BGLQuaternionMultiply(step, tc->rotation);
+        BGLNodeStoreComponentsChanged(c->store, c->nodes[i]);
+    }
+    BGLNodeStoreUpdateWorldMatrices(c->store, c->root, c->identity);
+    sink = c->store->world[BGLNodeHandleIndex(c->nodes[n - 1])][12];
+}
+
+
+// Particles
+
+
+static void *ParticleSetup(unsigned n)
+{
+    BGLParticleSystem *ps = malloc(sizeof(BGLParticleSystem));
+    BGLParticleConfig config;
+    BGLParticleConfigLoadDefaults(&config);
+    config.life = 1e6f; // none die, so every step moves n
+    config.lifeVariance = 0;
+    BGLParticleSystemInit(ps, n, &config);
+    BGLParticleSystemSpawn(ps, n);
+    return ps;
+}
+
+
+static void ParticleTeardown(void *ctx)
+{
+    BGLParticleSystemFree(ctx);
+    free(ctx);
+}
+
+
+static void ParticleStepRun(void *ctx, unsigned n)
+{
+    (void)n;
+    BGLParticleSystemStep(ctx, 1.0f / 60.0f, 0);
+}
+
+
+// Occlusion
+
+
+typedef struct {
+    BGLOcclusionBuffer buffer;
+    BGLMatrix mvp;
+} OcclusionContext;
+
+
+static void *OcclusionSetup(unsigned n)
+{
+    (void)n;
+    OcclusionContext *c = calloc(1, sizeof(OcclusionContext));
+    BGLMatrixLoadIdentity(c->mvp);
+    BGLMatrixOrtho(c->mvp, 0, 320, 0, 480, -1, 1);
+    return c;
+}
+
+
+static void OcclusionTeardown(void *ctx)
+{
+    OcclusionContext *c = ctx;
+    BGLOcclusionBufferFree(&c->buffer);
+    free(c);
+}
+
+
+static void OcclusionRun(void *ctx, unsigned n)
+{
+    // Sprites under a few opaque panels.
+    OcclusionContext *c = ctx;
+    BGLOcclusionBegin(&c->buffer, 640, 960);
+    for (unsigned i = 0; i < n; i++) {
+        float x = (i * 37) % 300, y = (i * 91) % 460;
+        BGLOcclusionRect r = { x, y, x + 20, y + 20 };
+        BGLOcclusionRect panel = { 0, y, 320, y + 60 };
+        BGLOcclusionAdd(&c->buffer, i, c->mvp, &r, (i % 64 == 63) ? &panel : NULL);
+    }
+    BGLOcclusionResolve(&c->buffer);
+    sink = c->buffer.stats.culledArea;
+}
+
+
+static void OcclusionClippedRun(void *ctx, unsigned n)
+{
+    // The same sprites in scrolling lists, each clipped to a third of the screen.
+    OcclusionContext *c = ctx;
+    BGLOcclusionBegin(&c->buffer, 640, 960);
+    for (unsigned i = 0; i < n; i++) {
+        if (i % 64 == 0) {
+            float top = (i / 64 % 3) * 160;
+            BGLOcclusionRect list = { 10, top, 310, top + 160 };
+            if (i) BGLOcclusionPopClip(&c->buffer);
+            BGLOcclusionPushClip(&c->buffer, c->mvp, &list);
+        }
+        float x = (i * 37) % 300, y = (i * 91) % 460;
+        BGLOcclusionRect r = { x, y, x + 20, y + 20 };
+        BGLOcclusionAdd(&c->buffer, i, c->mvp, &r, NULL);
+    }
+    if (n) BGLOcclusionPopClip(&c->buffer);
+    BGLOcclusionResolve(&c->buffer);
+    sink = c->buffer.stats.clippedArea;
+}
+
+
+// Draw recording
+
+
+typedef struct {
+    SceneContext *scene;
+    BGLDrawRecorder recorder;
+    BGLDrawProjection projection;
+} RecordContext;
+
+
+static int DrawListsMatch(const BGLDrawList *a, const BGLDrawList *b)
+{
+    if (a->count != b->count) return 0;
+    for (uint32_t i = 0; i < a->count; i++) {
+        const BGLDrawCommand *x = &a->commands[i], *y = &b->commands[i];
+        if (x->sortKey != y->sortKey || x->node != y->node || x->drawKey != y->drawKey || x->kind != y->kind ||
+            memcmp(x->modelView, y->modelView, sizeof(BGLMatrix)) ||
+            memcmp(x->modelViewProjection, y->modelViewProjection, sizeof(BGLMatrix))) return 0;
+    }
+    return 1;
+}
+
+
+static void *RecordSetup(unsigned n, uint32_t threads)
+{
+    RecordContext *c = calloc(1, sizeof(RecordContext));
+    c->scene = SceneSetup(n);
+    BGLNodeStore *s = c->scene->store;
+    for (unsigned i = 0; i < n; i++) s->drawKey[BGLNodeHandleIndex(c->scene->nodes[i])] = 1 + i % 3;
+    c->projection.drawKey = 1;
+    BGLMatrixLoadIdentity(c->projection.projection);
+    BGLMatrixOrtho(c->projection.projection, 0, 320, 0, 480, -1, 1);
+
+    BGLDrawRecorder serial;
+    BGLDrawRecorderInit(&serial, 1);
+    BGLDrawRecorderInit(&c->recorder, threads);
+    const BGLDrawList *expected = BGLDrawRecorderRecord(&serial, s, c->scene->root, &c->projection, 1);
+    const BGLDrawList *actual = BGLDrawRecorderRecord(&c->recorder, s, c->scene->root, &c->projection, 1);
+    if (! DrawListsMatch(expected, actual) || expected->count != n) {
+        fprintf(stderr, "draw_record: %u threads recorded differently from one\n", threads);
+        exit(3);
+    }
+    BGLDrawRecorderFree(&serial);
+    return c;
+}
+
+
+static void *Record1Setup(unsigned n) { return RecordSetup(n, 1); }
+static void *Record2Setup(unsigned n) { return RecordSetup(n, 2); }
+static void *Record4Setup(unsigned n) { return RecordSetup(n, 4); }
+static void *Record8Setup(unsigned n) { return RecordSetup(n, 8); }
+
+
+static void RecordTeardown(void *ctx)
+{
+    RecordContext *c = ctx;
+    BGLDrawRecorderFree(&c->recorder);
+    SceneTeardown(c->scene);
+    free(c);
+}
+
+
+static void RecordRun(void *ctx, unsigned n)
+{
+    (void)n;
+    RecordContext *c = ctx;
+    const BGLDrawList *list = BGLDrawRecorderRecord(&c->recorder, c->scene->store, c->scene->root, &c->projection, 1);
+    sink = list->commands[list->count - 1].modelViewProjection[12];
+}
+
+
+// Timers
+
+
+typedef struct {
+    BGLNodeStore *store;
+    BGLTimerWheel wheel;
+    BGLTimerHandle handles[kTimerCount];
+    unsigned fired;
+} TimerContext;
+
+
+static unsigned ItemsTimers(unsigned n)
+{
+    (void)n;
+    return kTimerCount;
+}
+
+
+static unsigned ItemsOne(unsigned n)
+{
+    (void)n;
+    return 1;
+}
+
+
+static void TimerFired(void *context, BGLTimerHandle timer)
+{
+    (void)timer;
+    ((TimerContext *)context)->fired += 1;
+}
+
+
+static void *TimerSetup(unsigned n)
+{
+    (void)n;
+    TimerContext *c = calloc(1, sizeof(TimerContext));
+    c->store = BGLNodeStoreCreate(0);
+    BGLTimerWheelInit(&c->wheel, c->store);
+    return c;
+}
+
+
+static void *TimerWaitingSetup(unsigned n, unsigned count)
+{
+    // Due in about a fortnight, so no run gets near them.
+    TimerContext *c = TimerSetup(n);
+    for (unsigned i = 0; i < count; i++) {
+        BGLTimerWheelSchedule(&c->wheel, 1e6 + (i * 7919) % 100000, 0, 0, TimerFired, c, NULL);
+    }
+    return c;
+}
+
+
+static void *TimerWaiting1Setup(unsigned n) { return TimerWaitingSetup(n, 1); }
+static void *TimerWaitingAllSetup(unsigned n) { return TimerWaitingSetup(n, kTimerCount); }
+
+
+static void TimerTeardown(void *ctx)
+{
+    TimerContext *c = ctx;
+    BGLTimerWheelFree(&c->wheel);
+    BGLNodeStoreDestroy(c->store);
+    free(c);
+}
+
+
+static void TimerScheduleCancelRun(void *ctx, unsigned n)
+{
+    (void)n;
+    TimerContext *c = ctx;
+    for (unsigned i = 0; i < kTimerCount; i++) {
+        double delay = (i * 7919) % 10000 * 0.001;
+        c->handles[i] = BGLTimerWheelSchedule(&c->wheel, delay, 0, 0, TimerFired, c, NULL);
+    }
+    for (unsigned i = 0; i < kTimerCount; i++) {
+        BGLTimerWheelCancel(&c->wheel, c->handles[i]);
+    }
+}
+
+
+static void TimerScheduleFireRun(void *ctx, unsigned n)
+{
+    (void)n;
+    TimerContext *c = ctx;
+    c->fired = 0;
+    for (unsigned i = 0; i < kTimerCount; i++) {
+        double delay = (i * 7919) % 10000 * 0.001;
+        BGLTimerWheelSchedule(&c->wheel, delay, 0, 0, TimerFired, c, NULL);
+    }
+    while (BGLTimerWheelScheduledCount(&c->wheel)) {
+        BGLTimerWheelAdvance(&c->wheel, 1.0 / 60.0);
+    }
+    if (c->fired != kTimerCount) {
+        fprintf(stderr, "timer_schedule_fire: %u of %u timers fired\n", c->fired, kTimerCount);
+        exit(3);
+    }
+}
+
+
+static void TimerFrameRun(void *ctx, unsigned n)
+{
+    (void)n;
+    TimerContext *c = ctx;
+    BGLTimerWheelAdvance(&c->wheel, 1.0 / 60.0);
+}
+
+
+// Text labels
+
+
+typedef struct {
+    BGLTextCache cache;
+    int font;                   // its address stands in for a font
+    unsigned frame;
+    uint16_t chars[16];
+} LabelContext;
+
+
+static void *LabelCreateText(void *font, const uint16_t *chars, uint32_t length, float *width, float *height)
+{
+    (void)font;
+    float *quads = malloc((length ? length : 1) * 16 * sizeof(float));
+    for (uint32_t i = 0; i < length; i++) quads[16 * i] = chars[i];
+    *width = 10.0f * length;
+    *height = 16;
+    return quads;
+}
+
+
+static void LabelReleaseText(void *text)
+{
+    free(text);
+}
+
+
+static void LabelRetainFont(void *font)
+{
+    (void)font;
+}
+
+
+static unsigned ItemsLabels(unsigned n)
+{
+    (void)n;
+    return kLabelCount;
+}
+
+
+static void *LabelSetup(unsigned n)
+{
+    (void)n;
+    LabelContext *c = calloc(1, sizeof(LabelContext));
+    BGLTextCacheCallbacks callbacks = { LabelCreateText, LabelReleaseText, LabelRetainFont, LabelRetainFont };
+    BGLTextCacheInit(&c->cache, &callbacks);
+    return c;
+}
+
+
+static void LabelTeardown(void *ctx)
+{
+    LabelContext *c = ctx;
+    BGLTextCacheFree(&c->cache);
+    free(c);
+}
+
+
+static uint32_t LabelFormat(uint16_t *chars, unsigned value)
+{
+    char s[16];
+    uint32_t length = snprintf(s, sizeof(s), "%u", value);
+    for (uint32_t i = 0; i < length; i++) chars[i] = s[i];
+    return length;
+}
+
+
+static void LabelsCyclingRun(void *ctx, unsigned n)
+{
+    // Countdown clocks, all showing one of "0:00" to "0:59".
+    (void)n;
+    LabelContext *c = ctx;
+    c->frame += 1;
+    for (unsigned i = 0; i < kLabelCount; i++) {
+        unsigned seconds = (c->frame + i) % 60;
+        uint16_t chars[4] = { '0', ':', '0' + seconds / 10, '0' + seconds % 10 };
+        sink = BGLTextCacheLookup(&c->cache, &c->font, chars, 4)->width;
+    }
+}
+
+
+static void LabelsCountingRun(void *ctx, unsigned n)
+{
+    // Scores, each a number never shown before.
+    (void)n;
+    LabelContext *c = ctx;
+    c->frame += 1;
+    for (unsigned i = 0; i < kLabelCount; i++) {
+        uint32_t length = LabelFormat(c->chars, c->frame * kLabelCount + i);
+        sink = BGLTextCacheLookup(&c->cache, &c->font, c->chars, length)->width;
+    }
+}
+
+
+// Strokes
+
+
+typedef struct {
+    BGLVector2 points[kStrokePointCount];
+    BGLStrokeGeometry geometry;
+} StrokeContext;
+
+
+static unsigned ItemsStrokePoints(unsigned n)
+{
+    (void)n;
+    return kStrokePointCount;
+}
+
+
+static void *StrokeSetup(unsigned n)
+{
+    (void)n;
+    StrokeContext *c = malloc(sizeof(StrokeContext));
+    srand(31);
+    BGLVector2 p = BGLVector2Make(0, 0);
+    for (int i = 0; i < kStrokePointCount; i++) {
+        p.x += (rand() % 17) - 8;
+        p.y += (rand() % 17) - 8;
+        c->points[i] = p;
+    }
+    BGLStrokeGeometryInit(&c->geometry, 4);
+    return c;
+}
+
+
+static void StrokeTeardown(void *ctx)
+{
+    StrokeContext *c = ctx;
+    BGLStrokeGeometryFree(&c->geometry);
+    free(c);
+}
+
+
+static void StrokeAppend(StrokeContext *c, size_t batch)
+{
+    // Reset keeps the vertex storage, as a stroke node reused would.
+    BGLStrokeGeometryReset(&c->geometry);
+    for (size_t i = 0; i < kStrokePointCount; i += batch) {
+        size_t count = (kStrokePointCount - i < batch) ? kStrokePointCount - i : batch;
+        BGLStrokeGeometryAddPoints(&c->geometry, &c->points[i], NULL, count);
+    }
+    sink = c->geometry.vertexes[c->geometry.vertexCount - 1].position.x;
+}
+
+
+static void StrokeAppendSingleRun(void *ctx, unsigned n)
+{
+    (void)n;
+    StrokeAppend(ctx, 1);
+}
+
+
+static void StrokeAppendBatchedRun(void *ctx, unsigned n)
+{
+    (void)n;
+    StrokeAppend(ctx, 32);
+}
+
+
+static const Benchmark kBenchmarks[] = {
+    { "matrix_multiply", 0, MatrixSetup, MatrixMultiplyRun, FreeContext, ItemsBatch },
+    { "matrix_multiply_affine", 0, MatrixSetup, MatrixMultiplyAffineRun, FreeContext, ItemsBatch },
+    { "matrix_invert", 0, MatrixSetup, MatrixInvertRun, FreeContext, ItemsBatch },
+    { "matrix_invert_affine", 0, MatrixSetup, MatrixInvertAffineRun, FreeContext, ItemsBatch },
+    { "matrix_invert_general", 0, MatrixSetup, MatrixInvertGeneralRun, FreeContext, ItemsBatch },
+    { "matrix_translate", 0, MatrixSetup, MatrixTranslateRun, FreeContext, ItemsBatch },
+    { "matrix_translate_general", 0, MatrixSetup, MatrixTranslateGeneralRun, FreeContext, ItemsBatch },
+    { "matrix_rotate", 0, MatrixSetup, MatrixRotateRun, FreeContext, ItemsBatch },
+    { "matrix_rotate_general", 0, MatrixSetup, MatrixRotateGeneralRun, FreeContext, ItemsBatch },
+    { "matrix_decompose_components", 0, MatrixSetup, MatrixDecomposeRun, FreeContext, ItemsBatch },
+    { "matrix_compose_components", 0, MatrixSetup, MatrixComposeRun, FreeContext, ItemsBatch },
+    { "matrix_apply_transform", 0, MatrixSetup, MatrixApplyRun, FreeContext, ItemsBatch },
+    { "node_add_remove", 1, FlatSceneSetup, StoreAddRemoveRun, SceneTeardown, ItemsN },
+    { "node_alloc_free", 1, FlatSceneSetup, StoreAllocFreeRun, SceneTeardown, ItemsN },
+    { "node_tag_search", 1, SceneSetup, StoreTagSearchRun, SceneTeardown, ItemsN },
+    { "node_hit_test", 1, SceneSetup, StoreHitTestRun, SceneTeardown, ItemsN },
+    { "node_world_matrices", 1, SceneSetup, StoreWorldMatricesRun, SceneTeardown, ItemsN },
+    { "node_animate_tick", 1, AnimatedSceneSetup, StoreAnimateRun, SceneTeardown, ItemsN },
+    { "particle_step", 1, ParticleSetup, ParticleStepRun, ParticleTeardown, ItemsN },
+    { "occlusion_resolve", 1, OcclusionSetup, OcclusionRun, OcclusionTeardown, ItemsN },
+    { "occlusion_clipped", 1, OcclusionSetup, OcclusionClippedRun, OcclusionTeardown, ItemsN },
+    { "draw_record_1t", 1, Record1Setup, RecordRun, RecordTeardown, ItemsN },
+    { "draw_record_2t", 1, Record2Setup, RecordRun, RecordTeardown, ItemsN },
+    { "draw_record_4t", 1, Record4Setup, RecordRun, RecordTeardown, ItemsN },
+    { "draw_record_8t", 1, Record8Setup, RecordRun, RecordTeardown, ItemsN },
+    { "timer_schedule_cancel", 0, TimerSetup, TimerScheduleCancelRun, TimerTeardown, ItemsTimers },
+    { "timer_schedule_fire", 0, TimerSetup, TimerScheduleFireRun, TimerTeardown, ItemsTimers },
+    { "timer_frame_1_waiting", 0, TimerWaiting1Setup, TimerFrameRun, TimerTeardown, ItemsOne },
+    { "timer_frame_100k_waiting", 0, TimerWaitingAllSetup, TimerFrameRun, TimerTeardown, ItemsOne },
+    { "text_labels_1000_cycling", 0, LabelSetup, LabelsCyclingRun, LabelTeardown, ItemsLabels },
+    { "text_labels_1000_counting", 0, LabelSetup, LabelsCountingRun, LabelTeardown, ItemsLabels },
+    { "stroke_append_100k_single", 0, StrokeSetup, StrokeAppendSingleRun, StrokeTeardown, ItemsStrokePoints },
+    { "stroke_append_100k_batched", 0, StrokeSetup, StrokeAppendBatchedRun, StrokeTeardown, ItemsStrokePoints },
+};
+
+
+static void Measure(const Benchmark *b, unsigned n, int repeat, Result *r)
+{
+    void *ctx = b->setup(n);
+    b->run(ctx, n); // warm up
+
+    // Find an iteration count that fills a sample, then keep the best sample.
+    unsigned iterations = 1;
+    for (;;) {
+        double t0 = Now();
+        for (unsigned i = 0; i < iterations; i++) b->run(ctx, n);
+        if (Now() - t0 >= kSampleSeconds || iterations >= (1u << 30)) break;
+        iterations *= 2;
+    }
+    double best = 0;
+    for (int k = 0; k < repeat; k++) {
+        double t0 = Now();
+        for (unsigned i = 0; i < iterations; i++) b->run(ctx, n);
+        double t = (Now() - t0) / iterations;
+        if (k == 0 || t < best) best = t;
+    }
+    b->teardown(ctx);
+
+    snprintf(r->name, sizeof(r->name), "%s", b->name);
+    r->n = b->sized ? n : 0;
+    r->nsPerRun = best * 1e9;
+    r->nsPerItem = r->nsPerRun / b->items(n);
+}
+
+
+static void WriteResults(FILE *f, const Result *results, int count)
+{
+    fprintf(f, "{\"benchmarks\": [\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "{\"name\": \"%s\", \"n\": %u, \"ns_per_run\": %.3f, \"ns_per_item\": %.4f}%s\n",
+                results[i].name, results[i].n, results[i].nsPerRun, results[i].nsPerItem,
+                (i + 1 < count) ? "," : "");
+    }
+    fprintf(f, "]}\n");
+}
+
+
+static int ReadResults(const char *path, Result *results, int max)
+{
+    // Reads only what WriteResults writes: one benchmark per line.
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    char line[512];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), f)) {
+        Result *r = &results[count];
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"n\": %u, \"ns_per_run\": %lf, \"ns_per_item\": %lf",
+                   r->name, &r->n, &r->nsPerRun, &r->nsPerItem) == 4) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+
+static int Compare(const Result *results, int count, const Result *baseline, int baselineCount, double threshold)
+{
+    int regressions = 0;
+    for (int i = 0; i < count; i++) {
+        const Result *r = &results[i];
+        const Result *b = NULL;
+        for (int j = 0; j < baselineCount && b == NULL; j++) {
+            if (baseline[j].n == r->n && strcmp(baseline[j].name, r->name) == 0) b = &baseline[j];
+        }
+        if (b == NULL) {
+            fprintf(stderr, "%-28s n=%-6u no baseline\n", r->name, r->n);
+            continue;
+        }
+        double change = r->nsPerRun / b->nsPerRun - 1;
+        const char *verdict = (change > threshold) ? "REGRESSED" : (change < -threshold) ? "improved" : "ok";
+        if (change > threshold) regressions++;
+        fprintf(stderr, "%-28s n=%-6u %12.1f ns -> %12.1f ns  %+6.1f%%  %s\n",
+                r->name, r->n, b->nsPerRun, r->nsPerRun, change * 100, verdict);
+    }
+    return regressions;
+}
+
+
+static int ParseSizes(const char *s, unsigned *sizes)
+{
+    int count = 0;
+    while (*s && count < kSizeMax) {
+        char *end;
+        unsigned long n = strtoul(s, &end, 10);
+        if (end == s || n == 0 || n > 1000000) return -1;
+        sizes[count++] = (unsigned)n;
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+
+static void WriteMemory(FILE *f, const unsigned *sizes, int sizeCount)
+{
+    fprintf(f, "{\"memory\": [\n");
+    for (int i = 0; i < sizeCount; i++) {
+        SceneContext *c = SceneSetup(sizes[i]);
+        BGLNodeStoreStats stats;
+        BGLNodeStoreGetStats(c->store, &stats);
+        fprintf(f, "{\"name\": \"node_store\", \"n\": %u, \"capacity\": %u, \"bytes_per_slot\": %zu, \"bytes_per_node\": %.1f}%s\n",
+                sizes[i], stats.capacity, stats.bytesPerNode, (double)stats.totalBytes / stats.count,
+                (i + 1 < sizeCount) ? "," : "");
+        SceneTeardown(c);
+    }
+    fprintf(f, "]}\n");
+}
+
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: bglbench [-n sizes] [-r repeat] [-f filter] [-o results.json] [-c baseline.json [-t threshold]]\n"
+                    "       bglbench -m [-n sizes]\n");
+    exit(2);
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned sizes[kSizeMax] = { 100, 1000, 10000 };
+    int sizeCount = 3;
+    int repeat = 5;
+    const char *filter = NULL;
+    const char *outputPath = NULL;
+    const char *baselinePath = NULL;
+    double threshold = 0.10;
+    int memory = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0) {
+            memory = 1;
+            continue;
+        }
+        if (i + 1 >= argc) Usage();
+        if (strcmp(argv[i], "-n") == 0) {
+            if ((sizeCount = ParseSizes(argv[++i], sizes)) <= 0) Usage();
+        } else if (strcmp(argv[i], "-r") == 0) {
+            if ((repeat = atoi(argv[++i])) < 1) Usage();
+        } else if (strcmp(argv[i], "-f") == 0) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0) {
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0) {
+            threshold = atof(argv[++i]);
+        } else {
+            Usage();
+        }
+    }
+
+    if (memory) {
+        WriteMemory(stdout, sizes, sizeCount);
+        return 0;
+    }
+
+    static Result results[kResultMax];
+    int count = 0;
+    for (size_t k = 0; k < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); k++) {
+        const Benchmark *b = &kBenchmarks[k];
+        if (filter && strstr(b->name, filter) == NULL) continue;
+        for (int s = 0; s < (b->sized ? sizeCount : 1) && count < kResultMax; s++) {
+            Measure(b, sizes[s], repeat, &results[count++]);
+        }
+    }
+
+    if (outputPath) {
+        FILE *f = fopen(outputPath, "w");
+        if (f == NULL) {
+            perror(outputPath);
+            return 2;
+        }
+        WriteResults(f, results, count);
+        fclose(f);
+    } else {
+        WriteResults(stdout, results, count);
+    }
+
+    if (baselinePath) {
+        static Result baseline[kResultMax];
+        int baselineCount = ReadResults(baselinePath, baseline, kResultMax);
+        if (baselineCount < 0) {
+            perror(baselinePath);
+            return 2;
+        }
+        int regressions = Compare(results, count, baseline, baselineCount, threshold);
+        if (regressions) {
+            fprintf(stderr, "%d benchmark(s) regressed by more than %.0f%%\n", regressions, threshold * 100);
+            return 1;
+        }
+    }
+    return 0;
+}
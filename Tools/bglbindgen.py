@@ -0,0 +1,332 @@
+#!/usr/bin/env python3
+"""
+bglbindgen: generates typed C bindings for the programs in a BGLScene
+manifest, so nodes can set uniforms and attributes by name checked at
+compile time instead of through the SHU array and sha_ constants.
+
+For each program in the manifest it reads the vertex and fragment shader
+sources, finds the type of every attribute and uniform the manifest lists,
+and emits into BGLProgramBindings.h and BGLProgramBindings.c:
+
+    kBGL<Program>Attribute<Name>    attribute locations, in manifest order,
+                                    matching the binding in loadManifestNamed:
+    BGL<Program>Uniforms            struct of resolved uniform locations
+    BGL<Program>Set<Name>(...)      typed inline setter per uniform
+    BGL<Program>UniformValues       struct holding a value for each
+                                    non-sampler uniform
+    BGL<Program>UploadUniforms(v)   uploads all of them in one call
+
+Samplers get setters but are left out of the values struct, since the code
+that binds a texture also chooses its unit. BGLProgram calls
+BGLProgramBindingsResolve() after linking each program.
+
+A uniform or attribute named in the manifest but not declared in either
+shader is an error, so mismatches fail the build instead of reading -1 at
+run time.
+
+Run it as a build phase before compiling, for example:
+
+    python3 Tools/bglbindgen.py Manifest.plist Shaders Classes
+
+In Xcode that is a Run Script phase ahead of Compile Sources, with the
+manifest and shaders as its input files and the two outputs as its output
+files, so it runs whenever one of them changes. It needs only the Python 3
+standard library, and leaves the output files untouched when nothing
+changed so they don't trigger rebuilds.
+
+With --check it writes nothing, and instead exits with status 1, naming
+the stale files, if the outputs aren't what it would generate. Run that in
+CI, or as a pre-commit hook, to catch bindings committed out of date:
+
+    python3 Tools/bglbindgen.py --check Manifest.plist Shaders Classes
+"""
+
+import os
+import plistlib
+import re
+import sys
+
+
+DECLARATION = re.compile(
+    r'\b(uniform|attribute)\s+(?:(?:lowp|mediump|highp)\s+)?(\w+)\s+([^;]+);')
+NAME = re.compile(r'^(\w+)\s*(?:\[\s*(\d+)\s*\])?$')
+
+
+# GLSL type -> (components, setter kind)
+TYPES = {
+    'float': (1, 'f'),
+    'vec2': (2, 'f'),
+    'vec3': (3, 'f'),
+    'vec4': (4, 'f'),
+    'int': (1, 'i'),
+    'bool': (1, 'i'),
+    'ivec2': (2, 'i'),
+    'ivec3': (3, 'i'),
+    'ivec4': (4, 'i'),
+    'mat2': (4, 'm'),
+    'mat3': (9, 'm'),
+    'mat4': (16, 'm'),
+    'sampler2D': (1, 's'),
+    'samplerCube': (1, 's'),
+}
+
+
+class BindingError(Exception):
+    pass
+
+
+def strip_comments(source):
+    source = re.sub(r'/\*.*?\*/', ' ', source, flags=re.S)
+    return re.sub(r'//[^\n]*', '', source)
+
+
+def parse_shader(path):
+    """Returns {name: (kind, type, array length)} for a shader source file."""
+    try:
+        with open(path) as f:
+            source = strip_comments(f.read())
+    except IOError as e:
+        raise BindingError('cannot read shader %s: %s' % (path, e.strerror))
+    declarations = {}
+    for kind, glsl_type, names in DECLARATION.findall(source):
+        for name in names.split(','):
+            m = NAME.match(name.strip())
+            if m is None:
+                raise BindingError('%s: cannot parse declaration of %r' % (path, name))
+            count = int(m.group(2)) if m.group(2) else 1
+            declarations[m.group(1)] = (kind, glsl_type, count)
+    return declarations
+
+
+def capitalized(name):
+    return name[0].upper() + name[1:]
+
+
+class Uniform(object):
+
+    def __init__(self, program, name, glsl_type, count):
+        if glsl_type not in TYPES:
+            raise BindingError('program %s: unsupported type %s for uniform %s'
+                               % (program, glsl_type, name))
+        self.program = program
+        self.name = name
+        self.glsl_type = glsl_type
+        self.count = count
+        self.components, self.kind = TYPES[glsl_type]
+
+    @property
+    def is_sampler(self):
+        return self.kind == 's'
+
+    def scalar_type(self):
+        return 'GLint' if self.kind in 'is' else 'GLfloat'
+
+    def gl_call(self, location, value):
+        c, n = self.components, self.count
+        if self.kind == 'm':
+            size = {4: 2, 9: 3, 16: 4}[c]
+            return 'glUniformMatrix%dfv(%s, %d, GL_FALSE, %s)' % (size, location, n, value)
+        suffix = 'i' if self.kind in 'is' else 'f'
+        if c == 1 and n == 1:
+            return 'glUniform1%s(%s, %s)' % (suffix, location, value)
+        return 'glUniform%d%sv(%s, %d, %s)' % (c, suffix, location, n, value)
+
+    def setter(self, prefix):
+        location = '%sUniforms.%s' % (prefix, self.name)
+        if self.components == 1 and self.count == 1:
+            param = '%s %s' % (self.scalar_type(), 'unit' if self.is_sampler else 'v')
+            value = 'unit' if self.is_sampler else 'v'
+        else:
+            param = 'const %s *v' % self.scalar_type()
+            value = 'v'
+        return ('static inline void %sSet%s(%s)\n{\n    %s;\n}\n'
+                % (prefix, capitalized(self.name), param, self.gl_call(location, value)))
+
+    def value_field(self):
+        total = self.components * self.count
+        if total == 1:
+            return '%s %s;' % (self.scalar_type(), self.name)
+        return '%s %s[%d];' % (self.scalar_type(), self.name, total)
+
+    def upload(self, prefix):
+        location = '%sUniforms.%s' % (prefix, self.name)
+        return ('    if (%s > -1) %s;\n'
+                % (location, self.gl_call(location, 'v->%s' % self.name)))
+
+
+class Program(object):
+
+    def __init__(self, info, shader_dir):
+        self.name = info['Name']
+        if not re.match(r'^[A-Za-z_]\w*$', self.name):
+            raise BindingError('program name %r is not a C identifier' % self.name)
+        self.prefix = 'BGL' + self.name
+        declarations = {}
+        for key, ext in (('VertexShaderName', 'vsh'), ('FragmentShaderName', 'fsh')):
+            path = os.path.join(shader_dir, '%s.%s' % (info[key], ext))
+            declarations.update(parse_shader(path))
+
+        self.attributes = []
+        for name in info.get('Attributes', []):
+            kind, glsl_type, count = declarations.get(name, (None, None, 0))
+            if kind != 'attribute':
+                raise BindingError('program %s: attribute %s is not declared in its vertex shader'
+                                   % (self.name, name))
+            self.attributes.append((name, glsl_type))
+
+        self.uniforms = []
+        for name in info.get('Uniforms', []):
+            kind, glsl_type, count = declarations.get(name, (None, None, 0))
+            if kind != 'uniform':
+                raise BindingError('program %s: uniform %s is not declared in its shaders'
+                                   % (self.name, name))
+            self.uniforms.append(Uniform(self.name, name, glsl_type, count))
+
+    @property
+    def values(self):
+        return [u for u in self.uniforms if not u.is_sampler]
+
+    def header(self):
+        p = self.prefix
+        out = ['#pragma mark %s\n\n' % self.name]
+        if self.attributes:
+            out.append('enum {\n')
+            for i, (name, glsl_type) in enumerate(self.attributes):
+                out.append('    k%sAttribute%s = %d, // %s\n' % (p, capitalized(name), i, glsl_type))
+            out.append('};\n\n\n')
+        if self.uniforms:
+            out.append('typedef struct {\n')
+            for u in self.uniforms:
+                out.append('    GLint %s; // %s%s\n' % (u.name, u.glsl_type,
+                                                       '[%d]' % u.count if u.count > 1 else ''))
+            out.append('} %sUniformSlots;\n\n\n' % p)
+            out.append('extern %sUniformSlots %sUniforms;\n\n\n' % (p, p))
+            for u in self.uniforms:
+                out.append(u.setter(p))
+                out.append('\n\n')
+        if self.values:
+            out.append('typedef struct {\n')
+            for u in self.values:
+                out.append('    %s\n' % u.value_field())
+            out.append('} %sUniformValues;\n\n\n' % p)
+            out.append('void %sUploadUniforms(const %sUniformValues *v);\n\n\n' % (p, p))
+        return ''.join(out)
+
+    def source(self):
+        p = self.prefix
+        out = ['#pragma mark %s\n\n\n' % self.name]
+        if self.uniforms:
+            out.append('%sUniformSlots %sUniforms = { %s };\n\n\n'
+                       % (p, p, ', '.join(['-1'] * len(self.uniforms))))
+        out.append('static void %sResolveUniforms(GLuint program)\n{\n' % p)
+        if not self.uniforms:
+            out.append('    (void)program;\n')
+        for u in self.uniforms:
+            out.append('    %sUniforms.%s = glGetUniformLocation(program, "%s");\n' % (p, u.name, u.name))
+        out.append('}\n\n\n')
+        if self.values:
+            out.append('void %sUploadUniforms(const %sUniformValues *v)\n{\n' % (p, p))
+            for u in self.values:
+                out.append(u.upload(p))
+            out.append('}\n\n\n')
+        return ''.join(out)
+
+
+HEADER_PROLOGUE = """/*
+ Generated by Tools/bglbindgen.py from %(manifest)s. Do not edit.
+ */
+
+#ifndef BGLPROGRAMBINDINGS_H
+#define BGLPROGRAMBINDINGS_H
+
+#include "BGLGLDispatch.h"
+
+
+// Looks up uniform locations for the named program after it is linked.
+// Returns 0 if the manifest had no program by that name.
+int BGLProgramBindingsResolve(const char *programName, GLuint program);
+
+
+"""
+
+SOURCE_PROLOGUE = """/*
+ Generated by Tools/bglbindgen.py from %(manifest)s. Do not edit.
+ */
+
+#include "BGLProgramBindings.h"
+
+#include <string.h>
+
+
+"""
+
+
+def generate(manifest_path, shader_dir):
+    with open(manifest_path, 'rb') as f:
+        manifest = plistlib.load(f)
+    programs = [Program(info, shader_dir) for info in manifest.get('Programs', [])]
+    names = {'manifest': os.path.basename(manifest_path)}
+
+    header = [HEADER_PROLOGUE % names]
+    for program in programs:
+        header.append(program.header())
+    header.append('#endif\n')
+
+    source = [SOURCE_PROLOGUE % names]
+    for program in programs:
+        source.append(program.source())
+    source.append('int BGLProgramBindingsResolve(const char *programName, GLuint program)\n{\n')
+    for program in programs:
+        source.append('    if (strcmp(programName, "%s") == 0) {\n' % program.name)
+        source.append('        %sResolveUniforms(program);\n' % program.prefix)
+        source.append('        return 1;\n')
+        source.append('    }\n')
+    source.append('    return 0;\n}\n')
+
+    return ''.join(header), ''.join(source)
+
+
+def is_current(path, text):
+    try:
+        with open(path) as f:
+            return f.read() == text
+    except IOError:
+        return False
+
+
+def write_if_changed(path, text):
+    if is_current(path, text):
+        return False
+    with open(path, 'w') as f:
+        f.write(text)
+    return True
+
+
+def main(argv):
+    args = argv[1:]
+    check = bool(args) and args[0] == '--check'
+    if check:
+        args = args[1:]
+    if len(args) != 3:
+        sys.stderr.write('usage: %s [--check] Manifest.plist shader-dir output-dir\n' % argv[0])
+        return 1
+    manifest_path, shader_dir, output_dir = args
+    try:
+        header, source = generate(manifest_path, shader_dir)
+    except BindingError as e:
+        sys.stderr.write('%s: error: %s\n' % (manifest_path, e))
+        return 1
+    stale = 0
+    for name, text in (('BGLProgramBindings.h', header), ('BGLProgramBindings.c', source)):
+        path = os.path.join(output_dir, name)
+        if check:
+            if not is_current(path, text):
+                sys.stderr.write('%s: error: out of date; run %s\n' % (path, os.path.basename(argv[0])))
+                stale += 1
+        elif write_if_changed(path, text):
+            print('wrote %s' % path)
+    return 1 if stale else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,483 @@
+/*
+ bglreplay: re-executes a GL command stream captured with
+ -[ES2Renderer captureFrames:toFile:] and reports what each frame submitted.
+
+ There is no GL here. The null driver decodes and dispatches every command
+ and does nothing else, which measures the CPU cost of walking the stream.
+ The recording driver also shadows GL state and counts calls that could not
+ have changed it: binding what is already bound, enabling what is enabled,
+ setting a uniform to the value it already has, and so on.
+
+ Build and run (any C99 compiler on a POSIX system):
+
+    cc -std=c99 -O2 -I../Classes -o bglreplay bglreplay.c ../Classes/BGLCommandStream.c
+    ./bglreplay [-d null|record] [-v] [-r repeat] capture.bglc
+
+ Per-frame lines (-v) give calls, draws, vertexes, redundant calls, bytes of
+ client data and submit time. The summary gives the same over all frames
+ and a per-command breakdown. With -r each frame is replayed several times
+ and the fastest pass is reported, to smooth out timer noise.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BGLCommandStream.h"
+
+
+// GL enums the recording driver needs; values from the ES 2.0 headers.
+#define GL_ARRAY_BUFFER             0x8892
+#define GL_ELEMENT_ARRAY_BUFFER     0x8893
+#define GL_TEXTURE0                 0x84C0
+
+
+typedef struct {
+    const char *name;
+    void *(*create)(void);
+    void (*execute)(void *ctx, const BGLCommand *cmd, int *redundant);
+    void (*destroy)(void *ctx);
+} Driver;
+
+
+// Null driver
+
+
+static void *NullCreate(void)
+{
+    return NULL;
+}
+
+
+static void NullExecute(void *ctx, const BGLCommand *cmd, int *redundant)
+{
+    (void)ctx;
+    (void)cmd;
+    *redundant = 0;
+}
+
+
+static void NullDestroy(void *ctx)
+{
+    (void)ctx;
+}
+
+
+// Recording driver
+
+
+enum {
+    kTextureUnitMax = 8,
+    kAttribMax = 16,
+    kCapMax = 16,
+    kUniformSlots = 1024, // power of two
+};
+
+
+typedef struct {
+    uint32_t args[kBGLCommandArgMax];
+    int valid;
+} AttribPointer;
+
+
+typedef struct {
+    uint32_t program;
+    int32_t location;
+    uint32_t length;
+    uint64_t hash;
+    int used;
+} UniformValue;
+
+
+typedef struct {
+    uint32_t program;
+    uint32_t activeTexture;
+    uint32_t textures[kTextureUnitMax];
+    uint32_t arrayBuffer;
+    uint32_t elementBuffer;
+    uint32_t framebuffer;
+    uint32_t renderbuffer;
+    uint32_t blend[4];
+    uint32_t clearColor[4];
+    uint32_t viewport[4];
+    uint32_t scissor[4];
+    uint32_t caps[kCapMax];
+    int capEnabled[kCapMax];
+    int capCount;
+    int attribEnabled[kAttribMax];
+    uint32_t attribDivisor[kAttribMax];
+    AttribPointer attribPointers[kAttribMax];
+    UniformValue uniforms[kUniformSlots];
+} RecordState;
+
+
+static void *RecordCreate(void)
+{
+    RecordState *s = calloc(1, sizeof(RecordState));
+    s->activeTexture = GL_TEXTURE0;
+    return s;
+}
+
+
+static void RecordDestroy(void *ctx)
+{
+    free(ctx);
+}
+
+
+static uint64_t HashBytes(const void *bytes, size_t length, uint64_t h)
+{
+    const uint8_t *p = bytes;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+
+// Returns 1 if the value is unchanged; records it otherwise.
+static int SetUniform(RecordState *s, int32_t location, const void *bytes, uint32_t length)
+{
+    uint64_t hash = HashBytes(bytes, length, 14695981039346656037ULL);
+    uint32_t slot = (s->program * 31 + (uint32_t)location) & (kUniformSlots - 1);
+    for (uint32_t probe = 0; probe < kUniformSlots; probe++) {
+        UniformValue *u = &s->uniforms[(slot + probe) & (kUniformSlots - 1)];
+        if (! u->used) {
+            u->used = 1;
+            u->program = s->program;
+            u->location = location;
+            u->length = length;
+            u->hash = hash;
+            return 0;
+        }
+        if (u->program == s->program && u->location == location) {
+            int same = (u->length == length && u->hash == hash);
+            u->length = length;
+            u->hash = hash;
+            return same;
+        }
+    }
+    return 0; // table full; count as a change
+}
+
+
+static int SetCap(RecordState *s, uint32_t cap, int enabled)
+{
+    for (int i = 0; i < s->capCount; i++) {
+        if (s->caps[i] == cap) {
+            int same = (s->capEnabled[i] == enabled);
+            s->capEnabled[i] = enabled;
+            return same;
+        }
+    }
+    if (s->capCount < kCapMax) {
+        s->caps[s->capCount] = cap;
+        s->capEnabled[s->capCount] = enabled;
+        s->capCount += 1;
+    }
+    // GL starts with every capability but dither disabled.
+    return !enabled;
+}
+
+
+static int SetWords(uint32_t *state, const uint32_t *args, size_t count)
+{
+    int same = (memcmp(state, args, count * sizeof(uint32_t)) == 0);
+    memcpy(state, args, count * sizeof(uint32_t));
+    return same;
+}
+
+
+static int SetWord(uint32_t *state, uint32_t value)
+{
+    int same = (*state == value);
+    *state = value;
+    return same;
+}
+
+
+static void RecordExecute(void *ctx, const BGLCommand *cmd, int *redundant)
+{
+    RecordState *s = ctx;
+    const uint32_t *a = cmd->args;
+    int r = 0;
+
+    switch (cmd->opcode) {
+        case kBGLCommandActiveTexture:
+            r = SetWord(&s->activeTexture, a[0]);
+            break;
+        case kBGLCommandBindTexture: {
+            uint32_t unit = s->activeTexture - GL_TEXTURE0;
+            if (unit < kTextureUnitMax) r = SetWord(&s->textures[unit], a[1]);
+            break;
+        }
+        case kBGLCommandBindBuffer:
+            if (a[0] == GL_ARRAY_BUFFER) r = SetWord(&s->arrayBuffer, a[1]);
+            if (a[0] == GL_ELEMENT_ARRAY_BUFFER) r = SetWord(&s->elementBuffer, a[1]);
+            break;
+        case kBGLCommandBindFramebuffer:
+            r = SetWord(&s->framebuffer, a[1]);
+            break;
+        case kBGLCommandBindRenderbuffer:
+            r = SetWord(&s->renderbuffer, a[1]);
+            break;
+        case kBGLCommandViewport:
+            r = SetWords(s->viewport, a, 4);
+            break;
+        case kBGLCommandScissor:
+            r = SetWords(s->scissor, a, 4);
+            break;
+        case kBGLCommandEnable:
+            r = SetCap(s, a[0], 1);
+            break;
+        case kBGLCommandDisable:
+            r = SetCap(s, a[0], 0);
+            break;
+        case kBGLCommandBlendFunc: {
+            uint32_t blend[4] = { a[0], a[1], a[0], a[1] };
+            r = SetWords(s->blend, blend, 4);
+            break;
+        }
+        case kBGLCommandBlendFuncSeparate:
+            r = SetWords(s->blend, a, 4);
+            break;
+        case kBGLCommandClearColor:
+            r = SetWords(s->clearColor, a, 4);
+            break;
+        case kBGLCommandUseProgram:
+            r = SetWord(&s->program, a[0]);
+            break;
+        case kBGLCommandUniform1i:
+        case kBGLCommandUniform1f:
+            r = SetUniform(s, (int32_t)a[0], &a[1], sizeof(uint32_t));
+            break;
+        case kBGLCommandUniform4fv:
+        case kBGLCommandUniformMatrix4fv:
+            r = SetUniform(s, (int32_t)a[0], cmd->data, cmd->dataLength);
+            break;
+        case kBGLCommandEnableVertexAttribArray:
+        case kBGLCommandDisableVertexAttribArray:
+            if (a[0] < kAttribMax) {
+                int enabled = (cmd->opcode == kBGLCommandEnableVertexAttribArray);
+                r = (s->attribEnabled[a[0]] == enabled);
+                s->attribEnabled[a[0]] = enabled;
+            }
+            break;
+        case kBGLCommandVertexAttribPointer:
+            // Client arrays may move between calls with the same arguments,
+            // so only buffer-relative pointers can be judged redundant.
+            if (a[0] < kAttribMax) {
+                AttribPointer *p = &s->attribPointers[a[0]];
+                r = p->valid && !a[5] && SetWords(p->args, a, cmd->argCount);
+                memcpy(p->args, a, cmd->argCount * sizeof(uint32_t));
+                p->valid = 1;
+            }
+            break;
+        case kBGLCommandVertexAttribDivisor:
+            if (a[0] < kAttribMax) r = SetWord(&s->attribDivisor[a[0]], a[1]);
+            break;
+        default:
+            break;
+    }
+    *redundant = r;
+}
+
+
+static const Driver kDrivers[] = {
+    { "null", NullCreate, NullExecute, NullDestroy },
+    { "record", RecordCreate, RecordExecute, RecordDestroy },
+};
+
+
+// Replay
+
+
+typedef struct {
+    uint32_t calls;
+    uint32_t draws;
+    uint64_t vertexes;
+    uint32_t redundant;
+    uint64_t dataBytes;
+    double seconds;
+} FrameStats;
+
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void *ReadFile(const char *path, size_t *length)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void *bytes = malloc(size > 0 ? size : 1);
+    if (size < 0 || fread(bytes, 1, size, f) != (size_t)size) {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(f);
+    *length = size;
+    return bytes;
+}
+
+
+// Replays commands up to the next frame marker. Returns 1 if a frame was
+// replayed, 0 at the end of the stream, -1 if the stream is corrupt.
+static int ReplayFrame(BGLCommandStreamReader *r, const Driver *driver, void *ctx, FrameStats *frame, uint32_t *callCounts, uint32_t *redundantCounts)
+{
+    BGLCommand cmd;
+    int status;
+    int sawCommand = 0;
+
+    memset(frame, 0, sizeof(FrameStats));
+    double t0 = Now();
+    while ((status = BGLCommandStreamNext(r, &cmd)) > 0) {
+        if (cmd.opcode == kBGLCommandFrame) {
+            if (sawCommand) {
+                r->offset -= 4 * (1 + cmd.argCount); // leave the marker for the next frame
+                break;
+            }
+            sawCommand = 1;
+            continue;
+        }
+        sawCommand = 1;
+        int redundant;
+        driver->execute(ctx, &cmd, &redundant);
+        frame->calls += 1;
+        frame->redundant += redundant;
+        frame->dataBytes += cmd.dataLength;
+        if (cmd.opcode == kBGLCommandDrawArrays || cmd.opcode == kBGLCommandDrawArraysInstanced) {
+            frame->draws += 1;
+            frame->vertexes += (uint64_t)cmd.args[2] * (cmd.opcode == kBGLCommandDrawArraysInstanced ? cmd.args[3] : 1);
+        }
+        if (callCounts) callCounts[cmd.opcode] += 1;
+        if (redundantCounts) redundantCounts[cmd.opcode] += redundant;
+    }
+    frame->seconds = Now() - t0;
+    if (status < 0) return -1;
+    return sawCommand;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const Driver *driver = &kDrivers[1];
+    int verbose = 0;
+    int repeat = 1;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            driver = NULL;
+            for (size_t k = 0; k < sizeof(kDrivers) / sizeof(kDrivers[0]); k++) {
+                if (strcmp(kDrivers[k].name, name) == 0) driver = &kDrivers[k];
+            }
+            if (driver == NULL) {
+                fprintf(stderr, "unknown driver %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1) repeat = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s [-d null|record] [-v] [-r repeat] capture.bglc\n", argv[0]);
+        return 1;
+    }
+
+    size_t length;
+    void *bytes = ReadFile(path, &length);
+    if (bytes == NULL) {
+        fprintf(stderr, "could not read %s\n", path);
+        return 1;
+    }
+    BGLCommandStreamReader reader;
+    if (! BGLCommandStreamReaderInit(&reader, bytes, length)) {
+        fprintf(stderr, "%s is not a version %d command stream\n", path, kBGLCommandStreamVersion);
+        return 1;
+    }
+
+    uint32_t callCounts[kBGLCommandCount] = { 0 };
+    uint32_t redundantCounts[kBGLCommandCount] = { 0 };
+    FrameStats total;
+    memset(&total, 0, sizeof(total));
+    double worst = 0;
+    unsigned frameCount = 0;
+    void *ctx = driver->create();
+    int status;
+
+    if (verbose) printf("frame    calls  draws  vertexes  redundant     bytes   submit(us)\n");
+    for (;;) {
+        // State carries over between frames, so repeated passes run with
+        // their own copy of the driver and only the first one is counted.
+        size_t start = reader.offset;
+        FrameStats frame, pass;
+        status = ReplayFrame(&reader, driver, ctx, &frame, callCounts, redundantCounts);
+        if (status <= 0) break;
+        size_t end = reader.offset;
+        for (int k = 1; k < repeat; k++) {
+            void *scratch = driver->create();
+            reader.offset = start;
+            ReplayFrame(&reader, driver, scratch, &pass, NULL, NULL);
+            driver->destroy(scratch);
+            if (pass.seconds < frame.seconds) frame.seconds = pass.seconds;
+        }
+        reader.offset = end;
+
+        if (verbose) {
+            printf("%5u  %7u  %5u  %8llu  %9u  %8llu  %11.1f\n", frameCount,
+                   frame.calls, frame.draws, (unsigned long long)frame.vertexes,
+                   frame.redundant, (unsigned long long)frame.dataBytes, frame.seconds * 1e6);
+        }
+        total.calls += frame.calls;
+        total.draws += frame.draws;
+        total.vertexes += frame.vertexes;
+        total.redundant += frame.redundant;
+        total.dataBytes += frame.dataBytes;
+        total.seconds += frame.seconds;
+        if (frame.seconds > worst) worst = frame.seconds;
+        frameCount += 1;
+    }
+    driver->destroy(ctx);
+
+    if (status < 0) {
+        fprintf(stderr, "%s is corrupt at offset %zu\n", path, reader.offset);
+    }
+    if (frameCount == 0) {
+        fprintf(stderr, "no frames\n");
+        free(bytes);
+        return 1;
+    }
+
+    printf("%s: %u frames, %zu bytes, driver %s\n", path, frameCount, length, driver->name);
+    printf("per frame: %.1f calls, %.1f draws, %.0f vertexes, %.1f redundant, %.0f bytes\n",
+           (double)total.calls / frameCount, (double)total.draws / frameCount,
+           (double)total.vertexes / frameCount, (double)total.redundant / frameCount,
+           (double)total.dataBytes / frameCount);
+    printf("submit: %.1f us mean, %.1f us worst\n", total.seconds / frameCount * 1e6, worst * 1e6);
+    printf("\n%-30s %10s %10s %7s\n", "command", "calls", "redundant", "%");
+    for (uint32_t op = 1; op < kBGLCommandCount; op++) {
+        if (callCounts[op] == 0 || op == kBGLCommandFrame) continue;
+        printf("%-30s %10u %10u %6.1f%%\n", BGLCommandName(op), callCounts[op], redundantCounts[op],
+               100.0 * redundantCounts[op] / callCounts[op]);
+    }
+
+    free(bytes);
+    return (status < 0) ? 1 : 0;
+}
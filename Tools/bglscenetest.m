@@ -0,0 +1,623 @@
+/*
+ bglscenetest: checks the Objective-C scene graph, headless.
+
+ The counterpart of bgltest for the parts that need the Objective-C runtime:
+ scenes, nodes and their edit queue. Most tests touch no GL, and draw
+ through a renderer that counts frames instead of drawing them. Tests and
+ CHECKs work as in bgltest.
+
+ Tests that draw make an offscreen EAGLContext and load the app's manifest
+ (named by -m, default Manifest) with its shaders; a command line program's
+ main bundle is its own directory, so copy them next to it. Their draws go
+ through a BGLGLDispatch that counts them on the way to GL.
+
+ The library imports headers the app generates or provides (BGLManifest.h,
+ BGLProgramBindings.h from bglbindgen, BGLFont.h, BGLTexture.h), so build it
+ against the app's, as a command line program for the simulator:
+
+    xcrun -sdk iphonesimulator clang -std=gnu99 -I../Classes -I$APP_INCLUDE \
+        -o bglscenetest bglscenetest.m ../Classes/*.m ../Classes/*.c $APP_SOURCES \
+        -framework Foundation -framework UIKit -framework QuartzCore -framework OpenGLES
+    xcrun simctl spawn booted ./bglscenetest [-b] [-f filter] [-m manifest]
+
+ With -f, only tests whose names contain the filter run. With -b, the
+ benchmarks run instead, printing one line each like bglbench's; they're
+ here rather than there because they need the scene graph.
+ */
+
+#import <Foundation/Foundation.h>
+#import <OpenGLES/EAGL.h>
+
+#import "BGLScene.h"
+#import "BGLNode.h"
+#import "BGLBasicAnimation.h"
+#import "BGLPolygon.h"
+#import "BGLPolygonBatch.h"
+#import "BGLMesh.h"
+#import "BGLProgram.h"
+#import "BGLRenderState.h"
+#import "BGLSnapshot.h"
+#import "ESRenderer.h"
+
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} Test;
+
+
+static int failureCount;
+
+
+#define CHECK(cond) \
+    do { \
+        if (! (cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failureCount += 1; \
+        } \
+    } while (0)
+
+
+// Counts frames instead of drawing them.
+
+@interface CountingRenderer : NSObject <ESRenderer> {
+@public
+    unsigned int frameCount;
+}
+@end
+
+
+@implementation CountingRenderer
+
+- (void)genBuffers {}
+- (BOOL)allocateBufferStorageForLayer:(CAEAGLLayer *)layer { return YES; }
+- (void)renderRootNode:(BGLNode *)rootNode { frameCount += 1; }
+- (void)deleteBuffers {}
+
+@end
+
+
+// Counts the scene's wake-ups, as EAGLView resumes its paused display link.
+@interface WakeCounter : NSObject {
+@public
+    unsigned int wakeCount;
+}
+@end
+
+
+@implementation WakeCounter
+
+- (void)sceneDidChange:(BGLScene *)scene { wakeCount += 1; }
+
+@end
+
+
+// Drawing
+
+
+static const char *manifestName = "Manifest";
+static unsigned drawCount;
+static BGLGLDispatch countingDispatch;
+
+
+static void CountDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    drawCount += 1;
+    BGLGLDirect.DrawArrays(mode, first, count);
+}
+
+
+static void CountDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei primcount)
+{
+    drawCount += 1;
+    BGLGLDirect.DrawArraysInstancedEXT(mode, first, count, primcount);
+}
+
+
+// Returns NO, failing the test, if there's no GL to draw with.
+static BOOL SetUpGL(void)
+{
+    static int ready = -1;
+    if (ready < 0) {
+        EAGLContext *context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+        ready = (context && [EAGLContext setCurrentContext:context] &&
+                 [BGLProgram loadManifestNamed:[NSString stringWithUTF8String:manifestName]]);
+        countingDispatch = BGLGLDirect;
+        countingDispatch.DrawArrays = CountDrawArrays;
+        countingDispatch.DrawArraysInstancedEXT = CountDrawArraysInstanced;
+    }
+    CHECK(ready);
+    return ready;
+}
+
+
+static unsigned CountDraws(BGLNode *root)
+{
+    BGLRenderState *state = [[BGLRenderState alloc] init];
+    [state resetWithViewportWidth:320 height:480];
+    glViewport(0, 0, 320, 480);
+    drawCount = 0;
+    BGLGL = &countingDispatch;
+    [root renderSelfAndSubnodesWithState:state];
+    BGLGL = &BGLGLDirect;
+    [state release];
+    return drawCount;
+}
+
+
+// What -[EAGLView drawView:] does for a display link tick, without input.
+static void DisplayLinkTick(BGLScene *scene, id <ESRenderer> renderer)
+{
+    if (! [scene needsDisplay]) {
+        [scene skipFrame];
+        return;
+    }
+    [scene performAnimations];
+    [scene renderWithRenderer:renderer];
+}
+
+
+// Idle frames
+
+
+static void TestIdleTicksDontRender(void)
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BGLScene *scene = [[BGLScene alloc] init];
+    CountingRenderer *renderer = [[CountingRenderer alloc] init];
+    BGLNode *root = [[BGLNode alloc] init];
+    BGLNode *child = [[BGLNode alloc] init];
+    [root addSubnode:child];
+    [scene syncAnimationClock];
+    scene.rootNode = root;
+
+    DisplayLinkTick(scene, renderer); // the new root needs drawing
+    CHECK(scene.renderCount == 1 && renderer->frameCount == 1);
+
+    for (int i = 0; i < 60; i++) DisplayLinkTick(scene, renderer);
+    CHECK(scene.renderCount == 1 && renderer->frameCount == 1);
+    CHECK(scene.skippedFrameCount == 60);
+
+    // One change, one frame, then idle again.
+    child.position = BGLVector3Make(1, 2, 0);
+    for (int i = 0; i < 60; i++) DisplayLinkTick(scene, renderer);
+    CHECK(scene.renderCount == 2 && renderer->frameCount == 2);
+    CHECK(scene.skippedFrameCount == 119);
+
+    // Once idle, the display link is paused; each of these must wake it.
+    WakeCounter *waker = [[WakeCounter alloc] init];
+    [scene setChangeTarget:waker action:@selector(sceneDidChange:)];
+
+    root.hidden = YES; // the root has no supernode to mark
+    CHECK(waker->wakeCount == 1 && [scene needsDisplay]);
+    DisplayLinkTick(scene, renderer);
+    root.hidden = NO;
+    DisplayLinkTick(scene, renderer);
+    CHECK(waker->wakeCount == 2 && scene.renderCount == 4);
+
+    child.paused = YES;
+    DisplayLinkTick(scene, renderer);
+    CHECK(! [scene needsDisplay]);
+    child.paused = NO;
+    CHECK(waker->wakeCount == 3 && [scene needsDisplay]);
+    DisplayLinkTick(scene, renderer);
+    CHECK(! [scene needsDisplay]);
+
+    // An animation added between frames, as from a touch handler.
+    BGLBasicAnimation *animation = [BGLBasicAnimation animationWithTarget:child selector:@selector(setPosition:)];
+    animation.duration = 60;
+    animation.initialVector3 = BGLVector3Make(0, 0, 0);
+    animation.finalVector3 = BGLVector3Make(100, 0, 0);
+    [child addAnimation:animation];
+    CHECK(waker->wakeCount == 4 && [scene needsDisplay]);
+    unsigned int rendered = scene.renderCount;
+    DisplayLinkTick(scene, renderer);
+    DisplayLinkTick(scene, renderer);
+    CHECK(scene.renderCount == rendered + 2 && [scene needsDisplay]); // still running
+
+    [scene setChangeTarget:nil action:NULL];
+    [waker release];
+    scene.rootNode = nil;
+    [child release];
+    [root release];
+    [renderer release];
+    [scene release];
+    [pool drain];
+}
+
+
+// Instancing
+
+
+static void TestPolygonBatchDrawsOnce(void)
+{
+    if (! SetUpGL()) return;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BGLPolygon *prototype = [BGLPolygon polygonWithRect:CGRectMake(0, 0, 8, 8) color:BGLColorWhite];
+
+    // A hundred copies as nodes draw one at a time...
+    BGLNode *separate = [[BGLNode alloc] init];
+    for (int i = 0; i < 100; i++) {
+        BGLPolygon *p = [[BGLPolygon alloc] initWithVertexData:[NSData dataWithBytes:[prototype vertexes]
+                                                                               length:4 * sizeof(BGLPolygonVertex)]
+                                                          mode:GL_TRIANGLE_STRIP];
+        p.position = BGLVector3Make(10 * (i % 10), 10 * (i / 10), 0);
+        [separate addSubnode:p];
+        [p release];
+    }
+    CHECK(CountDraws(separate) == 100);
+
+    // ...and as a batch, in one call, instanced or not.
+    BGLPolygonBatch *batch = [[BGLPolygonBatch alloc] initWithPolygon:prototype];
+    for (int i = 0; i < 100; i++) {
+        BGLMatrix m;
+        BGLMatrixLoadIdentity(m);
+        BGLMatrixTranslate(m, 10 * (i % 10), 10 * (i / 10), 0);
+        [batch addInstanceWithMatrix:m color:BGLColorGray];
+    }
+    CHECK(CountDraws(batch) == 1);
+
+    [batch release];
+    [separate release];
+    [pool drain];
+}
+
+
+// Packed meshes
+
+
+static BGLMatrix lastUniformMatrix;
+
+
+static void SaveUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    BGLMatrixCopy(lastUniformMatrix, value);
+    BGLGLDirect.UniformMatrix4fv(location, count, transpose, value);
+}
+
+
+// Where the last matrix set, the model-view-projection or (if the program
+// has none) the model-view, puts x = 1600: projected from 200 if the mesh's
+// 1/16 scale applied before its translation, from 106.25 if after.
+static BOOL DrewPackedVertexAt200(BGLProgram *program)
+{
+    BGLMatrix p;
+    [program getProjectionMatrix:p];
+    float expected = 200 * p[0] + p[12], x = 1600 * lastUniformMatrix[0] + lastUniformMatrix[12];
+    return fabsf(x - expected) < 1e-3f || fabsf(x - 200) < 1e-3f;
+}
+
+
+static void TestMeshScalesBeforeTranslating(void)
+{
+    if (! SetUpGL()) return;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    const BGLMeshVertex triangle[] = {
+        { { 100, 0 }, { 1, 1, 1, 1 } },
+        { { 100, 10 }, { 1, 1, 1, 1 } },
+        { { 110, 0 }, { 1, 1, 1, 1 } },
+    };
+    BGLMeshBuilder builder;
+    BGLMeshBuilderInit(&builder, kBGLVertexLayoutFixedUByte, kBGLPrimitiveTriangles);
+    CHECK(BGLMeshBuilderAdd(&builder, triangle, 3, kBGLPrimitiveTriangles, NULL));
+    BGLMesh *mesh = [[BGLMesh alloc] initWithBuilder:&builder];
+    BGLMeshBuilderFree(&builder);
+    CHECK(mesh.positionScale == 1 / 16.0f);
+    mesh.position = BGLVector3Make(100, 0, 0);
+
+    BGLGLDispatch saving = countingDispatch;
+    saving.UniformMatrix4fv = SaveUniformMatrix4fv;
+    BGLRenderState *state = [[BGLRenderState alloc] init];
+    [state resetWithViewportWidth:320 height:480];
+    BGLGL = &saving;
+
+    // Drawn by traversal...
+    BGLMatrixLoadIdentity(lastUniformMatrix);
+    [mesh renderSelfAndSubnodesWithState:state];
+    CHECK(DrewPackedVertexAt200(mesh.program));
+
+    // ...and from a recording.
+    BGLDrawProjection projections[32];
+    uint32_t projectionCount = [BGLProgram getDrawProjections:projections max:32];
+    BGLDrawRecorder recorder;
+    BGLDrawRecorderInit(&recorder, 1);
+    const BGLDrawList *list = BGLDrawRecorderRecord(&recorder, BGLNodeStoreGetDefault(), mesh.handle,
+                                                    projections, projectionCount);
+    BGLMatrixLoadIdentity(lastUniformMatrix);
+    [state resetWithViewportWidth:320 height:480];
+    [BGLNode submitDrawList:list state:state];
+    CHECK(DrewPackedVertexAt200(mesh.program));
+    BGLDrawRecorderFree(&recorder);
+
+    BGLGL = &BGLGLDirect;
+    [state release];
+    [mesh release];
+    [pool drain];
+}
+
+
+// Deferred edits
+
+
+static void TestDeferredRemoveThenReorder(void)
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BGLScene *scene = [[BGLScene alloc] init];
+    BGLNode *root = [[BGLNode alloc] init];
+    BGLNode *other = [[BGLNode alloc] init];
+    BGLNode *a = [[BGLNode alloc] init];
+    BGLNode *b = [[BGLNode alloc] init];
+    BGLNode *c = [[BGLNode alloc] init];
+    [root addSubnode:a];
+    [root addSubnode:b];
+    [root addSubnode:c];
+    [root addSubnode:other];
+    [scene syncAnimationClock];
+    scene.rootNode = root;
+
+    // Timers fire while the scene defers edits, as animations run.
+    [scene scheduleAfter:0 node:nil block:^{
+        CHECK([scene isDeferringEdits]);
+
+        // Removed, then reordered: stays removed.
+        [a removeFromSupernode];
+        CHECK(a.supernode == nil);
+        a.zOrder = 5;
+        [a bringToFront];
+        [a sendToBack];
+
+        // Moved, then reordered: reordered where it went.
+        [b removeFromSupernode];
+        [other addSubnode:b];
+        CHECK(b.supernode == other);
+        b.zOrder = 3;
+
+        // Removed and added back: stays, at the end.
+        [c removeFromSupernode];
+        [root addSubnode:c];
+    }];
+    [scene skipFrame];
+
+    CHECK(a.supernode == nil);
+    CHECK(b.supernode == other && other.firstSubnode == b && b.zOrder == 3);
+    CHECK(c.supernode == root && root.lastSubnode == c);
+    CHECK(root.subnodeCount == 2 && root.firstSubnode == other);
+
+    scene.rootNode = nil;
+    [a release];
+    [b release];
+    [c release];
+    [other release];
+    [root release];
+    [scene release];
+    [pool drain];
+}
+
+
+// Snapshots
+
+
+// A tree of plain nodes, fanout wide, with tags, flags and transforms that
+// vary by position, so a loader that mixes records up shows it.
+static BGLNode *NewNodeTree(int depth, int fanout, int *tag)
+{
+    BGLNode *node = [[BGLNode alloc] init];
+    node.tag = (*tag)++;
+    node.hidden = (node.tag % 7 == 3);
+    node.paused = (node.tag % 5 == 1);
+    [node translateBy:BGLVector3Make(node.tag, -node.tag, 0)];
+    [node rotateBy:node.tag % 360 about:BGLVector3Make(0, 0, 1)];
+    if (depth > 0) {
+        for (int i = 0; i < fanout; i++) {
+            BGLNode *subnode = NewNodeTree(depth - 1, fanout, tag);
+            [node addSubnode:subnode];
+            [subnode release];
+        }
+    }
+    return node;
+}
+
+
+static unsigned CountNodes(BGLNode *node)
+{
+    unsigned count = 1;
+    for (BGLNode *n = node.firstSubnode; n; n = n.nextSibling) count += CountNodes(n);
+    return count;
+}
+
+
+static void TestSnapshotRoundTrip(void)
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    int tag = 1;
+    BGLNode *root = NewNodeTree(3, 4, &tag);
+    NSData *data = [root snapshotData];
+    CHECK(data != nil);
+
+    BGLNode *copy = [BGLNode nodeWithSnapshotData:data];
+    CHECK(copy != nil && [copy class] == [BGLNode class]);
+    CHECK(CountNodes(copy) == CountNodes(root));
+    CHECK(copy.supernode == nil);
+
+    // Writing what was read gives back the same bytes: structure, tags,
+    // flags and matrices all survived.
+    CHECK([[copy snapshotData] isEqualToData:data]);
+
+    // Spot check a leaf, in case both directions agree on a mistake.
+    BGLNode *leaf = [root nodeWithTag:tag - 1];
+    BGLNode *copiedLeaf = [copy nodeWithTag:tag - 1];
+    CHECK(copiedLeaf != nil && copiedLeaf.subnodeCount == 0);
+    CHECK(copiedLeaf.hidden == leaf.hidden && copiedLeaf.paused == leaf.paused);
+    CHECK(copiedLeaf.supernode.tag == leaf.supernode.tag);
+
+    [root release];
+    [pool drain];
+}
+
+
+static void TestSnapshotPolygonsRoundTrip(void)
+{
+    if (! SetUpGL()) return;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BGLNode *root = [[BGLNode alloc] init];
+    BGLPolygon *square = [BGLPolygon polygonWithRect:CGRectMake(0, 0, 8, 8) color:BGLColorWhite];
+    BGLPolygon *fan = [[BGLPolygon alloc] init];
+    [fan addVertexAtPosition:BGLVector2Make(0, 0)];
+    [fan addVertexAtPosition:BGLVector2Make(4, 0)];
+    [fan addVertexAtPosition:BGLVector2Make(4, 4)];
+    [fan setColor:BGLColorGray];
+    square.tag = 1;
+    fan.tag = 2;
+    [root addSubnode:square];
+    [root addSubnode:fan];
+    [fan release];
+
+    NSData *data = [root snapshotData];
+    BGLNode *copy = [BGLNode nodeWithSnapshotData:data];
+    CHECK([[copy snapshotData] isEqualToData:data]);
+    for (int t = 1; t <= 2; t++) {
+        BGLPolygon *a = [root nodeWithTag:t];
+        BGLPolygon *b = [copy nodeWithTag:t];
+        CHECK([b isKindOfClass:[BGLPolygon class]]);
+        CHECK([b vertexCount] == [a vertexCount]);
+        CHECK(memcmp([b vertexes], [a vertexes], [a vertexCount] * sizeof(BGLPolygonVertex)) == 0);
+    }
+
+    [root release];
+    [pool drain];
+}
+
+
+static void TestSnapshotRejectsDamage(void)
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    int tag = 1;
+    BGLNode *root = NewNodeTree(2, 3, &tag);
+    NSData *data = [root snapshotData];
+
+    // Every truncation, including the empty one, is refused.
+    for (NSUInteger length = 0; length < [data length]; length++) {
+        CHECK([BGLNode nodeWithSnapshotData:[data subdataWithRange:NSMakeRange(0, length)]] == nil);
+    }
+
+    NSMutableData *damaged = [data mutableCopy];
+    ((uint8_t *)[damaged mutableBytes])[0] ^= 0xFF; // the magic
+    CHECK([BGLNode nodeWithSnapshotData:damaged] == nil);
+    [damaged release];
+
+    [root release];
+    [pool drain];
+}
+
+
+static const Test kTests[] = {
+    { "idle_ticks_dont_render", TestIdleTicksDontRender },
+    { "polygon_batch_draws_once", TestPolygonBatchDrawsOnce },
+    { "mesh_scales_before_translating", TestMeshScalesBeforeTranslating },
+    { "deferred_remove_then_reorder", TestDeferredRemoveThenReorder },
+    { "snapshot_round_trip", TestSnapshotRoundTrip },
+    { "snapshot_polygons_round_trip", TestSnapshotPolygonsRoundTrip },
+    { "snapshot_rejects_damage", TestSnapshotRejectsDamage },
+};
+
+
+// Benchmarks
+
+
+// Loading a 50k node scene from a snapshot, against building it in code:
+// 50 groups of 999 nodes under a root, 50001 nodes in all.
+static BGLNode *NewSceneOf50k(void)
+{
+    int tag = 1;
+    BGLNode *root = NewNodeTree(0, 0, &tag);
+    for (int i = 0; i < 50; i++) {
+        BGLNode *group = NewNodeTree(0, 0, &tag);
+        for (int j = 0; j < 999; j++) {
+            BGLNode *leaf = NewNodeTree(0, 0, &tag);
+            [group addSubnode:leaf];
+            [leaf release];
+        }
+        [root addSubnode:group];
+        [group release];
+    }
+    return root;
+}
+
+
+static void BenchSnapshotLoad(void)
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    const int repeats = 5;
+    BGLNode *root = nil;
+
+    CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < repeats; i++) {
+        [root release];
+        root = NewSceneOf50k();
+    }
+    CFAbsoluteTime built = (CFAbsoluteTimeGetCurrent() - t0) / repeats;
+    unsigned nodeCount = CountNodes(root);
+
+    NSData *data = [root snapshotData];
+    t0 = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < repeats; i++) {
+        NSAutoreleasePool *inner = [[NSAutoreleasePool alloc] init];
+        CHECK([BGLNode nodeWithSnapshotData:data] != nil);
+        [inner drain];
+    }
+    CFAbsoluteTime loaded = (CFAbsoluteTimeGetCurrent() - t0) / repeats;
+
+    printf("snapshot_load_50k  %u nodes  %lu bytes  %.1f ms  %.0f ns/node  (built in code: %.0f ns/node)\n",
+           nodeCount, (unsigned long)[data length], loaded * 1e3,
+           loaded * 1e9 / nodeCount, built * 1e9 / nodeCount);
+    [root release];
+    [pool drain];
+}
+
+
+static const Test kBenchmarks[] = {
+    { "snapshot_load_50k", BenchSnapshotLoad },
+};
+
+
+int main(int argc, char *argv[])
+{
+    const char *filter = NULL;
+    BOOL benchmarks = NO;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            benchmarks = YES;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            manifestName = argv[++i];
+        } else {
+            fprintf(stderr, "usage: bglscenetest [-b] [-f filter] [-m manifest]\n");
+            return 2;
+        }
+    }
+
+    if (benchmarks) {
+        for (size_t i = 0; i < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); i++) {
+            if (filter && strstr(kBenchmarks[i].name, filter) == NULL) continue;
+            kBenchmarks[i].run();
+        }
+        return failureCount ? 1 : 0;
+    }
+
+    int testCount = 0, failedCount = 0;
+    for (size_t i = 0; i < sizeof(kTests) / sizeof(kTests[0]); i++) {
+        if (filter && strstr(kTests[i].name, filter) == NULL) continue;
+        int failuresBefore = failureCount;
+        kTests[i].run();
+        testCount += 1;
+        if (failureCount > failuresBefore) {
+            failedCount += 1;
+            printf("FAIL %s\n", kTests[i].name);
+        } else {
+            printf("ok   %s\n", kTests[i].name);
+        }
+    }
+    printf("%d of %d tests passed\n", testCount - failedCount, testCount);
+    return failedCount ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+/*
+ bglsdfgen: converts a high resolution glyph atlas into a signed distance
+ field atlas for use with BGLDistanceFieldProgram.
+
+ Input is a binary greyscale PGM (P5, 8 bits) rendered at `scale` times the
+ desired output size; pixels >= 128 are considered inside a glyph. Output is
+ a PGM of the same format, 1/scale the size, where 128 is on the glyph edge
+ and each unit of 127/spread is one output pixel of distance. Glyph metrics
+ from the original font pipeline apply to the output after dividing by scale.
+
+ Build and run (any C99 compiler, no dependencies beyond libm):
+
+    cc -std=c99 -O2 -o bglsdfgen bglsdfgen.c -lm
+    ./bglsdfgen in.pgm out.pgm [scale] [spread]
+    ./bglsdfgen -m field.pgm bitmap.pgm...
+
+ Distances are computed with the 8-point sequential signed Euclidean distance
+ transform (8SSEDT), once for the inside and once for the outside.
+
+ With -m, nothing is converted; the tool reports the texture memory of a
+ typeface's bitmap atlases, one per size and style as the .bglfont pipeline
+ makes them, against the one distance field atlas that replaces them. Sizes
+ are of the textures as uploaded, one byte per texel, without mipmaps.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct {
+    int dx;
+    int dy;
+} Offset;
+
+
+typedef struct {
+    int width;
+    int height;
+    Offset *cells;
+} Grid;
+
+
+static const int kFar = 9999;
+
+
+static unsigned char *ReadPGM(const char *path, int *width, int *height)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+
+    int maxval;
+    if (fscanf(f, "P5 %d %d %d", width, height, &maxval) != 3 || maxval != 255) {
+        fclose(f);
+        return NULL;
+    }
+    fgetc(f); // single whitespace after header
+
+    size_t size = (size_t)*width * *height;
+    unsigned char *pixels = malloc(size);
+    if (fread(pixels, 1, size, f) != size) {
+        free(pixels);
+        pixels = NULL;
+    }
+    fclose(f);
+    return pixels;
+}
+
+
+static int WritePGM(const char *path, const unsigned char *pixels, int width, int height)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return 0;
+    fprintf(f, "P5\n%d %d\n255\n", width, height);
+    size_t size = (size_t)width * height;
+    int ok = (fwrite(pixels, 1, size, f) == size);
+    fclose(f);
+    return ok;
+}
+
+
+static inline int DistSq(Offset o)
+{
+    return o.dx * o.dx + o.dy * o.dy;
+}
+
+
+static inline Offset GridGet(const Grid *g, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= g->width || y >= g->height) {
+        Offset far = { kFar, kFar };
+        return far;
+    }
+    return g->cells[x + y * g->width];
+}
+
+
+static inline void Compare(Grid *g, Offset *p, int x, int y, int ox, int oy)
+{
+    Offset other = GridGet(g, x + ox, y + oy);
+    other.dx += ox;
+    other.dy += oy;
+    if (DistSq(other) < DistSq(*p)) *p = other;
+}
+
+
+static void GenerateSSEDT(Grid *g)
+{
+    // Pass 0: top to bottom
+    for (int y = 0; y < g->height; y++) {
+        for (int x = 0; x < g->width; x++) {
+            Offset p = g->cells[x + y * g->width];
+            Compare(g, &p, x, y, -1,  0);
+            Compare(g, &p, x, y,  0, -1);
+            Compare(g, &p, x, y, -1, -1);
+            Compare(g, &p, x, y,  1, -1);
+            g->cells[x + y * g->width] = p;
+        }
+        for (int x = g->width - 1; x >= 0; x--) {
+            Offset p = g->cells[x + y * g->width];
+            Compare(g, &p, x, y, 1, 0);
+            g->cells[x + y * g->width] = p;
+        }
+    }
+    // Pass 1: bottom to top
+    for (int y = g->height - 1; y >= 0; y--) {
+        for (int x = g->width - 1; x >= 0; x--) {
+            Offset p = g->cells[x + y * g->width];
+            Compare(g, &p, x, y,  1,  0);
+            Compare(g, &p, x, y,  0,  1);
+            Compare(g, &p, x, y, -1,  1);
+            Compare(g, &p, x, y,  1,  1);
+            g->cells[x + y * g->width] = p;
+        }
+        for (int x = 0; x < g->width; x++) {
+            Offset p = g->cells[x + y * g->width];
+            Compare(g, &p, x, y, -1, 0);
+            g->cells[x + y * g->width] = p;
+        }
+    }
+}
+
+
+static void GridInit(Grid *g, const unsigned char *pixels, int width, int height, int inside)
+{
+    g->width = width;
+    g->height = height;
+    g->cells = malloc(sizeof(Offset) * width * height);
+    for (int i = 0; i < width * height; i++) {
+        int isInside = (pixels[i] >= 128);
+        if (isInside == inside) {
+            g->cells[i].dx = 0;
+            g->cells[i].dy = 0;
+        } else {
+            g->cells[i].dx = kFar;
+            g->cells[i].dy = kFar;
+        }
+    }
+}
+
+
+static int Measure(int argc, const char *argv[])
+{
+    // argv[0] is the field atlas, the rest the bitmap atlases it replaces.
+    long before = 0, after = 0;
+    for (int i = 0; i < argc; i++) {
+        int width, height;
+        unsigned char *pixels = ReadPGM(argv[i], &width, &height);
+        if (pixels == NULL) {
+            fprintf(stderr, "could not read 8-bit binary PGM from %s\n", argv[i]);
+            return 1;
+        }
+        free(pixels);
+        long bytes = (long)width * height;
+        printf("%-8s %6dx%-6d %10ld bytes  %s\n", (i == 0) ? "field" : "bitmap", width, height, bytes, argv[i]);
+        if (i == 0) after = bytes; else before += bytes;
+    }
+    printf("before: %ld bytes in %d atlases\n", before, argc - 1);
+    printf("after:  %ld bytes in 1 atlas (%.1f%% of before)\n", after, (before > 0) ? 100.0 * after / before : 0.0);
+    return 0;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    if (argc > 2 && strcmp(argv[1], "-m") == 0) {
+        return Measure(argc - 2, argv + 2);
+    }
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s in.pgm out.pgm [scale] [spread]\n", argv[0]);
+        fprintf(stderr, "       %s -m field.pgm bitmap.pgm...\n", argv[0]);
+        return 1;
+    }
+    int scale = (argc > 3) ? atoi(argv[3]) : 8;
+    float spread = (argc > 4) ? atof(argv[4]) : 8.0f;
+    if (scale < 1 || spread <= 0) {
+        fprintf(stderr, "scale must be >= 1 and spread > 0\n");
+        return 1;
+    }
+
+    int width, height;
+    unsigned char *pixels = ReadPGM(argv[1], &width, &height);
+    if (pixels == NULL) {
+        fprintf(stderr, "could not read 8-bit binary PGM from %s\n", argv[1]);
+        return 1;
+    }
+
+    // Distance to nearest inside pixel (nonzero outside the glyph), and
+    // distance to nearest outside pixel (nonzero inside the glyph).
+    Grid outside, inside;
+    GridInit(&outside, pixels, width, height, 1);
+    GridInit(&inside, pixels, width, height, 0);
+    GenerateSSEDT(&outside);
+    GenerateSSEDT(&inside);
+
+    int outWidth = width / scale;
+    int outHeight = height / scale;
+    unsigned char *field = malloc((size_t)outWidth * outHeight);
+
+    for (int y = 0; y < outHeight; y++) {
+        for (int x = 0; x < outWidth; x++) {
+            // Sample the center of the output texel in source coordinates.
+            int sx = x * scale + scale / 2;
+            int sy = y * scale + scale / 2;
+            int i = sx + sy * width;
+            float d = sqrtf(DistSq(outside.cells[i])) - sqrtf(DistSq(inside.cells[i]));
+            d /= scale; // source pixels to output pixels
+            float v = 128.0f - d * (127.0f / spread);
+            if (v < 0) v = 0;
+            if (v > 255) v = 255;
+            field[x + y * outWidth] = (unsigned char)(v + 0.5f);
+        }
+    }
+
+    if (! WritePGM(argv[2], field, outWidth, outHeight)) {
+        fprintf(stderr, "could not write %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %dx%d (%d bytes) -> %s: %dx%d (%d bytes)\n",
+           argv[1], width, height, width * height,
+           argv[2], outWidth, outHeight, outWidth * outHeight);
+
+    free(field);
+    free(outside.cells);
+    free(inside.cells);
+    free(pixels);
+    return 0;
+}
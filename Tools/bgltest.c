@@ -0,0 +1,2066 @@
+/*
+ bgltest: checks the scene graph's plain C modules.
+
+ Like bglbench, it needs no GL and no Objective-C runtime, so it runs
+ anywhere. Each test is a function making CHECKs; a failed check prints
+ its file, line and expression and the test goes on. The exit status is 1
+ if any check failed.
+
+ Build and run (any C99 compiler on a POSIX system):
+
+    cc -std=gnu99 -DBGL_ACCOUNTING -I../Classes -o bgltest bgltest.c ../Classes/BGLTextCache.c \
+        ../Classes/BGLResourceRegistry.c ../Classes/BGLStrokeGeometry.c \
+        ../Classes/BGLCommandStream.c ../Classes/BGLMatrix.c ../Classes/BGLNodeStore.c \
+        ../Classes/BGLTimerWheel.c ../Classes/BGLTextureContainer.c \
+        ../Classes/BGLOcclusion.c ../Classes/BGLInputQueue.c ../Classes/BGLAccounting.c \
+        ../Classes/BGLDrawRecorder.c ../Classes/BGLResolutionController.c \
+        ../Classes/BGLMeshBuilder.c -lm -lpthread
+    ./bgltest [-f filter]
+
+ With -f, only tests whose names contain the filter run. BGL_ACCOUNTING
+ turns on the modules' allocation accounting, which the accounting tests
+ check; without it they check the counters alone.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BGLTextCache.h"
+#include "BGLResourceRegistry.h"
+#include "BGLStrokeGeometry.h"
+#include "BGLCommandStream.h"
+#include "BGLNodeStore.h"
+#include "BGLTimerWheel.h"
+#include "BGLTextureContainer.h"
+#include "BGLOcclusion.h"
+#include "BGLInputQueue.h"
+#include "BGLAccounting.h"
+#include "BGLDrawRecorder.h"
+#include "BGLResolutionController.h"
+#include "BGLMeshBuilder.h"
+
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} Test;
+
+
+static int failureCount;
+
+
+#define CHECK(cond) \
+    do { \
+        if (! (cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failureCount += 1; \
+        } \
+    } while (0)
+
+
+#define CHECK_NEAR(a, b) CHECK(fabsf((a) - (b)) < 1e-4f)
+
+
+// Text cache
+
+
+typedef struct {
+    int refs;
+} FakeFont;
+
+
+static int textCount;           // live texts
+static int createCount;
+
+
+static void *FakeCreateText(void *font, const uint16_t *chars, uint32_t length, float *width, float *height)
+{
+    (void)font;
+    if (length > 0 && chars[0] == '!') return NULL; // stands in for a layout failure
+    textCount += 1;
+    createCount += 1;
+    *width = 10.0f * length;
+    *height = 16;
+    return malloc(1);
+}
+
+
+static void FakeReleaseText(void *text)
+{
+    textCount -= 1;
+    free(text);
+}
+
+
+static void FakeRetainFont(void *font)
+{
+    ((FakeFont *)font)->refs += 1;
+}
+
+
+static void FakeReleaseFont(void *font)
+{
+    ((FakeFont *)font)->refs -= 1;
+}
+
+
+static void TextCacheInit(BGLTextCache *c)
+{
+    BGLTextCacheCallbacks callbacks = { FakeCreateText, FakeReleaseText, FakeRetainFont, FakeReleaseFont };
+    BGLTextCacheInit(c, &callbacks);
+    textCount = 0;
+    createCount = 0;
+}
+
+
+static uint32_t Chars(uint16_t *chars, const char *s)
+{
+    uint32_t length = strlen(s);
+    for (uint32_t i = 0; i < length; i++) chars[i] = s[i];
+    return length;
+}
+
+
+static void TestTextCacheHit(void)
+{
+    BGLTextCache c;
+    FakeFont font = { 1 };
+    uint16_t chars[16];
+    TextCacheInit(&c);
+
+    uint32_t length = Chars(chars, "0:59");
+    const BGLTextCacheEntry *e = BGLTextCacheLookup(&c, &font, chars, length);
+    CHECK(e != NULL && e->width == 40 && e->height == 16);
+    void *text = e->text;
+    chars[3] = '8';
+    e = BGLTextCacheLookup(&c, &font, chars, length);
+    CHECK(e != NULL && e->text != text);
+    chars[3] = '9';
+    e = BGLTextCacheLookup(&c, &font, chars, length);
+    CHECK(e != NULL && e->text == text);
+    CHECK(createCount == 2 && c.hitCount == 1 && c.missCount == 2);
+
+    // The same characters in another font are another layout.
+    FakeFont other = { 1 };
+    e = BGLTextCacheLookup(&c, &other, chars, length);
+    CHECK(e != NULL && e->text != text && createCount == 3);
+
+    BGLTextCacheFree(&c);
+    CHECK(textCount == 0 && font.refs == 1 && other.refs == 1);
+}
+
+
+static void TestTextCacheRetainsFont(void)
+{
+    // A layout keeps its font alive, so no font freed and reallocated at
+    // the same address can be handed the old layouts.
+    BGLTextCache c;
+    FakeFont font = { 1 };
+    uint16_t chars[16];
+    TextCacheInit(&c);
+
+    uint32_t length = Chars(chars, "SCORE");
+    BGLTextCacheLookup(&c, &font, chars, length);
+    BGLTextCacheLookup(&c, &font, chars, length);
+    CHECK(font.refs == 2);
+    font.refs -= 1; // the caller's reference goes; the cache's remains
+    CHECK(font.refs == 1);
+
+    BGLTextCacheFree(&c);
+    CHECK(font.refs == 0 && textCount == 0);
+}
+
+
+static void TestTextCacheEvictsLeastRecent(void)
+{
+    BGLTextCache c;
+    FakeFont font = { 1 };
+    uint16_t chars[16];
+    TextCacheInit(&c);
+
+    for (int i = 0; i < kBGLTextCacheCapacity; i++) {
+        char s[16];
+        snprintf(s, sizeof(s), "%d", i);
+        BGLTextCacheLookup(&c, &font, chars, Chars(chars, s));
+    }
+    CHECK(textCount == kBGLTextCacheCapacity && font.refs == 1 + kBGLTextCacheCapacity);
+    BGLTextCacheLookup(&c, &font, chars, Chars(chars, "0")); // now the most recent
+
+    BGLTextCacheLookup(&c, &font, chars, Chars(chars, "new"));
+    CHECK(textCount == kBGLTextCacheCapacity && font.refs == 1 + kBGLTextCacheCapacity);
+    uint32_t misses = c.missCount;
+    BGLTextCacheLookup(&c, &font, chars, Chars(chars, "0"));
+    CHECK(c.missCount == misses);
+    BGLTextCacheLookup(&c, &font, chars, Chars(chars, "1")); // was the oldest
+    CHECK(c.missCount == misses + 1);
+
+    BGLTextCacheFree(&c);
+    CHECK(textCount == 0 && font.refs == 1);
+}
+
+
+static void TestTextCacheLayoutFailure(void)
+{
+    BGLTextCache c;
+    FakeFont font = { 1 };
+    uint16_t chars[16];
+    TextCacheInit(&c);
+
+    CHECK(BGLTextCacheLookup(&c, &font, chars, Chars(chars, "!bad")) == NULL);
+    CHECK(font.refs == 1 && textCount == 0);
+    CHECK(BGLTextCacheLookup(&c, &font, chars, 0) != NULL); // the empty string is fine
+
+    BGLTextCacheFree(&c);
+    CHECK(textCount == 0 && font.refs == 1);
+}
+
+
+// Resource registry
+
+
+// Stands in for a GL texture; the callbacks log what they did to it.
+typedef struct {
+    int id;
+    size_t bytes;
+    int failReload;
+} FakeTexture;
+
+
+static int unloadLog[16];
+static int unloadLogCount;
+
+
+static void FakeUnload(void *info)
+{
+    if (unloadLogCount < 16) unloadLog[unloadLogCount++] = ((FakeTexture *)info)->id;
+}
+
+
+static size_t FakeReload(void *info)
+{
+    FakeTexture *t = info;
+    return t->failReload ? 0 : t->bytes;
+}
+
+
+static const BGLResourceCallbacks kFakeCallbacks = { FakeUnload, FakeReload };
+
+
+static BGLResourceID RegisterFake(BGLResourceRegistryRef reg, FakeTexture *t)
+{
+    return BGLResourceRegister(reg, kBGLResourceTexture, "fake", t->bytes, &kFakeCallbacks, t);
+}
+
+
+static void TestResourceEvictsLeastRecent(void)
+{
+    BGLResourceRegistryRef reg = BGLResourceRegistryCreate(300);
+    FakeTexture t[4] = { { 1, 100, 0 }, { 2, 100, 0 }, { 3, 100, 0 }, { 4, 100, 0 } };
+    BGLResourceID rid[4];
+    unloadLogCount = 0;
+
+    for (int i = 0; i < 3; i++) {
+        rid[i] = RegisterFake(reg, &t[i]);
+        BGLResourceRegistryAdvanceFrame(reg);
+    }
+    BGLResourceTouch(reg, rid[0]); // 2 is now the oldest, then 3
+    BGLResourceRegistryAdvanceFrame(reg);
+
+    rid[3] = RegisterFake(reg, &t[3]);
+    CHECK(unloadLogCount == 1 && unloadLog[0] == 2);
+    CHECK(! BGLResourceIsLoaded(reg, rid[1]) && BGLResourceIsLoaded(reg, rid[0]));
+
+    // Reloading 2 pushes out 3, the oldest left; nothing used this frame goes.
+    BGLResourceRegistryAdvanceFrame(reg);
+    CHECK(BGLResourceTouch(reg, rid[1]));
+    CHECK(unloadLogCount == 2 && unloadLog[1] == 3);
+
+    BGLResourceStats stats;
+    BGLResourceRegistryGetStats(reg, &stats);
+    CHECK(stats.loadedBytes == 300 && stats.totalBytes == 400);
+    CHECK(stats.evictionCount == 2 && stats.reloadCount == 1);
+    BGLResourceRegistryDestroy(reg);
+}
+
+
+static void TestResourcePinning(void)
+{
+    BGLResourceRegistryRef reg = BGLResourceRegistryCreate((size_t)-1);
+    FakeTexture held = { 1, 100, 0 }, loose = { 2, 100, 0 }, resident = { 3, 100, 0 };
+    BGLResourceID heldID = RegisterFake(reg, &held);
+    BGLResourceID looseID = RegisterFake(reg, &loose);
+    BGLResourceID residentID = RegisterFake(reg, &resident);
+    BGLResourceSetResident(reg, residentID, 1);
+    BGLResourceRetain(reg, heldID);
+    unloadLogCount = 0;
+
+    // What a memory warning does: only the unreferenced, non-resident go.
+    BGLResourceRegistryPurge(reg);
+    CHECK(unloadLogCount == 1 && unloadLog[0] == 2);
+    CHECK(BGLResourceIsLoaded(reg, heldID) && ! BGLResourceIsLoaded(reg, looseID));
+    CHECK(BGLResourceIsLoaded(reg, residentID));
+
+    BGLResourceRelease(reg, heldID);
+    BGLResourceRegistryPurge(reg);
+    CHECK(unloadLogCount == 2 && unloadLog[1] == 1);
+
+    // A failed reload leaves it unloaded and reports it.
+    loose.failReload = 1;
+    CHECK(! BGLResourceTouch(reg, looseID) && ! BGLResourceIsLoaded(reg, looseID));
+    BGLResourceRegistryDestroy(reg);
+}
+
+
+static void TestResourceBuffers(void)
+{
+    // Buffers have no reload callback, so they count against the budget
+    // without ever being evicted; growing one evicts textures instead.
+    BGLResourceRegistryRef reg = BGLResourceRegistryCreate(250);
+    FakeTexture t = { 1, 100, 0 };
+    BGLResourceID tid = RegisterFake(reg, &t);
+    BGLResourceID bid = BGLResourceRegister(reg, kBGLResourceBuffer, "buffer", 0, NULL, NULL);
+    BGLResourceRegistryAdvanceFrame(reg);
+    unloadLogCount = 0;
+
+    BGLResourceSetSize(reg, bid, 200);
+    CHECK(unloadLogCount == 1 && ! BGLResourceIsLoaded(reg, tid));
+    BGLResourceSetSize(reg, bid, 400);
+    BGLResourceRegistryPurge(reg);
+    CHECK(BGLResourceIsLoaded(reg, bid));
+
+    BGLResourceStats stats;
+    BGLResourceRegistryGetStats(reg, &stats);
+    CHECK(stats.loadedBytes == 400 && stats.loadedBytesByType[kBGLResourceBuffer] == 400);
+    BGLResourceUnregister(reg, bid);
+    BGLResourceRegistryGetStats(reg, &stats);
+    CHECK(stats.loadedBytes == 0 && stats.totalCount == 1);
+    BGLResourceRegistryDestroy(reg);
+}
+
+
+static void TestResourceReusesSlots(void)
+{
+    // A buffer per node, as nodes come and go: the registry doesn't grow.
+    BGLResourceRegistryRef reg = BGLResourceRegistryCreate((size_t)-1);
+    BGLResourceID first = BGLResourceRegister(reg, kBGLResourceBuffer, "buffer", 10, NULL, NULL);
+    BGLResourceID live[8];
+    for (int round = 0; round < 1000; round++) {
+        for (int i = 0; i < 8; i++) live[i] = BGLResourceRegister(reg, kBGLResourceBuffer, "buffer", 10, NULL, NULL);
+        for (int i = 0; i < 8; i++) BGLResourceUnregister(reg, live[i]);
+    }
+    BGLResourceStats stats;
+    BGLResourceRegistryGetStats(reg, &stats);
+    CHECK(stats.totalCount == 1 && stats.loadedBytes == 10);
+    CHECK(stats.slotCount == 9);
+
+    // An old ID doesn't name the resource now in its slot.
+    BGLResourceID old = live[0];
+    BGLResourceID reused = BGLResourceRegister(reg, kBGLResourceBuffer, "buffer", 20, NULL, NULL);
+    CHECK(reused != old && reused != 0);
+    CHECK(! BGLResourceIsLoaded(reg, old) && BGLResourceIsLoaded(reg, reused));
+    BGLResourceUnregister(reg, old);
+    CHECK(BGLResourceIsLoaded(reg, reused) && BGLResourceIsLoaded(reg, first));
+    BGLResourceRegistryGetStats(reg, &stats);
+    CHECK(stats.totalCount == 2 && stats.loadedBytes == 30);
+    BGLResourceRegistryDestroy(reg);
+}
+
+
+// Stroke geometry
+
+
+static void TestStrokeIncrementalMatchesBatch(void)
+{
+    // However the points arrive, the finished geometry is the same.
+    enum { kCount = 500 };
+    BGLVector2 points[kCount];
+    srand(7);
+    BGLVector2 p = BGLVector2Make(0, 0);
+    for (int i = 0; i < kCount; i++) {
+        p.x += (rand() % 21) - 10;
+        p.y += (rand() % 21) - 10;
+        points[i] = p;
+    }
+
+    BGLStrokeGeometry all, single, batched;
+    BGLStrokeGeometryInit(&all, 3);
+    BGLStrokeGeometryInit(&single, 3);
+    BGLStrokeGeometryInit(&batched, 3);
+    all.cap = single.cap = batched.cap = kBGLStrokeCapSquare;
+    BGLStrokeGeometryAddPoints(&all, points, NULL, kCount);
+    for (int i = 0; i < kCount; i++) {
+        BGLStrokeGeometryAddPoints(&single, &points[i], NULL, 1);
+    }
+    for (int i = 0; i < kCount; i += 7) {
+        BGLStrokeGeometryAddPoints(&batched, &points[i], NULL, (kCount - i < 7) ? kCount - i : 7);
+    }
+    CHECK(all.vertexCount == single.vertexCount && all.vertexCount == batched.vertexCount);
+    CHECK(memcmp(all.vertexes, single.vertexes, all.vertexCount * sizeof(BGLStrokeVertex)) == 0);
+    CHECK(memcmp(all.vertexes, batched.vertexes, all.vertexCount * sizeof(BGLStrokeVertex)) == 0);
+
+    BGLStrokeGeometryFree(&all);
+    BGLStrokeGeometryFree(&single);
+    BGLStrokeGeometryFree(&batched);
+}
+
+
+static void TestStrokeDirtyStart(void)
+{
+    BGLStrokeGeometry g;
+    BGLStrokeGeometryInit(&g, 2);
+    BGLVector2 points[4] = { { 0, 0 }, { 10, 0 }, { 20, 0 }, { 30, 0 } };
+    BGLStrokeGeometryAddPoints(&g, points, NULL, 3);
+    CHECK(g.vertexCount == 6 && g.dirtyStart == 0);
+    BGLStrokeGeometryClearDirty(&g);
+
+    // Only the old end cap, now a join, and what follows it are rewritten.
+    BGLStrokeVertex before[4];
+    memcpy(before, g.vertexes, sizeof(before));
+    BGLStrokeGeometryAddPoints(&g, &points[3], NULL, 1);
+    CHECK(g.vertexCount == 8 && g.dirtyStart == 4);
+    CHECK(memcmp(before, g.vertexes, sizeof(before)) == 0);
+
+    // A repeated point adds nothing.
+    BGLStrokeGeometryClearDirty(&g);
+    BGLStrokeGeometryAddPoints(&g, &points[3], NULL, 1);
+    CHECK(g.vertexCount == 8);
+    BGLStrokeGeometryFree(&g);
+}
+
+
+static void TestStrokeJoins(void)
+{
+    BGLStrokeGeometry g;
+    BGLStrokeGeometryInit(&g, 2);
+
+    // A right angle mitres: one pair at the corner, sqrt(2) out.
+    BGLVector2 corner[3] = { { 0, 0 }, { 10, 0 }, { 10, 10 } };
+    BGLStrokeGeometryAddPoints(&g, corner, NULL, 3);
+    CHECK(g.vertexCount == 6);
+    CHECK_NEAR(g.vertexes[2].position.x, 9);
+    CHECK_NEAR(g.vertexes[2].position.y, 1);
+    CHECK_NEAR(g.vertexes[3].position.x, 11);
+    CHECK_NEAR(g.vertexes[3].position.y, -1);
+
+    // Doubling back is past any miter limit, so it bevels: two pairs.
+    BGLStrokeGeometryReset(&g);
+    BGLVector2 hairpin[3] = { { 0, 0 }, { 10, 0 }, { 0, 1 } };
+    BGLStrokeGeometryAddPoints(&g, hairpin, NULL, 3);
+    CHECK(g.vertexCount == 8);
+
+    // And a bevel join bevels even the right angle.
+    BGLStrokeGeometryReset(&g);
+    g.join = kBGLStrokeJoinBevel;
+    BGLStrokeGeometryAddPoints(&g, corner, NULL, 3);
+    CHECK(g.vertexCount == 8);
+    BGLStrokeGeometryFree(&g);
+}
+
+
+static void TestStrokeSegmentNormals(void)
+{
+    // Enough segments for the vector path and a scalar remainder.
+    BGLVector2 points[7] = { { 0, 0 }, { 2, 0 }, { 2, 3 }, { 2, 3 }, { -1, 3 }, { -1, -1 }, { 2, 3 } };
+    BGLVector2 normals[6];
+    BGLStrokeComputeSegmentNormals(points, normals, 6);
+    CHECK_NEAR(normals[0].x, 0); CHECK_NEAR(normals[0].y, 1);
+    CHECK_NEAR(normals[1].x, -1); CHECK_NEAR(normals[1].y, 0);
+    CHECK(normals[2].x == 0 && normals[2].y == 0); // zero length
+    CHECK_NEAR(normals[3].x, 0); CHECK_NEAR(normals[3].y, -1);
+    CHECK_NEAR(normals[4].x, 1); CHECK_NEAR(normals[4].y, 0);
+    CHECK_NEAR(normals[5].x, -0.8f); CHECK_NEAR(normals[5].y, 0.6f);
+}
+
+
+// Command stream
+
+
+// Writes a stream to a temporary file and reads it all back; the caller
+// frees the bytes.
+static uint8_t *WriteStream(void (*write)(BGLCommandStreamWriter *), size_t *length, BGLCommandStreamWriter *w)
+{
+    char path[] = "/tmp/bgltestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    close(fd);
+    if (! BGLCommandStreamWriterOpen(w, path)) return NULL;
+    write(w);
+    BGLCommandStreamWriterClose(w);
+
+    FILE *f = fopen(path, "rb");
+    fseek(f, 0, SEEK_END);
+    *length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *bytes = malloc(*length);
+    *length = fread(bytes, 1, *length, f);
+    fclose(f);
+    unlink(path);
+    return bytes;
+}
+
+
+static const float kStreamMatrix[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0.5f, -2, 0, 1 };
+static const uint8_t kStreamOddBytes[5] = { 1, 2, 3, 4, 5 };
+
+
+static void WriteSampleStream(BGLCommandStreamWriter *w)
+{
+    uint32_t frame[1] = { 7 };
+    uint32_t viewport[4] = { 0, 0, 320, 480 };
+    uint32_t uniform[3] = { 3, 1, 0 };
+    uint32_t buffer[3] = { 0x8892, 5, 0x88E4 };
+    uint32_t clear[4] = { BGLCommandFloatBits(0.25f), 0, 0, BGLCommandFloatBits(1) };
+    uint32_t draw[3] = { 5, 0, 4 };
+    BGLCommandStreamWrite(w, kBGLCommandFrame, frame, 1, NULL, 0);
+    BGLCommandStreamWrite(w, kBGLCommandViewport, viewport, 4, NULL, 0);
+    BGLCommandStreamWrite(w, kBGLCommandUniformMatrix4fv, uniform, 3, kStreamMatrix, sizeof(kStreamMatrix));
+    BGLCommandStreamWrite(w, kBGLCommandBufferData, buffer, 3, kStreamOddBytes, sizeof(kStreamOddBytes));
+    BGLCommandStreamWrite(w, kBGLCommandClearColor, clear, 4, NULL, 0);
+    BGLCommandStreamWrite(w, kBGLCommandDrawArrays, draw, 3, NULL, 0);
+}
+
+
+static void TestCommandStreamRoundTrip(void)
+{
+    BGLCommandStreamWriter w;
+    size_t length = 0;
+    uint8_t *bytes = WriteStream(WriteSampleStream, &length, &w);
+    CHECK(bytes != NULL);
+    if (bytes == NULL) return;
+    CHECK(w.commandCount == 6 && w.byteCount == length);
+
+    BGLCommandStreamReader r;
+    BGLCommand cmd;
+    CHECK(BGLCommandStreamReaderInit(&r, bytes, length));
+
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 1);
+    CHECK(cmd.opcode == kBGLCommandFrame && cmd.argCount == 1 && cmd.args[0] == 7 && cmd.data == NULL);
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 1);
+    CHECK(cmd.opcode == kBGLCommandViewport && cmd.argCount == 4 && cmd.args[3] == 480);
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 1);
+    CHECK(cmd.opcode == kBGLCommandUniformMatrix4fv && cmd.dataLength == sizeof(kStreamMatrix));
+    CHECK(cmd.data && memcmp(cmd.data, kStreamMatrix, sizeof(kStreamMatrix)) == 0);
+    // Odd-length data is padded, and the next command still lines up.
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 1);
+    CHECK(cmd.opcode == kBGLCommandBufferData && cmd.dataLength == 5);
+    CHECK(cmd.data && memcmp(cmd.data, kStreamOddBytes, 5) == 0);
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 1);
+    CHECK(cmd.opcode == kBGLCommandClearColor);
+    CHECK(BGLCommandBitsFloat(cmd.args[0]) == 0.25f && BGLCommandBitsFloat(cmd.args[3]) == 1);
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 1);
+    CHECK(cmd.opcode == kBGLCommandDrawArrays && cmd.args[2] == 4);
+    CHECK(BGLCommandStreamNext(&r, &cmd) == 0);
+    CHECK(strcmp(BGLCommandName(kBGLCommandDrawArrays), "DrawArrays") == 0);
+    free(bytes);
+}
+
+
+static void TestCommandStreamRejectsDamage(void)
+{
+    BGLCommandStreamWriter w;
+    size_t length = 0;
+    uint8_t *bytes = WriteStream(WriteSampleStream, &length, &w);
+    CHECK(bytes != NULL);
+    if (bytes == NULL) return;
+
+    BGLCommandStreamReader r;
+    BGLCommand cmd;
+    CHECK(! BGLCommandStreamReaderInit(&r, bytes, 4));
+    bytes[4] += 1; // the version
+    CHECK(! BGLCommandStreamReaderInit(&r, bytes, length));
+    bytes[4] -= 1;
+
+    // Cut anywhere past the header but between commands, and the stream just
+    // ends; cut inside one, and it's corrupt, never read past the end.
+    int endCount = 0;
+    for (size_t cut = 8; cut < length; cut++) {
+        CHECK(BGLCommandStreamReaderInit(&r, bytes, cut));
+        int result;
+        while ((result = BGLCommandStreamNext(&r, &cmd)) == 1) {}
+        CHECK(r.offset <= cut);
+        if (result == 0) endCount += 1;
+    }
+    CHECK(endCount == 6); // the header alone, and after each of the first five commands
+
+    // An unknown opcode is corrupt.
+    bytes[8] = kBGLCommandCount;
+    CHECK(BGLCommandStreamReaderInit(&r, bytes, length));
+    CHECK(BGLCommandStreamNext(&r, &cmd) == -1);
+    free(bytes);
+}
+
+
+// Matrices
+
+
+static uint32_t matrixSeed = 1;
+
+
+static float RandomFloat(float lo, float hi)
+{
+    matrixSeed = matrixSeed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (matrixSeed >> 8) / (float)(1 << 24);
+}
+
+
+static void RandomAffine(BGLMatrix m)
+{
+    BGLMatrixLoadIdentity(m);
+    BGLMatrixScale(m, RandomFloat(0.5f, 2), RandomFloat(0.5f, 2), RandomFloat(0.5f, 2));
+    BGLMatrixRotate(m, RandomFloat(-180, 180), 0, 0, 1);
+    BGLMatrixTranslate(m, RandomFloat(-100, 100), RandomFloat(-100, 100), RandomFloat(-10, 10));
+}
+
+
+// The largest difference between entries, relative to the larger entry.
+static float MatrixError(const BGLMatrix a, const BGLMatrix b)
+{
+    float error = 0;
+    for (int i = 0; i < 16; i++) {
+        float e = fabsf(a[i] - b[i]) / fmaxf(1, fmaxf(fabsf(a[i]), fabsf(b[i])));
+        if (e > error) error = e;
+    }
+    return error;
+}
+
+
+// What translate, scale and rotate did before the fast paths: build the
+// operation's matrix and multiply it in.
+static void ReferenceApply(BGLMatrix m, void (*op)(BGLMatrix, const float *), const float *args)
+{
+    BGLMatrix t;
+    BGLMatrixLoadIdentity(t);
+    op(t, args);
+    BGLMatrixMultiply(m, t, m);
+}
+
+
+static void OpTranslate(BGLMatrix t, const float *a) { t[12] = a[0]; t[13] = a[1]; t[14] = a[2]; }
+static void OpScale(BGLMatrix t, const float *a) { t[0] = a[0]; t[5] = a[1]; t[10] = a[2]; }
+
+
+static void OpRotateZ(BGLMatrix t, const float *a)
+{
+    float radians = a[0] * (M_PI / 180.0);
+    t[0] = cosf(radians); t[4] = -sinf(radians);
+    t[1] = sinf(radians); t[5] = cosf(radians);
+}
+
+
+static void TestMatrixFastPathsMatchReference(void)
+{
+    float worst = 0;
+    for (int i = 0; i < 1000; i++) {
+        BGLMatrix m, fast, reference;
+        RandomAffine(m);
+        if (i % 4 == 0) m[3] = RandomFloat(-0.01f, 0.01f); // and some not affine
+        float args[3] = { RandomFloat(-50, 50), RandomFloat(0.5f, 2), RandomFloat(-3, 3) };
+
+        BGLMatrixCopy(fast, m);
+        BGLMatrixCopy(reference, m);
+        BGLMatrixTranslate(fast, args[0], args[1], args[2]);
+        ReferenceApply(reference, OpTranslate, args);
+        worst = fmaxf(worst, MatrixError(fast, reference));
+
+        BGLMatrixCopy(fast, m);
+        BGLMatrixCopy(reference, m);
+        BGLMatrixScale(fast, args[0], args[1], args[2]);
+        ReferenceApply(reference, OpScale, args);
+        worst = fmaxf(worst, MatrixError(fast, reference));
+
+        BGLMatrixCopy(fast, m);
+        BGLMatrixCopy(reference, m);
+        BGLMatrixRotate(fast, args[0], 0, 0, 1);
+        ReferenceApply(reference, OpRotateZ, args);
+        worst = fmaxf(worst, MatrixError(fast, reference));
+
+        if (BGLMatrixIsAffine(m)) {
+            BGLMatrix other;
+            RandomAffine(other);
+            BGLMatrixMultiplyAffine(fast, m, other);
+            BGLMatrixMultiply(reference, m, other);
+            worst = fmaxf(worst, MatrixError(fast, reference));
+        }
+    }
+    CHECK(worst < 1e-5f);
+}
+
+
+static void TestMatrixInverse(void)
+{
+    BGLMatrix identity;
+    BGLMatrixLoadIdentity(identity);
+    float worstAffine = 0, worstGeneral = 0;
+    for (int i = 0; i < 1000; i++) {
+        BGLMatrix m, inverse, product;
+        RandomAffine(m);
+        CHECK(BGLMatrixInvert(inverse, m));
+        BGLMatrixMultiply(product, m, inverse);
+        worstAffine = fmaxf(worstAffine, MatrixError(product, identity));
+
+        BGLMatrix perspective;
+        BGLMatrixLoadIdentity(perspective);
+        BGLMatrixPerspective(perspective, RandomFloat(30, 90), RandomFloat(0.5f, 2), 1, 100);
+        BGLMatrixMultiply(m, perspective, m);
+        CHECK(BGLMatrixInvert(inverse, m));
+        BGLMatrixMultiply(product, m, inverse);
+        worstGeneral = fmaxf(worstGeneral, MatrixError(product, identity));
+    }
+    CHECK(worstAffine < 1e-4f);
+    CHECK(worstGeneral < 1e-3f);
+
+    BGLMatrix singular, inverse;
+    BGLMatrixLoadIdentity(singular);
+    BGLMatrixScale(singular, 1, 0, 1);
+    CHECK(! BGLMatrixInvert(inverse, singular));
+}
+
+
+static void TestMatrixComponentsRoundTrip(void)
+{
+    float worst = 0;
+    int refused = 0;
+    for (int i = 0; i < 1000; i++) {
+        BGLTransformComponents tc, out;
+        tc.translation = BGLVector3Make(RandomFloat(-100, 100), RandomFloat(-100, 100), RandomFloat(-10, 10));
+        tc.rotation = BGLQuaternionMakeWithAngleAxis(RandomFloat(-180, 180), 0.6f, 0, 0.8f);
+        tc.scale = BGLVector3Make(RandomFloat(0.5f, 2), RandomFloat(0.5f, 2), RandomFloat(0.5f, 2));
+        if (i % 8 == 0) tc.scale.y = -tc.scale.y; // a reflection
+
+        BGLMatrix m, again;
+        BGLMatrixLoadTransformComponents(m, &tc);
+        if (! BGLMatrixGetTransformComponents(m, &out)) {
+            refused += 1;
+            continue;
+        }
+        BGLMatrixLoadTransformComponents(again, &out);
+        worst = fmaxf(worst, MatrixError(m, again));
+    }
+    CHECK(refused == 0);
+    CHECK(worst < 1e-5f);
+}
+
+
+static void TestMatrixComponentsRefuseShear(void)
+{
+    BGLTransformComponents tc, untouched;
+    BGLTransformComponentsLoadIdentity(&tc);
+    tc.translation = BGLVector3Make(7, 7, 7);
+    untouched = tc;
+
+    // A non-uniform scale after a rotation shears.
+    BGLMatrix m;
+    BGLMatrixLoadIdentity(m);
+    BGLMatrixRotate(m, 30, 0, 0, 1);
+    BGLMatrixScale(m, 2, 1, 1);
+    CHECK(! BGLMatrixGetTransformComponents(m, &tc));
+    CHECK(memcmp(&tc, &untouched, sizeof(tc)) == 0);
+
+    // Before the rotation, it doesn't.
+    BGLMatrixLoadIdentity(m);
+    BGLMatrixScale(m, 2, 1, 1);
+    BGLMatrixRotate(m, 30, 0, 0, 1);
+    CHECK(BGLMatrixGetTransformComponents(m, &tc));
+    CHECK_NEAR(tc.scale.x, 2); CHECK_NEAR(tc.scale.y, 1);
+
+    // Nor does the rounding a long run of small rotations leaves.
+    BGLMatrixLoadIdentity(m);
+    BGLMatrixScale(m, 3, 1, 1);
+    for (int i = 0; i < 100000; i++) BGLMatrixRotate(m, 0.7f, 0, 0, 1);
+    CHECK(BGLMatrixGetTransformComponents(m, &tc));
+
+    // Not affine, or flattened, isn't either.
+    BGLMatrixLoadIdentity(m);
+    m[3] = 0.5f;
+    CHECK(! BGLMatrixGetTransformComponents(m, &tc));
+    BGLMatrixLoadIdentity(m);
+    BGLMatrixScale(m, 1, 1, 0);
+    CHECK(! BGLMatrixGetTransformComponents(m, &tc));
+}
+
+
+// Node store
+
+
+static void TestNodeStoreHandles(void)
+{
+    BGLNodeStore *s = BGLNodeStoreCreate(4);
+    BGLNodeHandle parent = BGLNodeStoreAlloc(s);
+    BGLNodeHandle child = BGLNodeStoreAlloc(s);
+    BGLNodeStoreLink(s, parent, child);
+    CHECK(s->parent[BGLNodeHandleIndex(child)] == BGLNodeHandleIndex(parent));
+
+    // A freed slot is reused, under a handle the old one doesn't match.
+    BGLNodeStoreFree(s, child);
+    CHECK(! BGLNodeStoreIsValid(s, child));
+    CHECK(s->firstChild[BGLNodeHandleIndex(parent)] == kBGLNodeIndexNone);
+    BGLNodeHandle reused = BGLNodeStoreAlloc(s);
+    CHECK(BGLNodeHandleIndex(reused) == BGLNodeHandleIndex(child) && reused != child);
+    CHECK(BGLNodeStoreIsValid(s, reused) && ! BGLNodeStoreIsValid(s, child));
+
+    // Growing keeps every slot.
+    for (int i = 0; i < 100; i++) CHECK(BGLNodeStoreAlloc(s) != 0);
+    CHECK(s->capacity >= 102 && s->count == 102 && BGLNodeStoreIsValid(s, reused));
+    BGLNodeStoreDestroy(s);
+}
+
+
+static void TestNodeStoreRetiresWrappedSlots(void)
+{
+    // Reuse one slot through every generation: no handle comes back, and
+    // the slot is then retired rather than wrap around to the first.
+    BGLNodeStore *s = BGLNodeStoreCreate(4);
+    BGLNodeHandle first = BGLNodeStoreAlloc(s);
+    uint32_t index = BGLNodeHandleIndex(first);
+    BGLNodeHandle h = first;
+    int aliased = 0;
+    for (uint32_t g = 0; g < kBGLNodeGenerationMax; g++) {
+        BGLNodeStoreFree(s, h);
+        h = BGLNodeStoreAlloc(s);
+        if (BGLNodeHandleIndex(h) != index || BGLNodeStoreIsValid(s, first)) aliased += 1;
+    }
+    CHECK(aliased == 0);
+    CHECK(BGLNodeHandleGeneration(h) == kBGLNodeGenerationMax);
+
+    BGLNodeStoreFree(s, h);
+    BGLNodeHandle next = BGLNodeStoreAlloc(s);
+    CHECK(BGLNodeHandleIndex(next) != index);
+    CHECK(! BGLNodeStoreIsValid(s, first) && ! BGLNodeStoreIsValid(s, h));
+
+    BGLNodeStoreStats stats;
+    BGLNodeStoreGetStats(s, &stats);
+    CHECK(stats.retiredCount == 1 && stats.count == 1);
+    BGLNodeStoreDestroy(s);
+}
+
+
+// Timer wheel
+
+
+static void CountFired(void *context, BGLTimerHandle timer)
+{
+    (void)timer;
+    *(int *)context += 1;
+}
+
+
+static void TestTimerRetiresWrappedSlots(void)
+{
+    BGLNodeStore *s = BGLNodeStoreCreate(0);
+    BGLTimerWheel w;
+    BGLTimerWheelInit(&w, s);
+    int fired = 0;
+    BGLTimerHandle first = BGLTimerWheelSchedule(&w, 0, 0, 0, CountFired, &fired, NULL);
+    BGLTimerHandle h = first;
+    int aliased = 0;
+    for (uint32_t g = 0; g <= kBGLNodeGenerationMax; g++) {
+        BGLTimerWheelCancel(&w, h);
+        h = BGLTimerWheelSchedule(&w, 0, 0, 0, CountFired, &fired, NULL);
+        if (h == 0 || BGLTimerWheelIsPending(&w, first) || BGLTimerWheelCancel(&w, first)) aliased += 1;
+    }
+    CHECK(aliased == 0);
+    CHECK(BGLTimerWheelIsPending(&w, h));
+    BGLTimerWheelAdvance(&w, 0.01);
+    CHECK(fired == 1);
+    BGLTimerWheelFree(&w);
+    BGLNodeStoreDestroy(s);
+}
+
+
+static int firedLog[64];
+static int firedLogCount;
+static int releaseCount;
+
+
+// The context is the timer's ID, logged as it fires.
+static void LogFired(void *context, BGLTimerHandle timer)
+{
+    (void)timer;
+    if (firedLogCount < 64) firedLog[firedLogCount++] = (int)(intptr_t)context;
+}
+
+
+static void CountRelease(void *context)
+{
+    (void)context;
+    releaseCount += 1;
+}
+
+
+static void TestTimerOrder(void)
+{
+    BGLNodeStore *s = BGLNodeStoreCreate(0);
+    BGLTimerWheel w;
+    BGLTimerWheelInit(&w, s);
+    firedLogCount = 0;
+
+    // Due on every level of the wheel, scheduled out of order.
+    static const double delays[] = { 70, 0.3, 0.002, 20000, 1.5, 0.001 };
+    static const int expected[] = { 5, 2, 1, 4, 0, 3 };
+    for (int i = 0; i < 6; i++) {
+        CHECK(BGLTimerWheelSchedule(&w, delays[i], 0, 0, LogFired, (void *)(intptr_t)i, NULL) != 0);
+    }
+    CHECK(BGLTimerWheelScheduledCount(&w) == 6);
+
+    BGLTimerWheelAdvance(&w, 0.0015);
+    CHECK(firedLogCount == 1);
+    for (int step = 0; step < 25000; step++) BGLTimerWheelAdvance(&w, 1);
+    CHECK(firedLogCount == 6);
+    for (int i = 0; i < 6 && i < firedLogCount; i++) CHECK(firedLog[i] == expected[i]);
+    CHECK(BGLTimerWheelScheduledCount(&w) == 0 && w.count == 0);
+
+    BGLTimerWheelFree(&w);
+
+    // Due exactly when the clock gets there, not a tick late.
+    BGLTimerWheelInit(&w, s);
+    firedLogCount = 0;
+    BGLTimerWheelSchedule(&w, 0.25, 0, 0, LogFired, NULL, NULL);
+    for (int i = 0; i < 249; i++) BGLTimerWheelAdvance(&w, 0.001);
+    CHECK(firedLogCount == 0);
+    BGLTimerWheelAdvance(&w, 0.001);
+    CHECK(firedLogCount == 1);
+
+    BGLTimerWheelFree(&w);
+    BGLNodeStoreDestroy(s);
+}
+
+
+// Cancels itself from inside its own callback; the context is the wheel.
+static void CancelFired(void *context, BGLTimerHandle timer)
+{
+    (void)timer;
+    BGLTimerWheel *w = context;
+    CHECK(BGLTimerWheelCancel(w, timer)); // a repeating timer is still pending while it fires
+    CHECK(! BGLTimerWheelCancel(w, timer));
+}
+
+
+static void TestTimerCancelAndRepeat(void)
+{
+    BGLNodeStore *s = BGLNodeStoreCreate(0);
+    BGLTimerWheel w;
+    BGLTimerWheelInit(&w, s);
+    int fired = 0;
+    releaseCount = 0;
+
+    BGLTimerHandle once = BGLTimerWheelSchedule(&w, 0.1, 0, 0, CountFired, &fired, CountRelease);
+    CHECK(BGLTimerWheelIsPending(&w, once));
+    CHECK(BGLTimerWheelCancel(&w, once));
+    CHECK(releaseCount == 1);
+    CHECK(! BGLTimerWheelIsPending(&w, once));
+    CHECK(! BGLTimerWheelCancel(&w, once));
+    BGLTimerWheelAdvance(&w, 1);
+    CHECK(fired == 0 && releaseCount == 1);
+
+    // Every 10 ms from 10 ms on; released only once cancelled.
+    BGLTimerHandle repeat = BGLTimerWheelSchedule(&w, 0.01, 0.01, 0, CountFired, &fired, CountRelease);
+    for (int i = 0; i < 100; i++) BGLTimerWheelAdvance(&w, 0.001);
+    CHECK(fired == 10);
+    CHECK(BGLTimerWheelIsPending(&w, repeat) && releaseCount == 1);
+    BGLTimerWheelAdvance(&w, 0.5);
+    CHECK(fired == 60);
+    CHECK(BGLTimerWheelCancel(&w, repeat));
+    CHECK(releaseCount == 2);
+    BGLTimerWheelAdvance(&w, 0.5);
+    CHECK(fired == 60);
+
+    // One that cancels itself the first time it fires.
+    BGLTimerHandle self = BGLTimerWheelSchedule(&w, 0, 0.001, 0, CancelFired, &w, CountRelease);
+    BGLTimerWheelAdvance(&w, 0.01);
+    CHECK(! BGLTimerWheelIsPending(&w, self) && releaseCount == 3);
+    CHECK(w.count == 0);
+
+    // Freeing the wheel releases what's left, without firing it.
+    BGLTimerWheelSchedule(&w, 5, 0, 0, CountFired, &fired, CountRelease);
+    BGLTimerWheelFree(&w);
+    CHECK(fired == 60 && releaseCount == 4);
+    BGLNodeStoreDestroy(s);
+}
+
+
+static void TestTimerPausedNode(void)
+{
+    BGLNodeStore *s = BGLNodeStoreCreate(0);
+    BGLNodeHandle parent = BGLNodeStoreAlloc(s), child = BGLNodeStoreAlloc(s);
+    BGLNodeStoreLink(s, parent, child);
+    BGLTimerWheel w;
+    BGLTimerWheelInit(&w, s);
+    int fired = 0, repeats = 0;
+
+    BGLTimerHandle h = BGLTimerWheelSchedule(&w, 0.1, 0, child, CountFired, &fired, NULL);
+    BGLTimerWheelSchedule(&w, 0.01, 0.01, child, CountFired, &repeats, NULL);
+    BGLTimerWheelAdvance(&w, 0.04);
+    CHECK(repeats == 4);
+
+    // Pausing the parent stops the child's timers with the time they have left.
+    BGLNodeStoreSetFlag(s, parent, kBGLNodeFlagPaused, 1);
+    BGLTimerWheelSuspendNode(&w, parent);
+    CHECK(BGLTimerWheelScheduledCount(&w) == 0);
+    CHECK(BGLTimerWheelIsPending(&w, h));
+    BGLTimerWheelAdvance(&w, 1);
+    CHECK(fired == 0 && repeats == 4);
+
+    // A timer scheduled while paused waits too.
+    int later = 0;
+    BGLTimerWheelSchedule(&w, 0.01, 0, child, CountFired, &later, NULL);
+    BGLTimerWheelAdvance(&w, 1);
+    CHECK(later == 0);
+
+    BGLNodeStoreSetFlag(s, parent, kBGLNodeFlagPaused, 0);
+    BGLTimerWheelResumeNode(&w, parent);
+    CHECK(BGLTimerWheelScheduledCount(&w) == 3);
+    BGLTimerWheelAdvance(&w, 0.059);
+    CHECK(fired == 0 && later == 1);
+    BGLTimerWheelAdvance(&w, 0.001);
+    CHECK(fired == 1 && repeats == 10);
+
+    // A timer whose node is freed is dropped, not fired.
+    int orphaned = 0;
+    BGLTimerWheelSchedule(&w, 0.01, 0, child, CountFired, &orphaned, NULL);
+    BGLTimerWheelCancelNode(&w, child);
+    CHECK(repeats == 10 && BGLTimerWheelScheduledCount(&w) == 0);
+    BGLTimerWheelSchedule(&w, 0.01, 0, child, CountFired, &orphaned, NULL);
+    BGLNodeStoreUnlink(s, child);
+    BGLNodeStoreFree(s, child);
+    BGLTimerWheelAdvance(&w, 0.1);
+    CHECK(orphaned == 0 && w.count == 0);
+
+    BGLTimerWheelFree(&w);
+    BGLNodeStoreDestroy(s);
+}
+
+
+// Texture containers
+
+
+static uint8_t *PutUInt32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+    return p + 4;
+}
+
+
+// A KTX file of ETC1 levels from size x size down to 1x1, with 8 bytes of
+// key/value data; returns its length.
+static size_t MakeKTX(uint8_t *bytes, uint32_t size, uint32_t levels)
+{
+    static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    memcpy(bytes, identifier, 12);
+    uint8_t *p = bytes + 12;
+    uint32_t header[13] = { 0x04030201, 0, 1, 0, kBGLTextureFormatETC1_RGB8, 0x1907, size, size, 0, 0, 1, levels, 8 };
+    for (int i = 0; i < 13; i++) p = PutUInt32(p, header[i]);
+    memset(p, 0, 8);
+    p += 8;
+    for (uint32_t i = 0; i < levels; i++) {
+        uint32_t w = (size >> i) ? (size >> i) : 1;
+        uint32_t n = BGLTextureCompressedImageSize(kBGLTextureFormatETC1_RGB8, w, w);
+        p = PutUInt32(p, n);
+        memset(p, (int)i, n);
+        p += n;
+    }
+    return p - bytes;
+}
+
+
+static void TestTextureContainerKTX(void)
+{
+    static uint8_t bytes[4096];
+    size_t length = MakeKTX(bytes, 64, 7);
+    BGLTextureContainer c;
+    CHECK(BGLTextureContainerParse(bytes, length, &c));
+    CHECK(c.type == kBGLTextureContainerKTX && c.format == kBGLTextureFormatETC1_RGB8);
+    CHECK(c.width == 64 && c.height == 64 && c.levelCount == 7);
+    CHECK(c.levels[0].offset == 64 + 8 + 4 && c.levels[0].size == 2048);
+    CHECK(c.levels[6].width == 1 && c.levels[6].height == 1 && c.levels[6].size == 8);
+    CHECK(c.dataSize == 2048 + 512 + 128 + 32 + 8 + 8 + 8);
+    for (uint32_t i = 0; i < c.levelCount; i++) {
+        CHECK(c.levels[i].offset + c.levels[i].size <= length && bytes[c.levels[i].offset] == i);
+    }
+
+    // Any truncation is refused, never read past.
+    int accepted = 0;
+    for (size_t cut = 0; cut < length; cut++) accepted += BGLTextureContainerParse(bytes, cut, &c);
+    CHECK(accepted == 0);
+
+    // So are the other byte order, uncompressed data, a level whose size
+    // doesn't match its dimensions, and key/value data past the end.
+    bytes[12] = 0x04; bytes[15] = 0x01;
+    CHECK(! BGLTextureContainerParse(bytes, length, &c));
+    length = MakeKTX(bytes, 64, 7);
+    PutUInt32(bytes + 16, 0x1401);
+    CHECK(! BGLTextureContainerParse(bytes, length, &c));
+    length = MakeKTX(bytes, 64, 7);
+    PutUInt32(bytes + 64 + 8, 2047);
+    CHECK(! BGLTextureContainerParse(bytes, length, &c));
+    length = MakeKTX(bytes, 64, 7);
+    PutUInt32(bytes + 60, 0xFFFFFFF0);
+    CHECK(! BGLTextureContainerParse(bytes, length, &c));
+    length = MakeKTX(bytes, 64, 7);
+    PutUInt32(bytes + 56, kBGLTextureLevelMax + 1);
+    CHECK(! BGLTextureContainerParse(bytes, length, &c));
+}
+
+
+static size_t MakePVR(uint8_t *bytes, uint32_t pixelFormat, uint32_t width, uint32_t height, uint32_t format)
+{
+    uint8_t *p = bytes;
+    uint32_t header[13] = { 0x03525650, 0, pixelFormat, 0, 0, 0, height, width, 1, 1, 1, 1, 8 };
+    for (int i = 0; i < 13; i++) p = PutUInt32(p, header[i]);
+    memset(p, 0, 8);
+    p += 8;
+    size_t n = BGLTextureCompressedImageSize(format, width, height);
+    memset(p, 0x5A, n);
+    return p + n - bytes;
+}
+
+
+static void TestTextureContainerPVR(void)
+{
+    static uint8_t bytes[8192];
+    BGLTextureContainer c;
+
+    size_t length = MakePVR(bytes, 27, 100, 60, kBGLTextureFormatASTC_4x4);
+    CHECK(BGLTextureContainerParse(bytes, length, &c));
+    CHECK(c.type == kBGLTextureContainerPVR && c.format == kBGLTextureFormatASTC_4x4);
+    CHECK(c.width == 100 && c.height == 60 && c.levelCount == 1);
+    CHECK(c.levels[0].offset == 52 + 8 && c.levels[0].size == 25 * 15 * 16);
+    CHECK(! BGLTextureContainerParse(bytes, length - 1, &c));
+
+    // PVRTC pads small images to its minimum size.
+    length = MakePVR(bytes, 3, 4, 4, kBGLTextureFormatPVRTC_RGBA_4BPP);
+    CHECK(BGLTextureContainerParse(bytes, length, &c));
+    CHECK(c.format == kBGLTextureFormatPVRTC_RGBA_4BPP && c.levels[0].size == 32);
+
+    // Uncompressed pixel formats aren't ours to load.
+    length = MakePVR(bytes, 27, 16, 16, kBGLTextureFormatASTC_4x4);
+    PutUInt32(bytes + 12, 0x08080808);
+    CHECK(! BGLTextureContainerParse(bytes, length, &c));
+    CHECK(! BGLTextureContainerParse("PVR", 3, &c));
+}
+
+
+static void TestTextureSelectVariant(void)
+{
+    // ASTC, then ETC2, then PVRTC, as a manifest would list them; a 0 is
+    // a variant file that was missing or unreadable.
+    const uint32_t formats[4] = { 0, kBGLTextureFormatASTC_4x4, kBGLTextureFormatETC2_RGBA8, kBGLTextureFormatPVRTC_RGBA_4BPP };
+    CHECK(BGLTextureSelectVariant(formats, 4, "GL_KHR_texture_compression_astc_ldr GL_IMG_texture_compression_pvrtc") == 1);
+    CHECK(BGLTextureSelectVariant(formats, 4, "GL_OES_compressed_ETC2_RGBA8_texture GL_IMG_texture_compression_pvrtc") == 2);
+    CHECK(BGLTextureSelectVariant(formats, 4, "GL_EXT_foo GL_IMG_texture_compression_pvrtc") == 3);
+    CHECK(BGLTextureSelectVariant(formats, 4, "GL_EXT_foo") == -1);
+    CHECK(BGLTextureSelectVariant(formats, 4, NULL) == -1);
+    CHECK(BGLTextureSelectVariant(formats, 0, "GL_IMG_texture_compression_pvrtc") == -1);
+
+    // Names match whole, not as a prefix of another extension's.
+    CHECK(BGLTextureSelectVariant(formats + 3, 1, "GL_IMG_texture_compression_pvrtc2") == -1);
+    CHECK(BGLTextureSelectVariant(formats + 3, 1, "XGL_IMG_texture_compression_pvrtc") == -1);
+    CHECK(BGLTextureSelectVariant(formats + 3, 1, "GL_IMG_texture_compression_pvrtc2 GL_IMG_texture_compression_pvrtc") == 0);
+}
+
+
+// Occlusion
+
+
+static void TestOcclusionCulling(void)
+{
+    // One pixel per point, so areas are easy to add up by hand.
+    // Each operation applies after those before it.
+    BGLMatrix mvp, rotated;
+    BGLMatrixLoadIdentity(mvp);
+    BGLMatrixOrtho(mvp, 0, 320, 0, 480, -1, 1);
+    BGLMatrixLoadIdentity(rotated);
+    BGLMatrixRotate(rotated, 45, 0, 0, 1);
+    BGLMatrixTranslate(rotated, 160, 300, 0);
+    BGLMatrixOrtho(rotated, 0, 320, 0, 480, -1, 1);
+
+    const BGLOcclusionRect screen = { 0, 0, 320, 480 };
+    const BGLOcclusionRect covered = { 10, 10, 30, 30 };
+    const BGLOcclusionRect straddling = { 10, 90, 30, 110 };
+    const BGLOcclusionRect underRotated = { 150, 290, 170, 310 };
+    const BGLOcclusionRect offScreen = { 400, 10, 420, 30 };
+    const BGLOcclusionRect panel = { 0, 0, 320, 100 };
+    const BGLOcclusionRect square = { -50, -50, 50, 50 };
+
+    BGLOcclusionBuffer b;
+    memset(&b, 0, sizeof(b));
+    BGLOcclusionBegin(&b, 320, 480);
+    BGLOcclusionAdd(&b, 0, mvp, &screen, &screen);
+    BGLOcclusionAdd(&b, 1, mvp, &covered, NULL);
+    BGLOcclusionAdd(&b, 2, mvp, &straddling, NULL);
+    BGLOcclusionAdd(&b, 3, mvp, &underRotated, NULL);
+    BGLOcclusionAdd(&b, 4, mvp, &offScreen, NULL);
+    BGLOcclusionAdd(&b, 5, mvp, NULL, NULL);
+    BGLOcclusionAdd(&b, 6, mvp, &panel, &panel);
+    BGLOcclusionAdd(&b, 7, rotated, &square, &square);
+    BGLOcclusionResolve(&b);
+
+    CHECK(b.count == 8);
+    CHECK(b.items[0].culled == 0);  // nothing opaque covers all of it
+    CHECK(b.items[1].culled);       // inside the panel
+    CHECK(b.items[2].culled == 0);  // only partly inside
+    CHECK(b.items[3].culled == 0);  // a rotated rect never occludes
+    CHECK(b.items[4].culled);       // off the viewport
+    CHECK(b.items[5].culled == 0 && b.items[5].bounded == 0);
+    CHECK(b.items[6].culled == 0);
+    CHECK(b.items[7].culled == 0);
+
+    // The rotated square's bounds are its bounding box on screen.
+    const float side = 100 * sqrtf(2);
+    CHECK(fabsf(b.items[7].bounds.minX - (160 - side / 2)) < 0.01f);
+    CHECK(fabsf(b.items[7].bounds.maxY - (300 + side / 2)) < 0.01f);
+
+    const BGLOcclusionStats *stats = &b.stats;
+    CHECK(stats->drawCount == 8);
+    CHECK(stats->culledCount == 2);
+    CHECK(stats->unboundedCount == 1);
+    CHECK(stats->occluderCount == 2); // the panel and the background
+    CHECK(stats->viewportArea == 320 * 480);
+    CHECK(fabsf(stats->culledArea - 400) < 0.01f);
+    float drawn = 320 * 480 + 400 + 400 + 320 * 100 + side * side;
+    CHECK(fabsf(stats->drawnArea - drawn) < 1);
+    CHECK(fabsf(BGLOcclusionStatsOverdraw(stats) - drawn / (320 * 480)) < 1e-4f);
+    CHECK(fabsf(BGLOcclusionStatsOverdrawWithoutCulling(stats) - (drawn + 400) / (320 * 480)) < 1e-4f);
+
+    // Resolving again after Begin starts from nothing.
+    BGLOcclusionBegin(&b, 320, 480);
+    BGLOcclusionResolve(&b);
+    CHECK(b.stats.drawCount == 0 && b.stats.drawnArea == 0);
+    CHECK(BGLOcclusionStatsOverdraw(&b.stats) == 0);
+
+    BGLOcclusionBufferFree(&b);
+}
+
+
+static void TestOcclusionClips(void)
+{
+    BGLMatrix mvp;
+    BGLMatrixLoadIdentity(mvp);
+    BGLMatrixOrtho(mvp, 0, 320, 0, 480, -1, 1);
+    const BGLOcclusionRect viewport = { 0, 0, 320, 480 };
+
+    // Scissor rects round out to whole pixels and stay within the enclosing one.
+    BGLOcclusionRect pixels, r = { 10.3f, 20.7f, 100.2f, 200.5f };
+    BGLOcclusionGetClipRect(mvp, &r, 320, 480, &viewport, &pixels);
+    CHECK(pixels.minX == 10 && pixels.minY == 20 && pixels.maxX == 101 && pixels.maxY == 201);
+    const BGLOcclusionRect small = { 50, 50, 60, 60 };
+    BGLOcclusionGetClipRect(mvp, &r, 320, 480, &small, &pixels);
+    CHECK(pixels.minX == 50 && pixels.minY == 50 && pixels.maxX == 60 && pixels.maxY == 60);
+    const BGLOcclusionRect apart = { 200, 300, 210, 310 };
+    BGLOcclusionGetClipRect(mvp, &r, 320, 480, &apart, &pixels);
+    CHECK(pixels.maxX == pixels.minX && pixels.maxY == pixels.minY); // empty, not inside out
+
+    // A rotated clip scissors to its bounding box.
+    BGLMatrix rotated;
+    BGLMatrixLoadIdentity(rotated);
+    BGLMatrixRotate(rotated, 45, 0, 0, 1);
+    BGLMatrixTranslate(rotated, 160, 240, 0);
+    BGLMatrixOrtho(rotated, 0, 320, 0, 480, -1, 1);
+    const BGLOcclusionRect square = { -10, -10, 10, 10 };
+    BGLOcclusionGetClipRect(rotated, &square, 320, 480, &viewport, &pixels);
+    CHECK(pixels.minX == 145 && pixels.maxX == 175 && pixels.minY == 225 && pixels.maxY == 255);
+
+    BGLOcclusionBuffer b;
+    memset(&b, 0, sizeof(b));
+    BGLOcclusionBegin(&b, 320, 480);
+
+    // Nested clips intersect.
+    const BGLOcclusionRect outer = { 0, 0, 200, 200 }, inner = { 100, 100, 300, 300 };
+    const BGLOcclusionRect inside = { 150, 150, 170, 170 };
+    const BGLOcclusionRect outsideInner = { 50, 50, 70, 70 };
+    const BGLOcclusionRect straddling = { 190, 190, 250, 250 };
+    BGLOcclusionPushClip(&b, mvp, &outer);
+    BGLOcclusionPushClip(&b, mvp, &inner);
+    CHECK(b.clips[1].minX == 100 && b.clips[1].minY == 100 && b.clips[1].maxX == 200 && b.clips[1].maxY == 200);
+    BGLOcclusionAdd(&b, 0, mvp, &inside, NULL);
+    BGLOcclusionAdd(&b, 1, mvp, &outsideInner, NULL);
+    BGLOcclusionAdd(&b, 2, mvp, &straddling, NULL);
+    BGLOcclusionPushClip(&b, mvp, NULL); // clips no further
+    BGLOcclusionAdd(&b, 3, mvp, &straddling, NULL);
+    BGLOcclusionPopClip(&b);
+    BGLOcclusionPopClip(&b);
+    BGLOcclusionPopClip(&b);
+    CHECK(b.clipDepth == 0);
+
+    // An opaque rect under a clip only hides what's behind its visible part.
+    const BGLOcclusionRect band = { 0, 300, 320, 480 }, bandClip = { 0, 400, 320, 480 };
+    const BGLOcclusionRect underVisible = { 10, 410, 30, 430 }, underScissored = { 10, 310, 30, 330 };
+    BGLOcclusionAdd(&b, 4, mvp, &underVisible, NULL);
+    BGLOcclusionAdd(&b, 5, mvp, &underScissored, NULL);
+    BGLOcclusionAdd(&b, 6, mvp, &band, NULL);
+    BGLOcclusionPushClip(&b, mvp, &bandClip);
+    BGLOcclusionAdd(&b, 7, mvp, &band, &band);
+    BGLOcclusionPopClip(&b);
+    BGLOcclusionResolve(&b);
+
+    CHECK(b.items[0].culled == 0 && b.items[0].clippedArea == 0);
+    CHECK(b.items[1].culled && b.items[1].clipped);
+    CHECK(b.items[2].culled == 0 && b.items[2].clipped == 0);
+    CHECK(b.items[2].bounds.maxX == 200 && b.items[2].bounds.maxY == 200);
+    CHECK(fabsf(b.items[2].clippedArea - (3600 - 100)) < 0.01f);
+    CHECK(fabsf(b.items[3].clippedArea - b.items[2].clippedArea) < 0.01f);
+    CHECK(b.items[4].culled);
+    CHECK(b.items[5].culled == 0);
+    CHECK(b.items[6].culled == 0);
+    CHECK(b.items[7].culled == 0 && fabsf(b.items[7].clippedArea - 320 * 100) < 0.01f);
+
+    const BGLOcclusionStats *stats = &b.stats;
+    CHECK(stats->clipCount == 4);
+    CHECK(stats->culledCount == 2);
+    CHECK(stats->clippedCount == 1); // of those, the one outside its clip
+    CHECK(stats->occluderCount == 1);
+    CHECK(fabsf(stats->clippedArea - (400 + 2 * 3500 + 320 * 100)) < 0.01f);
+
+    // Clips nested past the limit clip as the deepest one kept.
+    BGLOcclusionBegin(&b, 320, 480);
+    for (int i = 0; i < kBGLOcclusionClipDepthMax + 4; i++) {
+        BGLOcclusionRect clip = { i, i, 320 - i, 480 - i };
+        BGLOcclusionPushClip(&b, mvp, &clip);
+    }
+    BGLOcclusionAdd(&b, 0, mvp, &viewport, NULL);
+    for (int i = 0; i < kBGLOcclusionClipDepthMax + 4; i++) BGLOcclusionPopClip(&b);
+    CHECK(b.clipDepth == 0);
+    BGLOcclusionPopClip(&b); // one too many does nothing
+    CHECK(b.clipDepth == 0);
+    BGLOcclusionResolve(&b);
+    float kept = kBGLOcclusionClipDepthMax - 1;
+    CHECK(b.items[0].bounds.minX == kept && b.items[0].bounds.maxY == 480 - kept);
+    CHECK(b.stats.clipCount == kBGLOcclusionClipDepthMax + 4);
+
+    BGLOcclusionBufferFree(&b);
+}
+
+
+// Input queue
+
+
+static const double kDragSpeed = 600; // points per second, along x
+
+
+// A drag sampled at 120 Hz with a millisecond of timestamp jitter and a
+// little position noise, drawn at 60 Hz and presented a frame after it's
+// drained, as EAGLView does. Returns the mean distance between the drained
+// positions and where the finger really was at presentation.
+static double RunDrag(BGLInputQueue *q, int frameCount)
+{
+    const double frameInterval = 1.0 / 60;
+    double error = 0;
+    int eventCount = 0;
+
+    BGLInputQueueBegin(q, 1, 0, 0, 100);
+    for (int f = 1; f <= frameCount; f++) {
+        for (int k = 2 * f - 1; k <= 2 * f; k++) {
+            double t = k / 120.0 + RandomFloat(-0.001f, 0.001f);
+            BGLInputQueueAddSample(q, 1, t, kDragSpeed * t + RandomFloat(-0.2f, 0.2f), 100);
+        }
+        double presentTime = (f + 1) * frameInterval;
+        BGLInputEvent events[kBGLInputTrackMax];
+        uint32_t n = BGLInputQueueDrain(q, presentTime, events);
+        CHECK(n == 1);
+        if (n == 1) {
+            CHECK(events[0].sampleCount == 2);
+            CHECK(events[0].oldestSampleTime < events[0].sampleTime);
+            error += fabs(events[0].x - kDragSpeed * presentTime);
+            eventCount += 1;
+        }
+        BGLInputQueueFramePresented(q, presentTime);
+    }
+    return eventCount ? error / eventCount : 0;
+}
+
+
+static void TestInputPrediction(void)
+{
+    BGLInputQueue q;
+    BGLInputQueueInit(&q);
+    double unpredictedError = RunDrag(&q, 60);
+
+    // Two samples per frame, coalesced into one event each.
+    CHECK(q.stats.frameCount == 60);
+    CHECK(q.stats.eventCount == 60);
+    CHECK(q.stats.sampleCount == 120);
+    double latency = BGLInputLatencyStatsMean(&q.stats);
+    CHECK(fabs(latency - 1.0 / 60) < 0.001); // the newest sample is taken as the frame starts
+    CHECK(BGLInputLatencyStatsMeanPredicted(&q.stats) == latency);
+    CHECK(q.stats.totalOldestLatency > q.stats.totalLatency);
+    CHECK(q.stats.maxLatency < 1.0 / 60 + 0.001);
+    CHECK(unpredictedError > 8); // a frame behind is 10 pt at this speed
+
+    BGLInputQueueInit(&q);
+    q.predictionLimit = 1.0f / 30;
+    double predictedError = RunDrag(&q, 60);
+    CHECK(predictedError < 1);
+    CHECK(BGLInputLatencyStatsMeanPredicted(&q.stats) < 0.002);
+    CHECK(fabs(BGLInputLatencyStatsMean(&q.stats) - latency) < 0.001);
+
+    // Ending the touch after a predicted drain delivers its true last position.
+    BGLInputEvent end;
+    CHECK(BGLInputQueueEnd(&q, 1, &end));
+    CHECK(end.predictedX == 0 && end.predictedTime == 0);
+    CHECK(fabs(end.x - kDragSpeed * end.sampleTime) < 1);
+    CHECK(! BGLInputQueueHasPending(&q));
+
+    BGLInputQueueResetStats(&q);
+    CHECK(q.stats.eventCount == 0 && BGLInputLatencyStatsMean(&q.stats) == 0);
+}
+
+
+static void TestInputStationary(void)
+{
+    BGLInputQueue q;
+    BGLInputQueueInit(&q);
+    q.predictionLimit = 1.0f / 30;
+    BGLInputEvent events[kBGLInputTrackMax];
+
+    // A finger held still but still reporting samples has no velocity.
+    BGLInputQueueBegin(&q, 1, 0, 50, 50);
+    for (int i = 1; i <= 4; i++) BGLInputQueueAddSample(&q, 1, i / 120.0, 50, 50);
+    CHECK(BGLInputQueueHasPending(&q));
+    CHECK(BGLInputQueueDrain(&q, 5 / 120.0 + 1 / 60.0, events) == 1);
+    CHECK(fabsf(events[0].predictedX) < 1e-3f && fabsf(events[0].predictedY) < 1e-3f);
+    CHECK(fabsf(events[0].x - 50) < 1e-3f && fabsf(events[0].y - 50) < 1e-3f);
+    CHECK(events[0].sampleCount == 4);
+
+    // One that moved and then stopped produces no more samples; once the
+    // newest is older than the velocity window, it isn't carried on.
+    BGLInputQueueBegin(&q, 2, 0, 0, 0);
+    for (int i = 1; i <= 4; i++) BGLInputQueueAddSample(&q, 2, i / 120.0, i * 5, 0);
+    CHECK(BGLInputQueueDrain(&q, 4 / 120.0 + 0.1, events) == 1);
+    CHECK(events[0].key == 2);
+    CHECK(events[0].x == 20 && events[0].predictedTime == 0);
+    CHECK(! BGLInputQueueHasPending(&q));
+    CHECK(BGLInputQueueDrain(&q, 1, events) == 0);
+
+    // Nothing new since the unpredicted drain, so ending delivers nothing.
+    CHECK(! BGLInputQueueEnd(&q, 2, NULL));
+    BGLInputEvent end;
+    CHECK(BGLInputQueueEnd(&q, 1, &end));
+    CHECK(end.x == 50 && end.y == 50);
+}
+
+
+// Accounting
+
+
+static int violationCount;
+static const char *violationSite;
+static size_t violationBytes;
+
+
+static void CountViolation(const char *site, BGLAccountingPhase phase, size_t bytes)
+{
+    (void)phase;
+    violationCount += 1;
+    violationSite = site;
+    violationBytes = bytes;
+}
+
+
+static void TestAccountingCounts(void)
+{
+    static const char *siteA = "a.c:1", *siteB = "b.c:2";
+    BGLAccountingReset();
+    BGLAccountingRecordAllocation(siteA, 100); // idle, outside any frame
+
+    BGLAccountingFrameBegin();
+    BGLAccountingSetPhase(kBGLAccountingPhaseRender);
+    BGLAccountingRecordAllocation(siteA, 16);
+    BGLAccountingRecordAllocation(siteA, 0);
+    BGLAccountingRecordAutorelease(siteB, 8);
+    BGLAccountingRecordMessages(3);
+    BGLAccountingFrameEnd();
+
+    CHECK(BGLAccountingGetFrameCount() == 1);
+    const BGLAccountingCounts *last = BGLAccountingGetLastFrame();
+    CHECK(last[kBGLAccountingPhaseRender].allocationCount == 3);
+    CHECK(last[kBGLAccountingPhaseRender].autoreleaseCount == 1);
+    CHECK(last[kBGLAccountingPhaseRender].allocationBytes == 24);
+    CHECK(last[kBGLAccountingPhaseRender].messageCount == 3);
+    CHECK(last[kBGLAccountingPhaseIdle].allocationCount == 0);
+    const BGLAccountingCounts *totals = BGLAccountingGetTotals();
+    CHECK(totals[kBGLAccountingPhaseIdle].allocationCount == 1);
+    CHECK(totals[kBGLAccountingPhaseIdle].allocationBytes == 100);
+
+    uint32_t count;
+    const BGLAccountingSite *sites = BGLAccountingGetSites(&count);
+    CHECK(count == 2);
+    CHECK(sites[0].name == siteA && sites[0].counts[kBGLAccountingPhaseRender].allocationBytes == 16);
+    CHECK(sites[0].counts[kBGLAccountingPhaseIdle].allocationBytes == 100);
+    CHECK(sites[1].name == siteB && sites[1].counts[kBGLAccountingPhaseRender].autoreleaseCount == 1);
+
+    // In steady state every allocation goes to the handler, and only allocations do.
+    violationCount = 0;
+    BGLAccountingSetViolationHandler(CountViolation);
+    BGLAccountingSetSteadyState(1);
+    BGLAccountingRecordMessages(10);
+    CHECK(violationCount == 0);
+    BGLAccountingRecordAllocation(siteB, 32);
+    CHECK(violationCount == 1 && violationSite == siteB && violationBytes == 32);
+    BGLAccountingSetSteadyState(0);
+    BGLAccountingRecordAllocation(siteB, 32);
+    CHECK(violationCount == 1);
+    BGLAccountingSetViolationHandler(NULL);
+
+    BGLAccountingReset();
+    CHECK(BGLAccountingGetFrameCount() == 0);
+    BGLAccountingGetSites(&count);
+    CHECK(count == 0);
+}
+
+
+static void TestAccountingSteadyState(void)
+{
+#ifdef BGL_ACCOUNTING
+    // A warm text cache allocates nothing; a miss names its copy of the characters.
+    BGLTextCache c;
+    FakeFont font = { 1 };
+    uint16_t chars[16];
+    TextCacheInit(&c);
+    BGLAccountingReset();
+    uint32_t length = Chars(chars, "score");
+    BGLTextCacheLookup(&c, &font, chars, length);
+    CHECK(BGLAccountingGetTotals()[kBGLAccountingPhaseIdle].allocationCount == 1);
+    CHECK(BGLAccountingGetTotals()[kBGLAccountingPhaseIdle].allocationBytes == length * sizeof(uint16_t));
+
+    violationCount = 0;
+    BGLAccountingSetViolationHandler(CountViolation);
+    BGLAccountingSetSteadyState(1);
+    for (int i = 0; i < 10; i++) {
+        BGLAccountingFrameBegin();
+        BGLAccountingSetPhase(kBGLAccountingPhaseRender);
+        BGLTextCacheLookup(&c, &font, chars, length);
+        BGLAccountingFrameEnd();
+    }
+    CHECK(violationCount == 0);
+    length = Chars(chars, "score!");
+    BGLTextCacheLookup(&c, &font, chars, length);
+    CHECK(violationCount == 1);
+    CHECK(violationSite && strstr(violationSite, "BGLTextCache.c:") != NULL);
+    CHECK(violationBytes == length * sizeof(uint16_t));
+    BGLAccountingSetSteadyState(0);
+    BGLAccountingSetViolationHandler(NULL);
+
+    BGLTextCacheFree(&c);
+    CHECK(textCount == 0);
+    BGLAccountingReset();
+#endif
+}
+
+
+// Draw recording
+
+
+#define kRecordNodeCount 3000
+
+
+typedef struct {
+    BGLDrawCommand *commands;
+    uint32_t count;
+} ReferenceList;
+
+
+// The draws rendering makes, walked recursively in preorder as
+// -[BGLNode renderSelfAndSubnodesWithState:] does.
+static void RecordReference(BGLNodeStore *s, uint32_t i, const BGLMatrix parentMatrix,
+                            const BGLDrawProjection *projections, uint32_t projectionCount, ReferenceList *list)
+{
+    if (s->flags[i] & kBGLNodeFlagHidden) return;
+    BGLDrawCommand *cmd = &list->commands[list->count];
+    if (s->flags[i] & kBGLNodeFlagRasterized) {
+        cmd->node = i;
+        cmd->kind = kBGLDrawCommandSubtree;
+        cmd->drawKey = s->drawKey[i];
+        BGLMatrixCopy(cmd->modelView, parentMatrix);
+        list->count += 1;
+        return;
+    }
+    BGLMatrix m;
+    BGLMatrixMultiply(m, BGLNodeStoreLocalMatrixAtIndex(s, i), parentMatrix);
+    int clips = (s->flags[i] & kBGLNodeFlagClips) && s->drawKey[i];
+    if (s->drawKey[i] && (clips || ! (s->flags[i] & kBGLNodeFlagOccluded))) {
+        cmd->node = i;
+        cmd->kind = clips ? kBGLDrawCommandClipBegin : kBGLDrawCommandNode;
+        cmd->drawKey = s->drawKey[i];
+        BGLMatrixCopy(cmd->modelView, m);
+        BGLMatrixCopy(cmd->modelViewProjection, m);
+        for (uint32_t p = 0; p < projectionCount; p++) {
+            if (projections[p].drawKey == cmd->drawKey) {
+                BGLMatrixMultiply(cmd->modelViewProjection, projections[p].projection, m);
+            }
+        }
+        list->count += 1;
+    }
+    for (uint32_t k = s->firstChild[i]; k != kBGLNodeIndexNone; k = s->nextSibling[k]) {
+        RecordReference(s, k, m, projections, projectionCount, list);
+    }
+    if (clips) {
+        cmd = &list->commands[list->count++];
+        cmd->node = i;
+        cmd->kind = kBGLDrawCommandClipEnd;
+        cmd->drawKey = s->drawKey[i];
+    }
+}
+
+
+// A tree deep in places and wide in one, with some of every kind of node.
+static BGLNodeStore *NewRecordScene(BGLNodeHandle *root, BGLNodeHandle *nodes)
+{
+    BGLNodeStore *s = BGLNodeStoreCreate(kRecordNodeCount + 1);
+    *root = BGLNodeStoreAlloc(s);
+    for (uint32_t i = 0; i < kRecordNodeCount; i++) {
+        BGLNodeHandle parent = (i < 5) ? *root : nodes[i / 5 - 1];
+        if (i >= 2000) parent = nodes[7]; // a layer of a thousand sprites
+        nodes[i] = BGLNodeStoreAlloc(s);
+        float *m = BGLNodeStoreLocalMatrix(s, nodes[i]);
+        BGLMatrixTranslate(m, 0.5f + i % 3, 0.25f, 0);
+        if (i % 5 == 0) BGLMatrixRotate(m, i, 0, 0, 1);
+        BGLNodeStoreLink(s, parent, nodes[i]);
+        uint32_t index = BGLNodeHandleIndex(nodes[i]);
+        s->drawKey[index] = i % 7; // 0 draws nothing
+        if (i % 97 == 3) s->flags[index] |= kBGLNodeFlagHidden;
+        if (i % 89 == 5) s->flags[index] |= kBGLNodeFlagRasterized;
+        if (i % 53 == 11) s->flags[index] |= kBGLNodeFlagClips;
+    }
+    return s;
+}
+
+
+static void MarkOccluded(BGLNodeStore *s, const BGLNodeHandle *nodes)
+{
+    for (uint32_t i = 7; i < kRecordNodeCount; i += 31) {
+        s->flags[BGLNodeHandleIndex(nodes[i])] |= kBGLNodeFlagOccluded;
+    }
+}
+
+
+static void TestDrawRecorderMatchesReference(void)
+{
+    BGLNodeHandle root, *nodes = malloc(kRecordNodeCount * sizeof(BGLNodeHandle));
+    BGLNodeStore *s = NewRecordScene(&root, nodes);
+    BGLDrawProjection projections[2];
+    for (uint32_t p = 0; p < 2; p++) {
+        projections[p].drawKey = p + 1;
+        BGLMatrixLoadIdentity(projections[p].projection);
+        BGLMatrixOrtho(projections[p].projection, 0, 320 * (p + 1), 0, 480, -1, 1);
+    }
+
+    ReferenceList expected = { calloc(2 * kRecordNodeCount, sizeof(BGLDrawCommand)), 0 };
+    BGLMatrix identity;
+    BGLMatrixLoadIdentity(identity);
+    MarkOccluded(s, nodes);
+    RecordReference(s, BGLNodeHandleIndex(root), identity, projections, 2, &expected);
+    CHECK(expected.count > 1000);
+
+    static const uint32_t threadCounts[] = { 1, 2, 4, 8 };
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+        BGLDrawRecorder r;
+        BGLDrawRecorderInit(&r, threadCounts[t]);
+        CHECK(r.threadCount == threadCounts[t]);
+        // Twice, so the second records into lists kept from the first.
+        for (int frame = 0; frame < 2; frame++) {
+            MarkOccluded(s, nodes);
+            const BGLDrawList *list = BGLDrawRecorderRecord(&r, s, root, projections, 2);
+            CHECK(r.partitionCount > 1);
+            CHECK(list->count == expected.count);
+            uint32_t mismatches = 0, unordered = 0;
+            for (uint32_t i = 0; i < list->count && i < expected.count; i++) {
+                const BGLDrawCommand *a = &list->commands[i], *b = &expected.commands[i];
+                if (a->node != b->node || a->kind != b->kind || a->drawKey != b->drawKey) {
+                    mismatches += 1;
+                } else if (a->kind == kBGLDrawCommandNode || a->kind == kBGLDrawCommandClipBegin) {
+                    if (MatrixError(a->modelView, b->modelView) > 1e-6f ||
+                        MatrixError(a->modelViewProjection, b->modelViewProjection) > 1e-6f) mismatches += 1;
+                } else if (a->kind == kBGLDrawCommandSubtree) {
+                    if (MatrixError(a->modelView, b->modelView) > 1e-6f) mismatches += 1;
+                }
+                if (i > 0 && a->sortKey <= list->commands[i - 1].sortKey) unordered += 1;
+            }
+            CHECK(mismatches == 0);
+            CHECK(unordered == 0);
+
+            // Recording clears the occluded marks, as rendering does.
+            uint32_t marked = 0;
+            for (uint32_t i = 0; i < kRecordNodeCount; i++) {
+                if (s->flags[BGLNodeHandleIndex(nodes[i])] & kBGLNodeFlagOccluded) marked += 1;
+            }
+            CHECK(marked > 0); // under a hidden or rasterized node, never visited
+            CHECK(marked < kRecordNodeCount / 31);
+        }
+        BGLDrawRecorderFree(&r);
+    }
+
+    free(expected.commands);
+    BGLNodeStoreDestroy(s);
+    free(nodes);
+}
+
+
+// Checks clip begins and ends pair up, innermost first; returns the depth
+// left open, or -1 if an end doesn't match.
+static int ClipDepthAfter(const BGLDrawCommand *commands, uint32_t count)
+{
+    uint32_t open[64];
+    int depth = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (commands[i].kind == kBGLDrawCommandClipBegin) {
+            if (depth == 64) return -1;
+            open[depth++] = commands[i].node;
+        } else if (commands[i].kind == kBGLDrawCommandClipEnd) {
+            if (depth == 0 || open[depth - 1] != commands[i].node) return -1;
+            depth -= 1;
+        }
+    }
+    return depth;
+}
+
+
+static void TestDrawRecorderClips(void)
+{
+    // A wide layer of sprites, every tenth a clipping list of 100 rows, some
+    // holding a nested clip; lists are the kind of subtree cutting would split.
+    BGLNodeStore *s = BGLNodeStoreCreate(0);
+    BGLNodeHandle root = BGLNodeStoreAlloc(s);
+    uint32_t clipCount = 0;
+    for (int i = 0; i < 300; i++) {
+        BGLNodeHandle node = BGLNodeStoreAlloc(s);
+        BGLNodeStoreLink(s, root, node);
+        BGLMatrixTranslate(BGLNodeStoreLocalMatrix(s, node), i, 0, 0);
+        s->drawKey[BGLNodeHandleIndex(node)] = 1;
+        if (i % 10 != 0) continue;
+        BGLNodeStoreSetFlag(s, node, kBGLNodeFlagClips, 1);
+        clipCount += 1;
+        BGLNodeHandle parent = node;
+        for (int k = 0; k < 100; k++) {
+            BGLNodeHandle row = BGLNodeStoreAlloc(s);
+            BGLNodeStoreLink(s, parent, row);
+            s->drawKey[BGLNodeHandleIndex(row)] = 2;
+            if (i % 30 == 0 && k == 50) {
+                BGLNodeStoreSetFlag(s, row, kBGLNodeFlagClips, 1);
+                clipCount += 1;
+                parent = row;
+            }
+        }
+    }
+    // A clip node that doesn't draw has no rect, so records nothing to scissor.
+    BGLNodeHandle bare = BGLNodeStoreAlloc(s);
+    BGLNodeStoreLink(s, root, bare);
+    BGLNodeStoreSetFlag(s, bare, kBGLNodeFlagClips, 1);
+
+    BGLDrawRecorder serial, parallel;
+    BGLDrawRecorderInit(&serial, 1);
+    BGLDrawRecorderInit(&parallel, 4);
+    const BGLDrawList *a = BGLDrawRecorderRecord(&serial, s, root, NULL, 0);
+    const BGLDrawList *b = BGLDrawRecorderRecord(&parallel, s, root, NULL, 0);
+
+    uint32_t begins = 0, ends = 0;
+    for (uint32_t i = 0; i < a->count; i++) {
+        begins += (a->commands[i].kind == kBGLDrawCommandClipBegin);
+        ends += (a->commands[i].kind == kBGLDrawCommandClipEnd);
+        CHECK(a->commands[i].node != BGLNodeHandleIndex(bare));
+    }
+    CHECK(begins == clipCount && ends == clipCount);
+    CHECK(ClipDepthAfter(a->commands, a->count) == 0);
+
+    // No partition starts or ends inside a clip.
+    CHECK(parallel.partitionCount > 1);
+    for (uint32_t p = 0; p < parallel.partitionCount; p++) {
+        const BGLDrawPartition *part = &parallel.partitions[p];
+        CHECK(ClipDepthAfter(&parallel.lists[part->list].commands[part->start], part->count) == 0);
+    }
+
+    // The same commands on four threads as on one; fields, since the struct has padding.
+    CHECK(a->count == b->count);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < a->count && i < b->count; i++) {
+        const BGLDrawCommand *x = &a->commands[i], *y = &b->commands[i];
+        if (x->sortKey != y->sortKey || x->node != y->node || x->drawKey != y->drawKey || x->kind != y->kind ||
+            memcmp(x->modelView, y->modelView, sizeof(BGLMatrix)) ||
+            memcmp(x->modelViewProjection, y->modelViewProjection, sizeof(BGLMatrix))) mismatches += 1;
+    }
+    CHECK(mismatches == 0);
+
+    BGLDrawRecorderFree(&serial);
+    BGLDrawRecorderFree(&parallel);
+    BGLNodeStoreDestroy(s);
+}
+
+
+// Resolution
+
+
+// Runs frames whose time is fullTime at full scale and falls with the
+// number of pixels; returns how many changed the scale, and if lastChange
+// isn't NULL, the frame of the last one.
+static int RunFrames(BGLResolutionController *c, float fullTime, int frames, int *lastChange)
+{
+    int changes = 0;
+    for (int i = 0; i < frames; i++) {
+        if (BGLResolutionControllerUpdate(c, fullTime * c->scale * c->scale)) {
+            changes += 1;
+            if (lastChange) *lastChange = i;
+        }
+    }
+    return changes;
+}
+
+
+static void TestResolutionSteps(void)
+{
+    const float budget = 1 / 60.0f;
+    BGLResolutionController c;
+    BGLResolutionControllerInit(&c, budget);
+    CHECK(c.scale == 1);
+
+    // 25 ms at full scale: 0.875 is still over budget, 0.75 is under it.
+    int last = -1;
+    CHECK(RunFrames(&c, 0.025f, (int)c.cooldown - 1, NULL) == 0);
+    CHECK(RunFrames(&c, 0.025f, 1, &last) == 1);
+    CHECK(c.scale == 0.875f);
+    CHECK(RunFrames(&c, 0.025f, (int)c.cooldown - 1, NULL) == 0);
+    CHECK(RunFrames(&c, 0.025f, 1, NULL) == 1);
+    CHECK(c.scale == 0.75f);
+
+    // Under budget but above the headroom: it stays put.
+    CHECK(RunFrames(&c, 0.025f, 10 * (int)c.cooldown, NULL) == 0);
+    CHECK(c.scale == 0.75f);
+    CHECK(c.average < budget && c.average > budget * c.headroom);
+
+    // A lighter scene earns the full scale back, a step per cooldown.
+    CHECK(RunFrames(&c, 0.010f, 10 * (int)c.cooldown, &last) == 2);
+    CHECK(c.scale == 1);
+    CHECK(last >= (int)c.cooldown);
+
+    // A hopeless one bottoms out at the minimum.
+    CHECK(RunFrames(&c, 1.0f, 10 * (int)c.cooldown, NULL) == 4);
+    CHECK(c.scale == c.minScale);
+}
+
+
+// Meshes
+
+
+// A grid of n x n unit squares, each two triangles of its own: 6n^2
+// vertexes as a polygon would have them, (n+1)^2 distinct.
+static BGLMeshVertex *NewSquareGrid(int n)
+{
+    BGLMeshVertex *v = malloc(6 * n * n * sizeof(BGLMeshVertex));
+    const float corners[6][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 0, 1 }, { 1, 0 }, { 1, 1 } };
+    for (int i = 0; i < n * n; i++) {
+        for (int k = 0; k < 6; k++) {
+            BGLMeshVertex *x = &v[6 * i + k];
+            x->position = BGLVector2Make(i % n + corners[k][0], i / n + corners[k][1]);
+            for (int c = 0; c < 4; c++) x->color[c] = 0.5f;
+        }
+    }
+    return v;
+}
+
+
+// Counts the triangles a float mesh draws that aren't degenerate, and how
+// many of those wind clockwise.
+static void CountTriangles(const BGLMeshBuilder *b, int *count, int *clockwise)
+{
+    *count = *clockwise = 0;
+    const int strip = (b->primitive == kBGLPrimitiveTriangleStrip);
+    for (uint32_t i = 0; i + 2 < b->indexCount; i += strip ? 1 : 3) {
+        uint16_t i0 = b->indexes[i], i1 = b->indexes[i + 1], i2 = b->indexes[i + 2];
+        if (strip && (i % 2)) { uint16_t t = i0; i0 = i1; i1 = t; }
+        if (i0 == i1 || i1 == i2 || i2 == i0) continue;
+        const float *p0 = (const float *)(b->vertexes + i0 * b->vertexSize);
+        const float *p1 = (const float *)(b->vertexes + i1 * b->vertexSize);
+        const float *p2 = (const float *)(b->vertexes + i2 * b->vertexSize);
+        float area = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p1[1] - p0[1]);
+        *count += 1;
+        if (area < 0) *clockwise += 1;
+    }
+}
+
+
+static void TestMeshDedupAndLayouts(void)
+{
+    const int n = 10, count = 6 * n * n;
+    BGLMeshVertex *grid = NewSquareGrid(n);
+
+    // Before: 600 vertexes of 24 bytes, 14400 bytes. After, with 121
+    // distinct vertexes and 600 16-bit indexes (1200 bytes):
+    const BGLVertexLayout layouts[] = {
+        kBGLVertexLayoutFloat, kBGLVertexLayoutFloatUByte, kBGLVertexLayoutHalfUByte, kBGLVertexLayoutFixedUByte,
+    };
+    const size_t vertexBytes[] = { 121 * 24, 121 * 12, 121 * 8, 121 * 8 };
+    for (int i = 0; i < 4; i++) {
+        BGLMeshBuilder b;
+        BGLMeshBuilderInit(&b, layouts[i], kBGLPrimitiveTriangles);
+        CHECK(BGLMeshBuilderAdd(&b, grid, count, kBGLPrimitiveTriangles, NULL));
+        BGLMeshStats stats;
+        BGLMeshBuilderGetStats(&b, &stats);
+        CHECK(stats.sourceVertexCount == 600 && stats.sourceBytes == 14400);
+        CHECK(stats.vertexCount == 121 && stats.vertexBytes == vertexBytes[i]);
+        CHECK(stats.indexCount == 600 && stats.indexBytes == 1200);
+        BGLMeshBuilderFree(&b);
+    }
+
+    // Vertexes equal at the layout's precision are stored once, and the
+    // triangles that collapse are dropped. At 1/16 unit, the first square's
+    // corners at 0.01 and 0.02 are both 0.
+    grid[1].position = BGLVector2Make(0.01f, 0);
+    grid[4].position = BGLVector2Make(0.02f, 0);
+    BGLMeshBuilder b;
+    BGLMeshBuilderInit(&b, kBGLVertexLayoutFixedUByte, kBGLPrimitiveTriangles);
+    CHECK(BGLMeshBuilderAdd(&b, grid, count, kBGLPrimitiveTriangles, NULL));
+    CHECK(b.vertexCount == 121 && b.indexCount == 597);
+    BGLMeshBuilderFree(&b);
+    free(grid);
+}
+
+
+static void TestMeshStitchesStrips(void)
+{
+    // Unit squares as counterclockwise strips, a triangle, then another square.
+    BGLMeshVertex square[4], triangle[3];
+    memset(square, 0, sizeof(square));
+    memset(triangle, 0, sizeof(triangle));
+    const float corners[4][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+    BGLMatrix apart[3];
+    for (int i = 0; i < 3; i++) {
+        BGLMatrixLoadIdentity(apart[i]);
+        BGLMatrixTranslate(apart[i], 2 * i, 0, 0);
+    }
+    for (int k = 0; k < 4; k++) square[k].position = BGLVector2Make(corners[k][0], corners[k][1]);
+    for (int k = 0; k < 3; k++) triangle[k].position = BGLVector2Make(corners[k][0], corners[k][1]);
+
+    BGLMeshBuilder b;
+    BGLMeshBuilderInit(&b, kBGLVertexLayoutFloat, kBGLPrimitiveTriangleStrip);
+    CHECK(BGLMeshBuilderAdd(&b, square, 4, kBGLPrimitiveTriangleStrip, apart[0]));
+    CHECK(BGLMeshBuilderAdd(&b, square, 4, kBGLPrimitiveTriangleStrip, apart[1]));
+    CHECK(BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangleStrip, apart[2]));
+    CHECK(BGLMeshBuilderAdd(&b, square, 4, kBGLPrimitiveTriangleStrip, NULL)); // a repeat
+
+    // One strip: each joined on with degenerate triangles, padded to keep
+    // its winding; the repeated square reuses its vertexes.
+    const uint16_t expected[] = { 0, 1, 2, 3, 3, 4, 4, 5, 6, 7, 7, 8, 8, 9, 10, 10, 0, 0, 0, 1, 2, 3 };
+    CHECK(b.indexCount == sizeof(expected) / sizeof(expected[0]));
+    CHECK(b.vertexCount == 11);
+    CHECK(memcmp(b.indexes, expected, sizeof(expected)) == 0);
+    int triangles, clockwise;
+    CountTriangles(&b, &triangles, &clockwise);
+    CHECK(triangles == 7 && clockwise == 0);
+    BGLMeshBuilderFree(&b);
+
+    // As a list, the same triangles, wound the same way.
+    BGLMeshBuilderInit(&b, kBGLVertexLayoutFloat, kBGLPrimitiveTriangles);
+    CHECK(BGLMeshBuilderAdd(&b, square, 4, kBGLPrimitiveTriangleStrip, apart[0]));
+    CHECK(BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangleFan, apart[2]));
+    CountTriangles(&b, &triangles, &clockwise);
+    CHECK(triangles == 3 && clockwise == 0);
+    BGLMeshBuilderFree(&b);
+}
+
+
+static void TestMeshRefusesOutOfRange(void)
+{
+    BGLMeshVertex triangle[3];
+    memset(triangle, 0, sizeof(triangle));
+    triangle[1].position = BGLVector2Make(2047, 0);
+    triangle[2].position = BGLVector2Make(0, -2048);
+
+    // At the default 1/16 unit, 16 bits reach from -2048 to 2047.9375.
+    BGLMeshBuilder b;
+    BGLMeshBuilderInit(&b, kBGLVertexLayoutFixedUByte, kBGLPrimitiveTriangles);
+    CHECK(BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangles, NULL));
+    triangle[1].position = BGLVector2Make(2048, 0);
+    CHECK(! BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangles, NULL));
+    CHECK(b.vertexCount == 3 && b.indexCount == 3 && b.sourceVertexCount == 3);
+    BGLMeshBuilderFree(&b);
+
+    // Fewer fraction bits reach further.
+    BGLMeshBuilderInit(&b, kBGLVertexLayoutFixedUByte, kBGLPrimitiveTriangles);
+    BGLMeshBuilderSetFixedPointBits(&b, 2);
+    CHECK(BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangles, NULL));
+    CHECK(BGLMeshBuilderPositionScale(&b) == 0.25f);
+    BGLMeshBuilderFree(&b);
+
+    // Half floats stop at 65504, through a transform too.
+    BGLMatrix far;
+    BGLMatrixLoadIdentity(far);
+    BGLMatrixTranslate(far, 70000, 0, 0);
+    BGLMeshBuilderInit(&b, kBGLVertexLayoutHalfUByte, kBGLPrimitiveTriangles);
+    CHECK(BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangles, NULL));
+    CHECK(! BGLMeshBuilderAdd(&b, triangle, 3, kBGLPrimitiveTriangles, far));
+    CHECK(b.vertexCount == 3);
+    BGLMeshBuilderFree(&b);
+}
+
+
+static const Test kTests[] = {
+    { "text_cache_hit", TestTextCacheHit },
+    { "text_cache_retains_font", TestTextCacheRetainsFont },
+    { "text_cache_evicts_least_recent", TestTextCacheEvictsLeastRecent },
+    { "text_cache_layout_failure", TestTextCacheLayoutFailure },
+    { "resource_evicts_least_recent", TestResourceEvictsLeastRecent },
+    { "resource_pinning", TestResourcePinning },
+    { "resource_buffers", TestResourceBuffers },
+    { "resource_reuses_slots", TestResourceReusesSlots },
+    { "stroke_incremental_matches_batch", TestStrokeIncrementalMatchesBatch },
+    { "stroke_dirty_start", TestStrokeDirtyStart },
+    { "stroke_joins", TestStrokeJoins },
+    { "stroke_segment_normals", TestStrokeSegmentNormals },
+    { "command_stream_round_trip", TestCommandStreamRoundTrip },
+    { "command_stream_rejects_damage", TestCommandStreamRejectsDamage },
+    { "matrix_fast_paths_match_reference", TestMatrixFastPathsMatchReference },
+    { "matrix_inverse", TestMatrixInverse },
+    { "matrix_components_round_trip", TestMatrixComponentsRoundTrip },
+    { "matrix_components_refuse_shear", TestMatrixComponentsRefuseShear },
+    { "node_store_handles", TestNodeStoreHandles },
+    { "node_store_retires_wrapped_slots", TestNodeStoreRetiresWrappedSlots },
+    { "timer_retires_wrapped_slots", TestTimerRetiresWrappedSlots },
+    { "timer_order", TestTimerOrder },
+    { "timer_cancel_and_repeat", TestTimerCancelAndRepeat },
+    { "timer_paused_node", TestTimerPausedNode },
+    { "texture_container_ktx", TestTextureContainerKTX },
+    { "texture_container_pvr", TestTextureContainerPVR },
+    { "texture_select_variant", TestTextureSelectVariant },
+    { "occlusion_culling", TestOcclusionCulling },
+    { "occlusion_clips", TestOcclusionClips },
+    { "input_prediction", TestInputPrediction },
+    { "input_stationary", TestInputStationary },
+    { "accounting_counts", TestAccountingCounts },
+    { "accounting_steady_state", TestAccountingSteadyState },
+    { "draw_recorder_matches_reference", TestDrawRecorderMatchesReference },
+    { "draw_recorder_clips", TestDrawRecorderClips },
+    { "resolution_steps", TestResolutionSteps },
+    { "mesh_dedup_and_layouts", TestMeshDedupAndLayouts },
+    { "mesh_stitches_strips", TestMeshStitchesStrips },
+    { "mesh_refuses_out_of_range", TestMeshRefusesOutOfRange },
+};
+
+
+int main(int argc, char *argv[])
+{
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: bgltest [-f filter]\n");
+            return 2;
+        }
+    }
+
+    int testCount = 0, failedCount = 0;
+    for (size_t i = 0; i < sizeof(kTests) / sizeof(kTests[0]); i++) {
+        if (filter && strstr(kTests[i].name, filter) == NULL) continue;
+        int failuresBefore = failureCount;
+        kTests[i].run();
+        testCount += 1;
+        if (failureCount > failuresBefore) {
+            failedCount += 1;
+            printf("FAIL %s\n", kTests[i].name);
+        } else {
+            printf("ok   %s\n", kTests[i].name);
+        }
+    }
+    printf("%d of %d tests passed\n", testCount - failedCount, testCount);
+    return failedCount ? 1 : 0;
+}